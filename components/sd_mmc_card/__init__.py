@@ -1,15 +1,20 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome import automation, pins
+from esphome.components import web_server_base
 from esphome.const import (
     CONF_ID,
     CONF_DATA,
+    CONF_SIZE,
     CONF_PATH,
     CONF_CLK_PIN,
     CONF_INPUT,
     CONF_OUTPUT,
     CONF_PULLUP,
     CONF_PULLDOWN,
+    CONF_FREQUENCY,
+    CONF_TRIGGER_ID,
+    CONF_TYPE,
 )
 from esphome.core import CORE
 
@@ -21,9 +26,150 @@ CONF_DATA2_PIN = "data2_pin"
 CONF_DATA3_PIN = "data3_pin"
 CONF_MODE_1BIT = "mode_1bit"
 CONF_POWER_CTRL_PIN = "power_ctrl_pin"
+CONF_CARD_DETECT_PIN = "card_detect_pin"
+CONF_MOUNT_RETRY_INTERVAL = "mount_retry_interval"
+CONF_WHEN_UNMOUNTED = "when_unmounted"
+CONF_ON_READY = "on_ready"
+CONF_HOST_ROOT = "host_root"
+CONF_HOST_BUS = "host_bus"
+CONF_COMMAND_LATENCY = "command_latency"
+CONF_WRITE_LATENCY = "write_latency"
+CONF_WRITE_BEHIND = "write_behind"
+CONF_BUFFER_SIZE = "buffer_size"
+CONF_SPACE_RECONCILE_INTERVAL = "space_reconcile_interval"
+CONF_MAX_OPEN_FILES = "max_open_files"
+CONF_FILE_HANDLE_POOL = "file_handle_pool"
+CONF_FLUSH_INTERVAL = "flush_interval"
+CONF_FLUSH_THRESHOLD = "flush_threshold"
+CONF_MAX_READ_SIZE = "max_read_size"
+CONF_METADATA_CACHE = "metadata_cache"
+CONF_SECTOR_CACHE = "sector_cache"
+CONF_BUS_SPEED = "bus_speed"
+CONF_ALLOCATION_UNIT_SIZE = "allocation_unit_size"
+CONF_ROTATING_LOG = "rotating_log"
+CONF_DIRECTORY = "directory"
+CONF_MAX_FILE_SIZE = "max_file_size"
+CONF_MAX_FILES = "max_files"
+CONF_MAX_TOTAL_BYTES = "max_total_bytes"
+CONF_MAX_AGE = "max_age"
+CONF_SYNC_INTERVAL = "sync_interval"
+CONF_DURABILITY = "durability"
+CONF_LEVEL = "level"
+CONF_ATOMIC_WRITE = "atomic_write"
+CONF_PATHS = "paths"
+CONF_FILE_SERVER = "file_server"
+CONF_COMPRESSION = "compression"
+CONF_WINDOW_BITS = "window_bits"
+CONF_BLOCK_SIZE = "block_size"
+CONF_COMPRESS = "compress"
+CONF_ALGORITHM = "algorithm"
+CONF_EXPECTED = "expected"
+CONF_PATTERN = "pattern"
+CONF_DEPTH = "depth"
+CONF_MIN_SIZE = "min_size"
+CONF_MAX_SIZE = "max_size"
+CONF_MIN_AGE = "min_age"
+CONF_SORT = "sort"
+CONF_DESCENDING = "descending"
+CONF_LIMIT = "limit"
+CONF_ON_FIND = "on_find"
+CONF_ON_CHECKSUM = "on_checksum"
+CONF_ON_FILE_OPERATION = "on_file_operation"
+CONF_SOURCE = "source"
+CONF_DESTINATION = "destination"
+CONF_URL_PREFIX = "url_prefix"
+CONF_OPERATION_STATS = "operation_stats"
+CONF_DEBUG_ALLOCATIONS = "debug_allocations"
+CONF_BENCHMARK = "benchmark"
+CONF_BENCHMARK_ID = "benchmark_id"
+CONF_SLICE = "slice"
+CONF_WORKLOADS = "workloads"
+CONF_FILE_SIZE = "file_size"
+CONF_RANDOM_BLOCK_SIZE = "random_block_size"
+CONF_RANDOM_OPS = "random_ops"
+CONF_APPEND_SIZE = "append_size"
+CONF_APPEND_OPS = "append_ops"
+CONF_TIME_BUDGET = "time_budget"
+CONF_WEB_SERVER_BASE_ID = "web_server_base_id"
 
 sd_mmc_card_component_ns = cg.esphome_ns.namespace("sd_mmc_card")
-SdMmc = sd_mmc_card_component_ns.class_("SdMmc", cg.Component)
+SdMmc = sd_mmc_card_component_ns.class_("SdMmc", cg.PollingComponent)
+HostBusModel = sd_mmc_card_component_ns.struct("HostBusModel")
+BusSpeed = sd_mmc_card_component_ns.enum("BusSpeed")
+FileServerHandler = sd_mmc_card_component_ns.class_("FileServerHandler", cg.Component)
+HashAlgorithm = sd_mmc_card_component_ns.enum("HashAlgorithm", is_class=True)
+BenchmarkRunner = sd_mmc_card_component_ns.class_("BenchmarkRunner", cg.Component)
+BenchmarkWorkload = sd_mmc_card_component_ns.enum("BenchmarkWorkload", is_class=True)
+UnmountedPolicy = sd_mmc_card_component_ns.enum("UnmountedPolicy", is_class=True)
+Durability = sd_mmc_card_component_ns.enum("Durability", is_class=True)
+ReadyTrigger = sd_mmc_card_component_ns.class_("ReadyTrigger", automation.Trigger.template())
+ChecksumTrigger = sd_mmc_card_component_ns.class_(
+    "ChecksumTrigger", automation.Trigger.template(cg.std_string, cg.std_string, cg.bool_)
+)
+FileOperationType = sd_mmc_card_component_ns.enum("FileOperationType", is_class=True)
+FileOperationProgress = sd_mmc_card_component_ns.struct("FileOperationProgress")
+WalkType = sd_mmc_card_component_ns.enum("WalkType", is_class=True)
+FindSort = sd_mmc_card_component_ns.enum("FindSort", is_class=True)
+FindResult = sd_mmc_card_component_ns.struct("FindResult")
+FindTrigger = sd_mmc_card_component_ns.class_(
+    "FindTrigger", automation.Trigger.template(cg.std_vector.template(FindResult), cg.bool_)
+)
+FileOperationTrigger = sd_mmc_card_component_ns.class_(
+    "FileOperationTrigger", automation.Trigger.template(FileOperationProgress)
+)
+
+BUS_SPEEDS = {
+    "default": BusSpeed.BUS_SPEED_DEFAULT,
+    "high_speed": BusSpeed.BUS_SPEED_HIGH_SPEED,
+    "ddr": BusSpeed.BUS_SPEED_DDR,
+    "auto": BusSpeed.BUS_SPEED_AUTO,
+}
+
+UNMOUNTED_POLICIES = {
+    "fail": UnmountedPolicy.FAIL,
+    "queue": UnmountedPolicy.QUEUE,
+}
+
+DURABILITY_LEVELS = {
+    "none": Durability.NONE,
+    "periodic": Durability.PERIODIC,
+    "group_commit": Durability.GROUP_COMMIT,
+    "every_write": Durability.EVERY_WRITE,
+}
+
+HASH_ALGORITHMS = {
+    "crc32": HashAlgorithm.CRC32,
+    "sha256": HashAlgorithm.SHA256,
+    "md5": HashAlgorithm.MD5,
+}
+
+WALK_TYPES = {
+    "all": WalkType.ALL,
+    "files": WalkType.FILES,
+    "directories": WalkType.DIRECTORIES,
+}
+
+FIND_SORTS = {
+    "none": FindSort.NONE,
+    "name": FindSort.NAME,
+    "size": FindSort.SIZE,
+    "mtime": FindSort.MTIME,
+}
+
+BENCHMARK_WORKLOADS = {
+    "seq_write": BenchmarkWorkload.SEQUENTIAL_WRITE,
+    "seq_read": BenchmarkWorkload.SEQUENTIAL_READ,
+    "read_file": BenchmarkWorkload.READ_FILE,
+    "process_file": BenchmarkWorkload.PROCESS_FILE,
+    "random_read": BenchmarkWorkload.RANDOM_READ,
+    "random_write": BenchmarkWorkload.RANDOM_WRITE,
+    "small_append": BenchmarkWorkload.SMALL_APPEND,
+    "create_files": BenchmarkWorkload.CREATE_FILES,
+    "directory_walk": BenchmarkWorkload.DIRECTORY_WALK,
+    "stat": BenchmarkWorkload.STAT,
+    "concurrent": BenchmarkWorkload.CONCURRENT,
+}
+DEFAULT_BENCHMARK_WORKLOADS = ["seq_write", "seq_read", "random_read", "random_write", "small_append"]
 
 # Action
 SdMmcWriteFileAction = sd_mmc_card_component_ns.class_("SdMmcWriteFileAction", automation.Action)
@@ -31,6 +177,17 @@ SdMmcAppendFileAction = sd_mmc_card_component_ns.class_("SdMmcAppendFileAction",
 SdMmcCreateDirectoryAction = sd_mmc_card_component_ns.class_("SdMmcCreateDirectoryAction", automation.Action)
 SdMmcRemoveDirectoryAction = sd_mmc_card_component_ns.class_("SdMmcRemoveDirectoryAction", automation.Action)
 SdMmcDeleteFileAction = sd_mmc_card_component_ns.class_("SdMmcDeleteFileAction", automation.Action)
+SdMmcFileOperationAction = sd_mmc_card_component_ns.class_("SdMmcFileOperationAction", automation.Action)
+SdMmcFlushAction = sd_mmc_card_component_ns.class_("SdMmcFlushAction", automation.Action)
+SdMmcSyncAction = sd_mmc_card_component_ns.class_("SdMmcSyncAction", automation.Action)
+SdMmcAppendLogAction = sd_mmc_card_component_ns.class_("SdMmcAppendLogAction", automation.Action)
+SdMmcChecksumAction = sd_mmc_card_component_ns.class_("SdMmcChecksumAction", automation.Action)
+SdMmcFindAction = sd_mmc_card_component_ns.class_("SdMmcFindAction", automation.Action)
+SdMmcResetStatisticsAction = sd_mmc_card_component_ns.class_("SdMmcResetStatisticsAction", automation.Action)
+SdMmcBenchmarkAction = sd_mmc_card_component_ns.class_("SdMmcBenchmarkAction", automation.Action)
+SdMmcMountAction = sd_mmc_card_component_ns.class_("SdMmcMountAction", automation.Action)
+SdMmcUnmountAction = sd_mmc_card_component_ns.class_("SdMmcUnmountAction", automation.Action)
+SdMmcRemountAction = sd_mmc_card_component_ns.class_("SdMmcRemountAction", automation.Action)
 
 def validate_raw_data(value):
     if isinstance(value, str):
@@ -41,23 +198,178 @@ def validate_raw_data(value):
         "data must either be a string wrapped in quotes or a list of bytes"
     )
 
-CONFIG_SCHEMA = cv.Schema(
+def validate_pins(config):
+    # The host backend maps the card onto a directory and has no bus pins
+    if CORE.is_host:
+        return config
+    required = [CONF_CLK_PIN, CONF_CMD_PIN, CONF_DATA0_PIN]
+    if not config[CONF_MODE_1BIT]:
+        required += [CONF_DATA1_PIN, CONF_DATA2_PIN, CONF_DATA3_PIN]
+    for key in required:
+        if key not in config:
+            raise cv.Invalid(f"{key} is required")
+    return config
+
+def validate_when_unmounted(config):
+    if config[CONF_WHEN_UNMOUNTED] == "queue" and CONF_WRITE_BEHIND not in config:
+        raise cv.Invalid(f"{CONF_WHEN_UNMOUNTED}: queue requires {CONF_WRITE_BEHIND}")
+    return config
+
+HOST_BUS_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_FREQUENCY, default="20MHz"): cv.All(cv.frequency, cv.Range(min=400e3, max=52e6)),
+        cv.Optional(CONF_COMMAND_LATENCY, default="100us"): cv.positive_time_period_microseconds,
+        cv.Optional(CONF_WRITE_LATENCY, default="250us"): cv.positive_time_period_microseconds,
+    }
+)
+
+WRITE_BEHIND_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_BUFFER_SIZE, default="16KB"): cv.All(cv.validate_bytes, cv.int_range(min=512)),
+    }
+)
+
+FILE_HANDLE_POOL_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_SIZE, default=4): cv.int_range(min=1, max=16),
+        cv.Optional(CONF_FLUSH_INTERVAL, default="5s"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_FLUSH_THRESHOLD, default="16KB"): cv.validate_bytes,
+    }
+)
+
+METADATA_CACHE_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_SIZE, default=64): cv.int_range(min=1, max=4096),
+    }
+)
+
+SECTOR_CACHE_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Optional(CONF_SIZE, default="64KB"): cv.All(
+                cv.validate_bytes, cv.int_range(min=4096, max=16 * 1024 * 1024)
+            ),
+        }
+    ),
+    cv.only_with_esp_idf,
+)
+
+ROTATING_LOG_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_DIRECTORY): cv.string_strict,
+        cv.Optional(CONF_MAX_FILE_SIZE, default="1MB"): cv.All(cv.validate_bytes, cv.int_range(min=512, max=2**32 - 1)),
+        cv.Optional(CONF_MAX_FILES, default=0): cv.positive_int,
+        cv.Optional(CONF_MAX_TOTAL_BYTES, default=0): cv.validate_bytes,
+        cv.Optional(CONF_MAX_AGE, default="0s"): cv.positive_time_period_seconds,
+        cv.Optional(CONF_SYNC_INTERVAL, default="1s"): cv.positive_time_period_milliseconds,
+    }
+)
+
+DURABILITY_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_LEVEL, default="none"): cv.enum(DURABILITY_LEVELS, lower=True),
+        cv.Optional(CONF_SYNC_INTERVAL, default="1s"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_ATOMIC_WRITE, default=False): cv.boolean,
+        # Without sync_interval / atomic_write, a rule takes the values above
+        cv.Optional(CONF_PATHS, default=[]): cv.ensure_list(
+            cv.Schema(
+                {
+                    cv.Required(CONF_PATH): cv.string_strict,
+                    cv.Required(CONF_LEVEL): cv.enum(DURABILITY_LEVELS, lower=True),
+                    cv.Optional(CONF_SYNC_INTERVAL): cv.positive_time_period_milliseconds,
+                    cv.Optional(CONF_ATOMIC_WRITE): cv.boolean,
+                }
+            )
+        ),
+    }
+)
+
+COMPRESSION_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_WINDOW_BITS, default=10): cv.int_range(min=8, max=12),
+        cv.Optional(CONF_BLOCK_SIZE, default="4KB"): cv.All(cv.validate_bytes, cv.int_range(min=512, max=32768)),
+    }
+)
+
+FILE_SERVER_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.declare_id(FileServerHandler),
+            cv.GenerateID(CONF_WEB_SERVER_BASE_ID): cv.use_id(web_server_base.WebServerBase),
+            cv.Optional(CONF_URL_PREFIX, default="/sd"): cv.string_strict,
+        }
+    ).extend(cv.COMPONENT_SCHEMA),
+    cv.only_with_esp_idf,
+)
+
+BENCHMARK_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(BenchmarkRunner),
+        cv.Optional(CONF_DIRECTORY, default="/.benchmark"): cv.string_strict,
+        cv.Optional(CONF_SLICE, default="20ms"): cv.positive_time_period_milliseconds,
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+CONFIG_SCHEMA = cv.All(cv.Schema(
     {
         cv.GenerateID(): cv.declare_id(SdMmc),
-        cv.Required(CONF_CLK_PIN): pins.internal_gpio_output_pin_number,
-        cv.Required(CONF_CMD_PIN): pins.internal_gpio_output_pin_number,
-        cv.Required(CONF_DATA0_PIN): pins.internal_gpio_pin_number({CONF_OUTPUT: True, CONF_INPUT: True}),
+        cv.Optional(CONF_CLK_PIN): pins.internal_gpio_output_pin_number,
+        cv.Optional(CONF_CMD_PIN): pins.internal_gpio_output_pin_number,
+        cv.Optional(CONF_DATA0_PIN): pins.internal_gpio_pin_number({CONF_OUTPUT: True, CONF_INPUT: True}),
         cv.Optional(CONF_DATA1_PIN): pins.internal_gpio_pin_number({CONF_OUTPUT: True, CONF_INPUT: True}),
         cv.Optional(CONF_DATA2_PIN): pins.internal_gpio_pin_number({CONF_OUTPUT: True, CONF_INPUT: True}),
         cv.Optional(CONF_DATA3_PIN): pins.internal_gpio_pin_number({CONF_OUTPUT: True, CONF_INPUT: True}),
         cv.Optional(CONF_MODE_1BIT, default=False): cv.boolean,
+        cv.Optional(CONF_BUS_SPEED, default="default"): cv.enum(BUS_SPEEDS, lower=True),
+        cv.Optional(CONF_ALLOCATION_UNIT_SIZE, default="16KB"): cv.All(
+            cv.validate_bytes, cv.one_of(*[512 << i for i in range(12)])
+        ),
         cv.Optional(CONF_POWER_CTRL_PIN) : pins.gpio_pin_schema({
             CONF_OUTPUT: True,
             CONF_PULLUP: False,
             CONF_PULLDOWN: False,
         }),
+        cv.Optional(CONF_CARD_DETECT_PIN): pins.gpio_input_pin_schema,
+        cv.Optional(CONF_MOUNT_RETRY_INTERVAL, default="10s"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_WHEN_UNMOUNTED, default="fail"): cv.enum(UNMOUNTED_POLICIES, lower=True),
+        cv.Optional(CONF_HOST_ROOT): cv.All(cv.only_on(["host"]), cv.string_strict),
+        cv.Optional(CONF_HOST_BUS): cv.All(cv.only_on(["host"]), HOST_BUS_SCHEMA),
+        cv.Optional(CONF_WRITE_BEHIND): WRITE_BEHIND_SCHEMA,
+        cv.Optional(CONF_SPACE_RECONCILE_INTERVAL, default="1h"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_MAX_OPEN_FILES, default=5): cv.int_range(min=1, max=32),
+        cv.Optional(CONF_FILE_HANDLE_POOL): FILE_HANDLE_POOL_SCHEMA,
+        cv.Optional(CONF_MAX_READ_SIZE): cv.validate_bytes,
+        cv.Optional(CONF_METADATA_CACHE): METADATA_CACHE_SCHEMA,
+        cv.Optional(CONF_SECTOR_CACHE): SECTOR_CACHE_SCHEMA,
+        cv.Optional(CONF_ROTATING_LOG): ROTATING_LOG_SCHEMA,
+        cv.Optional(CONF_DURABILITY): DURABILITY_SCHEMA,
+        cv.Optional(CONF_FILE_SERVER): FILE_SERVER_SCHEMA,
+        cv.Optional(CONF_COMPRESSION): COMPRESSION_SCHEMA,
+        cv.Optional(CONF_OPERATION_STATS, default=False): cv.boolean,
+        cv.Optional(CONF_DEBUG_ALLOCATIONS, default=False): cv.boolean,
+        cv.Optional(CONF_BENCHMARK): BENCHMARK_SCHEMA,
+        cv.Optional(CONF_ON_READY): automation.validate_automation(
+            {
+                cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(ReadyTrigger),
+            }
+        ),
+        cv.Optional(CONF_ON_CHECKSUM): automation.validate_automation(
+            {
+                cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(ChecksumTrigger),
+            }
+        ),
+        cv.Optional(CONF_ON_FILE_OPERATION): automation.validate_automation(
+            {
+                cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(FileOperationTrigger),
+            }
+        ),
+        cv.Optional(CONF_ON_FIND): automation.validate_automation(
+            {
+                cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(FindTrigger),
+            }
+        ),
     }
-).extend(cv.COMPONENT_SCHEMA)
+).extend(cv.polling_component_schema("60s")), validate_pins, validate_when_unmounted)
 
 
 async def to_code(config):
@@ -65,12 +377,17 @@ async def to_code(config):
     await cg.register_component(var, config)
 
     cg.add(var.set_mode_1bit(config[CONF_MODE_1BIT]))
+    cg.add(var.set_bus_speed(config[CONF_BUS_SPEED]))
+    cg.add(var.set_allocation_unit_size(config[CONF_ALLOCATION_UNIT_SIZE]))
+    cg.add(var.set_space_reconcile_interval(config[CONF_SPACE_RECONCILE_INTERVAL]))
+    cg.add(var.set_max_open_files(config[CONF_MAX_OPEN_FILES]))
 
-    cg.add(var.set_clk_pin(config[CONF_CLK_PIN]))
-    cg.add(var.set_cmd_pin(config[CONF_CMD_PIN]))
-    cg.add(var.set_data0_pin(config[CONF_DATA0_PIN]))
+    if CONF_CLK_PIN in config:
+        cg.add(var.set_clk_pin(config[CONF_CLK_PIN]))
+        cg.add(var.set_cmd_pin(config[CONF_CMD_PIN]))
+        cg.add(var.set_data0_pin(config[CONF_DATA0_PIN]))
 
-    if (config[CONF_MODE_1BIT] == False):
+    if (config[CONF_MODE_1BIT] == False and CONF_DATA1_PIN in config):
         cg.add(var.set_data1_pin(config[CONF_DATA1_PIN]))
         cg.add(var.set_data2_pin(config[CONF_DATA2_PIN]))
         cg.add(var.set_data3_pin(config[CONF_DATA3_PIN]))
@@ -79,12 +396,123 @@ async def to_code(config):
         power_ctrl = await cg.gpio_pin_expression(config[CONF_POWER_CTRL_PIN])
         cg.add(var.set_power_ctrl_pin(power_ctrl));
 
+    if CONF_CARD_DETECT_PIN in config:
+        card_detect = await cg.gpio_pin_expression(config[CONF_CARD_DETECT_PIN])
+        cg.add(var.set_card_detect_pin(card_detect))
+
+    cg.add(var.set_mount_retry_interval(config[CONF_MOUNT_RETRY_INTERVAL]))
+    cg.add(var.set_unmounted_policy(config[CONF_WHEN_UNMOUNTED]))
+
+    if CONF_MAX_READ_SIZE in config:
+        cg.add(var.set_max_read_size(config[CONF_MAX_READ_SIZE]))
+
+    if CONF_FILE_HANDLE_POOL in config:
+        pool = config[CONF_FILE_HANDLE_POOL]
+        cg.add(var.set_file_handle_pool(pool[CONF_SIZE], pool[CONF_FLUSH_INTERVAL], pool[CONF_FLUSH_THRESHOLD]))
+
+    if CONF_METADATA_CACHE in config:
+        cg.add(var.set_metadata_cache_size(config[CONF_METADATA_CACHE][CONF_SIZE]))
+
+    if CONF_SECTOR_CACHE in config:
+        cg.add(var.set_sector_cache_size(config[CONF_SECTOR_CACHE][CONF_SIZE]))
+
+    if CONF_WRITE_BEHIND in config:
+        cg.add(var.set_write_behind_buffer_size(config[CONF_WRITE_BEHIND][CONF_BUFFER_SIZE]))
+
+    if CONF_ROTATING_LOG in config:
+        log_config = config[CONF_ROTATING_LOG]
+        cg.add(var.set_rotating_log(log_config[CONF_DIRECTORY], log_config[CONF_MAX_FILE_SIZE]))
+        rotating_log = var.Pget_rotating_log()
+        cg.add(rotating_log.set_max_files(log_config[CONF_MAX_FILES]))
+        cg.add(rotating_log.set_max_total_bytes(log_config[CONF_MAX_TOTAL_BYTES]))
+        cg.add(rotating_log.set_max_age(log_config[CONF_MAX_AGE].total_seconds))
+        cg.add(rotating_log.set_sync_interval(log_config[CONF_SYNC_INTERVAL]))
+
+    if CONF_DURABILITY in config:
+        durability = config[CONF_DURABILITY]
+        interval = durability[CONF_SYNC_INTERVAL]
+        atomic_write = durability[CONF_ATOMIC_WRITE]
+        cg.add(var.set_default_durability(durability[CONF_LEVEL], interval, atomic_write))
+        for rule in durability[CONF_PATHS]:
+            cg.add(var.add_durability_rule(
+                rule[CONF_PATH],
+                rule[CONF_LEVEL],
+                rule.get(CONF_SYNC_INTERVAL, interval),
+                rule.get(CONF_ATOMIC_WRITE, atomic_write),
+            ))
+
+    if CONF_COMPRESSION in config:
+        compression = config[CONF_COMPRESSION]
+        cg.add(var.set_compression(compression[CONF_WINDOW_BITS], compression[CONF_BLOCK_SIZE]))
+
+    if config[CONF_OPERATION_STATS]:
+        cg.add_define("USE_SD_MMC_OPERATION_STATS")
+
+    if config[CONF_DEBUG_ALLOCATIONS]:
+        cg.add_define("USE_SD_MMC_ALLOCATION_COUNTER")
+
+    if CONF_BENCHMARK in config:
+        benchmark_config = config[CONF_BENCHMARK]
+        runner = cg.new_Pvariable(benchmark_config[CONF_ID], var)
+        await cg.register_component(runner, benchmark_config)
+        cg.add(runner.set_directory(benchmark_config[CONF_DIRECTORY]))
+        cg.add(runner.set_slice(benchmark_config[CONF_SLICE]))
+
+    for conf in config.get(CONF_ON_READY, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [], conf)
+
+    for conf in config.get(CONF_ON_CHECKSUM, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(
+            trigger, [(cg.std_string, "path"), (cg.std_string, "checksum"), (bool, "ok")], conf
+        )
+
+    for conf in config.get(CONF_ON_FILE_OPERATION, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(FileOperationProgress, "progress")], conf)
+
+    for conf in config.get(CONF_ON_FIND, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(
+            trigger, [(cg.std_vector.template(FindResult), "results"), (bool, "ok")], conf
+        )
+
+    if CONF_FILE_SERVER in config:
+        server_config = config[CONF_FILE_SERVER]
+        base = await cg.get_variable(server_config[CONF_WEB_SERVER_BASE_ID])
+        handler = cg.new_Pvariable(server_config[CONF_ID], base, var, server_config[CONF_URL_PREFIX])
+        await cg.register_component(handler, server_config)
+        cg.add_define("USE_SD_MMC_FILE_SERVER")
+
+    if CORE.is_host:
+        if CONF_HOST_ROOT in config:
+            cg.add(var.set_host_root(config[CONF_HOST_ROOT]))
+        if CONF_HOST_BUS in config:
+            bus = config[CONF_HOST_BUS]
+            cg.add(var.set_host_bus_model(cg.StructInitializer(
+                HostBusModel,
+                ("enabled", True),
+                ("frequency_khz", int(bus[CONF_FREQUENCY] / 1000)),
+                ("command_latency_us", bus[CONF_COMMAND_LATENCY].total_microseconds),
+                ("write_latency_us", bus[CONF_WRITE_LATENCY].total_microseconds),
+            )))
+
     if CORE.using_arduino:
         if CORE.is_esp32:
             cg.add_library("FS", None)
             cg.add_library("SD_MMC", None)
 
 
+async def set_action_data(var, data, args):
+    # Fixed data is stored once in the action and passed by reference on each run
+    if cg.is_template(data):
+        data_ = await cg.templatable(data, args, cg.std_vector.template(cg.uint8))
+        cg.add(var.set_data(data_))
+    else:
+        cg.add(var.set_data_static(list(data)))
+
+
 SD_MMC_PATH_ACTION_SCHEMA = cv.Schema(
     {
         cv.GenerateID(): cv.use_id(SdMmc),
@@ -92,37 +520,60 @@ SD_MMC_PATH_ACTION_SCHEMA = cv.Schema(
     }
 )
 
+def validate_action_durability(config):
+    # Queued writes follow the rules of their path when the writer task reaches them
+    if config[CONF_WRITE_BEHIND] and CONF_DURABILITY in config:
+        raise cv.Invalid(f"{CONF_DURABILITY} cannot be used with {CONF_WRITE_BEHIND}")
+    return config
+
 SD_MMC_WRITE_FILE_ACTION_SCHEMA = cv.Schema(
     {
         cv.GenerateID(): cv.use_id(SdMmc),
         cv.Required(CONF_PATH): cv.templatable(cv.string_strict),
         cv.Required(CONF_DATA): cv.templatable(validate_raw_data),
+        cv.Optional(CONF_WRITE_BEHIND, default=False): cv.boolean,
+        cv.Optional(CONF_DURABILITY): cv.enum(DURABILITY_LEVELS, lower=True),
     }
 ).extend(SD_MMC_PATH_ACTION_SCHEMA)
 
 @automation.register_action(
-    "sd_mmc_card.write_file", SdMmcWriteFileAction, SD_MMC_WRITE_FILE_ACTION_SCHEMA
+    "sd_mmc_card.write_file",
+    SdMmcWriteFileAction,
+    cv.All(SD_MMC_WRITE_FILE_ACTION_SCHEMA, validate_action_durability),
 )
 async def sd_mmc_write_file_to_code(config, action_id, template_arg, args):
     parent = await cg.get_variable(config[CONF_ID])
     var = cg.new_Pvariable(action_id, template_arg, parent)
     path_ = await cg.templatable(config[CONF_PATH], args, cg.std_string)
-    data_ = await cg.templatable(config[CONF_DATA], args, cg.std_vector.template(cg.uint8))
     cg.add(var.set_path(path_))
-    cg.add(var.set_data(data_))
+    await set_action_data(var, config[CONF_DATA], args)
+    cg.add(var.set_write_behind(config[CONF_WRITE_BEHIND]))
+    if CONF_DURABILITY in config:
+        cg.add(var.set_durability(config[CONF_DURABILITY]))
     return var
 
 
+SD_MMC_APPEND_FILE_ACTION_SCHEMA = SD_MMC_WRITE_FILE_ACTION_SCHEMA.extend(
+    {
+        cv.Optional(CONF_COMPRESS, default=False): cv.boolean,
+    }
+)
+
 @automation.register_action(
-    "sd_mmc_card.append_file", SdMmcAppendFileAction, SD_MMC_WRITE_FILE_ACTION_SCHEMA
+    "sd_mmc_card.append_file",
+    SdMmcAppendFileAction,
+    cv.All(SD_MMC_APPEND_FILE_ACTION_SCHEMA, validate_action_durability),
 )
 async def sd_mmc_append_file_to_code(config, action_id, template_arg, args):
     parent = await cg.get_variable(config[CONF_ID])
     var = cg.new_Pvariable(action_id, template_arg, parent)
     path_ = await cg.templatable(config[CONF_PATH], args, cg.std_string)
-    data_ = await cg.templatable(config[CONF_DATA], args, cg.std_vector.template(cg.uint8))
     cg.add(var.set_path(path_))
-    cg.add(var.set_data(data_))
+    await set_action_data(var, config[CONF_DATA], args)
+    cg.add(var.set_write_behind(config[CONF_WRITE_BEHIND]))
+    cg.add(var.set_compress(config[CONF_COMPRESS]))
+    if CONF_DURABILITY in config:
+        cg.add(var.set_durability(config[CONF_DURABILITY]))
     return var
 
 
@@ -157,3 +608,234 @@ async def sd_mmc_delete_file_to_code(config, action_id, template_arg, args):
     path_ = await cg.templatable(config[CONF_PATH], args, cg.std_string)
     cg.add(var.set_path(path_))
     return var
+
+
+SD_MMC_TRANSFER_ACTION_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.use_id(SdMmc),
+        cv.Required(CONF_SOURCE): cv.templatable(cv.string_strict),
+        cv.Required(CONF_DESTINATION): cv.templatable(cv.string_strict),
+    }
+)
+
+
+async def file_operation_to_code(config, action_id, template_arg, args, operation, source):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    cg.add(var.set_type(operation))
+    source_ = await cg.templatable(config[source], args, cg.std_string)
+    cg.add(var.set_source(source_))
+    if CONF_DESTINATION in config:
+        destination_ = await cg.templatable(config[CONF_DESTINATION], args, cg.std_string)
+        cg.add(var.set_destination(destination_))
+    return var
+
+
+@automation.register_action(
+    "sd_mmc_card.copy_file", SdMmcFileOperationAction, SD_MMC_TRANSFER_ACTION_SCHEMA
+)
+async def sd_mmc_copy_file_to_code(config, action_id, template_arg, args):
+    return await file_operation_to_code(
+        config, action_id, template_arg, args, FileOperationType.COPY, CONF_SOURCE
+    )
+
+
+@automation.register_action(
+    "sd_mmc_card.move_file", SdMmcFileOperationAction, SD_MMC_TRANSFER_ACTION_SCHEMA
+)
+async def sd_mmc_move_file_to_code(config, action_id, template_arg, args):
+    return await file_operation_to_code(
+        config, action_id, template_arg, args, FileOperationType.MOVE, CONF_SOURCE
+    )
+
+
+@automation.register_action(
+    "sd_mmc_card.copy_tree", SdMmcFileOperationAction, SD_MMC_TRANSFER_ACTION_SCHEMA
+)
+async def sd_mmc_copy_tree_to_code(config, action_id, template_arg, args):
+    return await file_operation_to_code(
+        config, action_id, template_arg, args, FileOperationType.COPY_TREE, CONF_SOURCE
+    )
+
+
+@automation.register_action(
+    "sd_mmc_card.remove_tree", SdMmcFileOperationAction, SD_MMC_PATH_ACTION_SCHEMA
+)
+async def sd_mmc_remove_tree_to_code(config, action_id, template_arg, args):
+    return await file_operation_to_code(
+        config, action_id, template_arg, args, FileOperationType.REMOVE_TREE, CONF_PATH
+    )
+
+
+@automation.register_action(
+    "sd_mmc_card.flush",
+    SdMmcFlushAction,
+    cv.Schema({cv.GenerateID(): cv.use_id(SdMmc)}),
+)
+async def sd_mmc_flush_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    return var
+
+
+@automation.register_action(
+    "sd_mmc_card.sync",
+    SdMmcSyncAction,
+    cv.Schema({cv.GenerateID(): cv.use_id(SdMmc)}),
+)
+async def sd_mmc_sync_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    return var
+
+
+@automation.register_action(
+    "sd_mmc_card.mount",
+    SdMmcMountAction,
+    cv.Schema({cv.GenerateID(): cv.use_id(SdMmc)}),
+)
+@automation.register_action(
+    "sd_mmc_card.unmount",
+    SdMmcUnmountAction,
+    cv.Schema({cv.GenerateID(): cv.use_id(SdMmc)}),
+)
+@automation.register_action(
+    "sd_mmc_card.remount",
+    SdMmcRemountAction,
+    cv.Schema({cv.GenerateID(): cv.use_id(SdMmc)}),
+)
+async def sd_mmc_mount_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    return var
+
+
+@automation.register_action(
+    "sd_mmc_card.reset_statistics",
+    SdMmcResetStatisticsAction,
+    cv.Schema({cv.GenerateID(): cv.use_id(SdMmc)}),
+)
+async def sd_mmc_reset_statistics_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    return var
+
+
+@automation.register_action(
+    "sd_mmc_card.benchmark",
+    SdMmcBenchmarkAction,
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.use_id(BenchmarkRunner),
+            cv.Optional(CONF_WORKLOADS, default=DEFAULT_BENCHMARK_WORKLOADS): cv.ensure_list(
+                cv.enum(BENCHMARK_WORKLOADS, lower=True)
+            ),
+            cv.Optional(CONF_FILE_SIZE, default="1MB"): cv.All(cv.validate_bytes, cv.int_range(min=4096)),
+            cv.Optional(CONF_BLOCK_SIZE, default="32KB"): cv.All(cv.validate_bytes, cv.int_range(min=512)),
+            cv.Optional(CONF_RANDOM_BLOCK_SIZE, default="4KB"): cv.All(cv.validate_bytes, cv.int_range(min=512)),
+            cv.Optional(CONF_RANDOM_OPS, default=256): cv.positive_int,
+            cv.Optional(CONF_APPEND_SIZE, default="64B"): cv.All(cv.validate_bytes, cv.int_range(min=1)),
+            cv.Optional(CONF_APPEND_OPS, default=512): cv.positive_int,
+            cv.Optional(CONF_TIME_BUDGET, default="30s"): cv.positive_time_period_milliseconds,
+        }
+    ),
+)
+async def sd_mmc_benchmark_to_code(config, action_id, template_arg, args):
+    runner = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, runner)
+    for workload in config[CONF_WORKLOADS]:
+        cg.add(var.add_workload(workload))
+    cg.add(var.set_file_size(config[CONF_FILE_SIZE]))
+    cg.add(var.set_block_size(config[CONF_BLOCK_SIZE]))
+    cg.add(var.set_random_block_size(config[CONF_RANDOM_BLOCK_SIZE]))
+    cg.add(var.set_random_ops(config[CONF_RANDOM_OPS]))
+    cg.add(var.set_append_size(config[CONF_APPEND_SIZE]))
+    cg.add(var.set_append_ops(config[CONF_APPEND_OPS]))
+    cg.add(var.set_time_budget(config[CONF_TIME_BUDGET]))
+    return var
+
+
+@automation.register_action(
+    "sd_mmc_card.append_log",
+    SdMmcAppendLogAction,
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.use_id(SdMmc),
+            cv.Required(CONF_DATA): cv.templatable(validate_raw_data),
+        }
+    ),
+)
+async def sd_mmc_append_log_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    await set_action_data(var, config[CONF_DATA], args)
+    return var
+
+
+SD_MMC_CHECKSUM_ACTION_SCHEMA = SD_MMC_PATH_ACTION_SCHEMA.extend(
+    {
+        cv.Optional(CONF_ALGORITHM, default="sha256"): cv.enum(HASH_ALGORITHMS, lower=True),
+    }
+)
+
+SD_MMC_VERIFY_ACTION_SCHEMA = SD_MMC_CHECKSUM_ACTION_SCHEMA.extend(
+    {
+        cv.Required(CONF_EXPECTED): cv.templatable(cv.string_strict),
+    }
+)
+
+
+@automation.register_action(
+    "sd_mmc_card.checksum", SdMmcChecksumAction, SD_MMC_CHECKSUM_ACTION_SCHEMA
+)
+@automation.register_action(
+    "sd_mmc_card.verify", SdMmcChecksumAction, SD_MMC_VERIFY_ACTION_SCHEMA
+)
+async def sd_mmc_checksum_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    path_ = await cg.templatable(config[CONF_PATH], args, cg.std_string)
+    cg.add(var.set_path(path_))
+    cg.add(var.set_algorithm(config[CONF_ALGORITHM]))
+    if CONF_EXPECTED in config:
+        expected_ = await cg.templatable(config[CONF_EXPECTED], args, cg.std_string)
+        cg.add(var.set_expected(expected_))
+    return var
+
+
+SD_MMC_FIND_ACTION_SCHEMA = SD_MMC_PATH_ACTION_SCHEMA.extend(
+    {
+        cv.Optional(CONF_PATTERN): cv.templatable(cv.string_strict),
+        cv.Optional(CONF_DEPTH, default=16): cv.int_range(min=0, max=255),
+        cv.Optional(CONF_TYPE, default="files"): cv.enum(WALK_TYPES, lower=True),
+        cv.Optional(CONF_MIN_SIZE, default="0B"): cv.validate_bytes,
+        cv.Optional(CONF_MAX_SIZE): cv.validate_bytes,
+        cv.Optional(CONF_MIN_AGE, default="0s"): cv.positive_time_period_seconds,
+        cv.Optional(CONF_MAX_AGE, default="0s"): cv.positive_time_period_seconds,
+        cv.Optional(CONF_SORT, default="none"): cv.enum(FIND_SORTS, lower=True),
+        cv.Optional(CONF_DESCENDING, default=False): cv.boolean,
+        cv.Optional(CONF_LIMIT, default=100): cv.positive_int,
+    }
+)
+
+
+@automation.register_action("sd_mmc_card.find", SdMmcFindAction, SD_MMC_FIND_ACTION_SCHEMA)
+async def sd_mmc_find_to_code(config, action_id, template_arg, args):
+    parent = await cg.get_variable(config[CONF_ID])
+    var = cg.new_Pvariable(action_id, template_arg, parent)
+    path_ = await cg.templatable(config[CONF_PATH], args, cg.std_string)
+    cg.add(var.set_path(path_))
+    if CONF_PATTERN in config:
+        pattern_ = await cg.templatable(config[CONF_PATTERN], args, cg.std_string)
+        cg.add(var.set_pattern(pattern_))
+    cg.add(var.set_depth(config[CONF_DEPTH]))
+    cg.add(var.set_type(config[CONF_TYPE]))
+    cg.add(var.set_min_size(config[CONF_MIN_SIZE]))
+    if CONF_MAX_SIZE in config:
+        cg.add(var.set_max_size(config[CONF_MAX_SIZE]))
+    cg.add(var.set_min_age(config[CONF_MIN_AGE].total_seconds))
+    cg.add(var.set_max_age(config[CONF_MAX_AGE].total_seconds))
+    cg.add(var.set_sort(config[CONF_SORT]))
+    cg.add(var.set_descending(config[CONF_DESCENDING]))
+    cg.add(var.set_limit(config[CONF_LIMIT]))
+    return var
@@ -0,0 +1,63 @@
+#include "sd_mmc_card.h"
+
+#ifdef USE_SD_MMC_ALLOCATION_COUNTER
+#include <cstdlib>
+#include <new>
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_alloc";
+
+static thread_local uint32_t t_allocation_count = 0;
+
+static void *counted_alloc(size_t size) {
+  t_allocation_count++;
+  return malloc(size == 0 ? 1 : size);
+}
+
+uint32_t thread_allocation_count() { return t_allocation_count; }
+
+AllocationProbe::~AllocationProbe() {
+  uint32_t count = thread_allocation_count() - this->start_;
+  if (count == 0)
+    return;
+  this->total_ += count;
+  ESP_LOGD(TAG, "%s made %u heap allocations", operation_to_string(this->operation_), static_cast<unsigned>(count));
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
+
+// Debug build only: every C++ allocation of the firmware goes through these
+void *operator new(size_t size) {
+  void *ptr = esphome::sd_mmc_card::counted_alloc(size);
+  if (ptr == nullptr) {
+#if __cpp_exceptions
+    throw std::bad_alloc();
+#else
+    abort();
+#endif
+  }
+  return ptr;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return esphome::sd_mmc_card::counted_alloc(size); }
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return esphome::sd_mmc_card::counted_alloc(size);
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+
+void operator delete[](void *ptr) noexcept { free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+#endif  // USE_SD_MMC_ALLOCATION_COUNTER
@@ -0,0 +1,575 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_benchmark";
+
+static const BenchmarkWorkload WORKLOADS[] = {
+    BenchmarkWorkload::SEQUENTIAL_WRITE, BenchmarkWorkload::SEQUENTIAL_READ, BenchmarkWorkload::READ_FILE,
+    BenchmarkWorkload::PROCESS_FILE,     BenchmarkWorkload::RANDOM_READ,     BenchmarkWorkload::RANDOM_WRITE,
+    BenchmarkWorkload::SMALL_APPEND,     BenchmarkWorkload::CREATE_FILES,    BenchmarkWorkload::DIRECTORY_WALK,
+    BenchmarkWorkload::STAT,             BenchmarkWorkload::CONCURRENT,
+};
+static constexpr uint32_t READ_FILE_OPS = 4;
+static constexpr size_t STRESS_RECORD_SIZE = 96;
+
+const char *benchmark_workload_to_string(BenchmarkWorkload workload) {
+  switch (workload) {
+    case BenchmarkWorkload::SEQUENTIAL_WRITE:
+      return "seq_write";
+    case BenchmarkWorkload::SEQUENTIAL_READ:
+      return "seq_read";
+    case BenchmarkWorkload::READ_FILE:
+      return "read_file";
+    case BenchmarkWorkload::PROCESS_FILE:
+      return "process_file";
+    case BenchmarkWorkload::RANDOM_READ:
+      return "random_read";
+    case BenchmarkWorkload::RANDOM_WRITE:
+      return "random_write";
+    case BenchmarkWorkload::SMALL_APPEND:
+      return "small_append";
+    case BenchmarkWorkload::CREATE_FILES:
+      return "create_files";
+    case BenchmarkWorkload::DIRECTORY_WALK:
+      return "directory_walk";
+    case BenchmarkWorkload::STAT:
+      return "stat";
+    case BenchmarkWorkload::CONCURRENT:
+      return "concurrent";
+  }
+  return "unknown";
+}
+
+float BenchmarkResult::throughput_mb_s() const {
+  if (this->elapsed_us == 0)
+    return 0;
+  return this->bytes * 1.0f / this->elapsed_us;
+}
+
+float BenchmarkResult::iops() const {
+  if (this->elapsed_us == 0)
+    return 0;
+  return this->ops * 1000000.0f / this->elapsed_us;
+}
+
+Benchmark::Benchmark(SdMmc *parent, BenchmarkConfig config) : parent_(parent), config_(std::move(config)) {}
+
+Benchmark::~Benchmark() { this->stop_concurrent_(); }
+
+bool Benchmark::start() {
+  this->results_.clear();
+  this->workload_index_ = 0;
+  this->op_index_ = 0;
+  this->random_state_ = this->config_.seed | 1;
+  this->truncated_ = false;
+  this->resolve_workloads_();
+
+  size_t buffer_size = std::max(this->config_.block_size, this->config_.random_block_size);
+  buffer_size = std::max(buffer_size, this->config_.append_size);
+  this->buffer_.resize(buffer_size);
+  for (auto &byte : this->buffer_)
+    byte = this->next_random_();
+
+  if (!this->parent_->is_directory(this->config_.directory) &&
+      !this->parent_->create_directory(this->config_.directory.c_str())) {
+    ESP_LOGE(TAG, "Failed to create benchmark directory %s", this->config_.directory.c_str());
+    return false;
+  }
+  this->running_ = true;
+  this->start_ms_ = millis();
+  return true;
+}
+
+static bool needs_data_file(BenchmarkWorkload workload) {
+  switch (workload) {
+    case BenchmarkWorkload::SEQUENTIAL_READ:
+    case BenchmarkWorkload::READ_FILE:
+    case BenchmarkWorkload::PROCESS_FILE:
+    case BenchmarkWorkload::RANDOM_READ:
+    case BenchmarkWorkload::RANDOM_WRITE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool needs_small_files(BenchmarkWorkload workload) {
+  return workload == BenchmarkWorkload::DIRECTORY_WALK || workload == BenchmarkWorkload::STAT;
+}
+
+void Benchmark::resolve_workloads_() {
+  auto &selected = this->config_.workloads;
+  auto is_selected = [&selected](BenchmarkWorkload workload) {
+    return selected.empty() || std::find(selected.begin(), selected.end(), workload) != selected.end();
+  };
+  bool data_file = false, small_files = false;
+  for (auto workload : WORKLOADS) {
+    if (is_selected(workload)) {
+      data_file |= needs_data_file(workload);
+      small_files |= needs_small_files(workload);
+    }
+  }
+  // Always in the canonical order, so that the files a workload reads already exist
+  this->workloads_.clear();
+  for (auto workload : WORKLOADS) {
+    if (is_selected(workload) || (data_file && workload == BenchmarkWorkload::SEQUENTIAL_WRITE) ||
+        (small_files && workload == BenchmarkWorkload::CREATE_FILES))
+      this->workloads_.push_back(workload);
+  }
+}
+
+void Benchmark::end_workload_(BenchmarkWorkload workload) {
+  this->finish_(workload);
+  this->results_.back().elapsed_us = micros() - this->workload_start_us_;
+  this->op_index_ = 0;
+  this->workload_index_++;
+}
+
+bool Benchmark::step() {
+  if (!this->running_)
+    return false;
+
+  if (this->config_.time_budget_ms != 0 && millis() - this->start_ms_ > this->config_.time_budget_ms) {
+    // A started workload keeps its partial measures
+    if (this->results_.size() > this->workload_index_)
+      this->end_workload_(this->workloads_[this->workload_index_]);
+    ESP_LOGW(TAG, "Time budget of %u ms exhausted, %zu of %zu workloads done", this->config_.time_budget_ms,
+             this->results_.size(), this->workloads_.size());
+    this->truncated_ = true;
+    this->workload_index_ = this->workloads_.size();
+  }
+  if (this->workload_index_ >= this->workloads_.size()) {
+    this->cleanup_();
+    this->running_ = false;
+    return false;
+  }
+
+  BenchmarkWorkload workload = this->workloads_[this->workload_index_];
+  // Started once: the concurrent workload stays at op 0 while its tasks run
+  if (this->results_.size() == this->workload_index_) {
+    this->results_.emplace_back();
+    this->results_.back().workload = workload;
+    this->workload_start_us_ = micros();
+    if (!this->prepare_(workload)) {
+      ESP_LOGE(TAG, "Failed to prepare workload %s", benchmark_workload_to_string(workload));
+      this->results_.back().errors++;
+      this->op_index_ = this->ops_for_(workload);
+    }
+  }
+
+  // The stress tasks run on their own: loop() keeps going until they are all done
+  if (workload == BenchmarkWorkload::CONCURRENT && this->concurrent_running_())
+    return true;
+
+  BenchmarkResult &result = this->results_.back();
+  if (this->op_index_ < this->ops_for_(workload)) {
+    size_t bytes = 0;
+    // The single concurrent op spans the whole stress run
+    uint32_t op_start = workload == BenchmarkWorkload::CONCURRENT ? this->workload_start_us_ : micros();
+    bool ok = this->run_op_(workload, this->op_index_, bytes);
+    result.latency.record(micros() - op_start);
+    result.ops++;
+    result.bytes += bytes;
+    if (!ok)
+      result.errors++;
+    this->op_index_++;
+  }
+
+  if (this->op_index_ >= this->ops_for_(workload)) {
+    this->end_workload_(workload);
+    if (this->workload_index_ >= this->workloads_.size()) {
+      this->cleanup_();
+      this->running_ = false;
+    }
+  }
+  return this->running_;
+}
+
+BenchmarkResult const *Benchmark::get_result(BenchmarkWorkload workload) const {
+  for (auto const &result : this->results_) {
+    if (result.workload == workload)
+      return &result;
+  }
+  return nullptr;
+}
+
+void Benchmark::run() {
+  if (!this->start())
+    return;
+  while (this->step()) {
+    // The stress tasks need the CPU more than this loop does
+    if (this->is_waiting())
+      delay(1);
+  }
+  this->log_results();
+}
+
+void Benchmark::log_results() const {
+  ESP_LOGI(TAG, "%-15s %6s %6s %9s %9s %8s %8s %8s %8s", "workload", "ops", "errors", "MB/s", "IOPS", "p50 us",
+           "p95 us", "p99 us", "max us");
+  for (auto const &result : this->results_) {
+    ESP_LOGI(TAG, "%-15s %6u %6u %9.2f %9.1f %8u %8u %8u %8u", benchmark_workload_to_string(result.workload),
+             result.ops, result.errors, result.throughput_mb_s(), result.iops(), result.latency.percentile(50),
+             result.latency.percentile(95), result.latency.percentile(99), result.latency.max());
+  }
+}
+
+uint32_t Benchmark::ops_for_(BenchmarkWorkload workload) const {
+  switch (workload) {
+    case BenchmarkWorkload::SEQUENTIAL_WRITE:
+    case BenchmarkWorkload::SEQUENTIAL_READ:
+      return (this->config_.file_size + this->config_.block_size - 1) / this->config_.block_size;
+    case BenchmarkWorkload::READ_FILE:
+    case BenchmarkWorkload::PROCESS_FILE:
+      return READ_FILE_OPS;
+    case BenchmarkWorkload::RANDOM_READ:
+    case BenchmarkWorkload::RANDOM_WRITE:
+      return this->config_.random_ops;
+    case BenchmarkWorkload::SMALL_APPEND:
+      return this->config_.append_ops;
+    case BenchmarkWorkload::CREATE_FILES:
+      return this->config_.file_count;
+    case BenchmarkWorkload::DIRECTORY_WALK:
+      return this->config_.walk_ops;
+    case BenchmarkWorkload::STAT:
+      return this->config_.stat_ops;
+    case BenchmarkWorkload::CONCURRENT:
+      return 1;
+  }
+  return 0;
+}
+
+bool Benchmark::prepare_(BenchmarkWorkload workload) {
+  std::string path = this->data_path_();
+  switch (workload) {
+    case BenchmarkWorkload::SEQUENTIAL_WRITE:
+      this->stream_ = this->parent_->open_file_write(path, "wb");
+      return this->stream_ != nullptr;
+    case BenchmarkWorkload::SEQUENTIAL_READ:
+    case BenchmarkWorkload::RANDOM_READ:
+      this->stream_ = this->parent_->open_file_read(path);
+      return this->stream_ != nullptr;
+    case BenchmarkWorkload::RANDOM_WRITE:
+      this->stream_ = this->parent_->open_file_write(path, "r+b");
+      return this->stream_ != nullptr;
+    case BenchmarkWorkload::SMALL_APPEND:
+      return this->parent_->write_file(this->append_path_().c_str(), this->buffer_.data(), 0);
+    case BenchmarkWorkload::CONCURRENT:
+      return this->start_concurrent_();
+    default:
+      return true;
+  }
+}
+
+void Benchmark::finish_(BenchmarkWorkload workload) {
+  this->stream_.reset();
+  // Cut short by the time budget
+  this->stop_concurrent_();
+}
+
+bool Benchmark::run_op_(BenchmarkWorkload workload, uint32_t index, size_t &bytes) {
+  switch (workload) {
+    case BenchmarkWorkload::SEQUENTIAL_WRITE: {
+      size_t len = std::min(this->config_.block_size, this->config_.file_size - index * this->config_.block_size);
+      bytes = this->stream_->write(this->buffer_.data(), len);
+      return bytes == len;
+    }
+    case BenchmarkWorkload::SEQUENTIAL_READ: {
+      size_t len = std::min(this->config_.block_size, this->config_.file_size - index * this->config_.block_size);
+      bytes = this->stream_->read(this->buffer_.data(), len);
+      return bytes == len;
+    }
+    case BenchmarkWorkload::READ_FILE: {
+      bytes = this->parent_->read_file(this->data_path_()).size();
+      return bytes == this->config_.file_size;
+    }
+    case BenchmarkWorkload::PROCESS_FILE: {
+      bool ok = this->parent_->process_file(
+          this->data_path_(),
+          [&bytes](const uint8_t *data, size_t size, size_t total_size, size_t position) {
+            bytes += size;
+            return true;
+          },
+          this->config_.block_size);
+      return ok && bytes == this->config_.file_size;
+    }
+    case BenchmarkWorkload::RANDOM_READ:
+    case BenchmarkWorkload::RANDOM_WRITE: {
+      size_t len = this->config_.random_block_size;
+      size_t blocks = this->config_.file_size / len;
+      if (blocks == 0)
+        return false;
+      uint64_t offset = (this->next_random_() % blocks) * static_cast<uint64_t>(len);
+      if (workload == BenchmarkWorkload::RANDOM_READ) {
+        bytes = this->stream_->pread(this->buffer_.data(), len, offset);
+      } else {
+        bytes = this->stream_->pwrite(this->buffer_.data(), len, offset);
+      }
+      return bytes == len;
+    }
+    case BenchmarkWorkload::SMALL_APPEND: {
+      if (!this->parent_->append_file(this->append_path_().c_str(), this->buffer_.data(), this->config_.append_size))
+        return false;
+      bytes = this->config_.append_size;
+      return true;
+    }
+    case BenchmarkWorkload::CREATE_FILES: {
+      size_t len = std::min<size_t>(this->buffer_.size(), 1024);
+      if (!this->parent_->write_file(this->small_file_path_(index).c_str(), this->buffer_.data(), len))
+        return false;
+      bytes = len;
+      return true;
+    }
+    case BenchmarkWorkload::DIRECTORY_WALK: {
+      auto entries = this->parent_->list_directory_file_info(this->config_.directory, 0);
+      return entries.size() >= this->config_.file_count;
+    }
+    case BenchmarkWorkload::STAT: {
+      std::string path = this->small_file_path_(index % std::max<uint32_t>(this->config_.file_count, 1));
+      switch (index % 3) {
+        case 0:
+          return this->parent_->file_size(path) != static_cast<size_t>(-1);
+        case 1:
+          return !this->parent_->is_directory(path);
+        default:
+          return this->parent_->exists(path);
+      }
+    }
+    case BenchmarkWorkload::CONCURRENT:
+      return this->check_concurrent_(bytes);
+  }
+  return false;
+}
+
+static bool is_record(const uint8_t *data, uint8_t tag) {
+  for (size_t i = 0; i < STRESS_RECORD_SIZE; i++) {
+    if (data[i] != tag)
+      return false;
+  }
+  return true;
+}
+
+// Every task appends tagged records to one shared file while reading it back, rewriting a
+// file of its own and creating directories. Interleaved or torn writes show up as records
+// that are not uniform or as a wrong count per task.
+bool Benchmark::start_concurrent_() {
+  std::string shared = this->stress_path_();
+  if (!this->parent_->write_file(shared.c_str(), this->buffer_.data(), 0))
+    return false;
+  uint8_t threads = std::min<uint8_t>(std::max<uint8_t>(this->config_.stress_threads, 1), 15);
+  uint32_t ops = this->config_.stress_ops;
+  this->stress_finished_ = 0;
+  this->stress_errors_ = 0;
+  this->stress_stop_ = false;
+  this->parent_->get_path_locks().reset_stats();
+
+  this->stress_workers_.reserve(threads);
+  for (uint8_t t = 0; t < threads; t++) {
+    this->stress_workers_.push_back(start_worker_thread("sd_stress", 6144, [this, t, ops, shared]() {
+      std::atomic<uint32_t> &errors = this->stress_errors_;
+      uint8_t record[STRESS_RECORD_SIZE];
+      uint8_t check[STRESS_RECORD_SIZE];
+      std::string own = this->small_file_path_(t);
+      char directory[16];
+      snprintf(directory, sizeof(directory), "/stress%u", t);
+      std::string own_directory = this->config_.directory + directory;
+      for (uint32_t i = 0; i < ops && !this->stress_stop_; i++) {
+        uint8_t tag = ((t + 1) << 4) | (i & 0x0F);
+        memset(record, tag, sizeof(record));
+        if (!this->parent_->append_file(shared.c_str(), record, sizeof(record)))
+          errors++;
+        switch (i % 4) {
+          case 0:
+            if (!this->parent_->write_file(own.c_str(), record, sizeof(record)) ||
+                this->parent_->read_file_into(own, check, sizeof(check)) != sizeof(check) || !is_record(check, tag))
+              errors++;
+            break;
+          case 1:
+            this->parent_->process_file(shared, [&errors](const uint8_t *, size_t, size_t total_size, size_t) {
+              if (total_size % STRESS_RECORD_SIZE != 0)
+                errors++;
+              return false;
+            });
+            break;
+          case 2:
+            if (!this->parent_->create_directory(own_directory.c_str()) ||
+                !this->parent_->remove_directory(own_directory.c_str()))
+              errors++;
+            break;
+          default:
+            this->parent_->exists(shared);
+            break;
+        }
+      }
+      this->stress_finished_++;
+    }));
+  }
+  return true;
+}
+
+void Benchmark::stop_concurrent_() {
+  this->stress_stop_ = true;
+  for (auto &worker : this->stress_workers_)
+    worker.join();
+  this->stress_workers_.clear();
+}
+
+bool Benchmark::check_concurrent_(size_t &bytes) {
+  // All tasks have finished: the joins do not wait
+  uint8_t threads = this->stress_workers_.size();
+  this->stop_concurrent_();
+  std::string shared = this->stress_path_();
+  uint32_t ops = this->config_.stress_ops;
+  std::atomic<uint32_t> &errors = this->stress_errors_;
+  uint32_t counts[16] = {0};
+  bool ok = this->parent_->process_file(
+      shared,
+      [&](const uint8_t *data, size_t size, size_t total_size, size_t position) {
+        if (position % STRESS_RECORD_SIZE != 0 || size % STRESS_RECORD_SIZE != 0) {
+          errors++;
+          return false;
+        }
+        for (size_t offset = 0; offset < size; offset += STRESS_RECORD_SIZE) {
+          uint8_t tag = data[offset];
+          if (!is_record(data + offset, tag) || (tag >> 4) == 0 || (tag >> 4) > threads) {
+            errors++;
+            return false;
+          }
+          counts[tag >> 4]++;
+        }
+        bytes += size;
+        return true;
+      },
+      STRESS_RECORD_SIZE * 64);
+  for (uint8_t t = 1; t <= threads; t++) {
+    if (counts[t] != ops)
+      errors++;
+  }
+
+  LockStats stats = this->parent_->get_path_lock_stats();
+  ESP_LOGI(TAG, "Concurrent: %u tasks, %u locks, %u contended, max wait %u us, max hold %u us, %u errors", threads,
+           stats.acquisitions, stats.contentions, stats.max_wait_us, stats.max_hold_us, errors.load());
+  return ok && errors == 0;
+}
+
+void Benchmark::cleanup_() {
+  // Only some workloads may have run, so only the files that exist are deleted
+  auto remove = [this](std::string const &path) {
+    if (this->parent_->exists(path))
+      this->parent_->delete_file(path);
+  };
+  for (uint32_t i = 0; i < this->config_.file_count; i++)
+    remove(this->small_file_path_(i));
+  remove(this->data_path_());
+  remove(this->append_path_());
+  remove(this->stress_path_());
+  this->parent_->remove_directory(this->config_.directory.c_str());
+}
+
+uint32_t Benchmark::next_random_() {
+  // xorshift32 : reproductible d'une exécution à l'autre pour un même seed
+  uint32_t x = this->random_state_;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  this->random_state_ = x;
+  return x;
+}
+
+std::string Benchmark::data_path_() const { return this->config_.directory + "/data.bin"; }
+
+std::string Benchmark::append_path_() const { return this->config_.directory + "/append.log"; }
+
+std::string Benchmark::stress_path_() const { return this->config_.directory + "/stress.log"; }
+
+std::string Benchmark::small_file_path_(uint32_t index) const {
+  char name[16];
+  snprintf(name, sizeof(name), "/f%05u.bin", index);
+  return this->config_.directory + name;
+}
+
+bool BenchmarkRunner::start(BenchmarkConfig config) {
+  if (this->is_running()) {
+    ESP_LOGW(TAG, "A benchmark is already running");
+    return false;
+  }
+  config.directory = this->directory_;
+  this->benchmark_ = std::make_unique<Benchmark>(this->parent_, std::move(config));
+  if (!this->benchmark_->start())
+    return false;
+  this->started_ms_ = millis();
+  ESP_LOGI(TAG, "Benchmark started in %s", this->directory_.c_str());
+  return true;
+}
+
+void BenchmarkRunner::loop() {
+  if (!this->is_running())
+    return;
+  // One slice per loop() call; a single operation may still exceed it
+  uint32_t start = millis();
+  while (this->benchmark_->step()) {
+    // Nothing to do until the stress tasks finish: no point spinning for the rest of the slice
+    if (millis() - start >= this->slice_ || this->benchmark_->is_waiting())
+      return;
+  }
+  ESP_LOGI(TAG, "Benchmark finished in %u ms%s", millis() - this->started_ms_,
+           this->benchmark_->is_truncated() ? " (time budget exhausted)" : "");
+  this->benchmark_->log_results();
+  this->publish_();
+}
+
+void BenchmarkRunner::publish_() {
+#ifdef USE_SENSOR
+  for (auto &sensor : this->sensors_) {
+    BenchmarkResult const *result = this->benchmark_->get_result(sensor.workload);
+    if (result == nullptr || result->ops == 0) {
+      sensor.sensor->publish_state(NAN);
+      continue;
+    }
+    switch (sensor.statistic) {
+      case BenchmarkStatistic::THROUGHPUT:
+        sensor.sensor->publish_state(result->throughput_mb_s());
+        break;
+      case BenchmarkStatistic::IOPS:
+        sensor.sensor->publish_state(result->iops());
+        break;
+      case BenchmarkStatistic::P50:
+        sensor.sensor->publish_state(result->latency.percentile(50) / 1000.0f);
+        break;
+      case BenchmarkStatistic::P95:
+        sensor.sensor->publish_state(result->latency.percentile(95) / 1000.0f);
+        break;
+      case BenchmarkStatistic::P99:
+        sensor.sensor->publish_state(result->latency.percentile(99) / 1000.0f);
+        break;
+      case BenchmarkStatistic::MAX:
+        sensor.sensor->publish_state(result->latency.max() / 1000.0f);
+        break;
+      case BenchmarkStatistic::ERRORS:
+        sensor.sensor->publish_state(result->errors);
+        break;
+    }
+  }
+#endif
+}
+
+void BenchmarkRunner::dump_config() {
+  ESP_LOGCONFIG(TAG, "SD MMC Benchmark");
+  ESP_LOGCONFIG(TAG, "  Directory: %s", this->directory_.c_str());
+  ESP_LOGCONFIG(TAG, "  Slice: %u ms", this->slice_);
+#ifdef USE_SENSOR
+  for (auto &sensor : this->sensors_)
+    LOG_SENSOR("  ", "Result", sensor.sensor);
+#endif
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
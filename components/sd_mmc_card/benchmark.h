@@ -0,0 +1,184 @@
+#pragma once
+#include "sd_mmc_card.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+enum class BenchmarkWorkload : uint8_t {
+  SEQUENTIAL_WRITE,
+  SEQUENTIAL_READ,
+  READ_FILE,
+  PROCESS_FILE,
+  RANDOM_READ,
+  RANDOM_WRITE,
+  SMALL_APPEND,
+  CREATE_FILES,
+  DIRECTORY_WALK,
+  STAT,
+  CONCURRENT,
+};
+
+const char *benchmark_workload_to_string(BenchmarkWorkload workload);
+
+struct BenchmarkConfig {
+  // Dossier de travail, créé puis supprimé par le benchmark
+  std::string directory{"/.benchmark"};
+  size_t file_size{1024 * 1024};
+  size_t block_size{32 * 1024};
+  size_t random_block_size{4096};
+  uint32_t random_ops{256};
+  size_t append_size{64};
+  uint32_t append_ops{512};
+  uint32_t file_count{128};
+  uint32_t walk_ops{8};
+  uint32_t stat_ops{1024};
+  // Tâches simultanées du test CONCURRENT et opérations par tâche
+  uint8_t stress_threads{4};
+  uint32_t stress_ops{64};
+  uint32_t seed{0x5D3C};
+  // Tests à exécuter (vide : tous). Les tests qui relisent le fichier de données ou les
+  // petits fichiers ajoutent d'eux-mêmes seq_write ou create_files.
+  std::vector<BenchmarkWorkload> workloads{};
+  // Durée maximale ; une fois dépassée, le test en cours s'arrête avec ses mesures partielles
+  // et les suivants sont sautés (0 : pas de limite)
+  uint32_t time_budget_ms{0};
+};
+
+struct BenchmarkResult {
+  BenchmarkWorkload workload;
+  uint32_t ops{0};
+  uint32_t errors{0};
+  uint64_t bytes{0};
+  uint64_t elapsed_us{0};
+  LatencyHistogram latency;
+
+  float throughput_mb_s() const;
+  float iops() const;
+};
+
+// Suite de mesures débit/latence sur les chemins de fichiers du composant.
+// Chaque appel à step() exécute une seule opération, ce qui permet de
+// l'entrelacer avec la boucle principale ; run() l'exécute d'un bloc.
+class Benchmark {
+ public:
+  Benchmark(SdMmc *parent, BenchmarkConfig config);
+  ~Benchmark();
+
+  bool start();
+  bool step();
+  void run();
+  bool is_running() const { return this->running_; }
+  // Vrai si le budget de temps a interrompu la dernière exécution
+  bool is_truncated() const { return this->truncated_; }
+  // Vrai tant que step() ne fait qu'attendre les tâches du test CONCURRENT
+  bool is_waiting() const { return this->concurrent_running_(); }
+  std::vector<BenchmarkResult> const &get_results() const { return this->results_; }
+  BenchmarkResult const *get_result(BenchmarkWorkload workload) const;
+  void log_results() const;
+
+ protected:
+  void resolve_workloads_();
+  void end_workload_(BenchmarkWorkload workload);
+  uint32_t ops_for_(BenchmarkWorkload workload) const;
+  bool prepare_(BenchmarkWorkload workload);
+  void finish_(BenchmarkWorkload workload);
+  bool run_op_(BenchmarkWorkload workload, uint32_t index, size_t &bytes);
+  // CONCURRENT : les tâches sont lancées par prepare_(), step() attend qu'elles aient toutes
+  // fini sans bloquer, puis run_op_() vérifie le fichier partagé
+  bool start_concurrent_();
+  bool concurrent_running_() const { return this->stress_finished_ < this->stress_workers_.size(); }
+  bool check_concurrent_(size_t &bytes);
+  void stop_concurrent_();
+  void cleanup_();
+  uint32_t next_random_();
+  std::string data_path_() const;
+  std::string append_path_() const;
+  std::string small_file_path_(uint32_t index) const;
+  std::string stress_path_() const;
+
+  SdMmc *parent_;
+  BenchmarkConfig config_;
+  std::vector<uint8_t> buffer_;
+  std::unique_ptr<FileStream> stream_;
+  std::vector<BenchmarkWorkload> workloads_;
+  std::vector<BenchmarkResult> results_;
+  size_t workload_index_{0};
+  uint32_t op_index_{0};
+  uint32_t workload_start_us_{0};
+  uint32_t start_ms_{0};
+  uint32_t random_state_{0};
+  bool running_{false};
+  bool truncated_{false};
+  std::vector<std::thread> stress_workers_;
+  std::atomic<uint32_t> stress_finished_{0};
+  std::atomic<uint32_t> stress_errors_{0};
+  std::atomic<bool> stress_stop_{false};
+};
+
+enum class BenchmarkStatistic : uint8_t { THROUGHPUT, IOPS, P50, P95, P99, MAX, ERRORS };
+
+#ifdef USE_SENSOR
+struct BenchmarkSensor {
+  sensor::Sensor *sensor;
+  BenchmarkWorkload workload;
+  BenchmarkStatistic statistic;
+};
+#endif
+
+// Exécute le benchmark depuis loop() par tranches de `slice` ms, pour ne pas bloquer la
+// boucle principale, puis publie les capteurs benchmark_* et un résumé dans les logs.
+class BenchmarkRunner : public Component {
+ public:
+  explicit BenchmarkRunner(SdMmc *parent) : parent_(parent) {}
+
+  void loop() override;
+  void dump_config() override;
+  float get_setup_priority() const override { return setup_priority::LATE; }
+
+  void set_directory(std::string const &directory) { this->directory_ = directory; }
+  void set_slice(uint32_t slice) { this->slice_ = slice; }
+  // false si un benchmark est déjà en cours ou si le dossier de travail ne peut être créé
+  bool start(BenchmarkConfig config);
+  bool is_running() const { return this->benchmark_ != nullptr && this->benchmark_->is_running(); }
+  Benchmark *get_benchmark() { return this->benchmark_.get(); }
+#ifdef USE_SENSOR
+  void add_sensor(sensor::Sensor *sensor, BenchmarkWorkload workload, BenchmarkStatistic statistic) {
+    this->sensors_.push_back(BenchmarkSensor{sensor, workload, statistic});
+  }
+#endif
+
+ protected:
+  void publish_();
+
+  SdMmc *parent_;
+  std::string directory_{"/.benchmark"};
+  uint32_t slice_{20};
+  uint32_t started_ms_{0};
+  std::unique_ptr<Benchmark> benchmark_;
+#ifdef USE_SENSOR
+  std::vector<BenchmarkSensor> sensors_{};
+#endif
+};
+
+template<typename... Ts> class SdMmcBenchmarkAction : public Action<Ts...> {
+ public:
+  SdMmcBenchmarkAction(BenchmarkRunner *runner) : runner_(runner) {}
+
+  void add_workload(BenchmarkWorkload workload) { this->config_.workloads.push_back(workload); }
+  void set_file_size(size_t file_size) { this->config_.file_size = file_size; }
+  void set_block_size(size_t block_size) { this->config_.block_size = block_size; }
+  void set_random_block_size(size_t block_size) { this->config_.random_block_size = block_size; }
+  void set_random_ops(uint32_t ops) { this->config_.random_ops = ops; }
+  void set_append_size(size_t append_size) { this->config_.append_size = append_size; }
+  void set_append_ops(uint32_t ops) { this->config_.append_ops = ops; }
+  void set_time_budget(uint32_t time_budget) { this->config_.time_budget_ms = time_budget; }
+
+  void play(Ts... x) { this->runner_->start(this->config_); }
+
+ protected:
+  BenchmarkRunner *runner_;
+  BenchmarkConfig config_;
+};
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
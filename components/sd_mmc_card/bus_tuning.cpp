@@ -0,0 +1,200 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+#include <unistd.h>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_bus";
+static const char *const PROBE_PATH = "/.bus_probe";
+static constexpr size_t PROBE_BLOCK_SIZE = 16 * 1024;
+static constexpr size_t PROBE_BLOCKS = 4;
+static constexpr uint8_t BUS_ERROR_THRESHOLD = 3;
+static constexpr uint32_t BUS_ERROR_WINDOW = 60 * 1000;
+static constexpr uint32_t BUS_MIN_FREQUENCY_KHZ = 5000;
+static const BusSpeed AUTO_SPEEDS[] = {BUS_SPEED_HIGH_SPEED, BUS_SPEED_DEFAULT};
+
+const char *bus_speed_to_string(BusSpeed speed) {
+  switch (speed) {
+    case BUS_SPEED_DEFAULT:
+      return "default";
+    case BUS_SPEED_HIGH_SPEED:
+      return "high_speed";
+    case BUS_SPEED_DDR:
+      return "ddr";
+    case BUS_SPEED_AUTO:
+      return "auto";
+  }
+  return "unknown";
+}
+
+// Test pattern, regenerated on read back instead of keeping a second copy in RAM.
+static uint32_t next_probe_word(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static void fill_probe_block(uint8_t *buffer, size_t block) {
+  uint32_t state = 0x9E3779B9u * (block + 1);
+  for (size_t i = 0; i < PROBE_BLOCK_SIZE; i += sizeof(uint32_t)) {
+    uint32_t word = next_probe_word(state);
+    memcpy(buffer + i, &word, sizeof(word));
+  }
+}
+
+static bool check_probe_block(const uint8_t *buffer, size_t block) {
+  uint32_t state = 0x9E3779B9u * (block + 1);
+  for (size_t i = 0; i < PROBE_BLOCK_SIZE; i += sizeof(uint32_t)) {
+    uint32_t word = next_probe_word(state);
+    if (memcmp(buffer + i, &word, sizeof(word)) != 0)
+      return false;
+  }
+  return true;
+}
+
+bool SdMmc::mount_bus_() {
+  // A fixed speed is kept whatever a self-test would say: no 64 KB write on every mount
+  if (this->bus_speed_ != BUS_SPEED_AUTO)
+    return this->mount_(this->bus_speed_);
+
+  for (BusSpeed speed : AUTO_SPEEDS) {
+    if (!this->mount_(speed)) {
+      ESP_LOGD(TAG, "Mount failed in %s mode", bus_speed_to_string(speed));
+      continue;
+    }
+    // The slowest mode is kept even if the test fails: a read-only or full card is still usable.
+    if (this->probe_bus_() || speed == BUS_SPEED_DEFAULT)
+      return true;
+    ESP_LOGW(TAG, "Bus self-test failed at %u kHz, stepping down", this->bus_frequency_khz_);
+    this->unmount_();
+  }
+  return false;
+}
+
+bool SdMmc::probe_bus_() {
+  uint8_t *buffer = allocate_stream_buffer(PROBE_BLOCK_SIZE);
+  if (buffer == nullptr)
+    return true;
+  PathBuffer path = build_path(PROBE_PATH);
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    ESP_LOGW(TAG, "Bus self-test skipped, cannot create %s", PROBE_PATH);
+    free_stream_buffer(buffer);
+    return true;
+  }
+  setvbuf(file, nullptr, _IONBF, 0);
+  bool ok = true;
+  for (size_t block = 0; ok && block < PROBE_BLOCKS; block++) {
+    fill_probe_block(buffer, block);
+    ok = fwrite(buffer, 1, PROBE_BLOCK_SIZE, file) == PROBE_BLOCK_SIZE;
+#ifdef USE_HOST
+    host_bus_transfer(PROBE_BLOCK_SIZE, true);
+#endif
+  }
+  ok = ok && fsync(fileno(file)) == 0;
+  fclose(file);
+
+  file = ok ? fopen(path.c_str(), "rb") : nullptr;
+  ok = file != nullptr;
+  if (ok) {
+    setvbuf(file, nullptr, _IONBF, 0);
+    uint32_t elapsed = 0;
+    for (size_t block = 0; ok && block < PROBE_BLOCKS; block++) {
+      uint32_t start = micros();
+      ok = fread(buffer, 1, PROBE_BLOCK_SIZE, file) == PROBE_BLOCK_SIZE;
+#ifdef USE_HOST
+      host_bus_transfer(PROBE_BLOCK_SIZE, false);
+#endif
+      elapsed += micros() - start;
+      // A CRC error surfaces as a failed read; compare anyway in case corrupted data got through.
+      ok = ok && check_probe_block(buffer, block);
+    }
+    fclose(file);
+    if (ok)
+      this->bus_throughput_ = PROBE_BLOCK_SIZE * PROBE_BLOCKS * 1.0f / std::max<uint32_t>(elapsed, 1);
+  }
+  remove(path.c_str());
+  free_stream_buffer(buffer);
+  if (ok) {
+    ESP_LOGI(TAG, "Bus self-test passed at %u kHz, read %.2f MB/s", this->bus_frequency_khz_, this->bus_throughput_);
+  }
+  return ok;
+}
+
+void SdMmc::report_io_error_() {
+  uint32_t now = millis();
+  if (now - this->io_error_window_start_ > BUS_ERROR_WINDOW) {
+    this->io_error_window_start_ = now;
+    this->io_errors_ = 0;
+  }
+  this->io_errors_++;
+}
+
+void SdMmc::handle_io_errors_() {
+  if (this->io_errors_ < BUS_ERROR_THRESHOLD)
+    return;
+  this->io_errors_ = 0;
+
+  uint32_t frequency = this->bus_frequency_khz_ / 2;
+  if (this->bus_speed_ != BUS_SPEED_AUTO || frequency < BUS_MIN_FREQUENCY_KHZ) {
+    // Nothing left to tune: a full card reinitialisation often clears a wedged card
+    uint32_t now = millis();
+    if (this->last_remount_ != 0 && now - this->last_remount_ < BUS_ERROR_WINDOW) {
+      ESP_LOGW(TAG, "Repeated transfer errors at %u kHz", this->bus_frequency_khz_);
+      return;
+    }
+    ESP_LOGW(TAG, "Repeated transfer errors at %u kHz, remounting the card", this->bus_frequency_khz_);
+    this->last_remount_ = std::max<uint32_t>(now, 1);
+    this->remount();
+    return;
+  }
+  if (this->card_state_ != CardState::MOUNTED)
+    return;
+  if (this->bus_step_khz_ == 0) {
+    ESP_LOGW(TAG, "Repeated transfer errors, lowering bus clock from %u to %u kHz once the card is idle",
+             this->bus_frequency_khz_, frequency);
+  }
+  this->bus_step_khz_ = frequency;
+}
+
+void SdMmc::lower_bus_clock_() {
+  if (this->bus_step_khz_ == 0 || this->active_operations_ != 0)
+    return;
+  // Operations admitted from now on wait in MountGuard; one admitted just before is seen below
+  this->bus_paused_ = true;
+  if (this->active_operations_ != 0) {
+    this->resume_bus_();
+    return;
+  }
+  uint32_t frequency = this->bus_step_khz_;
+  this->bus_step_khz_ = 0;
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->close_all();
+#ifdef USE_ESP32_FRAMEWORK_ARDUINO
+  // begin() mounts the volume again: files opened before do not survive it
+  this->mount_generation_++;
+  this->close_streams_();
+#endif
+  bool ok = this->set_bus_frequency_(frequency);
+  this->resume_bus_();
+  if (ok) {
+    ESP_LOGI(TAG, "Bus clock lowered to %u kHz", this->bus_frequency_khz_);
+  } else {
+    ESP_LOGE(TAG, "Failed to change bus clock");
+  }
+}
+
+void SdMmc::resume_bus_() {
+  std::lock_guard<std::mutex> lock(this->mount_mutex_);
+  this->bus_paused_ = false;
+  this->mount_cv_.notify_all();
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
@@ -0,0 +1,267 @@
+#include "sd_mmc_card.h"
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_mount";
+static constexpr size_t MOUNT_STACK_SIZE = 6144;
+static constexpr uint32_t CARD_DETECT_DEBOUNCE = 250;
+// Operations already admitted by this task: nested calls must not be refused mid-operation
+static thread_local uint8_t mount_guard_depth = 0;
+
+const char *card_state_to_string(CardState state) {
+  switch (state) {
+    case CardState::UNMOUNTED:
+      return "unmounted";
+    case CardState::MOUNTING:
+      return "mounting";
+    case CardState::MOUNTED:
+      return "mounted";
+    case CardState::UNMOUNTING:
+      return "unmounting";
+  }
+  return "unknown";
+}
+
+SdMmc::MountGuard::MountGuard(SdMmc *parent) : parent_(parent), mounted_(false) {
+  if (parent == nullptr) {
+    this->mounted_ = true;
+    return;
+  }
+  if (mount_guard_depth == 0) {
+    for (;;) {
+      // Refused without touching the counter, so that an unmount in progress sees it drain
+      if (parent->card_state_ != CardState::MOUNTED) {
+        ESP_LOGV(TAG, "Card %s, operation refused", card_state_to_string(parent->card_state_));
+        return;
+      }
+      parent->active_operations_++;
+      // Lost the race against unmount_card_()
+      if (parent->card_state_ != CardState::MOUNTED) {
+        this->release_();
+        return;
+      }
+      if (!parent->bus_paused_)
+        break;
+      // The bus clock is changing: wait a few microseconds rather than fail
+      this->release_();
+      std::unique_lock<std::mutex> lock(parent->mount_mutex_);
+      parent->mount_cv_.wait(lock, [parent]() { return !parent->bus_paused_; });
+    }
+  } else {
+    parent->active_operations_++;
+  }
+  this->mounted_ = true;
+  mount_guard_depth++;
+}
+
+SdMmc::MountGuard::~MountGuard() {
+  if (!this->mounted_ || this->parent_ == nullptr)
+    return;
+  mount_guard_depth--;
+  this->release_();
+}
+
+void SdMmc::MountGuard::release_() {
+  if (--this->parent_->active_operations_ == 0 && this->parent_->card_state_ == CardState::UNMOUNTING) {
+    std::lock_guard<std::mutex> lock(this->parent_->mount_mutex_);
+    this->parent_->mount_cv_.notify_all();
+  }
+}
+
+void SdMmc::setup() {
+  if (this->power_ctrl_pin_ != nullptr)
+    this->power_ctrl_pin_->setup();
+  if (this->card_detect_pin_ != nullptr) {
+    this->card_detect_pin_->setup();
+    this->card_present_ = this->card_detect_pin_->digital_read();
+  }
+  // Started paused: with when_unmounted: queue it takes writes before the card is ready
+  if (this->write_queue_ != nullptr) {
+    this->write_queue_->set_paused(true);
+    this->write_queue_->start();
+  }
+
+  if (!this->init_bus_()) {
+    this->mark_failed();
+    return;
+  }
+
+  if (this->card_present_) {
+    this->start_mount_();
+  } else {
+    ESP_LOGW(TAG, "No card inserted");
+  }
+}
+
+void SdMmc::start_mount_() {
+  if (this->card_state_ != CardState::UNMOUNTED || this->mount_thread_.joinable())
+    return;
+  this->card_state_ = CardState::MOUNTING;
+  this->mount_start_ = millis();
+  // Card initialisation, FAT mount and bus self-test take seconds on large cards
+  this->mount_thread_ = start_worker_thread("sd_mount", MOUNT_STACK_SIZE, [this]() {
+    this->mount_ok_ = this->mount_bus_();
+    // Before any operation can see the half-replaced file
+    if (this->mount_ok_)
+      this->recover_replace_();
+    this->mount_done_ = true;
+  });
+}
+
+void SdMmc::finish_mount_() {
+  this->mount_thread_.join();
+  this->mount_done_ = false;
+  uint32_t now = millis();
+  uint32_t elapsed = now - this->mount_start_;
+  if (!this->mount_ok_) {
+    this->card_state_ = CardState::UNMOUNTED;
+    this->status_set_warning();
+    if (this->mount_retry_interval_ != 0) {
+      ESP_LOGW(TAG, "%s after %u ms, retrying in %u ms", SdMmc::error_code_to_string(this->init_error_).c_str(),
+               elapsed, this->mount_retry_interval_);
+    } else {
+      ESP_LOGE(TAG, "%s after %u ms", SdMmc::error_code_to_string(this->init_error_).c_str(), elapsed);
+    }
+    return;
+  }
+
+  this->card_state_ = CardState::MOUNTED;
+  this->status_clear_warning();
+  if (this->ready_time_ == 0) {
+    this->ready_time_ = std::max<uint32_t>(now, 1);
+    ESP_LOGI(TAG, "Card ready %u ms after boot (mount took %u ms)", this->ready_time_, elapsed);
+  } else {
+    ESP_LOGI(TAG, "Card mounted in %u ms", elapsed);
+  }
+
+#ifdef USE_TEXT_SENSOR
+  if (this->sd_card_type_text_sensor_ != nullptr)
+    this->sd_card_type_text_sensor_->publish_state(this->sd_card_type());
+#endif
+#ifdef USE_SENSOR
+  if (this->ready_time_sensor_ != nullptr)
+    this->ready_time_sensor_->publish_state(this->ready_time_);
+  if (this->mount_time_sensor_ != nullptr)
+    this->mount_time_sensor_->publish_state(elapsed);
+#endif
+
+  if (this->write_queue_ != nullptr)
+    this->write_queue_->set_paused(false);
+  if (this->rotating_log_ != nullptr)
+    this->rotating_log_->start();
+  this->start_space_scan();
+  this->ready_callback_.call();
+}
+
+void SdMmc::mount() {
+  this->auto_mount_ = true;
+  if (!this->card_present_) {
+    ESP_LOGW(TAG, "No card inserted");
+    return;
+  }
+  this->start_mount_();
+}
+
+void SdMmc::unmount() {
+  this->auto_mount_ = false;
+  this->unmount_card_(true);
+}
+
+void SdMmc::remount() {
+  this->unmount_card_(true);
+  this->mount();
+}
+
+void SdMmc::unmount_card_(bool flush) {
+  if (this->mount_thread_.joinable()) {
+    // Removed while mounting: let the attempt finish, then undo it
+    this->mount_thread_.join();
+    this->mount_done_ = false;
+    this->mount_generation_++;
+    if (this->mount_ok_)
+      this->unmount_();
+    this->card_state_ = CardState::UNMOUNTED;
+    return;
+  }
+  if (this->card_state_ != CardState::MOUNTED)
+    return;
+
+  uint32_t start = millis();
+  if (this->write_queue_ != nullptr) {
+    if (flush)
+      this->write_queue_->flush();
+    // What is still queued goes to the next card mounted
+    this->write_queue_->set_paused(true);
+  }
+  // Before the drain: pruning old segments still needs the card
+  if (this->rotating_log_ != nullptr)
+    this->rotating_log_->stop();
+  if (flush)
+    this->sync_record_stores_();
+  // Before the drain: a handle admitted from now on sees the card as gone
+  this->mount_generation_++;
+  // The next mount picks its own speed
+  this->bus_step_khz_ = 0;
+  this->drain_operations_();
+  this->close_streams_();
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->close_all();
+  if (this->space_thread_.joinable())
+    this->finish_space_scan();
+
+  this->unmount_();
+  // Another card may be inserted: nothing known about this one still holds
+  if (this->metadata_index_ != nullptr)
+    this->metadata_index_->clear();
+  {
+    std::lock_guard<std::mutex> lock(this->space_mutex_);
+    this->space_valid_ = false;
+  }
+  this->io_errors_ = 0;
+  this->card_state_ = CardState::UNMOUNTED;
+  ESP_LOGI(TAG, "Card unmounted in %u ms", millis() - start);
+}
+
+void SdMmc::drain_operations_() {
+  // Stops at the next block or entry; reported as failed from loop()
+  this->file_operation_cancelled_ = true;
+  this->find_cancelled_ = true;
+  this->card_state_ = CardState::UNMOUNTING;
+  std::unique_lock<std::mutex> lock(this->mount_mutex_);
+  this->mount_cv_.wait(lock, [this]() { return this->active_operations_ == 0; });
+}
+
+void SdMmc::poll_card_detect_(uint32_t now) {
+  if (this->card_detect_pin_ == nullptr)
+    return;
+  bool present = this->card_detect_pin_->digital_read();
+  if (present == this->card_present_) {
+    this->card_detect_stable_ = now;
+    return;
+  }
+  // Contacts bounce while the card slides in
+  if (now - this->card_detect_stable_ < CARD_DETECT_DEBOUNCE)
+    return;
+  this->card_present_ = present;
+  if (present) {
+    ESP_LOGI(TAG, "Card inserted");
+    this->mount();
+  } else {
+    ESP_LOGW(TAG, "Card removed");
+    this->unmount_card_(false);
+  }
+}
+
+bool SdMmc::write_unmounted_(const char *path, const uint8_t *buffer, size_t len, bool append) {
+  if (this->unmounted_policy_ == UnmountedPolicy::QUEUE && this->write_queue_ != nullptr)
+    return this->write_queue_->enqueue(path, buffer, len, append);
+  ESP_LOGW(TAG, "Card %s, write to %s failed", card_state_to_string(this->card_state_), path);
+  return false;
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
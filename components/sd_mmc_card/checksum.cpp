@@ -0,0 +1,349 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+#include <strings.h>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+#ifdef USE_ESP32
+#include "mbedtls/md5.h"
+#include "mbedtls/sha256.h"
+#endif
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_checksum";
+
+const char *hash_algorithm_to_string(HashAlgorithm algorithm) {
+  switch (algorithm) {
+    case HashAlgorithm::CRC32:
+      return "CRC32";
+    case HashAlgorithm::SHA256:
+      return "SHA-256";
+    case HashAlgorithm::MD5:
+      return "MD5";
+  }
+  return "";
+}
+
+static std::string to_hex(const uint8_t *digest, size_t len) {
+  static const char *const DIGITS = "0123456789abcdef";
+  std::string hex(len * 2, '0');
+  for (size_t i = 0; i < len; i++) {
+    hex[2 * i] = DIGITS[digest[i] >> 4];
+    hex[2 * i + 1] = DIGITS[digest[i] & 0x0F];
+  }
+  return hex;
+}
+
+#ifndef USE_ESP32
+namespace {
+
+// Merkle-Damgard state shared by the software SHA-256 and MD5
+struct SoftHashState {
+  uint32_t h[8];
+  uint64_t length{0};
+  uint8_t block[64];
+  size_t used{0};
+};
+
+inline uint32_t rotr(uint32_t x, uint8_t n) { return (x >> n) | (x << (32 - n)); }
+inline uint32_t rotl(uint32_t x, uint8_t n) { return (x << n) | (x >> (32 - n)); }
+
+const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+void sha256_block(uint32_t *h, const uint8_t *p) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+    w[i] = (p[4 * i] << 24) | (p[4 * i + 1] << 16) | (p[4 * i + 2] << 8) | p[4 * i + 3];
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = k + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    k = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+  h[5] += f;
+  h[6] += g;
+  h[7] += k;
+}
+
+const uint8_t MD5_SHIFT[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 5, 9,  14, 20, 5, 9,
+                               14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+                               4, 11, 16, 23, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+void md5_block(uint32_t *h, const uint8_t *p) {
+  uint32_t m[16];
+  for (int i = 0; i < 16; i++)
+    m[i] = p[4 * i] | (p[4 * i + 1] << 8) | (p[4 * i + 2] << 16) | (p[4 * i + 3] << 24);
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+  for (int i = 0; i < 64; i++) {
+    uint32_t f;
+    int g;
+    if (i < 16) {
+      f = (b & c) | (~b & d);
+      g = i;
+    } else if (i < 32) {
+      f = (d & b) | (~d & c);
+      g = (5 * i + 1) & 15;
+    } else if (i < 48) {
+      f = b ^ c ^ d;
+      g = (3 * i + 5) & 15;
+    } else {
+      f = c ^ (b | ~d);
+      g = (7 * i) & 15;
+    }
+    f += a + MD5_K[i] + m[g];
+    a = d;
+    d = c;
+    c = b;
+    b += rotl(f, MD5_SHIFT[i]);
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+}
+
+using BlockFunction = void (*)(uint32_t *, const uint8_t *);
+
+void soft_update(SoftHashState &state, BlockFunction block, const uint8_t *data, size_t len) {
+  state.length += len;
+  if (state.used > 0) {
+    size_t n = std::min(len, sizeof(state.block) - state.used);
+    memcpy(state.block + state.used, data, n);
+    state.used += n;
+    data += n;
+    len -= n;
+    if (state.used < sizeof(state.block))
+      return;
+    block(state.h, state.block);
+    state.used = 0;
+  }
+  // Whole blocks straight from the caller's buffer
+  for (; len >= sizeof(state.block); data += sizeof(state.block), len -= sizeof(state.block))
+    block(state.h, data);
+  memcpy(state.block, data, len);
+  state.used = len;
+}
+
+void soft_finish(SoftHashState &state, BlockFunction block, bool big_endian) {
+  uint64_t bits = state.length * 8;
+  uint8_t padding[72] = {0x80};
+  size_t pad_len = (state.used < 56 ? 56 : 120) - state.used;
+  for (int i = 0; i < 8; i++)
+    padding[pad_len + i] = big_endian ? bits >> (56 - 8 * i) : bits >> (8 * i);
+  soft_update(state, block, padding, pad_len + 8);
+}
+
+}  // namespace
+#endif
+
+Hasher::Hasher(HashAlgorithm algorithm) : algorithm_(algorithm) {
+#ifdef USE_ESP32
+  if (algorithm == HashAlgorithm::SHA256) {
+    auto *context = new mbedtls_sha256_context;
+    mbedtls_sha256_init(context);
+    mbedtls_sha256_starts(context, 0);
+    this->context_ = context;
+  } else if (algorithm == HashAlgorithm::MD5) {
+    auto *context = new mbedtls_md5_context;
+    mbedtls_md5_init(context);
+    mbedtls_md5_starts(context);
+    this->context_ = context;
+  }
+#else
+  if (algorithm == HashAlgorithm::SHA256) {
+    static const uint32_t SHA256_INIT[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    auto *state = new SoftHashState;
+    memcpy(state->h, SHA256_INIT, sizeof(SHA256_INIT));
+    this->context_ = state;
+  } else if (algorithm == HashAlgorithm::MD5) {
+    auto *state = new SoftHashState;
+    state->h[0] = 0x67452301;
+    state->h[1] = 0xefcdab89;
+    state->h[2] = 0x98badcfe;
+    state->h[3] = 0x10325476;
+    this->context_ = state;
+  }
+#endif
+}
+
+Hasher::~Hasher() {
+#ifdef USE_ESP32
+  if (this->algorithm_ == HashAlgorithm::SHA256 && this->context_ != nullptr) {
+    mbedtls_sha256_free(static_cast<mbedtls_sha256_context *>(this->context_));
+    delete static_cast<mbedtls_sha256_context *>(this->context_);
+  } else if (this->algorithm_ == HashAlgorithm::MD5 && this->context_ != nullptr) {
+    mbedtls_md5_free(static_cast<mbedtls_md5_context *>(this->context_));
+    delete static_cast<mbedtls_md5_context *>(this->context_);
+  }
+#else
+  delete static_cast<SoftHashState *>(this->context_);
+#endif
+}
+
+void Hasher::update(const uint8_t *data, size_t len) {
+  switch (this->algorithm_) {
+    case HashAlgorithm::CRC32:
+      this->crc_ = crc32(data, len, this->crc_);
+      break;
+#ifdef USE_ESP32
+    case HashAlgorithm::SHA256:
+      mbedtls_sha256_update(static_cast<mbedtls_sha256_context *>(this->context_), data, len);
+      break;
+    case HashAlgorithm::MD5:
+      mbedtls_md5_update(static_cast<mbedtls_md5_context *>(this->context_), data, len);
+      break;
+#else
+    case HashAlgorithm::SHA256:
+      soft_update(*static_cast<SoftHashState *>(this->context_), sha256_block, data, len);
+      break;
+    case HashAlgorithm::MD5:
+      soft_update(*static_cast<SoftHashState *>(this->context_), md5_block, data, len);
+      break;
+#endif
+  }
+}
+
+std::string Hasher::finish() {
+  uint8_t digest[32];
+  switch (this->algorithm_) {
+    case HashAlgorithm::CRC32: {
+      char hex[9];
+      snprintf(hex, sizeof(hex), "%08x", static_cast<unsigned>(this->crc_));
+      return hex;
+    }
+#ifdef USE_ESP32
+    case HashAlgorithm::SHA256:
+      mbedtls_sha256_finish(static_cast<mbedtls_sha256_context *>(this->context_), digest);
+      return to_hex(digest, 32);
+    case HashAlgorithm::MD5:
+      mbedtls_md5_finish(static_cast<mbedtls_md5_context *>(this->context_), digest);
+      return to_hex(digest, 16);
+#else
+    case HashAlgorithm::SHA256: {
+      auto *state = static_cast<SoftHashState *>(this->context_);
+      soft_finish(*state, sha256_block, true);
+      for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++)
+          digest[4 * i + j] = state->h[i] >> (24 - 8 * j);
+      }
+      return to_hex(digest, 32);
+    }
+    case HashAlgorithm::MD5: {
+      auto *state = static_cast<SoftHashState *>(this->context_);
+      soft_finish(*state, md5_block, false);
+      for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++)
+          digest[4 * i + j] = state->h[i] >> (8 * j);
+      }
+      return to_hex(digest, 16);
+    }
+#endif
+  }
+  return "";
+}
+
+std::string SdMmc::checksum(const char *path, HashAlgorithm algorithm, size_t buffer_size) {
+  Hasher hasher(algorithm);
+  uint32_t start = millis();
+  size_t total = 0;
+  // process_file reads the next block on its own task while this one is hashed
+  bool ok = this->process_file(
+      path,
+      [&hasher, &total](const uint8_t *data, size_t size, size_t total_size, size_t position) {
+        hasher.update(data, size);
+        total = total_size;
+        return true;
+      },
+      buffer_size);
+  if (!ok)
+    return "";
+  std::string digest = hasher.finish();
+  uint32_t elapsed = millis() - start;
+  ESP_LOGD(TAG, "%s of %s (%s) in %u ms: %s", hash_algorithm_to_string(algorithm), path, format_size(total).c_str(),
+           elapsed, digest.c_str());
+  return digest;
+}
+
+bool SdMmc::start_checksum(std::string const &path, HashAlgorithm algorithm, std::string const &expected) {
+  if (this->checksum_done_)
+    this->finish_checksum_();
+  if (this->checksum_thread_.joinable()) {
+    ESP_LOGW(TAG, "A checksum is already running, %s skipped", path.c_str());
+    return false;
+  }
+  this->checksum_path_ = path;
+  this->checksum_algorithm_ = algorithm;
+  this->checksum_expected_ = expected;
+  this->checksum_thread_ = start_worker_thread("sd_checksum", 4096, [this]() {
+    this->checksum_result_ = this->checksum(this->checksum_path_.c_str(), this->checksum_algorithm_);
+    this->checksum_done_ = true;
+  });
+  return true;
+}
+
+void SdMmc::finish_checksum_() {
+  if (this->checksum_thread_.joinable())
+    this->checksum_thread_.join();
+  this->checksum_done_ = false;
+  std::string const &digest = this->checksum_result_;
+  bool ok = !digest.empty();
+  if (ok && !this->checksum_expected_.empty()) {
+    ok = strcasecmp(digest.c_str(), this->checksum_expected_.c_str()) == 0;
+    if (ok) {
+      ESP_LOGI(TAG, "%s verified", this->checksum_path_.c_str());
+    } else {
+      ESP_LOGW(TAG, "%s mismatch for %s: expected %s, got %s", hash_algorithm_to_string(this->checksum_algorithm_),
+               this->checksum_path_.c_str(), this->checksum_expected_.c_str(), digest.c_str());
+    }
+  }
+#ifdef USE_TEXT_SENSOR
+  if (this->last_checksum_text_sensor_ != nullptr && !digest.empty())
+    this->last_checksum_text_sensor_->publish_state(digest);
+#endif
+  this->checksum_callback_.call(this->checksum_path_, digest, ok);
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
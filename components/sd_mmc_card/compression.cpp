@@ -0,0 +1,375 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_compression";
+
+static const uint8_t FRAME_MAGIC[2] = {'S', 'Z'};
+static constexpr uint8_t FLAG_STORED = 0x01;
+static constexpr uint8_t HASH_BITS = 11;
+static constexpr size_t MIN_MATCH = 3;
+static constexpr size_t MAX_MATCH = 18;
+// Candidates tried per position: bounds the CPU time on repetitive data
+static constexpr size_t MAX_CHAIN = 16;
+static constexpr uint16_t NO_POSITION = 0xFFFF;
+static constexpr size_t READ_BUFFER_SIZE = 4096;
+
+static inline uint32_t hash3(const uint8_t *p) {
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static inline void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline uint16_t get_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+float CompressionStats::compress_ms_per_mb() const {
+  return this->raw_bytes == 0 ? NAN : this->compress_us * 1048.576f / this->raw_bytes;
+}
+
+float CompressionStats::decompress_ms_per_mb() const {
+  return this->decompressed_bytes == 0 ? NAN : this->decompress_us * 1048.576f / this->decompressed_bytes;
+}
+
+BlockCompressor::BlockCompressor(uint8_t window_bits, size_t block_size)
+    : window_bits_(std::min<uint8_t>(std::max<uint8_t>(window_bits, 8), 12)),
+      block_size_(std::min(std::max<size_t>(block_size, 512), MAX_BLOCK_SIZE)),
+      head_(1 << HASH_BITS),
+      prev_(1 << this->window_bits_) {}
+
+// Byte-oriented LZSS: a flag byte announces 8 items, literal (bit set) or match of 2 bytes
+// holding a 12-bit distance and a 4-bit length.
+size_t BlockCompressor::compress_(const uint8_t *in, size_t len, uint8_t *out, size_t capacity) {
+  std::fill(this->head_.begin(), this->head_.end(), NO_POSITION);
+  const size_t window = 1 << this->window_bits_;
+  const size_t mask = window - 1;
+  size_t out_pos = 0;
+  size_t flag_pos = 0;
+  uint8_t flag_bit = 8;
+  size_t pos = 0;
+  while (pos < len) {
+    if (flag_bit == 8) {
+      if (out_pos >= capacity)
+        return 0;
+      flag_pos = out_pos++;
+      out[flag_pos] = 0;
+      flag_bit = 0;
+    }
+    size_t best_len = 0;
+    size_t best_distance = 0;
+    if (pos + MIN_MATCH <= len) {
+      size_t max_len = std::min(MAX_MATCH, len - pos);
+      uint16_t candidate = this->head_[hash3(in + pos)];
+      for (size_t chain = 0; candidate != NO_POSITION && chain < MAX_CHAIN && pos - candidate <= window; chain++) {
+        if (in[candidate + best_len] == in[pos + best_len]) {
+          size_t match = 0;
+          while (match < max_len && in[candidate + match] == in[pos + match])
+            match++;
+          if (match > best_len) {
+            best_len = match;
+            best_distance = pos - candidate;
+            if (match == max_len)
+              break;
+          }
+        }
+        uint16_t next = this->prev_[candidate & mask];
+        if (next == NO_POSITION || next >= candidate)
+          break;
+        candidate = next;
+      }
+    }
+
+    size_t advance;
+    if (best_len >= MIN_MATCH) {
+      if (out_pos + 2 > capacity)
+        return 0;
+      size_t distance = best_distance - 1;
+      out[out_pos++] = distance & 0xFF;
+      out[out_pos++] = ((distance >> 8) << 4) | (best_len - MIN_MATCH);
+      advance = best_len;
+    } else {
+      if (out_pos + 1 > capacity)
+        return 0;
+      out[flag_pos] |= 1 << flag_bit;
+      out[out_pos++] = in[pos];
+      advance = 1;
+    }
+    flag_bit++;
+
+    for (size_t end = pos + advance; pos < end; pos++) {
+      if (pos + MIN_MATCH > len)
+        continue;
+      uint32_t hash = hash3(in + pos);
+      this->prev_[pos & mask] = this->head_[hash];
+      this->head_[hash] = pos;
+    }
+  }
+  return out_pos;
+}
+
+size_t BlockCompressor::compress_frame(const uint8_t *in, size_t len, uint8_t *out) {
+  uint8_t *payload = out + HEADER_SIZE;
+  // Only keep the compressed form when it saves at least one byte
+  size_t payload_len = len > MIN_MATCH ? this->compress_(in, len, payload, len - 1) : 0;
+  uint8_t flags = 0;
+  if (payload_len == 0) {
+    memcpy(payload, in, len);
+    payload_len = len;
+    flags |= FLAG_STORED;
+  }
+  out[0] = FRAME_MAGIC[0];
+  out[1] = FRAME_MAGIC[1];
+  out[2] = flags;
+  out[3] = 0;
+  put_u16(out + 4, len);
+  put_u16(out + 6, payload_len);
+  uint32_t crc = crc32(in, len);
+  memcpy(out + 8, &crc, sizeof(crc));
+  return HEADER_SIZE + payload_len;
+}
+
+bool BlockCompressor::parse_header(const uint8_t *frame, size_t &raw_len, size_t &payload_len) {
+  if (frame[0] != FRAME_MAGIC[0] || frame[1] != FRAME_MAGIC[1] || (frame[2] & ~FLAG_STORED) != 0)
+    return false;
+  raw_len = get_u16(frame + 4);
+  payload_len = get_u16(frame + 6);
+  return raw_len > 0 && raw_len <= MAX_BLOCK_SIZE &&
+         ((frame[2] & FLAG_STORED) ? payload_len == raw_len : payload_len < raw_len);
+}
+
+bool BlockCompressor::decompress_frame(const uint8_t *frame, uint8_t *out) {
+  size_t raw_len, payload_len;
+  if (!parse_header(frame, raw_len, payload_len))
+    return false;
+  const uint8_t *in = frame + HEADER_SIZE;
+  if (frame[2] & FLAG_STORED) {
+    memcpy(out, in, raw_len);
+  } else {
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    while (out_pos < raw_len) {
+      if (in_pos >= payload_len)
+        return false;
+      uint8_t flags = in[in_pos++];
+      for (uint8_t bit = 0; bit < 8 && out_pos < raw_len; bit++) {
+        if (flags & (1 << bit)) {
+          if (in_pos >= payload_len)
+            return false;
+          out[out_pos++] = in[in_pos++];
+          continue;
+        }
+        if (in_pos + 2 > payload_len)
+          return false;
+        size_t distance = (in[in_pos] | ((in[in_pos + 1] >> 4) << 8)) + 1;
+        size_t match = (in[in_pos + 1] & 0x0F) + MIN_MATCH;
+        in_pos += 2;
+        if (distance > out_pos || out_pos + match > raw_len)
+          return false;
+        // Overlapping copy on purpose: a distance shorter than the length repeats a pattern
+        for (size_t i = 0; i < match; i++, out_pos++)
+          out[out_pos] = out[out_pos - distance];
+      }
+    }
+    if (in_pos != payload_len)
+      return false;
+  }
+  uint32_t crc;
+  memcpy(&crc, frame + 8, sizeof(crc));
+  return crc32(out, raw_len) == crc;
+}
+
+void SdMmc::set_compression(uint8_t window_bits, size_t block_size) {
+  std::lock_guard<std::mutex> lock(this->compression_mutex_);
+  this->compression_window_bits_ = window_bits;
+  this->compression_block_size_ = block_size;
+  this->compressor_.reset();
+}
+
+CompressionStats SdMmc::get_compression_stats() {
+  std::lock_guard<std::mutex> lock(this->compression_mutex_);
+  return this->compression_stats_;
+}
+
+std::vector<uint8_t> SdMmc::compress(const uint8_t *data, size_t len) {
+  std::lock_guard<std::mutex> lock(this->compression_mutex_);
+  if (this->compressor_ == nullptr)
+    this->compressor_ = std::make_unique<BlockCompressor>(this->compression_window_bits_, this->compression_block_size_);
+  std::vector<uint8_t> frames;
+  uint32_t start = micros();
+  size_t block_size = this->compressor_->block_size();
+  for (size_t offset = 0; offset < len; offset += block_size) {
+    size_t block = std::min(block_size, len - offset);
+    size_t at = frames.size();
+    frames.resize(at + BlockCompressor::max_frame_size(block));
+    frames.resize(at + this->compressor_->compress_frame(data + offset, block, frames.data() + at));
+  }
+  this->compression_stats_.compress_us += micros() - start;
+  this->compression_stats_.raw_bytes += len;
+  this->compression_stats_.compressed_bytes += frames.size();
+  return frames;
+}
+
+void SdMmc::append_file_compressed(const char *path, const uint8_t *data, size_t len) {
+  auto frames = this->compress(data, len);
+  if (!frames.empty())
+    this->append_file(path, frames.data(), frames.size());
+}
+
+bool SdMmc::write_file_stream_compressed(const char *path, WriteCallback callback, bool append) {
+  size_t block_size, frame_size;
+  std::unique_ptr<BlockCompressor> compressor;
+  {
+    std::lock_guard<std::mutex> lock(this->compression_mutex_);
+    // A compressor of its own, so that short compress() calls are not held up by the stream
+    compressor = std::make_unique<BlockCompressor>(this->compression_window_bits_, this->compression_block_size_);
+  }
+  block_size = compressor->block_size();
+  frame_size = BlockCompressor::max_frame_size(block_size);
+  std::unique_ptr<uint8_t[]> raw(new uint8_t[block_size]);
+
+  bool source_done = false;
+  uint64_t raw_bytes = 0;
+  uint64_t compressed_bytes = 0;
+  uint64_t busy_us = 0;
+  // Several frames per stream buffer, so that the card still sees large writes
+  bool ok = this->write_stream_(
+      path, append ? "ab" : "wb",
+      [&](uint8_t *buffer, size_t max_size) -> size_t {
+        size_t used = 0;
+        while (!source_done && max_size - used >= frame_size) {
+          size_t filled = 0;
+          while (filled < block_size) {
+            size_t len = callback(raw.get() + filled, block_size - filled);
+            if (len == 0) {
+              source_done = true;
+              break;
+            }
+            filled += len;
+          }
+          if (filled == 0)
+            break;
+          uint32_t start = micros();
+          used += compressor->compress_frame(raw.get(), filled, buffer + used);
+          busy_us += micros() - start;
+          raw_bytes += filled;
+        }
+        compressed_bytes += used;
+        return used;
+      },
+      4 * frame_size);
+
+  std::lock_guard<std::mutex> lock(this->compression_mutex_);
+  this->compression_stats_.raw_bytes += raw_bytes;
+  this->compression_stats_.compressed_bytes += compressed_bytes;
+  this->compression_stats_.compress_us += busy_us;
+  return ok;
+}
+
+bool SdMmc::process_file_compressed(const char *path, ReadCallback callback, size_t offset) {
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::READ);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return false;
+  }
+  auto guard = this->path_locks_.lock_shared(path);
+  this->flush_pooled_file(path);
+  FILE *file = fopen(build_path(path).c_str(), "rb");
+  if (file == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for reading: %s", path);
+    timer.set_ok(false);
+    return false;
+  }
+  setvbuf(file, nullptr, _IOFBF, READ_BUFFER_SIZE);
+  fseek(file, 0, SEEK_END);
+  size_t file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  // Headers only: the callback gets the decompressed size, the unit of `position`. The frame
+  // holding `offset` is noted on the way, decoding starts there.
+  std::vector<uint8_t> frame(BlockCompressor::HEADER_SIZE);
+  size_t total_size = 0;
+  size_t raw_position = 0;
+  size_t file_position = 0;
+  size_t start_position = file_size;
+  size_t start_raw_position = 0;
+  while (file_position < file_size) {
+    size_t raw_len, payload_len;
+    if (fread(frame.data(), 1, BlockCompressor::HEADER_SIZE, file) != BlockCompressor::HEADER_SIZE ||
+        !BlockCompressor::parse_header(frame.data(), raw_len, payload_len) ||
+        file_position + BlockCompressor::HEADER_SIZE + payload_len > file_size)
+      break;
+    if (start_position == file_size && total_size + raw_len > offset) {
+      start_position = file_position;
+      start_raw_position = total_size;
+    }
+    file_position += BlockCompressor::HEADER_SIZE + payload_len;
+    total_size += raw_len;
+    fseek(file, payload_len, SEEK_CUR);
+  }
+  // A bad frame before `offset`: decoding stops on it and reports it
+  if (start_position == file_size && file_position < file_size) {
+    start_position = file_position;
+    start_raw_position = total_size;
+  }
+  fseek(file, start_position, SEEK_SET);
+  raw_position = start_raw_position;
+  file_position = start_position;
+
+  std::vector<uint8_t> raw;
+  uint64_t decompressed = 0;
+  uint64_t busy_us = 0;
+  bool ok = true;
+  while (file_position < file_size) {
+    size_t raw_len, payload_len;
+    if (fread(frame.data(), 1, BlockCompressor::HEADER_SIZE, file) != BlockCompressor::HEADER_SIZE ||
+        !BlockCompressor::parse_header(frame.data(), raw_len, payload_len) ||
+        file_position + BlockCompressor::HEADER_SIZE + payload_len > file_size) {
+      ESP_LOGW(TAG, "%s: invalid or truncated frame at offset %zu", path, file_position);
+      ok = false;
+      break;
+    }
+    file_position += BlockCompressor::HEADER_SIZE + payload_len;
+
+    frame.resize(BlockCompressor::HEADER_SIZE + payload_len);
+    raw.resize(raw_len);
+    size_t len = fread(frame.data() + BlockCompressor::HEADER_SIZE, 1, payload_len, file);
+#ifdef USE_HOST
+    host_bus_transfer(len, false);
+#endif
+    uint32_t start = micros();
+    if (len != payload_len || !BlockCompressor::decompress_frame(frame.data(), raw.data())) {
+      ESP_LOGW(TAG, "%s: corrupted frame at offset %zu", path, file_position - payload_len);
+      ok = false;
+      break;
+    }
+    busy_us += micros() - start;
+    decompressed += raw_len;
+
+    size_t skip = offset > raw_position ? offset - raw_position : 0;
+    bool more = callback(raw.data() + skip, raw_len - skip, total_size, raw_position + skip);
+    raw_position += raw_len;
+    if (!more)
+      break;
+  }
+  fclose(file);
+  timer.add_bytes(file_position);
+  timer.set_ok(ok);
+
+  std::lock_guard<std::mutex> lock(this->compression_mutex_);
+  this->compression_stats_.decompressed_bytes += decompressed;
+  this->compression_stats_.decompress_us += busy_us;
+  return ok;
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
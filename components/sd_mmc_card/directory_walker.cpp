@@ -0,0 +1,112 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+#include <strings.h>
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_walker";
+static constexpr size_t WALK_PATH_MAX = 256;
+
+bool WalkOptions::matches(DirEntry const &entry) const {
+  if (this->type == WalkType::FILES && entry.is_directory)
+    return false;
+  if (this->type == WalkType::DIRECTORIES && !entry.is_directory)
+    return false;
+  if (entry.is_directory)
+    return true;
+  if (entry.size < this->min_size || entry.size > this->max_size)
+    return false;
+  if (this->extension != nullptr) {
+    size_t name_len = strlen(entry.name);
+    size_t extension_len = strlen(this->extension);
+    if (name_len < extension_len || strcasecmp(entry.name + name_len - extension_len, this->extension) != 0)
+      return false;
+  }
+  return true;
+}
+
+bool SdMmc::walk_directory(const char *path, WalkCallback const &callback, WalkOptions const &options) {
+  ESP_LOGV(TAG, "Walking directory: %s", path);
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::LIST);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return false;
+  }
+  struct Frame {
+    DirCursor *cursor;
+    size_t path_len;
+  };
+
+  // One shared path buffer: each level only appends its entry name after its parent's prefix.
+  char entry_path[WALK_PATH_MAX];
+  size_t path_len = strlen(path);
+  if (path_len + 1 >= sizeof(entry_path)) {
+    ESP_LOGE(TAG, "Path too long: %s", path);
+    timer.set_ok(false);
+    return false;
+  }
+  memcpy(entry_path, path, path_len + 1);
+  if (path_len == 0 || entry_path[path_len - 1] != '/') {
+    entry_path[path_len++] = '/';
+    entry_path[path_len] = '\0';
+  }
+
+  DirCursor *root = this->open_directory_(path);
+  if (root == nullptr) {
+    ESP_LOGE(TAG, "Failed to open directory: %s", path);
+    timer.set_ok(false);
+    return false;
+  }
+  std::vector<Frame> stack;
+  stack.reserve(options.depth + 1);
+  stack.push_back(Frame{root, path_len});
+
+  DirEntry entry;
+  while (!stack.empty()) {
+    Frame const frame = stack.back();
+    if (!this->read_directory_(frame.cursor, entry)) {
+      this->close_directory_(frame.cursor);
+      stack.pop_back();
+      continue;
+    }
+    size_t name_len = strlen(entry.name);
+    if (frame.path_len + name_len + 1 >= sizeof(entry_path)) {
+      ESP_LOGW(TAG, "Skipping entry with too long path: %s", entry.name);
+      continue;
+    }
+    memcpy(entry_path + frame.path_len, entry.name, name_len + 1);
+    entry.path = entry_path;
+    entry.depth = stack.size() - 1;
+
+    if (options.matches(entry) && !callback(entry)) {
+      for (auto &open : stack)
+        this->close_directory_(open.cursor);
+      return true;
+    }
+
+    if (entry.is_directory && entry.depth < options.depth) {
+      DirCursor *child = this->open_directory_(entry_path);
+      if (child == nullptr) {
+        ESP_LOGE(TAG, "Failed to open directory: %s", entry_path);
+        continue;
+      }
+      size_t child_len = frame.path_len + name_len;
+      entry_path[child_len++] = '/';
+      entry_path[child_len] = '\0';
+      stack.push_back(Frame{child, child_len});
+    }
+  }
+  return true;
+}
+
+bool SdMmc::walk_directory(std::string_view path, WalkCallback const &callback, WalkOptions const &options) {
+  return this->walk_directory(PathBuffer(path).c_str(), callback, options);
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
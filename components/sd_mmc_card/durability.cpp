@@ -0,0 +1,177 @@
+#include "sd_mmc_card.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_durability";
+static const char *const TEMP_SUFFIX = ".tmp";
+// Target of the replacement in progress, one line ended by '\n'
+static const char *const REPLACE_JOURNAL = "/.sd_replace";
+
+const char *durability_to_string(Durability durability) {
+  switch (durability) {
+    case Durability::INHERIT:
+      return "inherit";
+    case Durability::NONE:
+      return "none";
+    case Durability::PERIODIC:
+      return "periodic";
+    case Durability::GROUP_COMMIT:
+      return "group_commit";
+    case Durability::EVERY_WRITE:
+      return "every_write";
+  }
+  return "unknown";
+}
+
+void SdMmc::set_default_durability(Durability level, uint32_t sync_interval, bool atomic_write) {
+  this->default_durability_ = DurabilityRule{"", level, sync_interval, atomic_write};
+}
+
+void SdMmc::add_durability_rule(std::string const &prefix, Durability level, uint32_t sync_interval,
+                                bool atomic_write) {
+  DurabilityRule rule{prefix, level, sync_interval, atomic_write};
+  // "/data/" and "/data" cover the same directory
+  if (rule.prefix.size() > 1 && rule.prefix.back() == '/')
+    rule.prefix.pop_back();
+  // Longest prefix first, so that the first match is the most specific rule
+  auto position =
+      std::find_if(this->durability_rules_.begin(), this->durability_rules_.end(),
+                   [&rule](DurabilityRule const &other) { return other.prefix.size() < rule.prefix.size(); });
+  this->durability_rules_.insert(position, std::move(rule));
+}
+
+DurabilityRule const &SdMmc::get_durability(const char *path) const {
+  for (auto const &rule : this->durability_rules_) {
+    size_t len = rule.prefix.size();
+    // Whole path components only: "/data" does not cover "/database"
+    if (strncmp(path, rule.prefix.c_str(), len) == 0 && (path[len] == '\0' || path[len] == '/'))
+      return rule;
+  }
+  return this->default_durability_;
+}
+
+void SdMmc::sync() {
+  MountGuard mounted(this);
+  if (!mounted)
+    return;
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->commit();
+  if (this->rotating_log_ != nullptr)
+    this->rotating_log_->sync();
+}
+
+void SdMmc::record_sync(uint32_t us, uint32_t files, uint32_t writes) {
+  std::lock_guard<std::mutex> lock(this->sync_mutex_);
+  this->sync_stats_.syncs++;
+  this->sync_stats_.files += files;
+  this->sync_stats_.writes += writes;
+  this->sync_stats_.latency.record(us);
+}
+
+SyncStats SdMmc::get_sync_stats() const {
+  std::lock_guard<std::mutex> lock(this->sync_mutex_);
+  return this->sync_stats_;
+}
+
+bool SdMmc::sync_file_(FILE *file) {
+  uint32_t start = micros();
+  bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+#ifdef USE_HOST
+  host_bus_transfer(0, true);
+#endif
+  this->record_sync(micros() - start, 1, 1);
+  if (!ok)
+    ESP_LOGW(TAG, "fsync failed: %s", strerror(errno));
+  return ok;
+}
+
+size_t SdMmc::replace_file_(const char *path, const uint8_t *buffer, size_t len) {
+  PathBuffer temp(path, TEMP_SUFFIX);
+  if (temp.overflowed())
+    return 0;
+  // Appends still buffered for the old file would land in the replaced one
+  this->close_pooled_file(path);
+  // The new content is on the card before it takes the place of the old one
+  size_t written = this->write_file_(temp.c_str(), buffer, len, "w", true);
+  if (written != len) {
+    this->delete_file_(temp.c_str());
+    return written;
+  }
+
+  PathBuffer absolut_path = build_path(path);
+  PathBuffer absolut_temp = build_path(temp.c_str());
+  struct stat info;
+  uint64_t old_size = stat(absolut_path.c_str(), &info) == 0 ? info.st_size : 0;
+#ifdef USE_HOST
+  host_bus_transfer(0, true);
+#endif
+  // POSIX replaces the target atomically
+  bool ok = rename(absolut_temp.c_str(), absolut_path.c_str()) == 0;
+  if (!ok && errno == EEXIST) {
+    // FatFS refuses to rename over an existing file: the old one has to go first, and the
+    // journal lets the next mount finish the job if power is lost in between
+    std::lock_guard<std::mutex> lock(this->replace_mutex_);
+    PathBuffer journal_path = build_path(REPLACE_JOURNAL);
+    FILE *journal = fopen(journal_path.c_str(), "w");
+    ok = journal != nullptr && fputs(path, journal) >= 0 && fputc('\n', journal) != EOF;
+    if (journal != nullptr) {
+      ok = ok && fflush(journal) == 0 && fsync(fileno(journal)) == 0;
+      fclose(journal);
+    }
+    ok = ok && (remove(absolut_path.c_str()) == 0 || errno == ENOENT) &&
+         rename(absolut_temp.c_str(), absolut_path.c_str()) == 0;
+    // Left behind on failure, so that the next mount retries
+    if (ok)
+      remove(journal_path.c_str());
+  }
+  this->update_metadata_(temp.c_str(), FileMetadata::missing());
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to replace %s: %s", path, strerror(errno));
+    this->invalidate_metadata_(path);
+    return 0;
+  }
+  this->account_file_change(old_size, 0);
+  this->update_metadata_(path, FileMetadata::file(written));
+  return written;
+}
+
+void SdMmc::recover_replace_() {
+  PathBuffer journal_path = build_path(REPLACE_JOURNAL);
+  FILE *journal = fopen(journal_path.c_str(), "r");
+  if (journal == nullptr)
+    return;
+  char line[PathBuffer::CAPACITY];
+  bool complete = fgets(line, sizeof(line), journal) != nullptr && strchr(line, '\n') != nullptr;
+  fclose(journal);
+  // A journal cut short means the old file was not touched yet
+  if (complete) {
+    *strchr(line, '\n') = '\0';
+    PathBuffer temp(line, TEMP_SUFFIX);
+    PathBuffer absolut_path = build_path(line);
+    PathBuffer absolut_temp = build_path(temp.c_str());
+    struct stat info;
+    if (stat(absolut_temp.c_str(), &info) == 0) {
+      remove(absolut_path.c_str());
+      if (rename(absolut_temp.c_str(), absolut_path.c_str()) == 0) {
+        ESP_LOGW(TAG, "Completed the interrupted replacement of %s", line);
+      } else {
+        ESP_LOGE(TAG, "Failed to complete the replacement of %s: %s", line, strerror(errno));
+        return;
+      }
+    }
+  }
+  remove(journal_path.c_str());
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
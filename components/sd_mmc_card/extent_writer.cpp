@@ -0,0 +1,158 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_extent";
+
+std::unique_ptr<ExtentWriter> SdMmc::open_extent(const char *path, uint64_t capacity, size_t buffer_size) {
+  capacity = (capacity + ExtentWriter::SECTOR_SIZE - 1) / ExtentWriter::SECTOR_SIZE * ExtentWriter::SECTOR_SIZE;
+  buffer_size = std::max<size_t>(buffer_size / ExtentWriter::SECTOR_SIZE, 1) * ExtentWriter::SECTOR_SIZE;
+  MountGuard mounted(this);
+  if (!mounted)
+    return nullptr;
+  auto guard = this->path_locks_.lock_exclusive(path);
+  this->close_pooled_file(path);
+  uint64_t first_sector;
+  ExtentHandle *handle = this->open_extent_(path, capacity, first_sector);
+  this->invalidate_metadata_(path);
+  if (handle == nullptr) {
+    ESP_LOGE(TAG, "Cannot reserve %s of contiguous space for %s", format_size(capacity).c_str(), path);
+    return nullptr;
+  }
+  this->account_file_change(0, capacity);
+  ESP_LOGD(TAG, "Reserved %s for %s at sector %llu", format_size(capacity).c_str(), path,
+           static_cast<unsigned long long>(first_sector));
+  return std::make_unique<ExtentWriter>(this, path, handle, first_sector, capacity, buffer_size);
+}
+
+ExtentWriter::ExtentWriter(SdMmc *parent, std::string path, ExtentHandle *handle, uint64_t first_sector,
+                           uint64_t capacity, size_t buffer_size)
+    : parent_(parent),
+      path_(std::move(path)),
+      handle_(handle),
+      generation_(parent->get_mount_generation()),
+      first_sector_(first_sector),
+      capacity_(capacity),
+      buffer_size_(buffer_size) {
+  this->buffer_ = allocate_stream_buffer(buffer_size);
+  if (this->buffer_ == nullptr) {
+    ESP_LOGE(TAG, "Failed to allocate a %s write buffer", format_size(buffer_size).c_str());
+    this->close();
+  }
+}
+
+ExtentWriter::~ExtentWriter() { this->close(); }
+
+size_t ExtentWriter::write(const uint8_t *data, size_t len) {
+  if (this->handle_ == nullptr)
+    return 0;
+  if (this->size_ + len > this->capacity_) {
+    if (this->size_ < this->capacity_)
+      ESP_LOGW(TAG, "%s is full (%s)", this->path_.c_str(), format_size(this->capacity_).c_str());
+    len = this->capacity_ - this->size_;
+  }
+  size_t accepted = 0;
+  while (accepted < len) {
+    size_t chunk = std::min(len - accepted, this->buffer_size_ - this->buffer_used_);
+    memcpy(this->buffer_ + this->buffer_used_, data + accepted, chunk);
+    this->buffer_used_ += chunk;
+    accepted += chunk;
+    if (this->buffer_used_ == this->buffer_size_ && !this->flush_(false))
+      break;
+  }
+  this->size_ += accepted;
+  return accepted;
+}
+
+bool ExtentWriter::same_card_(bool mounted) const {
+  if (mounted && this->parent_->get_mount_generation() == this->generation_)
+    return true;
+  ESP_LOGE(TAG, "Card unmounted since %s was opened", this->path_.c_str());
+  return false;
+}
+
+bool ExtentWriter::flush_(bool partial) {
+  size_t full = this->buffer_used_ / SECTOR_SIZE;
+  size_t remainder = this->buffer_used_ % SECTOR_SIZE;
+  size_t count = full + (partial && remainder > 0 ? 1 : 0);
+  if (count == 0)
+    return true;
+  // The sectors were reserved on the card mounted at open time: never write them to another one
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!this->same_card_(static_cast<bool>(mounted)))
+    return false;
+  if (count > full)
+    memset(this->buffer_ + this->buffer_used_, 0, SECTOR_SIZE - remainder);
+
+  // One multi-block command for the whole run
+  uint32_t start = micros();
+  bool ok = this->parent_->write_extent_(this->handle_, this->first_sector_ + this->sector_, this->buffer_, count);
+  uint32_t elapsed = micros() - start;
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to write %zu sectors to %s", count, this->path_.c_str());
+    return false;
+  }
+  this->latency_.record(elapsed);
+  this->busy_us_ += elapsed;
+  this->bytes_on_card_ += full * SECTOR_SIZE;
+
+  // The partial sector stays in the buffer and is written again once completed
+  this->sector_ += full;
+  if (remainder > 0)
+    memmove(this->buffer_, this->buffer_ + full * SECTOR_SIZE, remainder);
+  this->buffer_used_ = remainder;
+  return true;
+}
+
+bool ExtentWriter::checkpoint() {
+  if (this->handle_ == nullptr)
+    return false;
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!this->same_card_(static_cast<bool>(mounted)) || !this->flush_(true))
+    return false;
+  bool ok = this->parent_->set_extent_size_(this->handle_, this->size_);
+  this->parent_->invalidate_metadata_(this->path_.c_str());
+  return ok;
+}
+
+bool ExtentWriter::close() {
+  if (this->handle_ == nullptr) {
+    free_stream_buffer(this->buffer_);
+    this->buffer_ = nullptr;
+    return false;
+  }
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!this->same_card_(static_cast<bool>(mounted))) {
+    // Its volume is gone: the file keeps the size of the last checkpoint
+    this->parent_->discard_extent_(this->handle_);
+    this->handle_ = nullptr;
+    free_stream_buffer(this->buffer_);
+    this->buffer_ = nullptr;
+    return false;
+  }
+  bool ok = this->buffer_ != nullptr && this->flush_(true);
+  this->parent_->close_extent_(this->handle_, this->capacity_, this->size_);
+  this->handle_ = nullptr;
+  this->parent_->account_file_change(this->capacity_, this->size_);
+  this->parent_->update_metadata_(this->path_.c_str(), FileMetadata::file(this->size_));
+  ESP_LOGD(TAG, "Closed %s: %s, %.2f MB/s, worst write %u us", this->path_.c_str(), format_size(this->size_).c_str(),
+           this->throughput(), this->max_write_latency());
+  free_stream_buffer(this->buffer_);
+  this->buffer_ = nullptr;
+  return ok;
+}
+
+float ExtentWriter::throughput() const {
+  if (this->busy_us_ == 0)
+    return 0.0f;
+  return this->bytes_on_card_ * 1.0f / this->busy_us_;
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
@@ -0,0 +1,227 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+#include <unistd.h>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_handle_pool";
+
+FileHandlePool::FileHandlePool(size_t size, uint32_t flush_interval, size_t flush_threshold)
+    : size_(size), flush_interval_(flush_interval), flush_threshold_(flush_threshold) {
+  this->handles_.reserve(size);
+  this->commit_files_.reserve(size);
+}
+
+FileHandlePool::~FileHandlePool() { this->close_all(); }
+
+bool FileHandlePool::append(const char *path, const uint8_t *buffer, size_t len, Durability durability,
+                            uint32_t sync_interval, uint64_t &old_size, uint64_t &new_size, uint64_t &commit) {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  commit = 0;
+  uint32_t now = millis();
+  Handle *handle = this->find_(path);
+  if (handle != nullptr) {
+    this->hits_++;
+  } else {
+    this->misses_++;
+    if (this->handles_.size() >= this->size_)
+      this->wait_commit_(lock);
+    FILE *file = fopen(build_path(path).c_str(), "ab");
+    if (file == nullptr) {
+      ESP_LOGE(TAG, "Failed to open file for appending: %s", path);
+      return false;
+    }
+    fseek(file, 0, SEEK_END);
+    uint64_t size = ftell(file);
+
+    if (this->handles_.size() >= this->size_) {
+      auto lru = std::min_element(this->handles_.begin(), this->handles_.end(),
+                                  [](Handle const &a, Handle const &b) { return a.last_use < b.last_use; });
+      ESP_LOGV(TAG, "Evicting %s", lru->path.c_str());
+      this->close_(*lru);
+      *lru = Handle{path, file, size, 0, now, 0, 0, 0, 0};
+      handle = &*lru;
+    } else {
+      this->handles_.push_back(Handle{path, file, size, 0, now, 0, 0, 0, 0});
+      handle = &this->handles_.back();
+    }
+  }
+  handle->last_use = ++this->use_counter_;
+
+  old_size = handle->size;
+  size_t written = fwrite(buffer, 1, len, handle->file);
+  handle->size += written;
+  handle->dirty_bytes += written;
+  new_size = handle->size;
+  if (written != len) {
+    ESP_LOGE(TAG, "Failed to append to file: %s", path);
+    this->wait_commit_(lock);
+    handle = this->find_(path);
+    if (handle != nullptr) {
+      this->close_(*handle);
+      this->handles_.erase(this->handles_.begin() + (handle - this->handles_.data()));
+    }
+    return false;
+  }
+  if (handle->pending_writes++ == 0)
+    handle->dirty_since = now;
+  switch (durability) {
+    case Durability::EVERY_WRITE:
+      this->flush_(*handle, now);
+      break;
+    case Durability::PERIODIC:
+      // The earliest deadline wins when levels are mixed on the same file
+      sync_interval = std::max<uint32_t>(sync_interval, 1);
+      if (handle->sync_interval == 0 || sync_interval < handle->sync_interval)
+        handle->sync_interval = sync_interval;
+      break;
+    case Durability::GROUP_COMMIT:
+      commit = ++this->write_sequence_;
+      break;
+    default:
+      break;
+  }
+  if (handle->dirty_bytes >= this->flush_threshold_)
+    this->flush_(*handle, now);
+  return true;
+}
+
+void FileHandlePool::commit(uint64_t commit) {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  if (commit == 0)
+    commit = ++this->write_sequence_;
+  while (this->committed_sequence_ < commit) {
+    if (this->committing_) {
+      this->commit_cv_.wait(lock);
+      continue;
+    }
+    // This caller leads the sync point: it covers every write numbered so far, and
+    // the writes that arrive while it runs wait for the next one.
+    uint64_t target = this->write_sequence_;
+    this->committing_ = true;
+    uint32_t start = micros();
+    uint32_t now = millis();
+    uint32_t writes = 0;
+    this->commit_files_.clear();
+    for (auto &handle : this->handles_) {
+      if (handle.pending_writes == 0)
+        continue;
+      fflush(handle.file);
+#ifdef USE_HOST
+      host_bus_transfer(handle.dirty_bytes, true);
+#endif
+      this->commit_files_.push_back(handle.file);
+      writes += handle.pending_writes;
+      handle.pending_writes = 0;
+      handle.sync_interval = 0;
+      handle.dirty_bytes = 0;
+      handle.last_flush = now;
+    }
+    // fsync without the mutex, appends keep going meanwhile; closing waits for committing_
+    lock.unlock();
+    for (FILE *file : this->commit_files_)
+      fsync(fileno(file));
+    uint32_t elapsed = micros() - start;
+    lock.lock();
+    this->committed_sequence_ = target;
+    this->committing_ = false;
+    this->commit_cv_.notify_all();
+    if (!this->commit_files_.empty() && this->on_sync_)
+      this->on_sync_(elapsed, this->commit_files_.size(), writes);
+  }
+}
+
+void FileHandlePool::flush(const char *path) {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  // The size in the directory entry is only right once a running commit() has synced it
+  this->wait_commit_(lock);
+  Handle *handle = this->find_(path);
+  if (handle != nullptr)
+    this->flush_(*handle, millis());
+}
+
+void FileHandlePool::close(const char *path) {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->wait_commit_(lock);
+  Handle *handle = this->find_(path);
+  if (handle == nullptr)
+    return;
+  this->close_(*handle);
+  this->handles_.erase(this->handles_.begin() + (handle - this->handles_.data()));
+}
+
+void FileHandlePool::close_prefix(const char *prefix) {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->wait_commit_(lock);
+  size_t prefix_len = strlen(prefix);
+  for (auto it = this->handles_.begin(); it != this->handles_.end();) {
+    if (it->path.compare(0, prefix_len, prefix) == 0) {
+      this->close_(*it);
+      it = this->handles_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void FileHandlePool::flush_due(uint32_t now) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  for (auto &handle : this->handles_) {
+    bool periodic = handle.sync_interval != 0 && now - handle.dirty_since >= handle.sync_interval;
+    if (periodic || (handle.dirty_bytes > 0 && now - handle.last_flush >= this->flush_interval_))
+      this->flush_(handle, now);
+  }
+}
+
+void FileHandlePool::close_all() {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->wait_commit_(lock);
+  for (auto &handle : this->handles_)
+    this->close_(handle);
+  this->handles_.clear();
+}
+
+FileHandlePool::Handle *FileHandlePool::find_(const char *path) {
+  for (auto &handle : this->handles_) {
+    if (handle.path == path)
+      return &handle;
+  }
+  return nullptr;
+}
+
+void FileHandlePool::flush_(Handle &handle, uint32_t now) {
+  // fflush only hands the data to the filesystem; fsync is what commits the
+  // cluster chain and directory entry, so readers and stat() see the new size.
+  uint32_t start = micros();
+  fflush(handle.file);
+  fsync(fileno(handle.file));
+#ifdef USE_HOST
+  host_bus_transfer(handle.dirty_bytes, true);
+#endif
+  if (handle.pending_writes > 0 && this->on_sync_)
+    this->on_sync_(micros() - start, 1, handle.pending_writes);
+  handle.dirty_bytes = 0;
+  handle.pending_writes = 0;
+  handle.sync_interval = 0;
+  handle.last_flush = now;
+}
+
+void FileHandlePool::wait_commit_(std::unique_lock<std::mutex> &lock) {
+  this->commit_cv_.wait(lock, [this]() { return !this->committing_; });
+}
+
+void FileHandlePool::close_(Handle &handle) {
+#ifdef USE_HOST
+  host_bus_transfer(handle.dirty_bytes, true);
+#endif
+  fclose(handle.file);
+  handle.file = nullptr;
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
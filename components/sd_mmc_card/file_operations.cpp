@@ -0,0 +1,385 @@
+#include "sd_mmc_card.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_file_ops";
+static constexpr size_t FILE_OPERATION_STACK_SIZE = 7168;
+// Work done by the background task before it lets loop() at the card
+static constexpr uint32_t FILE_OPERATION_SLICE = 20;
+static constexpr uint32_t FILE_OPERATION_PUBLISH_INTERVAL = 1000;
+
+const char *file_operation_to_string(FileOperationType type) {
+  switch (type) {
+    case FileOperationType::COPY:
+      return "copy";
+    case FileOperationType::MOVE:
+      return "move";
+    case FileOperationType::COPY_TREE:
+      return "copy_tree";
+    case FileOperationType::REMOVE_TREE:
+      return "remove_tree";
+  }
+  return "unknown";
+}
+
+float FileOperationProgress::throughput() const {
+  if (this->elapsed_ms == 0)
+    return 0.0f;
+  return this->bytes / (this->elapsed_ms * 1000.0f);
+}
+
+// "//a/b/" becomes "/a/b": one spelling per path, for the comparisons below and for the path locks
+static PathBuffer normalize_path(const char *path) {
+  PathBuffer normalized;
+  bool absolute = path[0] == '/';
+  for (const char *p = path; *p != '\0';) {
+    while (*p == '/')
+      p++;
+    const char *end = p;
+    while (*end != '\0' && *end != '/')
+      end++;
+    if (end != p) {
+      if (absolute || normalized.size() > 0)
+        normalized.append("/");
+      normalized.append(std::string_view(p, end - p));
+    }
+    p = end;
+  }
+  if (absolute && normalized.size() == 0)
+    normalized.append("/");
+  return normalized;
+}
+
+// Normalized paths: "/a" contains "/a/b" but not "/ab"; the root contains everything
+static bool contains_path(const char *parent, const char *path) {
+  size_t len = strlen(parent);
+  if (len == 1 && parent[0] == '/')
+    return true;
+  return strncmp(parent, path, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+bool SdMmc::track_file_operation_(FileOperationProgress *progress, uint32_t files, uint32_t directories,
+                                  uint64_t bytes) {
+  if (progress == nullptr)
+    return true;
+  {
+    std::lock_guard<std::mutex> lock(this->file_operation_mutex_);
+    progress->files += files;
+    progress->directories += directories;
+    progress->bytes += bytes;
+  }
+  // At most the locks of the file being copied are held: loop() gets the rest of the card
+  if (millis() - this->file_operation_slice_start_ >= FILE_OPERATION_SLICE) {
+    delay(1);
+    this->file_operation_slice_start_ = millis();
+  }
+  return !this->file_operation_cancelled_;
+}
+
+bool SdMmc::copy_file(const char *source, const char *destination, size_t buffer_size) {
+  return this->copy_file_(source, destination, buffer_size, nullptr);
+}
+
+bool SdMmc::copy_file(std::string_view source, std::string_view destination, size_t buffer_size) {
+  return this->copy_file(PathBuffer(source).c_str(), PathBuffer(destination).c_str(), buffer_size);
+}
+
+bool SdMmc::copy_file_(const char *source, const char *destination, size_t buffer_size,
+                       FileOperationProgress *progress) {
+  PathBuffer source_path = normalize_path(source);
+  PathBuffer destination_path = normalize_path(destination);
+  source = source_path.c_str();
+  destination = destination_path.c_str();
+  ESP_LOGV(TAG, "Copy %s to %s", source, destination);
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::COPY);
+  MountGuard mounted(this);
+  if (!mounted || strcmp(source, destination) == 0) {
+    timer.set_ok(false);
+    return false;
+  }
+  PathLocks::Guard source_guard, destination_guard;
+  this->path_locks_.lock_pair(source, false, source_guard, destination, true, destination_guard);
+  uint64_t copied = 0;
+  bool ok = this->copy_locked_(source, destination, buffer_size, [this, progress, &copied](size_t len) {
+    copied += len;
+    // Files count once complete, bytes as they go
+    return this->track_file_operation_(progress, 0, 0, len);
+  });
+  timer.add_bytes(copied);
+  timer.set_ok(ok);
+  return ok && this->track_file_operation_(progress, 1, 0, 0);
+}
+
+bool SdMmc::move_file(const char *source, const char *destination) {
+  return this->move_file_(source, destination, nullptr);
+}
+
+bool SdMmc::move_file(std::string_view source, std::string_view destination) {
+  return this->move_file(PathBuffer(source).c_str(), PathBuffer(destination).c_str());
+}
+
+bool SdMmc::move_file_(const char *source, const char *destination, FileOperationProgress *progress) {
+  PathBuffer source_path = normalize_path(source);
+  PathBuffer destination_path = normalize_path(destination);
+  source = source_path.c_str();
+  destination = destination_path.c_str();
+  ESP_LOGV(TAG, "Move %s to %s", source, destination);
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::RENAME);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return false;
+  }
+  if (contains_path(source, destination)) {
+    ESP_LOGE(TAG, "Cannot move %s into itself", source);
+    timer.set_ok(false);
+    return false;
+  }
+  PathLocks::Guard source_guard, destination_guard;
+  this->path_locks_.lock_pair(source, true, source_guard, destination, true, destination_guard);
+  bool directory = this->is_directory(source);
+  if (this->handle_pool_ != nullptr && directory) {
+    this->handle_pool_->close_prefix(source);
+  } else {
+    this->close_pooled_file(source);
+  }
+  this->close_pooled_file(destination);
+
+  PathBuffer absolut_source = build_path(source);
+  PathBuffer absolut_destination = build_path(destination);
+  struct stat info;
+  bool replacing = !directory && stat(absolut_destination.c_str(), &info) == 0 && !S_ISDIR(info.st_mode);
+  bool ok;
+  {
+    std::lock_guard<VolumeLock> volume(this->volume_lock_);
+#ifdef USE_HOST
+    host_bus_transfer(0, true);
+#endif
+    // One directory entry rewritten, whatever the size of the file or the tree
+    ok = rename(absolut_source.c_str(), absolut_destination.c_str()) == 0;
+    // FatFS does not rename over an existing file
+    if (!ok && errno == EEXIST && replacing) {
+      replacing = false;
+      ok = this->delete_file_(destination) && rename(absolut_source.c_str(), absolut_destination.c_str()) == 0;
+    }
+  }
+  if (!ok && errno == EXDEV && !directory) {
+    replacing = false;
+    // Different volumes: copy, then remove the source
+    ok = this->copy_locked_(source, destination, DEFAULT_COPY_BUFFER_SIZE, [this, progress](size_t len) {
+      return this->track_file_operation_(progress, 0, 0, len);
+    });
+    std::lock_guard<VolumeLock> volume(this->volume_lock_);
+    ok = ok && this->delete_file_(source);
+  }
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to move %s to %s: %s", source, destination, strerror(errno));
+    timer.set_ok(false);
+    return false;
+  }
+  if (replacing)
+    this->account_file_change(info.st_size, 0);
+  this->invalidate_metadata_(source, directory);
+  this->update_metadata_(source, FileMetadata::missing());
+  this->invalidate_metadata_(destination, true);
+  return this->track_file_operation_(progress, directory ? 0 : 1, directory ? 1 : 0, 0);
+}
+
+bool SdMmc::copy_tree(const char *source, const char *destination, size_t buffer_size) {
+  return this->copy_tree_(source, destination, buffer_size, nullptr);
+}
+
+bool SdMmc::copy_tree(std::string_view source, std::string_view destination, size_t buffer_size) {
+  return this->copy_tree(PathBuffer(source).c_str(), PathBuffer(destination).c_str(), buffer_size);
+}
+
+bool SdMmc::copy_tree_(const char *source, const char *destination, size_t buffer_size,
+                       FileOperationProgress *progress) {
+  PathBuffer source_path = normalize_path(source);
+  PathBuffer destination_path = normalize_path(destination);
+  source = source_path.c_str();
+  destination = destination_path.c_str();
+  MountGuard mounted(this);
+  if (!mounted)
+    return false;
+  if (!this->is_directory(source))
+    return this->copy_file_(source, destination, buffer_size, progress);
+  if (contains_path(source, destination)) {
+    ESP_LOGE(TAG, "Cannot copy %s into itself", source);
+    return false;
+  }
+  if (!this->is_directory(destination) && !this->create_directory(destination))
+    return false;
+  if (!this->track_file_operation_(progress, 0, 1, 0))
+    return false;
+
+  // Entries come as "<source>/<relative path>"; the relative part is appended to `destination`
+  // The root is the only normalized path that ends with '/'
+  size_t source_len = source_path.size() == 1 ? 0 : source_path.size();
+  std::string_view target_root(destination, destination_path.size() == 1 ? 0 : destination_path.size());
+
+  bool ok = true;
+  WalkOptions options;
+  options.depth = UINT8_MAX;
+  // Parents are reported before their content, so each directory exists before it is filled
+  bool walked = this->walk_directory(
+      source,
+      [&](DirEntry const &entry) {
+        PathBuffer target(target_root, entry.path + source_len);
+        if (target.overflowed()) {
+          ESP_LOGE(TAG, "Path too long: %s", entry.path);
+          ok = false;
+          return true;
+        }
+        if (entry.is_directory) {
+          if (!this->is_directory(target.c_str()) && !this->create_directory(target.c_str())) {
+            ok = false;
+            return true;
+          }
+          return this->track_file_operation_(progress, 0, 1, 0);
+        }
+        if (!this->copy_file_(entry.path, target.c_str(), buffer_size, progress))
+          ok = false;
+        return progress == nullptr || !this->file_operation_cancelled_;
+      },
+      options);
+  return walked && ok && (progress == nullptr || !this->file_operation_cancelled_);
+}
+
+bool SdMmc::remove_tree(const char *path) { return this->remove_tree_(path, nullptr); }
+
+bool SdMmc::remove_tree(std::string_view path) { return this->remove_tree(PathBuffer(path).c_str()); }
+
+bool SdMmc::remove_tree_(const char *path, FileOperationProgress *progress) {
+  MountGuard mounted(this);
+  if (!mounted)
+    return false;
+  if (!this->is_directory(path)) {
+    size_t size = this->get_file_size(path);
+    return this->delete_file(path) && this->track_file_operation_(progress, 1, 0, size);
+  }
+
+  // Files go as the walk meets them; directories once empty, deepest first
+  std::vector<std::string> directories{path};
+  bool ok = true;
+  WalkOptions options;
+  options.depth = UINT8_MAX;
+  bool walked = this->walk_directory(
+      path,
+      [&](DirEntry const &entry) {
+        if (entry.is_directory) {
+          directories.emplace_back(entry.path);
+          return true;
+        }
+        if (!this->delete_file(entry.path)) {
+          ok = false;
+          return true;
+        }
+        return this->track_file_operation_(progress, 1, 0, entry.size);
+      },
+      options);
+  if (!walked || (progress != nullptr && this->file_operation_cancelled_))
+    return false;
+  for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+    if (!this->remove_directory(it->c_str())) {
+      ok = false;
+    } else if (!this->track_file_operation_(progress, 0, 1, 0)) {
+      return false;
+    }
+  }
+  return ok;
+}
+
+bool SdMmc::start_file_operation(FileOperationType type, std::string const &source, std::string const &destination) {
+  if (this->file_operation_done_)
+    this->finish_file_operation_();
+  if (this->file_operation_thread_.joinable()) {
+    ESP_LOGW(TAG, "A file operation is already running, %s of %s skipped", file_operation_to_string(type),
+             source.c_str());
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->file_operation_mutex_);
+    this->file_operation_progress_ = FileOperationProgress();
+    this->file_operation_progress_.type = type;
+    this->file_operation_progress_.source = source;
+    this->file_operation_progress_.destination = destination;
+  }
+  this->file_operation_cancelled_ = false;
+  this->file_operation_start_ = millis();
+  this->file_operation_slice_start_ = this->file_operation_start_;
+  this->last_file_operation_publish_ = this->file_operation_start_;
+  this->file_operation_thread_ = start_worker_thread("sd_file_op", FILE_OPERATION_STACK_SIZE, [this]() {
+    FileOperationProgress *progress = &this->file_operation_progress_;
+    // Only this task writes the paths, and not before the operation is over
+    const char *source = progress->source.c_str();
+    const char *destination = progress->destination.c_str();
+    bool ok = false;
+    switch (progress->type) {
+      case FileOperationType::COPY:
+        ok = this->copy_file_(source, destination, DEFAULT_COPY_BUFFER_SIZE, progress);
+        break;
+      case FileOperationType::MOVE:
+        ok = this->move_file_(source, destination, progress);
+        break;
+      case FileOperationType::COPY_TREE:
+        ok = this->copy_tree_(source, destination, DEFAULT_COPY_BUFFER_SIZE, progress);
+        break;
+      case FileOperationType::REMOVE_TREE:
+        ok = this->remove_tree_(source, progress);
+        break;
+    }
+    {
+      std::lock_guard<std::mutex> lock(this->file_operation_mutex_);
+      progress->ok = ok;
+    }
+    this->file_operation_done_ = true;
+  });
+  return true;
+}
+
+void SdMmc::publish_file_operation_(bool done) {
+  FileOperationProgress progress;
+  {
+    std::lock_guard<std::mutex> lock(this->file_operation_mutex_);
+    progress = this->file_operation_progress_;
+  }
+  progress.elapsed_ms = millis() - this->file_operation_start_;
+  progress.done = done;
+  if (done) {
+    ESP_LOGI(TAG, "%s %s%s%s %s: %u files, %u directories, %s in %u ms (%.2f MB/s)",
+             file_operation_to_string(progress.type), progress.source.c_str(),
+             progress.destination.empty() ? "" : " -> ", progress.destination.c_str(),
+             progress.ok ? "done" : "failed", progress.files, progress.directories,
+             format_size(progress.bytes).c_str(), progress.elapsed_ms, progress.throughput());
+  }
+  this->file_operation_callback_.call(progress);
+}
+
+void SdMmc::poll_file_operation_(uint32_t now) {
+  if (this->file_operation_done_) {
+    this->finish_file_operation_();
+  } else if (this->file_operation_thread_.joinable() &&
+             now - this->last_file_operation_publish_ >= FILE_OPERATION_PUBLISH_INTERVAL) {
+    this->last_file_operation_publish_ = now;
+    this->publish_file_operation_(false);
+  }
+}
+
+void SdMmc::finish_file_operation_() {
+  if (this->file_operation_thread_.joinable())
+    this->file_operation_thread_.join();
+  this->file_operation_done_ = false;
+  this->publish_file_operation_(true);
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
@@ -0,0 +1,739 @@
+#include "file_server.h"
+
+#include <cinttypes>
+#include <cstring>
+#include <strings.h>
+
+#include "esphome/core/log.h"
+
+#ifdef USE_HOST
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_file_server";
+static constexpr size_t MAX_HEADER_SIZE = 2048;
+// Uploads are written next to their target and renamed once complete
+static const char *const PART_SUFFIX = ".part";
+// A client silent for this long gives its connection up
+static constexpr uint32_t CONNECTION_TIMEOUT_MS = 10000;
+
+static const char *status_text(int status) {
+  switch (status) {
+    case 200:
+      return "OK";
+    case 201:
+      return "Created";
+    case 206:
+      return "Partial Content";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 409:
+      return "Conflict";
+    case 416:
+      return "Range Not Satisfiable";
+    case 431:
+      return "Request Header Fields Too Large";
+    case 503:
+      return "Service Unavailable";
+    default:
+      return "Internal Server Error";
+  }
+}
+
+static const char *content_type_of(std::string const &path) {
+  static const char *const TYPES[][2] = {
+      {".txt", "text/plain"},       {".log", "text/plain"},       {".csv", "text/csv"},
+      {".json", "application/json"}, {".html", "text/html"},       {".jpg", "image/jpeg"},
+      {".jpeg", "image/jpeg"},      {".png", "image/png"},        {".wav", "audio/wav"},
+  };
+  size_t dot = path.rfind('.');
+  if (dot != std::string::npos) {
+    for (auto &type : TYPES) {
+      if (strcasecmp(path.c_str() + dot, type[0]) == 0)
+        return type[1];
+    }
+  }
+  return "application/octet-stream";
+}
+
+static bool write_str(HttpTransport &transport, std::string const &str) {
+  return transport.write(reinterpret_cast<const uint8_t *>(str.data()), str.size());
+}
+
+static bool write_chunk(HttpTransport &transport, const uint8_t *data, size_t len) {
+  char size_line[12];
+  int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+  return transport.write(reinterpret_cast<const uint8_t *>(size_line), n) && transport.write(data, len) &&
+         transport.write(reinterpret_cast<const uint8_t *>("\r\n"), 2);
+}
+
+static void append_json_string(std::string &out, const char *str) {
+  out += '"';
+  for (; *str != '\0'; str++) {
+    char c = *str;
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<uint8_t>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// "bytes=a-b", "bytes=a-" or "bytes=-n". Multiple ranges are not supported and, as the RFC
+// allows, answered with the whole file.
+static bool parse_range(std::string const &range, uint64_t size, uint64_t &start, uint64_t &end, bool &satisfiable) {
+  satisfiable = true;
+  if (range.compare(0, 6, "bytes=") != 0 || range.find(',') != std::string::npos)
+    return false;
+  const char *spec = range.c_str() + 6;
+  const char *dash = strchr(spec, '-');
+  if (dash == nullptr)
+    return false;
+  char *tail;
+  if (dash == spec) {
+    uint64_t suffix = strtoull(dash + 1, &tail, 10);
+    if (*tail != '\0' || suffix == 0) {
+      satisfiable = *tail == '\0' && size > 0 ? false : satisfiable;
+      return *tail == '\0';
+    }
+    start = suffix >= size ? 0 : size - suffix;
+    end = size - 1;
+  } else {
+    start = strtoull(spec, &tail, 10);
+    if (tail != dash)
+      return false;
+    end = dash[1] == '\0' ? size - 1 : strtoull(dash + 1, &tail, 10);
+    if (dash[1] != '\0' && (*tail != '\0' || end < start))
+      return false;
+    end = std::min(end, size - 1);
+  }
+  satisfiable = size > 0 && start < size;
+  return true;
+}
+
+namespace {
+
+// Request body, undoing the chunked transfer encoding when needed.
+class BodyReader {
+ public:
+  BodyReader(HttpTransport &transport, HttpRequest const &request)
+      : transport_(transport), remaining_(request.content_length), chunked_(request.chunked) {
+    if (!this->chunked_ && this->remaining_ < 0)
+      this->remaining_ = 0;
+  }
+
+  int read(uint8_t *buffer, size_t len) {
+    if (this->failed_)
+      return -1;
+    if (this->chunked_ && this->remaining_ <= 0) {
+      if (this->done_ || !this->next_chunk_())
+        return this->failed_ ? -1 : 0;
+    }
+    if (this->remaining_ <= 0)
+      return 0;
+    int n = this->transport_.read(buffer, std::min<int64_t>(len, this->remaining_));
+    if (n <= 0) {
+      this->failed_ = true;
+      return -1;
+    }
+    this->remaining_ -= n;
+    if (this->chunked_ && this->remaining_ == 0)
+      this->failed_ = !this->expect_crlf_();
+    return n;
+  }
+
+  bool failed() const { return this->failed_; }
+  bool complete() const { return !this->failed_ && (this->chunked_ ? this->done_ : this->remaining_ == 0); }
+
+ protected:
+  bool read_line_(char *line, size_t size) {
+    size_t used = 0;
+    while (true) {
+      uint8_t c;
+      if (this->transport_.read(&c, 1) != 1)
+        return false;
+      if (c == '\n')
+        break;
+      if (c != '\r' && used + 1 < size)
+        line[used++] = c;
+    }
+    line[used] = '\0';
+    return true;
+  }
+
+  bool expect_crlf_() {
+    char line[4];
+    return this->read_line_(line, sizeof(line)) && line[0] == '\0';
+  }
+
+  bool next_chunk_() {
+    char line[32];
+    if (!this->read_line_(line, sizeof(line))) {
+      this->failed_ = true;
+      return false;
+    }
+    char *end;
+    this->remaining_ = strtoll(line, &end, 16);
+    if (end == line || this->remaining_ < 0) {
+      this->failed_ = true;
+      return false;
+    }
+    if (this->remaining_ == 0) {
+      // Skip trailers up to the empty line
+      while (this->read_line_(line, sizeof(line)) && line[0] != '\0') {
+      }
+      this->done_ = true;
+      return false;
+    }
+    return true;
+  }
+
+  HttpTransport &transport_;
+  int64_t remaining_;
+  bool chunked_;
+  bool done_{false};
+  bool failed_{false};
+};
+
+}  // namespace
+
+FileServer::FileServer(SdMmc *parent, std::string url_prefix, size_t chunk_size)
+    : parent_(parent), url_prefix_(std::move(url_prefix)), chunk_size_(chunk_size) {
+  if (!this->url_prefix_.empty() && this->url_prefix_.back() == '/')
+    this->url_prefix_.pop_back();
+}
+
+FileServer::~FileServer() {
+#ifdef USE_HOST
+  this->stop_loopback();
+#endif
+}
+
+bool FileServer::matches(std::string const &url) const {
+  if (url.compare(0, this->url_prefix_.size(), this->url_prefix_) != 0)
+    return false;
+  char next = url.size() > this->url_prefix_.size() ? url[this->url_prefix_.size()] : '\0';
+  return next == '\0' || next == '/' || next == '?';
+}
+
+bool FileServer::resolve_path_(std::string const &url, std::string &path) const {
+  if (!this->matches(url))
+    return false;
+  path.clear();
+  for (size_t i = this->url_prefix_.size(); i < url.size() && url[i] != '?'; i++) {
+    char c = url[i];
+    if (c == '%' && i + 2 < url.size()) {
+      char hex[3] = {url[i + 1], url[i + 2], '\0'};
+      char *end;
+      c = static_cast<char>(strtol(hex, &end, 16));
+      if (*end != '\0' || c == '\0')
+        return false;
+      i += 2;
+    }
+    path += c;
+  }
+  if (path.empty() || path[0] != '/')
+    path.insert(path.begin(), '/');
+  while (path.size() > 1 && path.back() == '/')
+    path.pop_back();
+  // Refuse anything that could climb out of the card
+  size_t start = 0;
+  while (start < path.size()) {
+    size_t end = path.find('/', start + 1);
+    if (end == std::string::npos)
+      end = path.size();
+    if (path.compare(start, end - start, "/..") == 0)
+      return false;
+    start = end;
+  }
+  return true;
+}
+
+bool FileServer::send_head_(HttpTransport &transport, int status, const char *content_type, int64_t content_length,
+                            const char *extra_headers) {
+  char head[256];
+  int n = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n", status, status_text(status),
+                   content_type);
+  if (content_length >= 0) {
+    n += snprintf(head + n, sizeof(head) - n, "Content-Length: %" PRId64 "\r\n", content_length);
+  } else {
+    n += snprintf(head + n, sizeof(head) - n, "Transfer-Encoding: chunked\r\n");
+  }
+  snprintf(head + n, sizeof(head) - n, "Connection: close\r\n");
+  return write_str(transport, std::string(head) + extra_headers + "\r\n");
+}
+
+void FileServer::send_error_(HttpTransport &transport, int status) {
+  std::string body = std::string(status_text(status)) + "\n";
+  if (this->send_head_(transport, status, "text/plain", body.size()))
+    write_str(transport, body);
+}
+
+void FileServer::handle(HttpRequest const &request, HttpTransport &transport) {
+  this->requests_++;
+  std::string path;
+  if (!this->resolve_path_(request.url, path)) {
+    this->send_error_(transport, 404);
+    return;
+  }
+  if (!this->parent_->is_mounted()) {
+    this->send_error_(transport, 503);
+    return;
+  }
+  ESP_LOGD(TAG, "%s %s", request.method.c_str(), path.c_str());
+  if (request.method == "GET" || request.method == "HEAD") {
+    bool head = request.method == "HEAD";
+    if (this->parent_->is_directory(path)) {
+      this->send_listing_(path, transport, head);
+    } else if (this->parent_->exists(path)) {
+      this->send_file_(path, request, transport, head);
+    } else {
+      this->send_error_(transport, 404);
+    }
+  } else if (request.method == "PUT") {
+    this->receive_file_(path, request, transport);
+  } else {
+    std::string body = "Method Not Allowed\n";
+    if (this->send_head_(transport, 405, "text/plain", body.size(), "Allow: GET, HEAD, PUT\r\n"))
+      write_str(transport, body);
+  }
+}
+
+void FileServer::send_listing_(std::string const &path, HttpTransport &transport, bool head) {
+  if (!this->send_head_(transport, 200, "application/json", -1) || head)
+    return;
+  // Entries are batched into chunks of about chunk_size bytes, never the whole listing.
+  std::string out = "[";
+  bool first = true;
+  bool ok = this->parent_->walk_directory(path, [&](DirEntry const &entry) {
+    if (!first)
+      out += ',';
+    first = false;
+    out += "{\"name\":";
+    append_json_string(out, entry.name);
+    char fields[96];
+    snprintf(fields, sizeof(fields), ",\"size\":%zu,\"directory\":%s,\"mtime\":%lld}", entry.size,
+             entry.is_directory ? "true" : "false", static_cast<long long>(entry.mtime));
+    out += fields;
+    if (out.size() < this->chunk_size_)
+      return true;
+    bool sent = write_chunk(transport, reinterpret_cast<const uint8_t *>(out.data()), out.size());
+    this->bytes_sent_ += out.size();
+    out.clear();
+    return sent;
+  });
+  if (!ok)
+    ESP_LOGW(TAG, "Listing of %s interrupted", path.c_str());
+  out += "]";
+  write_chunk(transport, reinterpret_cast<const uint8_t *>(out.data()), out.size());
+  this->bytes_sent_ += out.size();
+  write_str(transport, "0\r\n\r\n");
+}
+
+void FileServer::send_file_(std::string const &path, HttpRequest const &request, HttpTransport &transport,
+                            bool head) {
+  // Whole chunks go straight from the card into the aligned buffer below
+  auto stream = this->parent_->open_file_read(path, FileStream::UNBUFFERED);
+  if (stream == nullptr) {
+    this->send_error_(transport, 500);
+    return;
+  }
+  uint64_t size = stream->size();
+  uint64_t start = 0;
+  uint64_t end = size == 0 ? 0 : size - 1;
+  bool satisfiable;
+  bool partial = !request.range.empty() && parse_range(request.range, size, start, end, satisfiable);
+  char headers[128];
+  if (partial && !satisfiable) {
+    snprintf(headers, sizeof(headers), "Content-Range: bytes */%" PRIu64 "\r\n", size);
+    this->send_head_(transport, 416, "text/plain", 0, headers);
+    return;
+  }
+  uint64_t length = size == 0 ? 0 : end - start + 1;
+  if (partial) {
+    snprintf(headers, sizeof(headers), "Accept-Ranges: bytes\r\nContent-Range: bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64
+             "\r\n", start, end, size);
+  } else {
+    snprintf(headers, sizeof(headers), "Accept-Ranges: bytes\r\n");
+  }
+  if (!this->send_head_(transport, partial ? 206 : 200, content_type_of(path), length, headers) || head ||
+      length == 0)
+    return;
+
+  uint8_t *buffer = allocate_stream_buffer(this->chunk_size_);
+  if (buffer == nullptr || !stream->seek(start)) {
+    free_stream_buffer(buffer);
+    return;
+  }
+  uint64_t remaining = length;
+  while (remaining > 0) {
+    size_t len = stream->read(buffer, std::min<uint64_t>(remaining, this->chunk_size_));
+    if (len == 0) {
+      ESP_LOGE(TAG, "Read error on %s", path.c_str());
+      break;
+    }
+    if (!transport.write(buffer, len)) {
+      ESP_LOGD(TAG, "Client went away during %s", path.c_str());
+      break;
+    }
+    remaining -= len;
+    this->bytes_sent_ += len;
+  }
+  free_stream_buffer(buffer);
+}
+
+void FileServer::receive_file_(std::string const &path, HttpRequest const &request, HttpTransport &transport) {
+  if (path == "/" || this->parent_->is_directory(path)) {
+    this->send_error_(transport, 409);
+    return;
+  }
+  if (request.content_length < 0 && !request.chunked) {
+    this->send_error_(transport, 400);
+    return;
+  }
+  BodyReader reader(transport, request);
+  uint64_t received = 0;
+  // The existing file stays untouched until the whole body is on the card
+  std::string part = path + PART_SUFFIX;
+  // write_file_stream writes the previous buffer on its own task while this one fills up.
+  bool written = this->parent_->write_file_stream(
+      part,
+      [&](uint8_t *buffer, size_t max_size) -> size_t {
+        size_t filled = 0;
+        while (filled < max_size) {
+          int n = reader.read(buffer + filled, max_size - filled);
+          if (n <= 0)
+            break;
+          filled += n;
+        }
+        received += filled;
+        return filled;
+      },
+      this->chunk_size_);
+  this->bytes_received_ += received;
+
+  if (!reader.complete()) {
+    ESP_LOGW(TAG, "Upload of %s truncated after %" PRIu64 " bytes", path.c_str(), received);
+    this->parent_->delete_file(part);
+    this->send_error_(transport, 400);
+    return;
+  }
+  if (!written || !this->parent_->move_file(part, path)) {
+    this->parent_->delete_file(part);
+    this->send_error_(transport, 500);
+    return;
+  }
+  std::string body = "{\"path\":";
+  append_json_string(body, path.c_str());
+  body += ",\"size\":" + std::to_string(received) + "}";
+  if (this->send_head_(transport, 201, "application/json", body.size()))
+    write_str(transport, body);
+}
+
+bool FileServer::begin_upload(std::string const &url, std::string const &filename) {
+  this->upload_.reset();
+  this->upload_ok_ = false;
+  if (!this->resolve_path_(url, this->upload_path_))
+    return false;
+  // Posted to a directory: the file keeps the name it had on the client
+  if (this->upload_path_ == "/" || this->parent_->is_directory(this->upload_path_)) {
+    if (filename.empty() || filename.find('/') != std::string::npos || filename == "..")
+      return false;
+    if (this->upload_path_ != "/")
+      this->upload_path_ += '/';
+    this->upload_path_ += filename;
+  }
+  // Network segments are small: gather them into chunks before they reach FatFS
+  this->upload_ = this->parent_->open_file_write(this->upload_path_ + PART_SUFFIX, "wb", this->chunk_size_);
+  this->upload_ok_ = this->upload_ != nullptr;
+  return this->upload_ok_;
+}
+
+bool FileServer::upload_chunk(const uint8_t *data, size_t len) {
+  if (this->upload_ == nullptr)
+    return false;
+  size_t written = this->upload_->write(data, len);
+  this->bytes_received_ += written;
+  if (written != len)
+    this->upload_ok_ = false;
+  return this->upload_ok_;
+}
+
+bool FileServer::end_upload() {
+  if (this->upload_ == nullptr)
+    return false;
+  // The last chunk is still in the stream buffer: a full card shows up here, not in close()
+  this->upload_ok_ = this->upload_ok_ && this->upload_->flush();
+  this->upload_->close();
+  this->upload_.reset();
+  std::string part = this->upload_path_ + PART_SUFFIX;
+  this->upload_ok_ = this->upload_ok_ && this->parent_->move_file(part, this->upload_path_);
+  if (!this->upload_ok_)
+    this->parent_->delete_file(part);
+  return this->upload_ok_;
+}
+
+#ifdef USE_HOST
+namespace {
+
+class SocketTransport : public HttpTransport {
+ public:
+  SocketTransport(int fd, const char *pending, size_t pending_len)
+      : fd_(fd), pending_(pending), pending_len_(pending_len) {}
+
+  int read(uint8_t *buffer, size_t len) override {
+    if (this->pending_len_ > 0) {
+      size_t n = std::min(len, this->pending_len_);
+      memcpy(buffer, this->pending_, n);
+      this->pending_ += n;
+      this->pending_len_ -= n;
+      return n;
+    }
+    return recv(this->fd_, buffer, len, 0);
+  }
+
+  bool write(const uint8_t *data, size_t len) override {
+    while (len > 0) {
+      ssize_t n = send(this->fd_, data, len, MSG_NOSIGNAL);
+      if (n <= 0)
+        return false;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+ protected:
+  int fd_;
+  const char *pending_;
+  size_t pending_len_;
+};
+
+}  // namespace
+
+bool FileServer::start_loopback(uint16_t port) {
+  this->listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (this->listen_fd_ < 0)
+    return false;
+  int yes = 1;
+  setsockopt(this->listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  socklen_t addr_len = sizeof(addr);
+  if (bind(this->listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(this->listen_fd_, 4) != 0 ||
+      getsockname(this->listen_fd_, reinterpret_cast<sockaddr *>(&addr), &addr_len) != 0) {
+    ESP_LOGE(TAG, "Cannot listen on port %u: %s", port, strerror(errno));
+    close(this->listen_fd_);
+    this->listen_fd_ = -1;
+    return false;
+  }
+  this->loopback_port_ = ntohs(addr.sin_port);
+  this->loopback_stop_ = false;
+  // One connection at a time: enough for tests and keeps memory bounded.
+  this->loopback_thread_ = start_worker_thread("sd_http", 8192, [this]() {
+    while (!this->loopback_stop_) {
+      pollfd pfd{this->listen_fd_, POLLIN, 0};
+      if (poll(&pfd, 1, 100) <= 0)
+        continue;
+      int fd = accept(this->listen_fd_, nullptr, nullptr);
+      if (fd < 0)
+        continue;
+      // An idle client would otherwise hold the only connection slot, and stop_loopback() with it
+      timeval timeout{CONNECTION_TIMEOUT_MS / 1000, (CONNECTION_TIMEOUT_MS % 1000) * 1000};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      {
+        std::lock_guard<std::mutex> lock(this->connection_mutex_);
+        this->connection_fd_ = fd;
+      }
+      this->serve_connection_(fd);
+      {
+        std::lock_guard<std::mutex> lock(this->connection_mutex_);
+        this->connection_fd_ = -1;
+      }
+      close(fd);
+    }
+  });
+  ESP_LOGI(TAG, "Serving %s on http://127.0.0.1:%u%s", build_path("").c_str(), this->loopback_port_,
+           this->url_prefix_.c_str());
+  return true;
+}
+
+void FileServer::stop_loopback() {
+  if (this->listen_fd_ < 0)
+    return;
+  this->loopback_stop_ = true;
+  {
+    // Wakes up a request waiting on its client
+    std::lock_guard<std::mutex> lock(this->connection_mutex_);
+    if (this->connection_fd_ >= 0)
+      shutdown(this->connection_fd_, SHUT_RDWR);
+  }
+  if (this->loopback_thread_.joinable())
+    this->loopback_thread_.join();
+  close(this->listen_fd_);
+  this->listen_fd_ = -1;
+}
+
+void FileServer::serve_connection_(int fd) {
+  char header[MAX_HEADER_SIZE + 1];
+  size_t used = 0;
+  char *end = nullptr;
+  while (end == nullptr) {
+    if (used == MAX_HEADER_SIZE) {
+      SocketTransport transport(fd, nullptr, 0);
+      this->send_error_(transport, 431);
+      return;
+    }
+    ssize_t n = recv(fd, header + used, MAX_HEADER_SIZE - used, 0);
+    if (n <= 0)
+      return;
+    used += n;
+    header[used] = '\0';
+    end = strstr(header, "\r\n\r\n");
+  }
+  *end = '\0';
+  const char *body = end + 4;
+
+  HttpRequest request;
+  char *save;
+  char *line = strtok_r(header, "\r\n", &save);
+  char *request_save = nullptr;
+  char *method = line != nullptr ? strtok_r(line, " ", &request_save) : nullptr;
+  char *target = method != nullptr ? strtok_r(nullptr, " ", &request_save) : nullptr;
+  SocketTransport transport(fd, body, header + used - body);
+  if (target == nullptr) {
+    this->send_error_(transport, 400);
+    return;
+  }
+  request.method = method;
+  request.url = target;
+  while ((line = strtok_r(nullptr, "\r\n", &save)) != nullptr) {
+    char *colon = strchr(line, ':');
+    if (colon == nullptr)
+      continue;
+    *colon = '\0';
+    const char *value = colon + 1;
+    while (*value == ' ')
+      value++;
+    if (strcasecmp(line, "Range") == 0) {
+      request.range = value;
+    } else if (strcasecmp(line, "Content-Length") == 0) {
+      request.content_length = strtoll(value, nullptr, 10);
+    } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+      request.chunked = strcasestr(value, "chunked") != nullptr;
+    }
+  }
+  this->handle(request, transport);
+}
+#endif  // USE_HOST
+
+#ifdef USE_SD_MMC_FILE_SERVER
+namespace {
+
+constexpr int MAX_RECEIVE_TIMEOUTS = 2;
+
+class HttpdTransport : public HttpTransport {
+ public:
+  explicit HttpdTransport(httpd_req_t *req) : req_(req) {}
+
+  int read(uint8_t *buffer, size_t len) override {
+    int n;
+    // Each timeout is httpd's recv_wait_timeout: a client that stops sending does not keep the task forever
+    int timeouts = 0;
+    do {
+      n = httpd_req_recv(this->req_, reinterpret_cast<char *>(buffer), len);
+    } while (n == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= MAX_RECEIVE_TIMEOUTS);
+    return n;
+  }
+
+  bool write(const uint8_t *data, size_t len) override {
+    while (len > 0) {
+      int n = httpd_send(this->req_, reinterpret_cast<const char *>(data), len);
+      if (n <= 0)
+        return false;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+ protected:
+  httpd_req_t *req_;
+};
+
+}  // namespace
+
+void FileServerHandler::setup() {
+  this->base_->init();
+  this->base_->add_handler(this);
+}
+
+bool FileServerHandler::canHandle(AsyncWebServerRequest *request) const { return this->server_.matches(request->url()); }
+
+void FileServerHandler::handleRequest(AsyncWebServerRequest *request) {
+  if (request->method() == HTTP_POST) {
+    // Multipart upload, already written by handleUpload
+    bool ok = this->server_.upload_ok();
+    request->send(ok ? 201 : 400, "text/plain", ok ? this->server_.upload_path().c_str() : "Upload failed");
+    return;
+  }
+  HttpRequest http_request;
+  switch (request->method()) {
+    case HTTP_GET:
+      http_request.method = "GET";
+      break;
+    case HTTP_HEAD:
+      http_request.method = "HEAD";
+      break;
+    case HTTP_PUT:
+      http_request.method = "PUT";
+      break;
+    default:
+      http_request.method = "OTHER";
+      break;
+  }
+  http_request.url = request->url();
+  auto range = request->get_header("Range");
+  if (range.has_value())
+    http_request.range = *range;
+  httpd_req_t *req = *request;
+  http_request.content_length = req->content_len;
+  HttpdTransport transport(req);
+  this->server_.handle(http_request, transport);
+}
+
+void FileServerHandler::handleUpload(AsyncWebServerRequest *request, const std::string &filename, size_t index,
+                                     uint8_t *data, size_t len, bool final) {
+  if (index == 0 && !this->server_.begin_upload(request->url(), filename))
+    ESP_LOGW(TAG, "Rejected upload of %s to %s", filename.c_str(), request->url().c_str());
+  if (len > 0)
+    this->server_.upload_chunk(data, len);
+  if (final)
+    this->server_.end_upload();
+}
+#endif  // USE_SD_MMC_FILE_SERVER
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
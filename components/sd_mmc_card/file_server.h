@@ -0,0 +1,119 @@
+#pragma once
+#include "sd_mmc_card.h"
+
+#ifdef USE_SD_MMC_FILE_SERVER
+#include "esphome/components/web_server_base/web_server_base.h"
+#endif
+
+namespace esphome {
+namespace sd_mmc_card {
+
+// Connexion HTTP brute vue par FileServer : la réponse (statut, en-têtes, corps) est écrite
+// telle quelle, le corps de la requête est lu tel que reçu.
+class HttpTransport {
+ public:
+  virtual ~HttpTransport() = default;
+  // Lit jusqu'à `len` octets du corps ; 0 en fin de flux, < 0 en cas d'erreur
+  virtual int read(uint8_t *buffer, size_t len) = 0;
+  virtual bool write(const uint8_t *data, size_t len) = 0;
+};
+
+struct HttpRequest {
+  std::string method;
+  // URL sans la chaîne de requête, encore encodée
+  std::string url;
+  std::string range;
+  int64_t content_length{-1};
+  bool chunked{false};
+};
+
+// API fichiers HTTP, indépendante du serveur qui la porte :
+//   GET/HEAD <prefix>/dossier  liste JSON produite au fil du parcours (réponse chunked)
+//   GET/HEAD <prefix>/fichier  téléchargement par blocs de `chunk_size`, avec Range
+//   PUT <prefix>/fichier       écriture du corps (Content-Length ou chunked) au fil de l'eau
+// La mémoire utilisée est bornée par `chunk_size` quelle que soit la taille des fichiers.
+class FileServer {
+ public:
+  FileServer(SdMmc *parent, std::string url_prefix, size_t chunk_size = DEFAULT_STREAM_BUFFER_SIZE);
+  ~FileServer();
+
+  bool matches(std::string const &url) const;
+  void handle(HttpRequest const &request, HttpTransport &transport);
+
+  // Réception en plusieurs appels (formulaire multipart de web_server_base)
+  bool begin_upload(std::string const &url, std::string const &filename);
+  bool upload_chunk(const uint8_t *data, size_t len);
+  bool end_upload();
+  bool upload_ok() const { return this->upload_ok_; }
+  std::string const &upload_path() const { return this->upload_path_; }
+
+#ifdef USE_HOST
+  // Serveur HTTP/1.1 minimal sur 127.0.0.1 (port 0 : port libre choisi par le système)
+  bool start_loopback(uint16_t port);
+  void stop_loopback();
+  uint16_t loopback_port() const { return this->loopback_port_; }
+#endif
+
+  uint32_t requests() const { return this->requests_; }
+  uint64_t bytes_sent() const { return this->bytes_sent_; }
+  uint64_t bytes_received() const { return this->bytes_received_; }
+
+ protected:
+  // Chemin sur la carte ; false si l'URL sort du préfixe ou contient ".."
+  bool resolve_path_(std::string const &url, std::string &path) const;
+  bool send_head_(HttpTransport &transport, int status, const char *content_type, int64_t content_length,
+                  const char *extra_headers = "");
+  void send_error_(HttpTransport &transport, int status);
+  void send_listing_(std::string const &path, HttpTransport &transport, bool head);
+  void send_file_(std::string const &path, HttpRequest const &request, HttpTransport &transport, bool head);
+  void receive_file_(std::string const &path, HttpRequest const &request, HttpTransport &transport);
+#ifdef USE_HOST
+  void serve_connection_(int fd);
+#endif
+
+  SdMmc *parent_;
+  std::string url_prefix_;
+  size_t chunk_size_;
+  std::unique_ptr<FileStream> upload_;
+  std::string upload_path_;
+  bool upload_ok_{false};
+  std::atomic<uint32_t> requests_{0};
+  std::atomic<uint64_t> bytes_sent_{0};
+  std::atomic<uint64_t> bytes_received_{0};
+#ifdef USE_HOST
+  int listen_fd_{-1};
+  uint16_t loopback_port_{0};
+  std::atomic<bool> loopback_stop_{false};
+  std::thread loopback_thread_;
+  // Connexion en cours, fermée par stop_loopback() pour ne pas attendre le client
+  std::mutex connection_mutex_;
+  int connection_fd_{-1};
+#endif
+};
+
+#ifdef USE_SD_MMC_FILE_SERVER
+// Branche FileServer sur web_server_base (ESP-IDF) : GET/HEAD passent directement par la
+// socket de la requête, les envois se font en formulaire multipart (POST).
+class FileServerHandler : public AsyncWebHandler, public Component {
+ public:
+  FileServerHandler(web_server_base::WebServerBase *base, SdMmc *parent, std::string const &url_prefix)
+      : base_(base), server_(parent, url_prefix) {}
+
+  void setup() override;
+  float get_setup_priority() const override { return setup_priority::WIFI - 1.0f; }
+
+  bool canHandle(AsyncWebServerRequest *request) const override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+  void handleUpload(AsyncWebServerRequest *request, const std::string &filename, size_t index, uint8_t *data,
+                    size_t len, bool final) override;
+
+  FileServer *get_server() { return &this->server_; }
+
+ protected:
+  web_server_base::WebServerBase *base_;
+  FileServer server_;
+};
+#endif
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
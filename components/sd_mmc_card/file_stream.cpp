@@ -1,4 +1,12 @@
 #include "sd_mmc_card.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "esphome/core/log.h"
 
 namespace esphome {
@@ -6,102 +14,295 @@ namespace sd_mmc_card {
 
 static const char *TAG = "sd_mmc_file_stream";
 
+static bool fits_off_t(uint64_t offset) { return offset <= static_cast<uint64_t>(std::numeric_limits<off_t>::max()); }
+
 FileStream::~FileStream() {
   this->close();
 }
 
-bool FileStream::open_read(const char* path) {
-  this->close();
-  this->file_ = fopen(path, "rb");
-  if (this->file_ == nullptr) {
+bool FileStream::open_read(const char* path, size_t buffer_size) {
+  if (!this->open_(path, "rb", buffer_size)) {
     ESP_LOGE(TAG, "Failed to open file for reading: %s", path);
     return false;
   }
-  
-  // Déterminer la taille du fichier
-  fseek(this->file_, 0, SEEK_END);
-  this->file_size_ = ftell(this->file_);
-  fseek(this->file_, 0, SEEK_SET);
-  
   ESP_LOGV(TAG, "Opened file for reading: %s (size: %s)", path, format_size(this->file_size_).c_str());
   return true;
 }
 
-bool FileStream::open_write(const char* path, const char* mode) {
-  this->close();
-  this->file_ = fopen(path, mode);
-  if (this->file_ == nullptr) {
+bool FileStream::open_write(const char* path, const char* mode, size_t buffer_size) {
+  if (!this->open_(path, mode, buffer_size)) {
     ESP_LOGE(TAG, "Failed to open file for writing: %s", path);
     return false;
   }
-  
   ESP_LOGV(TAG, "Opened file for writing: %s", path);
   return true;
 }
 
+bool FileStream::open_(const char* path, const char* mode, size_t buffer_size) {
+  this->close();
+  this->file_ = fopen(path, mode);
+  if (this->file_ == nullptr)
+    return false;
+
+  // setvbuf must come before any other operation on the stream
+  bool buffered = true;
+  if (buffer_size == UNBUFFERED) {
+    buffered = setvbuf(this->file_, nullptr, _IONBF, 0) == 0;
+  } else if (buffer_size != DEFAULT_BUFFER) {
+    buffer_size = std::max<size_t>(buffer_size / STREAM_BUFFER_ALIGNMENT, 1) * STREAM_BUFFER_ALIGNMENT;
+    this->buffer_ = allocate_stream_buffer(buffer_size);
+    buffered = this->buffer_ != nullptr &&
+               setvbuf(this->file_, reinterpret_cast<char*>(this->buffer_), _IOFBF, buffer_size) == 0;
+  }
+  if (!buffered)
+    ESP_LOGW(TAG, "Cannot set the buffer of %s, using the default one", path);
+
+  // Size from the directory entry: no seek to the end and back
+  struct stat info;
+  this->file_size_ = fstat(fileno(this->file_), &info) == 0 ? info.st_size : 0;
+  this->append_ = mode[0] == 'a';
+  this->position_ = mode[0] == 'a' ? this->file_size_ : 0;
+  this->last_operation_ = LastOperation::NONE;
+  return true;
+}
+
 size_t FileStream::read(uint8_t* buffer, size_t max_size) {
-  if (!this->is_open()) {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open()) {
     ESP_LOGE(TAG, "Attempted to read from closed file");
     return 0;
   }
+  OperationTimer timer(this->operation_stats_, SdMmcOperation::STREAM_READ);
   
   size_t bytes_read = fread(buffer, 1, max_size, this->file_);
+#ifdef USE_HOST
+  host_bus_transfer(bytes_read, false);
+#endif
   if (bytes_read < max_size && !feof(this->file_)) {
     ESP_LOGE(TAG, "Error reading from file");
+    timer.set_ok(false);
   }
+  timer.add_bytes(bytes_read);
+  this->position_ += bytes_read;
+  this->last_operation_ = LastOperation::READ;
   
   return bytes_read;
 }
 
 size_t FileStream::write(const uint8_t* buffer, size_t len) {
-  if (!this->is_open()) {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open()) {
     ESP_LOGE(TAG, "Attempted to write to closed file");
     return 0;
   }
+  OperationTimer timer(this->operation_stats_, SdMmcOperation::STREAM_WRITE);
   
   size_t bytes_written = fwrite(buffer, 1, len, this->file_);
+#ifdef USE_HOST
+  host_bus_transfer(bytes_written, true);
+#endif
   if (bytes_written < len) {
     ESP_LOGE(TAG, "Error writing to file");
+    timer.set_ok(false);
   }
+  timer.add_bytes(bytes_written);
+  if (this->append_)
+    this->position_ = this->file_size_;
+  this->position_ += bytes_written;
+  this->file_size_ = std::max(this->file_size_, this->position_);
+  this->last_operation_ = LastOperation::WRITE;
   
   return bytes_written;
 }
 
+bool FileStream::sync_stdio_(bool drop_read_buffer) {
+  if (this->last_operation_ == LastOperation::NONE ||
+      (this->last_operation_ == LastOperation::READ && !drop_read_buffer))
+    return true;
+  // Writes reach the file; on a read stream, read ahead that pwrite may change is discarded
+  // (seeking in place is not enough: stdio keeps its buffer when the target is inside it)
+  if (fflush(this->file_) != 0)
+    return false;
+  this->last_operation_ = LastOperation::NONE;
+  return true;
+}
+
+size_t FileStream::pread(uint8_t* buffer, size_t max_size, uint64_t offset) {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open()) {
+    ESP_LOGE(TAG, "Attempted to read from closed file");
+    return 0;
+  }
+  if (!fits_off_t(offset)) {
+    ESP_LOGE(TAG, "Offset %llu out of range", static_cast<unsigned long long>(offset));
+    return 0;
+  }
+  OperationTimer timer(this->operation_stats_, SdMmcOperation::STREAM_READ);
+  // Written data still buffered by stdio must reach the file first
+  if (!this->sync_stdio_(false)) {
+    timer.set_ok(false);
+    return 0;
+  }
+
+  size_t bytes_read = 0;
+  while (bytes_read < max_size) {
+    ssize_t result = ::pread(fileno(this->file_), buffer + bytes_read, max_size - bytes_read, offset + bytes_read);
+    if (result <= 0) {
+      if (result < 0) {
+        ESP_LOGE(TAG, "Error reading from file: %s", strerror(errno));
+        timer.set_ok(false);
+      }
+      break;
+    }
+    bytes_read += result;
+  }
+#ifdef USE_HOST
+  host_bus_transfer(bytes_read, false);
+#endif
+  timer.add_bytes(bytes_read);
+  return bytes_read;
+}
+
+size_t FileStream::pwrite(const uint8_t* buffer, size_t len, uint64_t offset) {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open()) {
+    ESP_LOGE(TAG, "Attempted to write to closed file");
+    return 0;
+  }
+  if (!fits_off_t(offset + len)) {
+    ESP_LOGE(TAG, "Offset %llu out of range", static_cast<unsigned long long>(offset));
+    return 0;
+  }
+  OperationTimer timer(this->operation_stats_, SdMmcOperation::STREAM_WRITE);
+  if (!this->sync_stdio_(true)) {
+    timer.set_ok(false);
+    return 0;
+  }
+
+  size_t bytes_written = 0;
+  while (bytes_written < len) {
+    ssize_t result = ::pwrite(fileno(this->file_), buffer + bytes_written, len - bytes_written, offset + bytes_written);
+    if (result <= 0) {
+      ESP_LOGE(TAG, "Error writing to file: %s", strerror(errno));
+      timer.set_ok(false);
+      break;
+    }
+    bytes_written += result;
+  }
+#ifdef USE_HOST
+  host_bus_transfer(bytes_written, true);
+#endif
+  timer.add_bytes(bytes_written);
+  if (this->append_) {
+    this->file_size_ += bytes_written;
+  } else {
+    this->file_size_ = std::max(this->file_size_, offset + bytes_written);
+  }
+  return bytes_written;
+}
+
 bool FileStream::eof() const {
-  if (!this->is_open()) 
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open())
     return true;
-    
+
   return feof(this->file_) != 0;
 }
 
 void FileStream::close() {
+  if (this->parent_ != nullptr) {
+    // An unmount may be closing it from another task at the same time
+    this->parent_->close_stream_(this);
+    this->parent_ = nullptr;
+    return;
+  }
+  this->close_file_();
+}
+
+void FileStream::close_file_() {
   if (this->file_ != nullptr) {
     fclose(this->file_);
     this->file_ = nullptr;
     this->file_size_ = 0;
+    this->position_ = 0;
+    if (this->on_close_) {
+      auto on_close = std::move(this->on_close_);
+      this->on_close_ = nullptr;
+      on_close();
+    }
   }
+  // Only once stdio is done with it
+  free_stream_buffer(this->buffer_);
+  this->buffer_ = nullptr;
 }
 
 bool FileStream::is_open() const {
-  return this->file_ != nullptr;
+  // Admitted: an unmount is not closing it at the same time
+  SdMmc::MountGuard mounted(this->parent_);
+  return mounted && this->file_ != nullptr;
 }
 
-size_t FileStream::size() const {
-  return this->file_size_;
+uint64_t FileStream::size() const {
+  SdMmc::MountGuard mounted(this->parent_);
+  return mounted ? this->file_size_ : 0;
 }
 
-size_t FileStream::tell() const {
-  if (!this->is_open())
+uint64_t FileStream::tell() const {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open())
     return 0;
     
-  return ftell(this->file_);
+  return this->position_;
 }
 
-bool FileStream::seek(size_t position) {
-  if (!this->is_open())
+bool FileStream::seek(uint64_t position) {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open())
     return false;
-    
-  return fseek(this->file_, position, SEEK_SET) == 0;
+  if (!fits_off_t(position)) {
+    ESP_LOGE(TAG, "Offset %llu out of range", static_cast<unsigned long long>(position));
+    return false;
+  }
+  if (fseeko(this->file_, position, SEEK_SET) != 0)
+    return false;
+  this->position_ = position;
+  this->last_operation_ = LastOperation::NONE;
+  return true;
+}
+
+bool FileStream::truncate(uint64_t size) {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open() || !fits_off_t(size))
+    return false;
+  if (!this->sync_stdio_(true) || ftruncate(fileno(this->file_), size) != 0) {
+    ESP_LOGE(TAG, "Failed to truncate to %s: %s", format_size(size).c_str(), strerror(errno));
+    return false;
+  }
+  this->file_size_ = size;
+  return true;
+}
+
+bool FileStream::flush() {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->is_open())
+    return false;
+  if (fflush(this->file_) != 0)
+    return false;
+  this->last_operation_ = LastOperation::NONE;
+  return true;
+}
+
+bool FileStream::sync() {
+  SdMmc::MountGuard mounted(this->parent_);
+  if (!mounted || !this->flush())
+    return false;
+  bool ok = fsync(fileno(this->file_)) == 0;
+#ifdef USE_HOST
+  host_bus_transfer(0, true);
+#endif
+  if (!ok)
+    ESP_LOGE(TAG, "fsync failed: %s", strerror(errno));
+  return ok;
 }
 
 }  // namespace sd_mmc_card
@@ -0,0 +1,270 @@
+#include "sd_mmc_card.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <strings.h>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_find";
+static constexpr size_t FIND_STACK_SIZE = 4096;
+
+const char *find_sort_to_string(FindSort sort) {
+  switch (sort) {
+    case FindSort::NONE:
+      return "none";
+    case FindSort::NAME:
+      return "name";
+    case FindSort::SIZE:
+      return "size";
+    case FindSort::MTIME:
+      return "mtime";
+  }
+  return "unknown";
+}
+
+// Matches `c` against the set opening at `pattern` ('[' excluded) and returns the character
+// after ']', or nullptr when the set does not match. An unterminated set is a literal '['.
+static const char *match_set(const char *pattern, char c, bool *literal) {
+  const char *p = pattern;
+  bool negate = *p == '!' || *p == '^';
+  if (negate)
+    p++;
+  bool found = false;
+  char lower = tolower(static_cast<unsigned char>(c));
+  // ']' right after the opening bracket is part of the set
+  for (bool first = true; *p != '\0' && (first || *p != ']'); first = false) {
+    char from = tolower(static_cast<unsigned char>(*p));
+    if (p[1] == '-' && p[2] != '\0' && p[2] != ']') {
+      char to = tolower(static_cast<unsigned char>(p[2]));
+      found = found || (lower >= from && lower <= to);
+      p += 3;
+    } else {
+      found = found || lower == from;
+      p++;
+    }
+  }
+  *literal = *p == '\0';
+  if (*literal)
+    return nullptr;
+  return found != negate && c != '/' ? p + 1 : nullptr;
+}
+
+bool glob_match(const char *pattern, const char *text) {
+  const char *p = pattern;
+  const char *t = text;
+  for (; *p != '\0'; p++, t++) {
+    switch (*p) {
+      case '*': {
+        bool globstar = p[1] == '*';
+        while (*p == '*')
+          p++;
+        // "**/" also matches no directory at all
+        if (globstar && *p == '/' && glob_match(p + 1, t))
+          return true;
+        for (;; t++) {
+          if (glob_match(p, t))
+            return true;
+          if (*t == '\0' || (!globstar && *t == '/'))
+            return false;
+        }
+      }
+      case '?':
+        if (*t == '\0' || *t == '/')
+          return false;
+        break;
+      case '[': {
+        if (*t == '\0')
+          return false;
+        bool literal;
+        const char *next = match_set(p + 1, *t, &literal);
+        if (literal) {
+          if (*t != '[')
+            return false;
+        } else if (next == nullptr) {
+          return false;
+        } else {
+          p = next - 1;
+        }
+        break;
+      }
+      default:
+        if (tolower(static_cast<unsigned char>(*p)) != tolower(static_cast<unsigned char>(*t)))
+          return false;
+        break;
+    }
+  }
+  return *t == '\0';
+}
+
+namespace {
+
+// Sort key of a result or of a candidate entry, so that rejected entries are never copied
+struct FindKey {
+  const char *path;
+  size_t size;
+  time_t mtime;
+};
+
+// true when `a` comes before `b` in the results
+bool find_before(FindOptions const &options, FindKey const &a, FindKey const &b) {
+  int order = 0;
+  switch (options.sort) {
+    case FindSort::NONE:
+    case FindSort::NAME:
+      // FAT names are case-insensitive
+      order = strcasecmp(a.path, b.path);
+      break;
+    case FindSort::SIZE:
+      order = a.size < b.size ? -1 : a.size > b.size;
+      break;
+    case FindSort::MTIME:
+      order = a.mtime < b.mtime ? -1 : a.mtime > b.mtime;
+      break;
+  }
+  // Ties in path order, whatever the direction, so that results do not depend on the walk
+  if (order == 0)
+    return strcmp(a.path, b.path) < 0;
+  return options.descending ? order > 0 : order < 0;
+}
+
+FindKey key_of(FindResult const &result) { return FindKey{result.path.c_str(), result.size, result.mtime}; }
+
+}  // namespace
+
+bool SdMmc::find(const char *root, FindOptions const &options, std::vector<FindResult> &results) {
+  return this->find_(root, options, results, nullptr);
+}
+
+bool SdMmc::find(std::string_view root, FindOptions const &options, std::vector<FindResult> &results) {
+  return this->find(PathBuffer(root).c_str(), options, results);
+}
+
+bool SdMmc::find_(const char *root, FindOptions const &options, std::vector<FindResult> &results,
+                  std::atomic<bool> const *cancelled) {
+  results.clear();
+  time_t modified_after = options.modified_after;
+  time_t modified_before = options.modified_before;
+  if (options.min_age != 0 || options.max_age != 0) {
+    time_t now = time(nullptr);
+    // Every file would look decades old
+    if (now < MIN_VALID_TIME) {
+      ESP_LOGW(TAG, "Clock not set, cannot search %s by age", root);
+      return false;
+    }
+    if (options.min_age != 0 && (modified_before == 0 || now - options.min_age < modified_before))
+      modified_before = now - options.min_age;
+    if (options.max_age != 0 && now - options.max_age > modified_after)
+      modified_after = now - options.max_age;
+  }
+
+  const char *pattern = options.pattern != nullptr && options.pattern[0] != '\0' ? options.pattern : nullptr;
+  bool relative = pattern != nullptr && strchr(pattern, '/') != nullptr;
+  // walk_directory puts exactly one '/' between the root and the relative path
+  size_t root_len = strlen(root);
+  size_t prefix_len = root_len > 0 && root[root_len - 1] == '/' ? root_len : root_len + 1;
+
+  WalkOptions walk;
+  walk.depth = options.depth;
+  walk.type = options.type;
+  walk.min_size = options.min_size;
+  walk.max_size = options.max_size;
+
+  bool sorted = options.sort != FindSort::NONE;
+  size_t limit = options.limit;
+  uint32_t matched = 0;
+  auto before = [&options](FindResult const &a, FindResult const &b) {
+    return find_before(options, key_of(a), key_of(b));
+  };
+  if (limit != 0)
+    results.reserve(limit);
+
+  uint32_t start = millis();
+  bool ok = this->walk_directory(
+      root,
+      [&](DirEntry const &entry) {
+        if (cancelled != nullptr && *cancelled)
+          return false;
+        if (pattern != nullptr && !glob_match(pattern, relative ? entry.path + prefix_len : entry.name))
+          return true;
+        // An unknown date (0) satisfies no date predicate
+        if (!entry.is_directory && (modified_after != 0 || modified_before != 0) &&
+            (entry.mtime == 0 || (modified_after != 0 && entry.mtime < modified_after) ||
+             (modified_before != 0 && entry.mtime >= modified_before)))
+          return true;
+        matched++;
+        if (limit == 0 || results.size() < limit) {
+          results.push_back(FindResult{entry.path, entry.size, entry.is_directory, entry.mtime});
+          // Top-K: a heap whose front is the worst result kept so far
+          if (sorted && limit != 0 && results.size() == limit)
+            std::make_heap(results.begin(), results.end(), before);
+          return sorted || limit == 0 || results.size() < limit;
+        }
+        if (!find_before(options, FindKey{entry.path, entry.size, entry.mtime}, key_of(results.front())))
+          return true;
+        // The evicted result's string is reused: no allocation once the heap is warm
+        std::pop_heap(results.begin(), results.end(), before);
+        FindResult &slot = results.back();
+        slot.path.assign(entry.path);
+        slot.size = entry.size;
+        slot.is_directory = entry.is_directory;
+        slot.mtime = entry.mtime;
+        std::push_heap(results.begin(), results.end(), before);
+        return true;
+      },
+      walk);
+  if (cancelled != nullptr && *cancelled)
+    ok = false;
+
+  if (sorted) {
+    if (limit != 0 && results.size() == limit) {
+      std::sort_heap(results.begin(), results.end(), before);
+    } else {
+      std::sort(results.begin(), results.end(), before);
+    }
+  }
+  ESP_LOGD(TAG, "Found %u entries under %s matching %s in %u ms, kept %zu (sort %s%s)", matched, root,
+           pattern != nullptr ? pattern : "*", millis() - start, results.size(), find_sort_to_string(options.sort),
+           sorted && options.descending ? ", descending" : "");
+  return ok;
+}
+
+bool SdMmc::start_find(std::string const &root, FindOptions const &options) {
+  if (this->find_done_)
+    this->finish_find_();
+  if (this->find_thread_.joinable()) {
+    ESP_LOGW(TAG, "A search is already running, %s skipped", root.c_str());
+    return false;
+  }
+  this->find_root_ = root;
+  this->find_pattern_ = options.pattern != nullptr ? options.pattern : "";
+  this->find_options_ = options;
+  this->find_options_.pattern = this->find_pattern_.c_str();
+  this->find_cancelled_ = false;
+  this->find_thread_ = start_worker_thread("sd_find", FIND_STACK_SIZE, [this]() {
+    this->find_ok_ = this->find_(this->find_root_.c_str(), this->find_options_, this->find_results_,
+                                 &this->find_cancelled_);
+    this->find_done_ = true;
+  });
+  return true;
+}
+
+void SdMmc::finish_find_() {
+  if (this->find_thread_.joinable())
+    this->find_thread_.join();
+  this->find_done_ = false;
+  if (!this->find_ok_)
+    ESP_LOGW(TAG, "Search under %s failed", this->find_root_.c_str());
+  // The results are handed over: the next search starts from an empty vector anyway
+  std::vector<FindResult> results = std::move(this->find_results_);
+  this->find_results_.clear();
+  this->find_callback_.call(std::move(results), this->find_ok_);
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
@@ -0,0 +1,83 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace sd_mmc_card {
+
+bool MetadataIndex::find(const char *path, FileMetadata &metadata) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  auto it = this->map_.find(path);
+  if (it == this->map_.end()) {
+    this->misses_++;
+    return false;
+  }
+  this->hits_++;
+  this->entries_.splice(this->entries_.begin(), this->entries_, it->second);
+  metadata = it->second->second;
+  return true;
+}
+
+void MetadataIndex::put(const char *path, FileMetadata const &metadata) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  auto it = this->map_.find(path);
+  if (it != this->map_.end()) {
+    it->second->second = metadata;
+    this->entries_.splice(this->entries_.begin(), this->entries_, it->second);
+    return;
+  }
+  if (this->entries_.size() >= this->capacity_) {
+    // Reuse the least recently used node rather than freeing and allocating a new one.
+    auto lru = std::prev(this->entries_.end());
+    this->map_.erase(lru->first);
+    lru->first = path;
+    lru->second = metadata;
+    this->entries_.splice(this->entries_.begin(), this->entries_, lru);
+  } else {
+    this->entries_.emplace_front(path, metadata);
+  }
+  this->map_.emplace(this->entries_.front().first, this->entries_.begin());
+}
+
+void MetadataIndex::invalidate(const char *path) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  auto it = this->map_.find(path);
+  if (it == this->map_.end())
+    return;
+  this->invalidations_++;
+  this->entries_.erase(it->second);
+  this->map_.erase(it);
+}
+
+void MetadataIndex::invalidate_prefix(const char *prefix) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  size_t prefix_len = strlen(prefix);
+  for (auto it = this->entries_.begin(); it != this->entries_.end();) {
+    std::string const &path = it->first;
+    bool inside = prefix_len == 0 ||
+                  (path.compare(0, prefix_len, prefix) == 0 &&
+                   (path.size() == prefix_len || path[prefix_len] == '/' || prefix[prefix_len - 1] == '/'));
+    if (inside) {
+      this->invalidations_++;
+      this->map_.erase(path);
+      it = this->entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void MetadataIndex::clear() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->invalidations_ += this->entries_.size();
+  this->entries_.clear();
+  this->map_.clear();
+}
+
+size_t MetadataIndex::size() const {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->entries_.size();
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
@@ -0,0 +1,121 @@
+#include "sd_mmc_card.h"
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+const char *operation_to_string(SdMmcOperation operation) {
+  switch (operation) {
+    case SdMmcOperation::READ:
+      return "read";
+    case SdMmcOperation::WRITE:
+      return "write";
+    case SdMmcOperation::APPEND:
+      return "append";
+    case SdMmcOperation::QUEUE:
+      return "queue";
+    case SdMmcOperation::DELETE:
+      return "delete";
+    case SdMmcOperation::MKDIR:
+      return "mkdir";
+    case SdMmcOperation::RMDIR:
+      return "rmdir";
+    case SdMmcOperation::STAT:
+      return "stat";
+    case SdMmcOperation::LIST:
+      return "list";
+    case SdMmcOperation::STREAM_READ:
+      return "stream_read";
+    case SdMmcOperation::STREAM_WRITE:
+      return "stream_write";
+    case SdMmcOperation::COPY:
+      return "copy";
+    case SdMmcOperation::RENAME:
+      return "rename";
+  }
+  return "unknown";
+}
+
+float OperationStats::throughput() const {
+  if (this->latency.total() == 0)
+    return 0.0f;
+  return this->bytes * 1.0f / this->latency.total();
+}
+
+float OperationStats::value(OperationStatistic statistic) const {
+  switch (statistic) {
+    case OperationStatistic::COUNT:
+      return this->count;
+    case OperationStatistic::BYTES:
+      return this->bytes;
+    case OperationStatistic::ERRORS:
+      return this->errors;
+    case OperationStatistic::P50:
+      return this->latency.percentile(50) / 1000.0f;
+    case OperationStatistic::P95:
+      return this->latency.percentile(95) / 1000.0f;
+    case OperationStatistic::P99:
+      return this->latency.percentile(99) / 1000.0f;
+    case OperationStatistic::MAX:
+      return this->latency.max() / 1000.0f;
+    case OperationStatistic::THROUGHPUT:
+      return this->throughput();
+  }
+  return NAN;
+}
+
+void OperationStatsTable::record(SdMmcOperation operation, uint32_t us, size_t bytes, bool ok) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  OperationStats &stats = this->stats_[static_cast<uint8_t>(operation)];
+  stats.count++;
+  stats.bytes += bytes;
+  if (!ok)
+    stats.errors++;
+  stats.latency.record(us);
+}
+
+OperationStats OperationStatsTable::get(SdMmcOperation operation) const {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->stats_[static_cast<uint8_t>(operation)];
+}
+
+void OperationStatsTable::reset() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  for (auto &stats : this->stats_)
+    stats = OperationStats();
+}
+
+#ifdef USE_SD_MMC_OPERATION_STATS
+OperationTimer::OperationTimer(OperationStatsTable *table, SdMmcOperation operation)
+    : table_(table), operation_(operation), start_(micros()) {}
+
+OperationTimer::~OperationTimer() {
+  if (this->table_ != nullptr)
+    this->table_->record(this->operation_, micros() - this->start_, this->bytes_, this->ok_);
+}
+
+#ifdef USE_SENSOR
+void SdMmc::add_operation_sensor(sensor::Sensor *sensor, SdMmcOperation operation, OperationStatistic statistic) {
+  this->operation_sensors_.push_back(OperationSensor{sensor, operation, statistic});
+}
+#endif
+#endif
+
+void SdMmc::reset_statistics() {
+#ifdef USE_SD_MMC_OPERATION_STATS
+  this->operation_stats_.reset();
+#endif
+  this->path_locks_.reset_stats();
+  this->volume_lock_.reset_stats();
+  {
+    std::lock_guard<std::mutex> lock(this->sync_mutex_);
+    this->sync_stats_ = SyncStats();
+  }
+  if (this->sector_cache_ != nullptr)
+    this->sector_cache_->reset_stats();
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
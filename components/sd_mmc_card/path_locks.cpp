@@ -0,0 +1,172 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+
+#include "esphome/core/hal.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static void record_wait(LockStats &stats, bool waited, uint32_t wait_us) {
+  stats.acquisitions++;
+  if (!waited)
+    return;
+  stats.contentions++;
+  stats.wait_us += wait_us;
+  stats.max_wait_us = std::max(stats.max_wait_us, wait_us);
+}
+
+PathLocks::Guard::Guard(PathLocks *owner, const char *path, bool exclusive) : owner_(owner), exclusive_(exclusive) {
+  this->entry_ = this->owner_->acquire_(path, exclusive);
+  this->acquired_us_ = micros();
+}
+
+PathLocks::Guard &PathLocks::Guard::operator=(Guard &&other) noexcept {
+  if (this != &other) {
+    this->release();
+    this->owner_ = other.owner_;
+    this->entry_ = other.entry_;
+    this->exclusive_ = other.exclusive_;
+    this->acquired_us_ = other.acquired_us_;
+    other.owner_ = nullptr;
+  }
+  return *this;
+}
+
+void PathLocks::Guard::release() {
+  if (this->owner_ == nullptr)
+    return;
+  this->owner_->release_(this->entry_, this->exclusive_, micros() - this->acquired_us_);
+  this->owner_ = nullptr;
+}
+
+PathLocks::Entry *PathLocks::find_or_insert_(const char *path) {
+  Slot *free_slot = nullptr;
+  for (auto &slot : this->slots_) {
+    if (!slot.used) {
+      if (free_slot == nullptr)
+        free_slot = &slot;
+    } else if (strcmp(slot.path, path) == 0) {
+      return &slot.entry;
+    }
+  }
+  // Only reached with more than SLOTS paths locked at once or with very long paths
+  if (!this->overflow_.empty()) {
+    auto it = this->overflow_.find(path);
+    if (it != this->overflow_.end())
+      return &it->second;
+  }
+  size_t len = strlen(path);
+  if (free_slot != nullptr && len < SLOT_PATH_SIZE) {
+    memcpy(free_slot->path, path, len + 1);
+    free_slot->used = true;
+    free_slot->entry = Entry();
+    free_slot->entry.slot = free_slot - this->slots_;
+    return &free_slot->entry;
+  }
+  auto it = this->overflow_.emplace(path, Entry()).first;
+  it->second.overflow_key = &it->first;
+  return &it->second;
+}
+
+PathLocks::Entry *PathLocks::acquire_(const char *path, bool exclusive) {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  Entry *entry = this->find_or_insert_(path);
+  bool waited = false;
+  uint32_t start = 0;
+  if (exclusive) {
+    if (entry->writer || entry->readers > 0) {
+      waited = true;
+      start = micros();
+      entry->waiting_writers++;
+      this->cv_.wait(lock, [entry]() { return !entry->writer && entry->readers == 0; });
+      entry->waiting_writers--;
+    }
+    entry->writer = true;
+  } else {
+    if (entry->writer || entry->waiting_writers > 0) {
+      waited = true;
+      start = micros();
+      entry->waiting_readers++;
+      this->cv_.wait(lock, [entry]() { return !entry->writer && entry->waiting_writers == 0; });
+      entry->waiting_readers--;
+    }
+    entry->readers++;
+  }
+  record_wait(this->stats_, waited, waited ? micros() - start : 0);
+  return entry;
+}
+
+void PathLocks::release_(Entry *entry, bool exclusive, uint32_t held_us) {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (exclusive) {
+      entry->writer = false;
+    } else if (entry->readers > 0) {
+      entry->readers--;
+    }
+    if (entry->idle()) {
+      if (entry->slot >= 0) {
+        this->slots_[entry->slot].used = false;
+      } else {
+        this->overflow_.erase(this->overflow_.find(*entry->overflow_key));
+      }
+    }
+    this->stats_.max_hold_us = std::max(this->stats_.max_hold_us, held_us);
+  }
+  this->cv_.notify_all();
+}
+
+void PathLocks::lock_pair(const char *first, bool first_exclusive, Guard &first_guard, const char *second,
+                          bool second_exclusive, Guard &second_guard) {
+  if (strcmp(first, second) > 0) {
+    second_guard = Guard(this, second, second_exclusive);
+    first_guard = Guard(this, first, first_exclusive);
+  } else {
+    first_guard = Guard(this, first, first_exclusive);
+    second_guard = Guard(this, second, second_exclusive);
+  }
+}
+
+LockStats PathLocks::stats() const {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->stats_;
+}
+
+void PathLocks::reset_stats() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->stats_ = LockStats();
+}
+
+void VolumeLock::lock() {
+  bool waited = !this->mutex_.try_lock();
+  uint32_t start = micros();
+  if (waited)
+    this->mutex_.lock();
+  uint32_t now = micros();
+  this->acquired_us_ = now;
+  std::lock_guard<std::mutex> lock(this->stats_mutex_);
+  record_wait(this->stats_, waited, now - start);
+}
+
+void VolumeLock::unlock() {
+  uint32_t held = micros() - this->acquired_us_;
+  {
+    std::lock_guard<std::mutex> lock(this->stats_mutex_);
+    this->stats_.max_hold_us = std::max(this->stats_.max_hold_us, held);
+  }
+  this->mutex_.unlock();
+}
+
+LockStats VolumeLock::stats() const {
+  std::lock_guard<std::mutex> lock(this->stats_mutex_);
+  return this->stats_;
+}
+
+void VolumeLock::reset_stats() {
+  std::lock_guard<std::mutex> lock(this->stats_mutex_);
+  this->stats_ = LockStats();
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
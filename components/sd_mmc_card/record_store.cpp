@@ -0,0 +1,474 @@
+#include "record_store.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_record_store";
+static constexpr uint32_t BLOCK_MAGIC = 0x53524453;  // "SDRS"
+
+// Block header layout, little endian
+static constexpr size_t MAGIC_OFFSET = 0;
+static constexpr size_t NUMBER_OFFSET = 4;
+static constexpr size_t FIRST_TIME_OFFSET = 8;
+static constexpr size_t LAST_TIME_OFFSET = 16;
+static constexpr size_t COUNT_OFFSET = 24;
+static constexpr size_t USED_OFFSET = 26;
+static constexpr size_t CRC_OFFSET = 28;
+
+template<typename T> static T get(const uint8_t *buffer, size_t offset) {
+  T value;
+  memcpy(&value, buffer + offset, sizeof(T));
+  return value;
+}
+
+template<typename T> static void put(uint8_t *buffer, size_t offset, T value) {
+  memcpy(buffer + offset, &value, sizeof(T));
+}
+
+static uint32_t block_crc(const uint8_t *buffer, size_t used) {
+  uint32_t crc = crc32(buffer, CRC_OFFSET);
+  return crc32(buffer + RecordStore::HEADER_SIZE, used - RecordStore::HEADER_SIZE, crc);
+}
+
+RecordStore::RecordStore(SdMmc *parent, std::string path, size_t block_size)
+    : parent_(parent), path_(std::move(path)) {
+  // The used size of a full block must fit in the 16-bit header field
+  if (block_size > MAX_BLOCK_SIZE) {
+    ESP_LOGW(TAG, "Block size %zu too large for %s, using %zu", block_size, this->path_.c_str(), MAX_BLOCK_SIZE);
+    block_size = MAX_BLOCK_SIZE;
+  }
+  this->block_size_ = std::max<size_t>(block_size, 512) / 512 * 512;
+  this->index_path_ = this->path_ + ".idx";
+}
+
+RecordStore::~RecordStore() { this->close(); }
+
+bool RecordStore::open() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (this->open_)
+      return true;
+    this->block_ = allocate_stream_buffer(this->block_size_);
+    if (this->block_ == nullptr) {
+      ESP_LOGE(TAG, "Failed to allocate a %s block buffer", format_size(this->block_size_).c_str());
+      return false;
+    }
+    PathLocks::Guard data_lock, index_lock;
+    this->lock_(data_lock, index_lock);
+    if (!this->open_files_()) {
+      this->close_files_();
+      free_stream_buffer(this->block_);
+      this->block_ = nullptr;
+      return false;
+    }
+    this->open_ = true;
+  }
+  // Outside the store lock: the parent takes its own lock first, then ours
+  this->parent_->register_record_store(this);
+  return true;
+}
+
+void RecordStore::close() {
+  this->parent_->unregister_record_store(this);
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (!this->open_)
+    return;
+  {
+    PathLocks::Guard data_lock, index_lock;
+    this->lock_(data_lock, index_lock);
+    if (this->file_ != nullptr && this->file_->is_open())
+      this->write_block_();
+    this->close_files_();
+  }
+  free_stream_buffer(this->block_);
+  this->block_ = nullptr;
+  this->open_ = false;
+}
+
+void RecordStore::lock_(PathLocks::Guard &data, PathLocks::Guard &index) {
+  this->parent_->get_path_locks().lock_pair(this->path_.c_str(), true, data, this->index_path_.c_str(), true, index);
+}
+
+bool RecordStore::open_files_() {
+  const char *mode = this->parent_->exists(this->path_.c_str()) ? "r+b" : "w+b";
+  // Whole blocks are written at once, a stdio buffer would only add a copy.
+  this->file_ = this->parent_->open_file_write(this->path_.c_str(), mode, FileStream::UNBUFFERED);
+  if (this->file_ == nullptr) {
+    ESP_LOGE(TAG, "Failed to open %s", this->path_.c_str());
+    return false;
+  }
+  uint64_t size = this->file_->size();
+
+  // A power loss can leave a torn or half-extended last block: drop everything after
+  // the last block whose CRC checks out.
+  uint32_t blocks = size / this->block_size_;
+  while (blocks > 0 && !(this->read_block_(blocks - 1, this->block_) && this->block_valid_(this->block_, blocks - 1)))
+    blocks--;
+  uint64_t valid_size = static_cast<uint64_t>(blocks) * this->block_size_;
+  if (valid_size != size) {
+    ESP_LOGW(TAG, "%s: dropping %s of incomplete data", this->path_.c_str(), format_size(size - valid_size).c_str());
+    if (!this->file_->truncate(valid_size))
+      ESP_LOGE(TAG, "Failed to truncate %s", this->path_.c_str());
+    this->file_resized_(this->path_, size, valid_size);
+  }
+  this->disk_blocks_ = blocks;
+
+  if (blocks > 0) {
+    // Keep filling the last block; it is already in the buffer from the check above.
+    this->block_index_ = blocks - 1;
+    this->block_used_ = get<uint16_t>(this->block_, USED_OFFSET);
+    this->block_dirty_ = false;
+    this->last_timestamp_ = get<uint64_t>(this->block_, LAST_TIME_OFFSET);
+    this->read_first_timestamp_(0, this->first_timestamp_);
+  } else {
+    this->reset_block_(0);
+  }
+
+  if (!this->recover_index_())
+    ESP_LOGW(TAG, "%s: time index unavailable, queries will scan from the start", this->path_.c_str());
+  this->last_sync_ = millis();
+  ESP_LOGD(TAG, "Opened %s: %u blocks, %u index entries", this->path_.c_str(), this->disk_blocks_,
+           this->index_entries_);
+  return true;
+}
+
+void RecordStore::close_files_() {
+  this->file_.reset();
+  this->index_file_.reset();
+  this->index_entries_ = 0;
+}
+
+bool RecordStore::reopen_() {
+  if (this->file_ != nullptr && this->file_->is_open())
+    return true;
+  if (!this->parent_->is_mounted())
+    return false;
+  ESP_LOGI(TAG, "Reopening %s after an unmount", this->path_.c_str());
+  // Records appended since the last write survive if the card still ends with that write
+  uint8_t *pending = this->block_dirty_ ? allocate_stream_buffer(this->block_size_) : nullptr;
+  if (pending != nullptr)
+    memcpy(pending, this->block_, this->block_size_);
+  uint32_t block_index = this->block_index_;
+  size_t block_used = this->block_used_;
+  uint32_t disk_blocks = this->disk_blocks_;
+  uint64_t first_timestamp = this->first_timestamp_;
+  uint64_t last_timestamp = this->last_timestamp_;
+
+  this->close_files_();
+  bool ok = this->open_files_();
+  if (ok && pending != nullptr && this->disk_blocks_ == disk_blocks &&
+      (disk_blocks == 0 || get<uint32_t>(this->block_, CRC_OFFSET) == this->written_crc_)) {
+    memcpy(this->block_, pending, this->block_size_);
+    this->block_index_ = block_index;
+    this->block_used_ = block_used;
+    this->block_dirty_ = true;
+    this->first_timestamp_ = first_timestamp;
+    this->last_timestamp_ = last_timestamp;
+  } else if (pending != nullptr) {
+    ESP_LOGW(TAG, "%s changed while unmounted, records not yet written are lost", this->path_.c_str());
+  }
+  free_stream_buffer(pending);
+  return ok;
+}
+
+void RecordStore::loop_(uint32_t now) {
+  // A range() in progress must not hold up the main loop: retried on the next one
+  std::unique_lock<std::mutex> lock(this->mutex_, std::try_to_lock);
+  if (!lock.owns_lock() || !this->open_ || !this->block_dirty_ || now - this->last_sync_ < this->sync_interval_)
+    return;
+  PathLocks::Guard data_lock, index_lock;
+  this->lock_(data_lock, index_lock);
+  if (this->file_ != nullptr && this->file_->is_open())
+    this->write_block_();
+}
+
+bool RecordStore::append(uint64_t timestamp, const uint8_t *data, size_t len) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (!this->open_)
+    return false;
+  if (len > this->max_record_size()) {
+    ESP_LOGE(TAG, "Record of %zu bytes exceeds the %zu bytes limit", len, this->max_record_size());
+    return false;
+  }
+  PathLocks::Guard data_lock, index_lock;
+  this->lock_(data_lock, index_lock);
+  if (!this->reopen_())
+    return false;
+  bool empty = this->block_index_ == 0 && this->record_count_() == 0;
+  if (!empty && timestamp < this->last_timestamp_) {
+    ESP_LOGW(TAG, "Rejecting out of order record in %s", this->path_.c_str());
+    return false;
+  }
+
+  if (this->record_count_() > 0) {
+    uint64_t block_first = get<uint64_t>(this->block_, FIRST_TIME_OFFSET);
+    if (this->block_used_ + RECORD_HEADER_SIZE + len > this->block_size_ || timestamp - block_first > UINT32_MAX) {
+      if (!this->write_block_())
+        return false;
+      this->reset_block_(this->block_index_ + 1);
+    }
+  }
+  uint16_t count = this->record_count_();
+  if (count == 0)
+    put<uint64_t>(this->block_, FIRST_TIME_OFFSET, timestamp);
+  uint32_t delta = timestamp - get<uint64_t>(this->block_, FIRST_TIME_OFFSET);
+  put<uint32_t>(this->block_, this->block_used_, delta);
+  put<uint16_t>(this->block_, this->block_used_ + 4, len);
+  memcpy(this->block_ + this->block_used_ + RECORD_HEADER_SIZE, data, len);
+  this->block_used_ += RECORD_HEADER_SIZE + len;
+  put<uint16_t>(this->block_, COUNT_OFFSET, count + 1);
+  put<uint64_t>(this->block_, LAST_TIME_OFFSET, timestamp);
+  this->block_dirty_ = true;
+
+  if (empty)
+    this->first_timestamp_ = timestamp;
+  this->last_timestamp_ = timestamp;
+  if (millis() - this->last_sync_ >= this->sync_interval_)
+    return this->write_block_();
+  return true;
+}
+
+bool RecordStore::sync() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (!this->open_)
+    return false;
+  PathLocks::Guard data_lock, index_lock;
+  this->lock_(data_lock, index_lock);
+  return this->reopen_() && this->write_block_();
+}
+
+bool RecordStore::range(uint64_t from, uint64_t to, RecordCallback const &callback) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (!this->open_)
+    return false;
+  PathLocks::Guard data_lock, index_lock;
+  this->lock_(data_lock, index_lock);
+  if (!this->reopen_())
+    return false;
+  uint8_t *buffer = allocate_stream_buffer(this->block_size_);
+  if (buffer == nullptr)
+    return false;
+
+  bool done = false;
+  bool ok = true;
+  uint32_t block = this->find_block_(from);
+  // Blocks before the current one are complete on the card; the current one is read from RAM,
+  // its on-card copy may be older.
+  for (; !done && block < this->block_index_; block++) {
+    bool read = this->read_block_(block, buffer);
+    // Unmounted during the scan: the remaining blocks are not corrupted, just out of reach
+    if (!read && !this->file_->is_open()) {
+      ok = false;
+      break;
+    }
+    if (!read || !this->block_valid_(buffer, block)) {
+      ESP_LOGW(TAG, "%s: skipping corrupted block %u", this->path_.c_str(), block);
+      continue;
+    }
+    if (get<uint64_t>(buffer, FIRST_TIME_OFFSET) > to) {
+      done = true;
+      break;
+    }
+    this->scan_block_(buffer, from, to, callback, done);
+  }
+  if (ok && !done && block == this->block_index_)
+    this->scan_block_(this->block_, from, to, callback, done);
+  free_stream_buffer(buffer);
+  return ok;
+}
+
+uint16_t RecordStore::record_count_() const {
+  return this->block_ == nullptr ? 0 : get<uint16_t>(this->block_, COUNT_OFFSET);
+}
+
+bool RecordStore::write_block_() {
+  if (!this->block_dirty_)
+    return true;
+  put<uint16_t>(this->block_, USED_OFFSET, this->block_used_);
+  uint32_t crc = block_crc(this->block_, this->block_used_);
+  put<uint32_t>(this->block_, CRC_OFFSET, crc);
+
+  uint64_t offset = static_cast<uint64_t>(this->block_index_) * this->block_size_;
+  // The sync commits the file length in the directory entry, without it a new block is lost on power loss.
+  bool ok = this->file_->pwrite(this->block_, this->block_size_, offset) == this->block_size_ && this->file_->sync();
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to write block %u of %s", this->block_index_, this->path_.c_str());
+    return false;
+  }
+  this->blocks_written_++;
+  this->written_crc_ = crc;
+  this->last_sync_ = millis();
+  this->block_dirty_ = false;
+
+  if (this->block_index_ >= this->disk_blocks_) {
+    this->file_resized_(this->path_, static_cast<uint64_t>(this->disk_blocks_) * this->block_size_,
+                        offset + this->block_size_);
+    this->disk_blocks_ = this->block_index_ + 1;
+  }
+  if (this->block_index_ == this->index_entries_ * INDEX_STRIDE)
+    this->append_index_(this->block_index_, get<uint64_t>(this->block_, FIRST_TIME_OFFSET));
+  return true;
+}
+
+bool RecordStore::read_block_(uint32_t block, uint8_t *buffer) {
+  return this->file_->pread(buffer, this->block_size_, static_cast<uint64_t>(block) * this->block_size_) ==
+         this->block_size_;
+}
+
+bool RecordStore::block_valid_(const uint8_t *buffer, uint32_t block) const {
+  uint16_t used = get<uint16_t>(buffer, USED_OFFSET);
+  return get<uint32_t>(buffer, MAGIC_OFFSET) == BLOCK_MAGIC && get<uint32_t>(buffer, NUMBER_OFFSET) == block &&
+         used >= HEADER_SIZE && used <= this->block_size_ &&
+         get<uint32_t>(buffer, CRC_OFFSET) == block_crc(buffer, used);
+}
+
+void RecordStore::reset_block_(uint32_t block) {
+  memset(this->block_, 0, this->block_size_);
+  put<uint32_t>(this->block_, MAGIC_OFFSET, BLOCK_MAGIC);
+  put<uint32_t>(this->block_, NUMBER_OFFSET, block);
+  this->block_index_ = block;
+  this->block_used_ = HEADER_SIZE;
+  this->block_dirty_ = false;
+}
+
+bool RecordStore::read_first_timestamp_(uint32_t block, uint64_t &timestamp) {
+  uint64_t offset = static_cast<uint64_t>(block) * this->block_size_ + FIRST_TIME_OFFSET;
+  return this->file_->pread(reinterpret_cast<uint8_t *>(&timestamp), sizeof(timestamp), offset) == sizeof(timestamp);
+}
+
+bool RecordStore::recover_index_() {
+  const char *mode = this->parent_->exists(this->index_path_.c_str()) ? "r+b" : "w+b";
+  this->index_file_ = this->parent_->open_file_write(this->index_path_.c_str(), mode, FileStream::UNBUFFERED);
+  if (this->index_file_ == nullptr)
+    return false;
+  uint64_t size = this->index_file_->size();
+
+  // Entries pointing past the recovered data, or torn by a power loss, are dropped...
+  uint32_t entries = size / sizeof(IndexEntry);
+  IndexEntry entry;
+  while (entries > 0 && !(this->read_index_(entries - 1, entry) && entry.block == (entries - 1) * INDEX_STRIDE &&
+                          entry.block < this->disk_blocks_))
+    entries--;
+  uint64_t valid_size = static_cast<uint64_t>(entries) * sizeof(IndexEntry);
+  if (valid_size != size) {
+    if (!this->index_file_->truncate(valid_size))
+      return false;
+    this->file_resized_(this->index_path_, size, valid_size);
+  }
+  this->index_entries_ = entries;
+
+  // ...and entries whose data block reached the card before the index write are rebuilt.
+  for (uint32_t block = entries * INDEX_STRIDE; block < this->disk_blocks_; block += INDEX_STRIDE) {
+    uint64_t timestamp;
+    if (!this->read_first_timestamp_(block, timestamp) || !this->append_index_(block, timestamp))
+      return false;
+  }
+  return true;
+}
+
+bool RecordStore::append_index_(uint32_t block, uint64_t timestamp) {
+  if (this->index_file_ == nullptr)
+    return false;
+  IndexEntry entry{timestamp, block, 0};
+  uint64_t offset = static_cast<uint64_t>(this->index_entries_) * sizeof(IndexEntry);
+  bool ok = this->index_file_->pwrite(reinterpret_cast<const uint8_t *>(&entry), sizeof(entry), offset) ==
+                sizeof(entry) &&
+            this->index_file_->sync();
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to write index entry for block %u", block);
+    return false;
+  }
+  this->index_entries_++;
+  this->file_resized_(this->index_path_, offset, offset + sizeof(entry));
+  return true;
+}
+
+bool RecordStore::read_index_(uint32_t entry, IndexEntry &index_entry) {
+  return this->index_file_->pread(reinterpret_cast<uint8_t *>(&index_entry), sizeof(index_entry),
+                                  static_cast<uint64_t>(entry) * sizeof(IndexEntry)) == sizeof(index_entry);
+}
+
+uint32_t RecordStore::find_block_(uint64_t timestamp) {
+  // Binary search for the last indexed block starting at or before `timestamp`
+  uint32_t low = 0;
+  uint32_t high = this->index_entries_;
+  uint32_t block = 0;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    IndexEntry entry;
+    if (!this->read_index_(middle, entry))
+      return block;
+    if (entry.timestamp <= timestamp) {
+      block = entry.block;
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return block;
+}
+
+void RecordStore::scan_block_(const uint8_t *buffer, uint64_t from, uint64_t to, RecordCallback const &callback,
+                              bool &done) {
+  uint64_t first = get<uint64_t>(buffer, FIRST_TIME_OFFSET);
+  uint16_t count = get<uint16_t>(buffer, COUNT_OFFSET);
+  size_t used = std::min<size_t>(get<uint16_t>(buffer, USED_OFFSET), this->block_size_);
+  if (buffer == this->block_)
+    used = this->block_used_;
+  size_t position = HEADER_SIZE;
+  for (uint16_t i = 0; i < count && position + RECORD_HEADER_SIZE <= used; i++) {
+    uint64_t timestamp = first + get<uint32_t>(buffer, position);
+    uint16_t len = get<uint16_t>(buffer, position + 4);
+    if (position + RECORD_HEADER_SIZE + len > used)
+      break;
+    if (timestamp > to) {
+      done = true;
+      return;
+    }
+    if (timestamp >= from && !callback(timestamp, buffer + position + RECORD_HEADER_SIZE, len)) {
+      done = true;
+      return;
+    }
+    position += RECORD_HEADER_SIZE + len;
+  }
+}
+
+void RecordStore::file_resized_(std::string const &path, uint64_t old_size, uint64_t new_size) {
+  this->parent_->account_file_change(old_size, new_size);
+  MetadataIndex *index = this->parent_->get_metadata_index();
+  if (index != nullptr)
+    index->put(path.c_str(), FileMetadata::file(new_size));
+}
+
+void SdMmc::register_record_store(RecordStore *store) {
+  std::lock_guard<std::mutex> lock(this->record_stores_mutex_);
+  this->record_stores_.push_back(store);
+}
+
+void SdMmc::unregister_record_store(RecordStore *store) {
+  std::lock_guard<std::mutex> lock(this->record_stores_mutex_);
+  auto it = std::find(this->record_stores_.begin(), this->record_stores_.end(), store);
+  if (it != this->record_stores_.end())
+    this->record_stores_.erase(it);
+}
+
+void SdMmc::loop_record_stores_(uint32_t now) {
+  std::lock_guard<std::mutex> lock(this->record_stores_mutex_);
+  for (RecordStore *store : this->record_stores_)
+    store->loop_(now);
+}
+
+void SdMmc::sync_record_stores_() {
+  std::lock_guard<std::mutex> lock(this->record_stores_mutex_);
+  for (RecordStore *store : this->record_stores_)
+    store->sync();
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
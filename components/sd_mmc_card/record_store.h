@@ -0,0 +1,116 @@
+#pragma once
+#include "sd_mmc_card.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+// Journal binaire en ajout seul, horodaté, avec index temporel creux.
+//
+// Le fichier de données est une suite de blocs de `block_size` octets (multiple de 512,
+// au plus MAX_BLOCK_SIZE : taille et nombre d'enregistrements tiennent sur 16 bits).
+// Chaque bloc commence par un en-tête (numéro, premier/dernier horodatage, nombre
+// d'enregistrements, CRC32) suivi des enregistrements : delta de temps sur 32 bits,
+// taille sur 16 bits, puis les données. Un enregistrement ne chevauche jamais deux blocs.
+//
+// Le bloc courant est gardé en RAM et réécrit en place à chaque sync(), puis écrit une
+// dernière fois quand il est plein. SdMmc::loop() le synchronise au plus tard
+// sync_interval ms après l'ajout qui l'a modifié, et le démontage avant de démonter. Le
+// fichier `<path>.idx` reçoit une entrée (horodatage, numéro de bloc) tous les INDEX_STRIDE
+// blocs. À l'ouverture, les blocs de fin dont le CRC est invalide sont tronqués et l'index
+// est réaligné sur les données.
+//
+// Les fichiers passent par des FileStream de SdMmc et chaque opération prend les verrous
+// exclusifs des deux chemins. Après un démontage, le journal est rouvert à la première
+// opération, carte remontée, et récupéré comme après une coupure ; le bloc en RAM est gardé
+// si le fichier se termine toujours par le dernier bloc écrit.
+class RecordStore {
+ public:
+  static constexpr size_t HEADER_SIZE = 32;
+  static constexpr size_t RECORD_HEADER_SIZE = 6;
+  static constexpr uint32_t INDEX_STRIDE = 8;
+  static constexpr size_t MAX_BLOCK_SIZE = 32768;
+
+  // Reçoit l'horodatage et les données d'un enregistrement ; renvoie false pour arrêter
+  using RecordCallback = std::function<bool(uint64_t timestamp, const uint8_t *data, size_t len)>;
+
+  RecordStore(SdMmc *parent, std::string path, size_t block_size = 512);
+  ~RecordStore();
+
+  // Ouvre (ou crée) le journal et répare une fin de fichier incomplète
+  bool open();
+  void close();
+  bool is_open() const { return this->open_; }
+
+  // Ajoute un enregistrement ; les horodatages doivent être croissants
+  bool append(uint64_t timestamp, const uint8_t *data, size_t len);
+  // Écrit le bloc courant sur la carte (sans le clore)
+  bool sync();
+  // Appelle `callback` pour chaque enregistrement dont l'horodatage est dans [from, to]
+  bool range(uint64_t from, uint64_t to, RecordCallback const &callback);
+
+  // Délai maximal pendant lequel un bloc partiellement rempli reste uniquement en RAM (hors
+  // coupure de la boucle principale)
+  void set_sync_interval(uint32_t interval) { this->sync_interval_ = interval; }
+  size_t max_record_size() const { return this->block_size_ - HEADER_SIZE - RECORD_HEADER_SIZE; }
+  uint32_t block_count() const { return this->block_index_ + (this->record_count_() > 0 ? 1 : 0); }
+  uint64_t first_timestamp() const { return this->first_timestamp_; }
+  uint64_t last_timestamp() const { return this->last_timestamp_; }
+  uint32_t blocks_written() const { return this->blocks_written_; }
+
+ protected:
+  friend class SdMmc;
+  struct IndexEntry {
+    uint64_t timestamp;
+    uint32_t block;
+    uint32_t reserved;
+  };
+
+  // Appelé par SdMmc::loop() : écrit le bloc courant si sync_interval est écoulé
+  void loop_(uint32_t now);
+  // Ouvre les fichiers et récupère leur fin, avec les verrous déjà pris
+  bool open_files_();
+  void close_files_();
+  // Rouvre les fichiers fermés par un démontage
+  bool reopen_();
+  // Verrous exclusifs des deux fichiers, pris dans l'ordre commun à toutes les paires
+  void lock_(PathLocks::Guard &data, PathLocks::Guard &index);
+  uint16_t record_count_() const;
+  bool write_block_();
+  bool read_block_(uint32_t block, uint8_t *buffer);
+  bool block_valid_(const uint8_t *buffer, uint32_t block) const;
+  void reset_block_(uint32_t block);
+  bool read_first_timestamp_(uint32_t block, uint64_t &timestamp);
+  bool recover_index_();
+  bool append_index_(uint32_t block, uint64_t timestamp);
+  bool read_index_(uint32_t entry, IndexEntry &index_entry);
+  uint32_t find_block_(uint64_t timestamp);
+  void scan_block_(const uint8_t *buffer, uint64_t from, uint64_t to, RecordCallback const &callback, bool &done);
+  void file_resized_(std::string const &path, uint64_t old_size, uint64_t new_size);
+
+  SdMmc *parent_;
+  std::string path_;
+  std::string index_path_;
+  size_t block_size_;
+  bool open_{false};
+  std::unique_ptr<FileStream> file_;
+  std::unique_ptr<FileStream> index_file_;
+  uint8_t *block_{nullptr};
+  // Numéro du bloc courant (en RAM) ; les blocs précédents sont complets sur la carte
+  uint32_t block_index_{0};
+  size_t block_used_{HEADER_SIZE};
+  bool block_dirty_{false};
+  // Nombre de blocs présents dans le fichier
+  uint32_t disk_blocks_{0};
+  uint32_t index_entries_{0};
+  uint64_t first_timestamp_{0};
+  uint64_t last_timestamp_{0};
+  uint32_t sync_interval_{1000};
+  uint32_t last_sync_{0};
+  uint32_t blocks_written_{0};
+  // CRC du dernier bloc écrit, pour reconnaître la fin du fichier à la réouverture
+  uint32_t written_crc_{0};
+  std::mutex mutex_;
+};
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
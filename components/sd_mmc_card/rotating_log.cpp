@@ -0,0 +1,306 @@
+#include "sd_mmc_card.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_rotating_log";
+static const char *const STATE_FILE = "/.log_state";
+static const char *const SEGMENT_EXTENSION = ".log";
+static constexpr size_t SEGMENT_BUFFER_SIZE = 4096;
+
+RotatingLog::RotatingLog(SdMmc *parent, std::string directory, size_t max_file_size)
+    : parent_(parent), directory_(std::move(directory)), max_file_size_(max_file_size) {
+  if (!this->directory_.empty() && this->directory_.back() == '/')
+    this->directory_.pop_back();
+}
+
+RotatingLog::~RotatingLog() { this->stop(); }
+
+std::string RotatingLog::segment_path(uint32_t number) const {
+  char name[16];
+  snprintf(name, sizeof(name), "/%08u%s", number, SEGMENT_EXTENSION);
+  return this->directory_ + name;
+}
+
+size_t RotatingLog::segment_count() const {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->segments_.size() + (this->file_ != nullptr ? 1 : 0);
+}
+
+void RotatingLog::start() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (!this->parent_->is_directory(this->directory_) && !this->parent_->create_directory(this->directory_.c_str())) {
+    ESP_LOGE(TAG, "Cannot create log directory %s", this->directory_.c_str());
+    return;
+  }
+  this->state_path_ = this->directory_ + STATE_FILE;
+  const char *mode = this->parent_->exists(this->state_path_) ? "r+b" : "w+b";
+  this->state_file_ = this->parent_->open_file_write(this->state_path_, mode, FileStream::UNBUFFERED);
+
+  this->recover_();
+  uint32_t next = this->segments_.empty() ? 1 : this->segments_.back().number + 1;
+  if (this->open_segment_(next))
+    this->schedule_prune_();
+}
+
+void RotatingLog::stop() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->close_segment_();
+    if (this->state_file_ != nullptr) {
+      this->state_file_->close();
+      this->state_file_.reset();
+    }
+  }
+  // Without the mutex: the pass takes it to pick each segment
+  if (this->prune_thread_.joinable())
+    this->prune_thread_.join();
+  this->prune_done_ = false;
+  this->prune_pending_ = false;
+}
+
+void RotatingLog::recover_() {
+  State state{};
+  bool has_state = this->state_file_ != nullptr &&
+                   this->state_file_->pread(reinterpret_cast<uint8_t *>(&state), sizeof(state), 0) == sizeof(state);
+
+  std::vector<Segment> found;
+  WalkOptions options;
+  options.type = WalkType::FILES;
+  options.extension = SEGMENT_EXTENSION;
+  this->parent_->walk_directory(
+      this->directory_,
+      [&found](DirEntry const &entry) {
+        char *end;
+        unsigned long number = strtoul(entry.name, &end, 10);
+        if (number > 0 && strcmp(end, SEGMENT_EXTENSION) == 0)
+          found.push_back(Segment{static_cast<uint32_t>(number), entry.size, entry.mtime});
+        return true;
+      },
+      options);
+  std::sort(found.begin(), found.end(), [](Segment const &a, Segment const &b) { return a.number < b.number; });
+
+  // Only the newest segment can still carry unwritten preallocated space: older ones were
+  // truncated when they were closed.
+  if (!found.empty()) {
+    Segment &newest = found.back();
+    uint64_t valid = newest.size;
+    if (has_state && state.number == newest.number) {
+      valid = std::min<uint64_t>(state.position, newest.size);
+    } else if (has_state && state.number < newest.number) {
+      // Created, but the power went before its first state write
+      valid = 0;
+    }
+    std::string path = this->segment_path(newest.number);
+    if (valid == 0) {
+      ESP_LOGW(TAG, "Dropping empty segment %s", path.c_str());
+      this->parent_->delete_file(path.c_str());
+      found.pop_back();
+    } else if (valid < newest.size) {
+      ESP_LOGW(TAG, "Trimming %s of unwritten space from %s", format_size(newest.size - valid).c_str(), path.c_str());
+      auto guard = this->parent_->get_path_locks().lock_exclusive(path.c_str());
+      auto file = this->parent_->open_file_write(path, "r+b", FileStream::UNBUFFERED);
+      if (file != nullptr && file->truncate(valid)) {
+        this->parent_->account_file_change(newest.size, valid);
+        newest.size = valid;
+      }
+    }
+  }
+
+  this->segments_.assign(found.begin(), found.end());
+  ESP_LOGD(TAG, "Found %zu segments in %s", this->segments_.size(), this->directory_.c_str());
+}
+
+bool RotatingLog::open_segment_(uint32_t number) {
+  std::string path = this->segment_path(number);
+  bool preallocated = this->parent_->preallocate_file(path.c_str(), this->max_file_size_);
+  // Through SdMmc: counted in the statistics and closed by an unmount
+  auto file = this->parent_->open_file_write(path, preallocated ? "r+b" : "wb", SEGMENT_BUFFER_SIZE);
+  if (file == nullptr) {
+    ESP_LOGE(TAG, "Failed to open segment %s", path.c_str());
+    return false;
+  }
+  this->file_ = std::move(file);
+  this->path_ = std::move(path);
+  this->number_ = number;
+  this->position_ = 0;
+  this->allocated_ = preallocated ? this->max_file_size_ : 0;
+  this->dirty_bytes_ = 0;
+  this->pending_writes_ = 0;
+  this->last_sync_ = millis();
+  this->parent_->account_file_change(0, this->allocated_);
+  this->write_state_();
+  return true;
+}
+
+void RotatingLog::close_segment_() {
+  if (this->file_ == nullptr)
+    return;
+  {
+    auto guard = this->parent_->get_path_locks().lock_exclusive(this->path_.c_str());
+    this->file_->flush();
+    // Give back the preallocated clusters that were not used
+    if (this->allocated_ > this->position_) {
+      if (this->file_->truncate(this->position_)) {
+        this->parent_->account_file_change(this->allocated_, this->position_);
+        this->allocated_ = this->position_;
+      } else {
+        ESP_LOGW(TAG, "Failed to trim segment %u", this->number_.load());
+      }
+    }
+    this->file_->close();
+  }
+  this->file_.reset();
+  this->dirty_bytes_ = 0;
+  this->pending_writes_ = 0;
+  this->write_state_();
+  this->segments_.push_back(Segment{this->number_, this->allocated_, time(nullptr)});
+}
+
+bool RotatingLog::rotate_() {
+  uint32_t start = millis();
+  this->close_segment_();
+  bool ok = this->open_segment_(this->number_ + 1);
+  this->rotation_latency_ = millis() - start;
+  this->rotations_++;
+  ESP_LOGD(TAG, "Rotated to segment %u in %u ms", this->number_.load(), this->rotation_latency_.load());
+  this->schedule_prune_();
+  return ok;
+}
+
+bool RotatingLog::append(const uint8_t *data, size_t len) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (this->file_ == nullptr)
+    return false;
+  if (this->position_ > 0 && this->position_ + len > this->max_file_size_ && !this->rotate_())
+    return false;
+  auto guard = this->parent_->get_path_locks().lock_exclusive(this->path_.c_str());
+  size_t written = this->file_->write(data, len);
+  this->position_ += written;
+  this->dirty_bytes_ += written;
+  this->pending_writes_++;
+  this->bytes_written_ += written;
+  if (this->position_ > this->allocated_) {
+    this->parent_->account_file_change(this->allocated_, this->position_);
+    this->allocated_ = this->position_;
+  }
+  if (written != len) {
+    ESP_LOGE(TAG, "Failed to append to segment %u", this->number_.load());
+    return false;
+  }
+  return true;
+}
+
+bool RotatingLog::sync() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->sync_();
+}
+
+bool RotatingLog::sync_() {
+  if (this->file_ == nullptr)
+    return false;
+  uint32_t start = micros();
+  bool ok;
+  {
+    auto guard = this->parent_->get_path_locks().lock_exclusive(this->path_.c_str());
+    ok = this->file_->sync();
+  }
+  if (this->pending_writes_ > 0)
+    this->parent_->record_sync(micros() - start, 1, this->pending_writes_);
+  this->dirty_bytes_ = 0;
+  this->pending_writes_ = 0;
+  this->last_sync_ = millis();
+  // Data first, then the position that marks it valid
+  if (ok)
+    this->write_state_();
+  return ok;
+}
+
+void RotatingLog::loop(uint32_t now) {
+  // An append in progress on another task: try again on the next loop rather than wait for it
+  std::unique_lock<std::mutex> lock(this->mutex_, std::try_to_lock);
+  if (!lock.owns_lock())
+    return;
+  if (this->dirty_bytes_ > 0 && now - this->last_sync_ >= this->sync_interval_)
+    this->sync_();
+  // The pass is over and no longer needs the mutex
+  if (this->prune_done_) {
+    this->prune_thread_.join();
+    this->prune_done_ = false;
+    // Rotations that happened while the previous pass was running
+    if (this->prune_pending_)
+      this->schedule_prune_();
+  }
+}
+
+void RotatingLog::write_state_() {
+  if (this->state_file_ == nullptr)
+    return;
+  State state{this->number_, static_cast<uint32_t>(this->position_)};
+  auto guard = this->parent_->get_path_locks().lock_exclusive(this->state_path_.c_str());
+  if (this->state_file_->pwrite(reinterpret_cast<const uint8_t *>(&state), sizeof(state), 0) != sizeof(state) ||
+      !this->state_file_->sync())
+    ESP_LOGW(TAG, "Failed to save log state");
+}
+
+void RotatingLog::schedule_prune_() {
+  if (this->max_files_ == 0 && this->max_total_bytes_ == 0 && this->max_age_ == 0)
+    return;
+  this->prune_pending_ = this->prune_thread_.joinable();
+  if (this->prune_pending_)
+    return;
+  this->prune_thread_ = start_worker_thread("sd_log_prune", 4096, [this]() {
+    this->prune_();
+    this->prune_done_ = true;
+  });
+}
+
+void RotatingLog::prune_() {
+  time_t now = time(nullptr);
+  bool check_age = this->max_age_ != 0 && now >= MIN_VALID_TIME;
+  while (true) {
+    Segment oldest;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      if (this->segments_.empty())
+        return;
+      // The current segment counts towards the limits with everything it has reserved
+      size_t count = this->segments_.size() + (this->file_ != nullptr ? 1 : 0);
+      uint64_t total = this->allocated_;
+      for (auto &segment : this->segments_)
+        total += segment.size;
+      oldest = this->segments_.front();
+      bool expired = (this->max_files_ != 0 && count > this->max_files_) ||
+                     (this->max_total_bytes_ != 0 && total > this->max_total_bytes_) ||
+                     (check_age && oldest.modified != 0 && now - oldest.modified > static_cast<time_t>(this->max_age_));
+      if (!expired)
+        return;
+      this->segments_.pop_front();
+    }
+    ESP_LOGD(TAG, "Removing segment %u (%s)", oldest.number, format_size(oldest.size).c_str());
+    this->parent_->delete_file(this->segment_path(oldest.number).c_str());
+  }
+}
+
+RotatingLog *SdMmc::set_rotating_log(std::string const &directory, size_t max_file_size) {
+  this->rotating_log_ = std::make_unique<RotatingLog>(this, directory, max_file_size);
+  return this->rotating_log_.get();
+}
+
+bool SdMmc::append_log(const uint8_t *data, size_t len) {
+  if (this->rotating_log_ == nullptr) {
+    ESP_LOGE(TAG, "No rotating_log configured");
+    return false;
+  }
+  return this->rotating_log_->append(data, len);
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
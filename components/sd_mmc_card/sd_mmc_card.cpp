@@ -1,44 +1,373 @@
 #include "sd_mmc_card.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
 
 #include "math.h"
+#include "esphome/core/hal.h"
 #include "esphome/core/log.h"
 
+#ifdef USE_ESP32
+#include "esp_heap_caps.h"
+#include "esp_pthread.h"
+#include "esp_rom_crc.h"
+#endif
+
 namespace esphome {
 namespace sd_mmc_card {
 
 static const char *TAG = "sd_mmc_card";
 
-bool SdMmc::exists(const std::string &path) {
-  FILE *file = fopen(path.c_str(), "rb");
-  if (file != nullptr) {
-    fclose(file);
+bool SdMmc::exists(const char *path) {
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::STAT);
+  FileMetadata metadata;
+  return this->stat_(path, metadata);
+}
+
+bool SdMmc::exists(std::string_view path) { return this->exists(PathBuffer(path).c_str()); }
+
+size_t SdMmc::get_file_size(const char *path) {
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::STAT);
+  FileMetadata metadata;
+  if (!this->stat_(path, metadata) || metadata.is_directory)
+    return 0;
+  return metadata.size;
+}
+
+size_t SdMmc::get_file_size(std::string_view path) { return this->get_file_size(PathBuffer(path).c_str()); }
+
+bool SdMmc::is_directory(const char *path) {
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::STAT);
+  FileMetadata metadata;
+  return this->stat_(path, metadata) && metadata.is_directory;
+}
+
+size_t SdMmc::file_size(const char *path) {
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::STAT);
+  FileMetadata metadata;
+  if (!this->stat_(path, metadata)) {
+    ESP_LOGE(TAG, "Failed to stat file: %s", path);
+    timer.set_ok(false);
+    return -1;
+  }
+  return metadata.size;
+}
+
+bool SdMmc::stat_(const char *path, FileMetadata &metadata) {
+  MountGuard mounted(this);
+  if (!mounted) {
+    metadata = FileMetadata::missing();
+    return false;
+  }
+  // FatFS cannot stat the volume root
+  if (path[0] == '\0' || strcmp(path, "/") == 0) {
+    metadata = FileMetadata::directory();
     return true;
   }
-  return false;
+  if (this->metadata_index_ != nullptr && this->metadata_index_->find(path, metadata))
+    return metadata.exists;
+
+  this->flush_pooled_file(path);
+#ifdef USE_HOST
+  host_bus_transfer(0, false);
+#endif
+  struct stat info;
+  if (stat(build_path(path).c_str(), &info) == 0) {
+    bool directory = S_ISDIR(info.st_mode);
+    metadata = FileMetadata{true, directory, directory ? 0 : static_cast<uint64_t>(info.st_size), info.st_mtime};
+  } else if (errno == ENOENT || errno == ENOTDIR) {
+    metadata = FileMetadata::missing();
+  } else {
+    ESP_LOGW(TAG, "Failed to stat %s: %s", path, strerror(errno));
+    metadata = FileMetadata::missing();
+    return false;
+  }
+  if (this->metadata_index_ != nullptr)
+    this->metadata_index_->put(path, metadata);
+  return metadata.exists;
 }
 
-size_t SdMmc::get_file_size(const std::string &path) {
-  FILE *file = fopen(path.c_str(), "rb");
-  if (file == nullptr) {
-    return 0;
+void SdMmc::update_metadata_(const char *path, FileMetadata const &metadata) {
+  if (this->metadata_index_ != nullptr)
+    this->metadata_index_->put(path, metadata);
+}
+
+void SdMmc::invalidate_metadata_(const char *path, bool recursive) {
+  if (this->metadata_index_ == nullptr)
+    return;
+  if (recursive) {
+    this->metadata_index_->invalidate_prefix(path);
+  } else {
+    this->metadata_index_->invalidate(path);
   }
-  fseek(file, 0, SEEK_END);
-  size_t size = ftell(file);
-  fclose(file);
-  return size;
+}
+
+void SdMmc::set_metadata_cache_size(size_t size) { this->metadata_index_ = std::make_unique<MetadataIndex>(size); }
+
+void SdMmc::set_sector_cache_size(size_t size) {
+  this->sector_cache_ = std::make_unique<SectorCache>(size);
+  if (!this->sector_cache_->ok())
+    this->sector_cache_.reset();
 }
 
 #ifdef USE_SENSOR
 FileSizeSensor::FileSizeSensor(sensor::Sensor *sensor, std::string const &path) : sensor(sensor), path(path) {}
 #endif
 
-void SdMmc::loop() {}
+void SdMmc::loop() {
+  uint32_t now = millis();
+  this->poll_card_detect_(now);
+  if (this->mount_done_)
+    this->finish_mount_();
+  if (this->card_state_ == CardState::UNMOUNTED && this->auto_mount_ && this->card_present_ &&
+      this->mount_retry_interval_ != 0 && now - this->mount_start_ >= this->mount_retry_interval_)
+    this->start_mount_();
+  if (this->checksum_done_)
+    this->finish_checksum_();
+  this->poll_file_operation_(now);
+  if (this->find_done_)
+    this->finish_find_();
+  if (this->write_queue_ != nullptr && now - this->last_queue_publish_ >= 1000) {
+    this->last_queue_publish_ = now;
+    this->publish_write_queue_sensors();
+  }
+  if (!this->is_mounted())
+    return;
+  this->handle_io_errors_();
+  this->lower_bus_clock_();
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->flush_due(now);
+  if (this->rotating_log_ != nullptr)
+    this->rotating_log_->loop(now);
+  this->loop_record_stores_(now);
+}
+
+void SdMmc::update() {
+  if (this->space_scan_done_)
+    this->finish_space_scan();
+  if (this->is_mounted() && this->space_valid_ && !this->space_thread_.joinable() &&
+      millis() - this->last_space_scan_ >= this->space_reconcile_interval_)
+    this->start_space_scan();
+  this->update_sensors();
+}
+
+void SdMmc::on_shutdown() {
+  if (this->mount_thread_.joinable())
+    this->mount_thread_.join();
+  if (this->write_queue_ != nullptr) {
+    if (this->write_queue_->is_paused() && this->write_queue_->depth() > 0)
+      ESP_LOGW(TAG, "Card not mounted, %zu queued writes are lost", this->write_queue_->depth());
+    this->write_queue_->flush();
+    this->write_queue_->stop();
+  }
+  if (this->rotating_log_ != nullptr)
+    this->rotating_log_->stop();
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->close_all();
+  if (this->space_thread_.joinable())
+    this->space_thread_.join();
+  if (this->checksum_thread_.joinable())
+    this->checksum_thread_.join();
+  if (this->file_operation_thread_.joinable()) {
+    this->file_operation_cancelled_ = true;
+    this->file_operation_thread_.join();
+  }
+  if (this->find_thread_.joinable()) {
+    this->find_cancelled_ = true;
+    this->find_thread_.join();
+  }
+}
+
+void SdMmc::start_space_scan() {
+  if (this->space_scan_done_)
+    this->finish_space_scan();
+  if (this->space_thread_.joinable())
+    return;
+  this->space_thread_ = start_worker_thread("sd_space_scan", 4096, [this]() {
+    uint64_t total_bytes, used_bytes;
+    uint32_t cluster_size;
+    uint32_t start = millis();
+    MountGuard mounted(this);
+    if (mounted && this->query_space(total_bytes, used_bytes, cluster_size)) {
+      std::lock_guard<std::mutex> lock(this->space_mutex_);
+      if (this->space_valid_) {
+        ESP_LOGD(TAG, "Space reconciled in %u ms, drift %lld bytes", millis() - start,
+                 static_cast<long long>(used_bytes) - static_cast<long long>(this->used_bytes_));
+      } else {
+        ESP_LOGD(TAG, "Space computed in %u ms", millis() - start);
+      }
+      this->total_bytes_ = total_bytes;
+      this->used_bytes_ = used_bytes;
+      this->cluster_size_ = cluster_size;
+      this->space_valid_ = true;
+    } else {
+      ESP_LOGW(TAG, "Failed to compute free space");
+    }
+    this->space_scan_done_ = true;
+  });
+}
+
+void SdMmc::finish_space_scan() {
+  if (this->space_thread_.joinable())
+    this->space_thread_.join();
+  this->space_scan_done_ = false;
+  this->last_space_scan_ = millis();
+}
+
+void SdMmc::account_file_change(uint64_t old_size, uint64_t new_size) {
+  std::lock_guard<std::mutex> lock(this->space_mutex_);
+  if (!this->space_valid_ || this->cluster_size_ == 0)
+    return;
+  uint64_t old_clusters = (old_size + this->cluster_size_ - 1) / this->cluster_size_;
+  uint64_t new_clusters = (new_size + this->cluster_size_ - 1) / this->cluster_size_;
+  if (new_clusters >= old_clusters) {
+    this->used_bytes_ = std::min(this->total_bytes_, this->used_bytes_ + (new_clusters - old_clusters) * this->cluster_size_);
+  } else {
+    uint64_t freed = (old_clusters - new_clusters) * this->cluster_size_;
+    this->used_bytes_ = freed > this->used_bytes_ ? 0 : this->used_bytes_ - freed;
+  }
+}
+
+void SdMmc::account_directory_change(bool created) {
+  // A new directory occupies a single cluster until it grows past its first block of entries.
+  this->account_file_change(created ? 0 : 1, created ? 1 : 0);
+}
+
+void SdMmc::update_sensors() {
+#ifdef USE_SENSOR
+  bool space_valid;
+  uint64_t total_bytes, used_bytes;
+  {
+    std::lock_guard<std::mutex> lock(this->space_mutex_);
+    space_valid = this->space_valid_;
+    total_bytes = this->total_bytes_;
+    used_bytes = this->used_bytes_;
+  }
+  if (space_valid) {
+    if (this->used_space_sensor_ != nullptr)
+      this->used_space_sensor_->publish_state(used_bytes);
+    if (this->total_space_sensor_ != nullptr)
+      this->total_space_sensor_->publish_state(total_bytes);
+    if (this->free_space_sensor_ != nullptr)
+      this->free_space_sensor_->publish_state(total_bytes - used_bytes);
+  }
+
+  if (this->handle_pool_ != nullptr) {
+    if (this->file_handle_hits_sensor_ != nullptr)
+      this->file_handle_hits_sensor_->publish_state(this->handle_pool_->hits());
+    if (this->file_handle_misses_sensor_ != nullptr)
+      this->file_handle_misses_sensor_->publish_state(this->handle_pool_->misses());
+  }
+
+  if (this->bus_frequency_sensor_ != nullptr && this->bus_frequency_khz_ != 0)
+    this->bus_frequency_sensor_->publish_state(this->bus_frequency_khz_ / 1000.0f);
+  if (this->bus_throughput_sensor_ != nullptr && !std::isnan(this->bus_throughput_))
+    this->bus_throughput_sensor_->publish_state(this->bus_throughput_);
+
+  if (this->metadata_index_ != nullptr) {
+    if (this->metadata_hits_sensor_ != nullptr)
+      this->metadata_hits_sensor_->publish_state(this->metadata_index_->hits());
+    if (this->metadata_misses_sensor_ != nullptr)
+      this->metadata_misses_sensor_->publish_state(this->metadata_index_->misses());
+    if (this->metadata_invalidations_sensor_ != nullptr)
+      this->metadata_invalidations_sensor_->publish_state(this->metadata_index_->invalidations());
+  }
+
+#ifdef USE_SD_MMC_ALLOCATION_COUNTER
+  if (this->hot_path_allocations_sensor_ != nullptr)
+    this->hot_path_allocations_sensor_->publish_state(this->hot_path_allocations_);
+#endif
+
+  if (this->sector_cache_ != nullptr) {
+    if (this->sector_cache_hits_sensor_ != nullptr)
+      this->sector_cache_hits_sensor_->publish_state(this->sector_cache_->hits());
+    if (this->sector_cache_misses_sensor_ != nullptr)
+      this->sector_cache_misses_sensor_->publish_state(this->sector_cache_->misses());
+    float hit_rate = this->sector_cache_->hit_rate();
+    if (this->sector_cache_hit_rate_sensor_ != nullptr && !std::isnan(hit_rate))
+      this->sector_cache_hit_rate_sensor_->publish_state(hit_rate);
+  }
+
+  if (this->rotating_log_ != nullptr) {
+    if (this->log_segment_sensor_ != nullptr)
+      this->log_segment_sensor_->publish_state(this->rotating_log_->segment());
+    if (this->log_bytes_written_sensor_ != nullptr)
+      this->log_bytes_written_sensor_->publish_state(this->rotating_log_->bytes_written());
+    if (this->log_rotation_latency_sensor_ != nullptr && this->rotating_log_->rotations() > 0)
+      this->log_rotation_latency_sensor_->publish_state(this->rotating_log_->last_rotation_latency());
+  }
+
+  if (this->lock_contentions_sensor_ != nullptr || this->lock_wait_time_sensor_ != nullptr ||
+      this->lock_hold_time_sensor_ != nullptr) {
+    LockStats paths = this->path_locks_.stats();
+    LockStats volume = this->volume_lock_.stats();
+    if (this->lock_contentions_sensor_ != nullptr)
+      this->lock_contentions_sensor_->publish_state(paths.contentions + volume.contentions);
+    if (this->lock_wait_time_sensor_ != nullptr)
+      this->lock_wait_time_sensor_->publish_state(std::max(paths.max_wait_us, volume.max_wait_us) / 1000.0f);
+    if (this->lock_hold_time_sensor_ != nullptr)
+      this->lock_hold_time_sensor_->publish_state(std::max(paths.max_hold_us, volume.max_hold_us) / 1000.0f);
+  }
+
+  if (this->compression_ratio_sensor_ != nullptr || this->compression_time_sensor_ != nullptr ||
+      this->decompression_time_sensor_ != nullptr) {
+    CompressionStats stats = this->get_compression_stats();
+    if (this->compression_ratio_sensor_ != nullptr && stats.compressed_bytes > 0)
+      this->compression_ratio_sensor_->publish_state(stats.ratio());
+    if (this->compression_time_sensor_ != nullptr && stats.raw_bytes > 0)
+      this->compression_time_sensor_->publish_state(stats.compress_ms_per_mb());
+    if (this->decompression_time_sensor_ != nullptr && stats.decompressed_bytes > 0)
+      this->decompression_time_sensor_->publish_state(stats.decompress_ms_per_mb());
+  }
+
+  if (this->sync_count_sensor_ != nullptr || this->sync_latency_sensor_ != nullptr ||
+      this->writes_per_sync_sensor_ != nullptr) {
+    SyncStats stats = this->get_sync_stats();
+    if (this->sync_count_sensor_ != nullptr)
+      this->sync_count_sensor_->publish_state(stats.syncs);
+    if (this->sync_latency_sensor_ != nullptr && stats.syncs > 0)
+      this->sync_latency_sensor_->publish_state(stats.latency.percentile(95) / 1000.0f);
+    if (this->writes_per_sync_sensor_ != nullptr && stats.syncs > 0)
+      this->writes_per_sync_sensor_->publish_state(stats.writes_per_sync());
+  }
+
+  for (auto &sensor : this->file_size_sensors_) {
+    if (sensor.sensor != nullptr && this->is_mounted())
+      sensor.sensor->publish_state(this->file_size(sensor.path));
+  }
+#ifdef USE_SD_MMC_OPERATION_STATS
+  for (auto &sensor : this->operation_sensors_) {
+    OperationStats stats = this->operation_stats_.get(sensor.operation);
+    bool latency = sensor.statistic != OperationStatistic::COUNT && sensor.statistic != OperationStatistic::BYTES &&
+                   sensor.statistic != OperationStatistic::ERRORS;
+    // No latency without operations: keep the last value rather than publishing 0 ms
+    if (latency && stats.count == 0)
+      continue;
+    sensor.sensor->publish_state(stats.value(sensor.statistic));
+  }
+#endif
+#endif
+}
 
 void SdMmc::dump_config() {
   ESP_LOGCONFIG(TAG, "SD MMC Component");
+  LOG_UPDATE_INTERVAL(this);
+  ESP_LOGCONFIG(TAG, "  Card: %s", card_state_to_string(this->card_state_));
+  if (this->ready_time_ != 0)
+    ESP_LOGCONFIG(TAG, "  Ready %u ms after boot", this->ready_time_);
+  if (this->card_detect_pin_ != nullptr) {
+    LOG_PIN("  Card Detect Pin: ", this->card_detect_pin_);
+  }
+  if (this->mount_retry_interval_ != 0)
+    ESP_LOGCONFIG(TAG, "  Mount retry interval: %u s", this->mount_retry_interval_ / 1000);
+  ESP_LOGCONFIG(TAG, "  When unmounted: %s", this->unmounted_policy_ == UnmountedPolicy::QUEUE ? "queue" : "fail");
+  ESP_LOGCONFIG(TAG, "  Space reconcile interval: %u s", this->space_reconcile_interval_ / 1000);
   ESP_LOGCONFIG(TAG, "  Mode 1 bit: %s", TRUEFALSE(this->mode_1bit_));
+  ESP_LOGCONFIG(TAG, "  Bus speed: %s, %u kHz", bus_speed_to_string(this->bus_speed_), this->bus_frequency_khz_);
+  if (!std::isnan(this->bus_throughput_))
+    ESP_LOGCONFIG(TAG, "  Measured read throughput: %.2f MB/s", this->bus_throughput_);
   ESP_LOGCONFIG(TAG, "  CLK Pin: %d", this->clk_pin_);
   ESP_LOGCONFIG(TAG, "  CMD Pin: %d", this->cmd_pin_);
   ESP_LOGCONFIG(TAG, "  DATA0 Pin: %d", this->data0_pin_);
@@ -51,64 +380,434 @@ void SdMmc::dump_config() {
   if (this->power_ctrl_pin_ != nullptr) {
     LOG_PIN("  Power Ctrl Pin: ", this->power_ctrl_pin_);
   }
+#ifdef USE_HOST
+  ESP_LOGCONFIG(TAG, "  Host root: %s", build_path("").c_str());
+  if (this->bus_model_.enabled) {
+    ESP_LOGCONFIG(TAG, "  Simulated bus: up to %u kHz, %u bit, command %u us, write busy %u us",
+                  this->bus_model_.frequency_khz, this->bus_model_.bus_width, this->bus_model_.command_latency_us,
+                  this->bus_model_.write_latency_us);
+  }
+#endif
+
+  ESP_LOGCONFIG(TAG, "  Max open files: %u", this->mount_max_files());
+  if (this->write_queue_ != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Write-behind buffer: %s", format_size(this->write_queue_->capacity()).c_str());
+  }
+  if (this->handle_pool_ != nullptr) {
+    ESP_LOGCONFIG(TAG, "  File handle pool: %zu", this->handle_pool_->size());
+  }
+  if (this->metadata_index_ != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Metadata cache: %zu entries", this->metadata_index_->capacity());
+  }
+#ifdef USE_SD_MMC_ALLOCATION_COUNTER
+  ESP_LOGCONFIG(TAG, "  Hot path allocations: %u", static_cast<unsigned>(this->hot_path_allocations_));
+#endif
+  if (this->sector_cache_ != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Sector cache: %zu sectors (%s)", this->sector_cache_->capacity(),
+                  this->sector_cache_->is_external() ? "PSRAM" : "internal RAM");
+  }
+  if (this->rotating_log_ != nullptr) {
+    ESP_LOGCONFIG(TAG, "  Rotating log: %s", this->rotating_log_->segment_path(this->rotating_log_->segment()).c_str());
+  }
+  if (this->max_read_size_ != 0) {
+    ESP_LOGCONFIG(TAG, "  Max read_file size: %s", format_size(this->max_read_size_).c_str());
+  }
+  ESP_LOGCONFIG(TAG, "  Durability: %s%s", durability_to_string(this->default_durability_.level),
+                this->default_durability_.atomic_write ? ", atomic write" : "");
+  for (auto const &rule : this->durability_rules_) {
+    ESP_LOGCONFIG(TAG, "    %s: %s%s", rule.prefix.c_str(), durability_to_string(rule.level),
+                  rule.atomic_write ? ", atomic write" : "");
+  }
+  SyncStats sync_stats = this->get_sync_stats();
+  if (sync_stats.syncs > 0) {
+    ESP_LOGCONFIG(TAG, "    %u syncs for %u writes on %u files, p95 %u us, max %u us", sync_stats.syncs,
+                  sync_stats.writes, sync_stats.files, sync_stats.latency.percentile(95), sync_stats.latency.max());
+  }
+#ifdef USE_SD_MMC_OPERATION_STATS
+  ESP_LOGCONFIG(TAG, "  Operation statistics:");
+  for (uint8_t i = 0; i < OPERATION_COUNT; i++) {
+    auto operation = static_cast<SdMmcOperation>(i);
+    OperationStats stats = this->operation_stats_.get(operation);
+    if (stats.count == 0)
+      continue;
+    ESP_LOGCONFIG(TAG, "    %-12s %u ops, %u errors, %s, p50 %u us, p95 %u us, p99 %u us, max %u us",
+                  operation_to_string(operation), stats.count, stats.errors, format_size(stats.bytes).c_str(),
+                  stats.latency.percentile(50), stats.latency.percentile(95), stats.latency.percentile(99),
+                  stats.latency.max());
+  }
+#endif
 
 #ifdef USE_SENSOR
   LOG_SENSOR("  ", "Used space", this->used_space_sensor_);
   LOG_SENSOR("  ", "Total space", this->total_space_sensor_);
   LOG_SENSOR("  ", "Free space", this->free_space_sensor_);
+  LOG_SENSOR("  ", "Write queue depth", this->write_queue_depth_sensor_);
+  LOG_SENSOR("  ", "Write queue dropped", this->write_queue_dropped_sensor_);
+  LOG_SENSOR("  ", "Write queue latency", this->write_queue_latency_sensor_);
+  LOG_SENSOR("  ", "File handle hits", this->file_handle_hits_sensor_);
+  LOG_SENSOR("  ", "File handle misses", this->file_handle_misses_sensor_);
+  LOG_SENSOR("  ", "Metadata hits", this->metadata_hits_sensor_);
+  LOG_SENSOR("  ", "Metadata misses", this->metadata_misses_sensor_);
+  LOG_SENSOR("  ", "Metadata invalidations", this->metadata_invalidations_sensor_);
+  LOG_SENSOR("  ", "Sector cache hits", this->sector_cache_hits_sensor_);
+  LOG_SENSOR("  ", "Sector cache misses", this->sector_cache_misses_sensor_);
+  LOG_SENSOR("  ", "Sector cache hit rate", this->sector_cache_hit_rate_sensor_);
+  LOG_SENSOR("  ", "Bus frequency", this->bus_frequency_sensor_);
+  LOG_SENSOR("  ", "Bus throughput", this->bus_throughput_sensor_);
+  LOG_SENSOR("  ", "Log segment", this->log_segment_sensor_);
+  LOG_SENSOR("  ", "Log bytes written", this->log_bytes_written_sensor_);
+  LOG_SENSOR("  ", "Log rotation latency", this->log_rotation_latency_sensor_);
+  LOG_SENSOR("  ", "Lock contentions", this->lock_contentions_sensor_);
+  LOG_SENSOR("  ", "Lock wait time", this->lock_wait_time_sensor_);
+  LOG_SENSOR("  ", "Lock hold time", this->lock_hold_time_sensor_);
+  LOG_SENSOR("  ", "Hot path allocations", this->hot_path_allocations_sensor_);
+  LOG_SENSOR("  ", "Compression ratio", this->compression_ratio_sensor_);
+  LOG_SENSOR("  ", "Compression time", this->compression_time_sensor_);
+  LOG_SENSOR("  ", "Decompression time", this->decompression_time_sensor_);
+  LOG_SENSOR("  ", "Ready time", this->ready_time_sensor_);
+  LOG_SENSOR("  ", "Mount time", this->mount_time_sensor_);
+  LOG_SENSOR("  ", "Sync count", this->sync_count_sensor_);
+  LOG_SENSOR("  ", "Sync latency", this->sync_latency_sensor_);
+  LOG_SENSOR("  ", "Writes per sync", this->writes_per_sync_sensor_);
   for (auto &sensor : this->file_size_sensors_) {
     if (sensor.sensor != nullptr)
       LOG_SENSOR("  ", "File size", sensor.sensor);
   }
+#ifdef USE_SD_MMC_OPERATION_STATS
+  for (auto &sensor : this->operation_sensors_)
+    LOG_SENSOR("  ", "Operation", sensor.sensor);
+#endif
 #endif
 #ifdef USE_TEXT_SENSOR
   LOG_TEXT_SENSOR("  ", "SD Card Type", this->sd_card_type_text_sensor_);
+  LOG_TEXT_SENSOR("  ", "Last checksum", this->last_checksum_text_sensor_);
 #endif
 
   if (this->is_failed()) {
     ESP_LOGE(TAG, "Setup failed : %s", SdMmc::error_code_to_string(this->init_error_).c_str());
     return;
   }
+  if (this->card_state_ == CardState::UNMOUNTED && this->auto_mount_ && this->card_present_)
+    ESP_LOGW(TAG, "Last mount failed : %s", SdMmc::error_code_to_string(this->init_error_).c_str());
+}
+
+bool SdMmc::write_file(const char *path, const uint8_t *buffer, size_t len) {
+  ESP_LOGV(TAG, "Writing to file: %s", path);
+  return this->write_file(path, buffer, len, "w");
 }
 
-void SdMmc::write_file(const char *path, const uint8_t *buffer, size_t len) {
+bool SdMmc::write_file(const char *path, const uint8_t *buffer, size_t len, Durability durability) {
   ESP_LOGV(TAG, "Writing to file: %s", path);
-  this->write_file(path, buffer, len, "w");
+  return this->write_file(path, buffer, len, "w", durability);
 }
 
-void SdMmc::append_file(const char *path, const uint8_t *buffer, size_t len) {
+bool SdMmc::write_file(const char *path, const uint8_t *buffer, size_t len, const char *mode,
+                       Durability durability) {
+  AllocationProbe probe(this->hot_path_allocations_, mode[0] == 'a' ? SdMmcOperation::APPEND : SdMmcOperation::WRITE);
+  OperationTimer timer(this->operation_stats_table_(),
+                       mode[0] == 'a' ? SdMmcOperation::APPEND : SdMmcOperation::WRITE);
+  MountGuard mounted(this);
+  if (!mounted) {
+    bool queued = this->write_unmounted_(path, buffer, len, mode[0] == 'a');
+    timer.set_ok(queued);
+    return queued;
+  }
+  DurabilityRule const &rule = this->get_durability(path);
+  if (durability == Durability::INHERIT)
+    durability = rule.level;
+  // The file is closed right away, nothing is left for a later sync point to cover
+  bool sync = durability == Durability::GROUP_COMMIT || durability == Durability::EVERY_WRITE;
+  auto guard = this->path_locks_.lock_exclusive(path);
+  size_t written = mode[0] == 'w' && rule.atomic_write ? this->replace_file_(path, buffer, len)
+                                                       : this->write_file_(path, buffer, len, mode, sync);
+  timer.add_bytes(written);
+  timer.set_ok(written == len);
+  return written == len;
+}
+
+bool SdMmc::write_file(std::string_view path, const uint8_t *buffer, size_t len) {
+  return this->write_file(PathBuffer(path).c_str(), buffer, len, "w");
+}
+
+bool SdMmc::append_file(const char *path, const uint8_t *buffer, size_t len, Durability durability) {
   ESP_LOGV(TAG, "Appending to file: %s", path);
-  this->write_file(path, buffer, len, "a");
+  if (this->handle_pool_ == nullptr) {
+    return this->write_file(path, buffer, len, "a", durability);
+  }
+  AllocationProbe probe(this->hot_path_allocations_, SdMmcOperation::APPEND);
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::APPEND);
+  MountGuard mounted(this);
+  if (!mounted) {
+    bool queued = this->write_unmounted_(path, buffer, len, true);
+    timer.set_ok(queued);
+    return queued;
+  }
+  DurabilityRule const &rule = this->get_durability(path);
+  if (durability == Durability::INHERIT)
+    durability = rule.level;
+  uint64_t commit = 0;
+  bool ok;
+  {
+    auto guard = this->path_locks_.lock_exclusive(path);
+    uint64_t old_size, new_size;
+    ok = this->handle_pool_->append(path, buffer, len, durability, rule.sync_interval, old_size, new_size, commit);
+    if (ok) {
+      this->account_file_change(old_size, new_size);
+      this->update_metadata_(path, FileMetadata::file(new_size));
+      timer.add_bytes(len);
+    } else {
+      this->invalidate_metadata_(path);
+      timer.set_ok(false);
+    }
+  }
+  // Without the path lock, so that other appends to this file join the same sync point
+  if (commit != 0)
+    this->handle_pool_->commit(commit);
+  return ok;
+}
+
+bool SdMmc::append_file(std::string_view path, const uint8_t *buffer, size_t len) {
+  return this->append_file(PathBuffer(path).c_str(), buffer, len);
+}
+
+void SdMmc::set_file_handle_pool(size_t size, uint32_t flush_interval, size_t flush_threshold) {
+  this->handle_pool_ = std::make_unique<FileHandlePool>(size, flush_interval, flush_threshold);
+  this->handle_pool_->set_on_sync(
+      [this](uint32_t us, uint32_t files, uint32_t writes) { this->record_sync(us, files, writes); });
+}
+
+uint8_t SdMmc::mount_max_files() const {
+  return this->max_open_files_ + (this->handle_pool_ != nullptr ? this->handle_pool_->size() : 0);
+}
+
+void SdMmc::flush_pooled_file(const char *path) {
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->flush(path);
+}
+
+void SdMmc::close_pooled_file(const char *path) {
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->close(path);
+}
+
+void SdMmc::set_write_behind_buffer_size(size_t size) {
+  this->write_queue_ = std::make_unique<WriteBehindQueue>(size);
+  this->write_queue_->set_path_locks(&this->path_locks_);
+  this->write_queue_->set_on_write_start([this](const char *path) { this->close_pooled_file(path); });
+  this->write_queue_->set_on_written([this](const char *path, uint64_t old_size, uint64_t new_size) {
+    this->account_file_change(old_size, new_size);
+    this->update_metadata_(path, FileMetadata::file(new_size));
+  });
+  this->write_queue_->set_on_before_close([this](const char *path, FILE *file) {
+    Durability level = this->get_durability(path).level;
+    if (level == Durability::GROUP_COMMIT || level == Durability::EVERY_WRITE)
+      this->sync_file_(file);
+  });
+}
+
+bool SdMmc::queue_write_file(const char *path, const uint8_t *buffer, size_t len) {
+  if (this->write_queue_ == nullptr) {
+    this->write_file(path, buffer, len);
+    return true;
+  }
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::QUEUE);
+  bool queued = this->is_mounted() || this->unmounted_policy_ == UnmountedPolicy::QUEUE
+                    ? this->write_queue_->enqueue(path, buffer, len, false)
+                    : this->write_unmounted_(path, buffer, len, false);
+  timer.add_bytes(queued ? len : 0);
+  timer.set_ok(queued);
+  return queued;
+}
+
+bool SdMmc::queue_append_file(const char *path, const uint8_t *buffer, size_t len) {
+  if (this->write_queue_ == nullptr) {
+    this->append_file(path, buffer, len);
+    return true;
+  }
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::QUEUE);
+  bool queued = this->is_mounted() || this->unmounted_policy_ == UnmountedPolicy::QUEUE
+                    ? this->write_queue_->enqueue(path, buffer, len, true)
+                    : this->write_unmounted_(path, buffer, len, true);
+  timer.add_bytes(queued ? len : 0);
+  timer.set_ok(queued);
+  return queued;
+}
+
+void SdMmc::flush_write_queue() {
+  if (this->write_queue_ == nullptr)
+    return;
+  this->write_queue_->flush();
+}
+
+void SdMmc::publish_write_queue_sensors() {
+#ifdef USE_SENSOR
+  if (this->write_queue_depth_sensor_ != nullptr)
+    this->write_queue_depth_sensor_->publish_state(this->write_queue_->depth());
+  if (this->write_queue_dropped_sensor_ != nullptr)
+    this->write_queue_dropped_sensor_->publish_state(this->write_queue_->dropped());
+  if (this->write_queue_latency_sensor_ != nullptr)
+    this->write_queue_latency_sensor_->publish_state(this->write_queue_->last_flush_latency());
+#endif
+}
+
+std::thread start_worker_thread(const char *name, size_t stack_size, std::function<void()> &&fn) {
+#ifdef USE_ESP32
+  esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+  cfg.stack_size = stack_size;
+  cfg.thread_name = name;
+  esp_pthread_set_cfg(&cfg);
+#endif
+  std::thread thread(std::move(fn));
+#ifdef USE_ESP32
+  cfg = esp_pthread_get_default_config();
+  esp_pthread_set_cfg(&cfg);
+#endif
+  return thread;
 }
 
 std::vector<std::string> SdMmc::list_directory(const char *path, uint8_t depth) {
   std::vector<std::string> list;
-  std::vector<FileInfo> infos = list_directory_file_info(path, depth);
-  std::transform(infos.cbegin(), infos.cend(), list.begin(), [](FileInfo const &info) { return info.path; });
+  WalkOptions options;
+  options.depth = depth;
+  this->walk_directory(
+      path,
+      [&list](DirEntry const &entry) {
+        list.emplace_back(entry.path);
+        return true;
+      },
+      options);
   return list;
 }
 
-std::vector<std::string> SdMmc::list_directory(std::string path, uint8_t depth) {
-  return this->list_directory(path.c_str(), depth);
+std::vector<std::string> SdMmc::list_directory(std::string_view path, uint8_t depth) {
+  return this->list_directory(PathBuffer(path).c_str(), depth);
 }
 
 std::vector<FileInfo> SdMmc::list_directory_file_info(const char *path, uint8_t depth) {
   std::vector<FileInfo> list;
-  list_directory_file_info_rec(path, depth, list);
+  WalkOptions options;
+  options.depth = depth;
+  this->walk_directory(
+      path,
+      [&list](DirEntry const &entry) {
+        list.emplace_back(entry.path, entry.size, entry.is_directory);
+        return true;
+      },
+      options);
   return list;
 }
 
-std::vector<FileInfo> SdMmc::list_directory_file_info(std::string path, uint8_t depth) {
-  return this->list_directory_file_info(path.c_str(), depth);
+std::vector<FileInfo> SdMmc::list_directory_file_info(std::string_view path, uint8_t depth) {
+  return this->list_directory_file_info(PathBuffer(path).c_str(), depth);
 }
 
-size_t SdMmc::file_size(std::string const &path) { return this->file_size(path.c_str()); }
+size_t SdMmc::file_size(std::string_view path) { return this->file_size(PathBuffer(path).c_str()); }
 
-bool SdMmc::is_directory(std::string const &path) { return this->is_directory(path.c_str()); }
+bool SdMmc::is_directory(std::string_view path) { return this->is_directory(PathBuffer(path).c_str()); }
 
-bool SdMmc::delete_file(std::string const &path) { return this->delete_file(path.c_str()); }
+bool SdMmc::delete_file(const char *path) {
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::DELETE);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return false;
+  }
+  auto guard = this->path_locks_.lock_exclusive(path);
+  std::lock_guard<VolumeLock> volume(this->volume_lock_);
+  bool ok = this->delete_file_(path);
+  timer.set_ok(ok);
+  return ok;
+}
+
+bool SdMmc::delete_file(std::string_view path) { return this->delete_file(PathBuffer(path).c_str()); }
+
+bool SdMmc::create_directory(const char *path) {
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::MKDIR);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return false;
+  }
+  auto guard = this->path_locks_.lock_exclusive(path);
+  std::lock_guard<VolumeLock> volume(this->volume_lock_);
+  bool ok = this->create_directory_(path);
+  timer.set_ok(ok);
+  return ok;
+}
+
+bool SdMmc::create_directory(std::string_view path) { return this->create_directory(PathBuffer(path).c_str()); }
+
+bool SdMmc::remove_directory(const char *path) {
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::RMDIR);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return false;
+  }
+  auto guard = this->path_locks_.lock_exclusive(path);
+  std::lock_guard<VolumeLock> volume(this->volume_lock_);
+  bool ok = this->remove_directory_(path);
+  timer.set_ok(ok);
+  return ok;
+}
+
+bool SdMmc::remove_directory(std::string_view path) { return this->remove_directory(PathBuffer(path).c_str()); }
+
+std::vector<uint8_t> SdMmc::read_file(char const *path) {
+  ESP_LOGV(TAG, "Read File: %s", path);
+  return this->read_file_alloc<std::allocator<uint8_t>>(path);
+}
+
+std::vector<uint8_t> SdMmc::read_file(std::string_view path) { return this->read_file(PathBuffer(path).c_str()); }
 
-std::vector<uint8_t> SdMmc::read_file(std::string const &path) { return this->read_file(path.c_str()); }
+size_t SdMmc::read_file_into(const char *path, uint8_t *buffer, size_t capacity, size_t offset) {
+  ESP_LOGV(TAG, "Read File into buffer: %s", path);
+  AllocationProbe probe(this->hot_path_allocations_, SdMmcOperation::READ);
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::READ);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return 0;
+  }
+  auto guard = this->path_locks_.lock_shared(path);
+  // A single pointer capture keeps the callback within std::function's inline storage
+  struct {
+    uint8_t *buffer;
+    size_t capacity;
+    bool opened;
+  } target{buffer, capacity, false};
+  size_t len = this->read_file_(path, offset, [&target](size_t file_size, size_t &available) {
+    available = target.capacity;
+    target.opened = true;
+    return target.buffer;
+  });
+  timer.add_bytes(len);
+  timer.set_ok(target.opened);
+  return len;
+}
+
+size_t SdMmc::read_file_into(std::string_view path, uint8_t *buffer, size_t capacity, size_t offset) {
+  return this->read_file_into(PathBuffer(path).c_str(), buffer, capacity, offset);
+}
+
+bool SdMmc::can_allocate_read_(const char *path, size_t size, bool external) const {
+  if (this->max_read_size_ != 0 && size > this->max_read_size_) {
+    ESP_LOGE(TAG, "%s is %s, over the %s read limit; use process_file or read_file_into", path,
+             format_size(size).c_str(), format_size(this->max_read_size_).c_str());
+    return false;
+  }
+#ifdef USE_ESP32
+  size_t largest = external ? heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) : 0;
+  if (largest == 0)
+    largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (size > largest) {
+    ESP_LOGE(TAG, "%s is %s but the largest free block is %s; use process_file or read_file_into", path,
+             format_size(size).c_str(), format_size(largest).c_str());
+    return false;
+  }
+#endif
+  return true;
+}
 
 #ifdef USE_SENSOR
 void SdMmc::add_file_size_sensor(sensor::Sensor *sensor, std::string const &path) {
@@ -149,7 +848,7 @@ long double convertBytes(uint64_t value, MemoryUnits unit) {
   return value * 1.0 / pow(1024, static_cast<uint64_t>(unit));
 }
 
-std::string memory_unit_to_string(MemoryUnits unit) {
+const char *memory_unit_suffix(MemoryUnits unit) {
   switch (unit) {
     case MemoryUnits::Byte:
       return "B";
@@ -167,6 +866,8 @@ std::string memory_unit_to_string(MemoryUnits unit) {
   return "unknown";
 }
 
+std::string memory_unit_to_string(MemoryUnits unit) { return memory_unit_suffix(unit); }
+
 MemoryUnits memory_unit_from_size(size_t size) {
   short unit = MemoryUnits::Byte;
   double s = static_cast<double>(size);
@@ -177,15 +878,97 @@ MemoryUnits memory_unit_from_size(size_t size) {
   return static_cast<MemoryUnits>(unit);
 }
 
-std::string format_size(size_t size) {
+SizeString format_size(size_t size) {
   MemoryUnits unit = memory_unit_from_size(size);
-  char buffer[32];
-  snprintf(buffer, sizeof(buffer), "%.2f %s", convertBytes(size, unit), memory_unit_to_string(unit).c_str());
-  return std::string(buffer);
+  SizeString result;
+  snprintf(result.text, sizeof(result.text), "%.2f %s", static_cast<double>(convertBytes(size, unit)),
+           memory_unit_suffix(unit));
+  return result;
+}
+
+bool PathBuffer::append(std::string_view part) {
+  if (this->overflowed_)
+    return false;
+  if (this->size_ + part.size() >= CAPACITY) {
+    ESP_LOGE(TAG, "Path too long (%zu bytes max): %.*s", CAPACITY - 1, static_cast<int>(std::min<size_t>(part.size(), 64)),
+             part.data());
+    this->overflowed_ = true;
+    this->size_ = 0;
+    this->data_[0] = '\0';
+    return false;
+  }
+  memcpy(this->data_ + this->size_, part.data(), part.size());
+  this->size_ += part.size();
+  this->data_[this->size_] = '\0';
+  return true;
+}
+
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc) {
+#ifdef USE_ESP32
+  return esp_rom_crc32_le(crc, data, len);
+#else
+  // Half-byte table: same result as the ROM routine at a fraction of the 1 KiB table.
+  static const uint32_t TABLE[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+                                     0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+                                     0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = TABLE[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = TABLE[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+#endif
 }
 
 FileInfo::FileInfo(std::string const &path, size_t size, bool is_directory)
     : path(path), size(size), is_directory(is_directory) {}
 
+uint8_t LatencyHistogram::bucket_of(uint32_t us) {
+  if (us < 4)
+    return us;
+  uint8_t exponent = 31 - __builtin_clz(us);
+  uint8_t sub = (us >> (exponent - 2)) & 3;
+  return 4 * (exponent - 1) + sub;
+}
+
+uint32_t LatencyHistogram::bucket_upper_bound(uint8_t bucket) {
+  if (bucket < 4)
+    return bucket;
+  uint8_t exponent = bucket / 4 + 1;
+  uint8_t sub = bucket % 4;
+  uint64_t bound = ((4ULL + sub + 1) << (exponent - 2)) - 1;
+  return bound > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(bound);
+}
+
+void LatencyHistogram::record(uint32_t us) {
+  this->buckets_[bucket_of(us)]++;
+  this->count_++;
+  this->total_ += us;
+  if (us > this->max_)
+    this->max_ = us;
+}
+
+void LatencyHistogram::reset() {
+  std::fill(std::begin(this->buckets_), std::end(this->buckets_), 0);
+  this->count_ = 0;
+  this->max_ = 0;
+  this->total_ = 0;
+}
+
+uint32_t LatencyHistogram::percentile(float p) const {
+  if (this->count_ == 0)
+    return 0;
+  uint64_t rank = static_cast<uint64_t>(ceil(this->count_ * p / 100.0f));
+  if (rank == 0)
+    rank = 1;
+  uint64_t seen = 0;
+  for (uint8_t i = 0; i < BUCKET_COUNT; i++) {
+    seen += this->buckets_[i];
+    if (seen >= rank)
+      return std::min(bucket_upper_bound(i), this->max_);
+  }
+  return this->max_;
+}
+
 }  // namespace sd_mmc_card
 }  // namespace esphome
@@ -3,6 +3,17 @@
 #include "esphome/core/defines.h"
 #include "esphome/core/component.h"
 #include "esphome/core/automation.h"
+#include "esphome/core/helpers.h"
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #ifdef USE_SENSOR
 #include "esphome/components/sensor/sensor.h"
 #endif
@@ -19,29 +30,22 @@ namespace sd_mmc_card {
 
 enum MemoryUnits : short { Byte = 0, KiloByte = 1, MegaByte = 2, GigaByte = 3, TeraByte = 4, PetaByte = 5 };
 
-// À ajouter dans sd_mmc_card.h
-fs::FS& get_filesystem() { return this->fs_; }
-
-
-// À ajouter dans sd_mmc_card.h
-size_t get_file_size(const std::string& path) {
-  File file = this->fs_.open(path.c_str(), FILE_READ);
-  if (!file) return 0;
-  size_t size = file.size();
-  file.close();
-  return size;
-}
-
-
-
-// À ajouter dans sd_mmc_card.h
-bool exists(const std::string& path) {
-  return this->fs_.exists(path.c_str());
-}
-
+// Vitesse du bus SDMMC. AUTO essaie la plus rapide au démarrage et redescend en cas d'erreurs.
+enum BusSpeed : uint8_t { BUS_SPEED_DEFAULT = 0, BUS_SPEED_HIGH_SPEED = 1, BUS_SPEED_DDR = 2, BUS_SPEED_AUTO = 3 };
+const char *bus_speed_to_string(BusSpeed speed);
 
 // Taille du buffer pour le streaming
-static constexpr size_t DEFAULT_STREAM_BUFFER_SIZE = 1024;
+static constexpr size_t DEFAULT_STREAM_BUFFER_SIZE = 4096;
+// Taille de chacun des deux tampons d'une copie
+static constexpr size_t DEFAULT_COPY_BUFFER_SIZE = 8192;
+// Nombre de tampons en vol dans process_file / write_file_stream (double buffering)
+static constexpr size_t STREAM_BUFFER_COUNT = 2;
+// Alignement des tampons de streaming (secteur SD), qui permet des transferts DMA directs
+static constexpr size_t STREAM_BUFFER_ALIGNMENT = 512;
+// Nombre de résultats gardés par défaut par find
+static constexpr size_t DEFAULT_FIND_LIMIT = 100;
+// Avant cette date (2020-01-01), l'horloge n'est pas encore réglée et les âges n'ont pas de sens
+static constexpr time_t MIN_VALID_TIME = 1577836800;
 
 #ifdef USE_SENSOR
 struct FileSizeSensor {
@@ -61,23 +65,795 @@ struct FileInfo {
   FileInfo(std::string const &, size_t, bool);
 };
 
-// Classe pour les opérations de streaming sur les fichiers
+// Entrée remontée par walk_directory. Taille, type et date viennent directement de
+// l'entrée de répertoire ; path et name ne sont valides que pendant le callback.
+struct DirEntry {
+  const char *path{nullptr};
+  const char *name{nullptr};
+  size_t size{0};
+  bool is_directory{false};
+  time_t mtime{0};
+  uint8_t depth{0};
+};
+
+enum class WalkType : uint8_t { ALL, FILES, DIRECTORIES };
+
+// Filtres du parcours. Ils ne s'appliquent qu'aux entrées remontées : un dossier
+// exclu par le filtre est tout de même parcouru jusqu'à `depth`. Taille et extension
+// ne concernent que les fichiers.
+struct WalkOptions {
+  uint8_t depth{0};
+  WalkType type{WalkType::ALL};
+  // Extension sans tenir compte de la casse, ex. ".jpg"
+  const char *extension{nullptr};
+  size_t min_size{0};
+  size_t max_size{SIZE_MAX};
+
+  bool matches(DirEntry const &entry) const;
+};
+
+// Motif glob sans tenir compte de la casse : `*` et `?` ne franchissent pas '/', `**` si
+// (et `**/` couvre aussi zéro dossier), `[a-z]` et `[!0-9]` désignent des ensembles.
+bool glob_match(const char *pattern, const char *text);
+
+enum class FindSort : uint8_t { NONE, NAME, SIZE, MTIME };
+const char *find_sort_to_string(FindSort sort);
+
+// Critères de find. Sans '/', `pattern` s'applique au nom de l'entrée, sinon au chemin
+// relatif à la racine de la recherche. Taille et dates ne concernent que les fichiers ;
+// les dates absolues et les âges (en secondes, relatifs à l'horloge) valent 0 sans limite.
+struct FindOptions {
+  const char *pattern{nullptr};
+  uint8_t depth{16};
+  WalkType type{WalkType::FILES};
+  size_t min_size{0};
+  size_t max_size{SIZE_MAX};
+  time_t modified_after{0};
+  time_t modified_before{0};
+  uint32_t min_age{0};
+  uint32_t max_age{0};
+  // Avec un tri, seuls les `limit` premiers restent en mémoire pendant le parcours ; sans
+  // tri, le parcours s'arrête au `limit`-ième résultat. 0 = pas de limite.
+  FindSort sort{FindSort::NONE};
+  bool descending{false};
+  size_t limit{DEFAULT_FIND_LIMIT};
+};
+
+struct FindResult {
+  std::string path;
+  size_t size{0};
+  bool is_directory{false};
+  time_t mtime{0};
+};
+
+// Répertoire ouvert, défini par chaque backend
+struct DirCursor;
+// Fichier à étendue contiguë ouvert pour l'écriture directe par secteurs, défini par chaque backend
+struct ExtentHandle;
+// Journal horodaté, défini dans record_store.h
+class RecordStore;
+
+enum class FileOperationType : uint8_t { COPY, MOVE, COPY_TREE, REMOVE_TREE };
+const char *file_operation_to_string(FileOperationType type);
+
+// Avancement d'une opération de fond (start_file_operation), publié toutes les secondes
+// puis une dernière fois avec `done`
+struct FileOperationProgress {
+  FileOperationType type{FileOperationType::COPY};
+  std::string source;
+  std::string destination;
+  // Fichiers copiés ou supprimés, dossiers créés ou supprimés
+  uint32_t files{0};
+  uint32_t directories{0};
+  // Octets copiés ; pour remove_tree, octets libérés
+  uint64_t bytes{0};
+  uint32_t elapsed_ms{0};
+  bool done{false};
+  bool ok{true};
+
+  // MB/s depuis le début de l'opération
+  float throughput() const;
+};
+
+// Histogramme de latence à seaux fixes (4 sous-seaux par puissance de 2, en microsecondes)
+class LatencyHistogram {
+ public:
+  static constexpr uint8_t BUCKET_COUNT = 124;
+
+  void record(uint32_t us);
+  void reset();
+  uint32_t count() const { return this->count_; }
+  uint32_t max() const { return this->max_; }
+  uint64_t total() const { return this->total_; }
+  // Borne supérieure du seau contenant le percentile demandé (0-100)
+  uint32_t percentile(float p) const;
+
+ protected:
+  static uint8_t bucket_of(uint32_t us);
+  static uint32_t bucket_upper_bound(uint8_t bucket);
+
+  uint32_t buckets_[BUCKET_COUNT]{};
+  uint32_t count_{0};
+  uint32_t max_{0};
+  uint64_t total_{0};
+};
+
+#ifdef USE_HOST
+// Modèle de latence/débit du bus SDMMC simulé par le backend hôte
+struct HostBusModel {
+  bool enabled{false};
+  uint32_t frequency_khz{20000};
+  uint8_t bus_width{4};
+  uint32_t command_latency_us{100};
+  uint32_t write_latency_us{250};
+
+  // Durée simulée d'un transfert de `bytes` octets, arrondi au secteur de 512 octets
+  uint32_t transfer_us(size_t bytes, bool write) const;
+};
+
+// Applique le modèle de bus actif à un transfert (commande seule si bytes == 0)
+void host_bus_transfer(size_t bytes, bool write);
+#endif
+
+// Chemin dans un tampon de taille fixe, sur la pile : aucune allocation. Un chemin trop long
+// est refusé (chaîne vide, erreur dans le journal) plutôt que tronqué, les appels système
+// échouent alors proprement.
+class PathBuffer {
+ public:
+  static constexpr size_t CAPACITY = 272;
+
+  PathBuffer() { this->data_[0] = '\0'; }
+  explicit PathBuffer(std::string_view path) : PathBuffer() { this->append(path); }
+  PathBuffer(std::string_view prefix, std::string_view path) : PathBuffer() {
+    if (this->append(prefix))
+      this->append(path);
+  }
+  bool append(std::string_view part);
+
+  const char *c_str() const { return this->data_; }
+  size_t size() const { return this->size_; }
+  bool overflowed() const { return this->overflowed_; }
+  operator std::string_view() const { return std::string_view(this->data_, this->size_); }
+
+ protected:
+  char data_[CAPACITY];
+  size_t size_{0};
+  bool overflowed_{false};
+};
+
+// Chemin absolu (point de montage + chemin) utilisé par le backend actif
+PathBuffer build_path(const char *path);
+
+// Tampon aligné sur STREAM_BUFFER_ALIGNMENT, en mémoire DMA sur ESP32
+uint8_t *allocate_stream_buffer(size_t size);
+void free_stream_buffer(uint8_t *buffer);
+
+// Lance un thread de travail ; sur ESP32 la pile et le nom de la tâche pthread sont configurés
+std::thread start_worker_thread(const char *name, size_t stack_size, std::function<void()> &&fn);
+
+class SdMmc;
+
+// Opérations instrumentées. Les écritures différées ne comptent ici que la mise en file
+// (QUEUE) ; l'écriture sur la carte a ses propres capteurs write_queue_*.
+enum class SdMmcOperation : uint8_t {
+  READ,
+  WRITE,
+  APPEND,
+  QUEUE,
+  DELETE,
+  MKDIR,
+  RMDIR,
+  STAT,
+  LIST,
+  STREAM_READ,
+  STREAM_WRITE,
+  COPY,
+  RENAME,
+};
+static constexpr uint8_t OPERATION_COUNT = 13;
+const char *operation_to_string(SdMmcOperation operation);
+
+enum class OperationStatistic : uint8_t { COUNT, BYTES, ERRORS, P50, P95, P99, MAX, THROUGHPUT };
+
+struct OperationStats {
+  uint32_t count{0};
+  uint32_t errors{0};
+  uint64_t bytes{0};
+  LatencyHistogram latency;
+
+  // Débit en MB/s pendant les opérations (octets / temps cumulé des opérations)
+  float throughput() const;
+  // Latences en ms
+  float value(OperationStatistic statistic) const;
+};
+
+// Compteurs et histogrammes par opération, protégés par un mutex
+class OperationStatsTable {
+ public:
+  void record(SdMmcOperation operation, uint32_t us, size_t bytes, bool ok);
+  OperationStats get(SdMmcOperation operation) const;
+  void reset();
+
+ protected:
+  mutable std::mutex mutex_;
+  OperationStats stats_[OPERATION_COUNT];
+};
+
+// Mesure une opération entre sa construction et sa destruction. Sans
+// USE_SD_MMC_OPERATION_STATS, la classe est vide et les appels disparaissent à la compilation.
+class OperationTimer {
+ public:
+#ifdef USE_SD_MMC_OPERATION_STATS
+  OperationTimer(OperationStatsTable *table, SdMmcOperation operation);
+  ~OperationTimer();
+  void add_bytes(size_t bytes) { this->bytes_ += bytes; }
+  void set_ok(bool ok) { this->ok_ = ok; }
+#else
+  OperationTimer(OperationStatsTable *table, SdMmcOperation operation) {}
+  void add_bytes(size_t bytes) {}
+  void set_ok(bool ok) {}
+#endif
+  OperationTimer(OperationTimer const &) = delete;
+  OperationTimer &operator=(OperationTimer const &) = delete;
+
+#ifdef USE_SD_MMC_OPERATION_STATS
+ protected:
+  OperationStatsTable *table_;
+  SdMmcOperation operation_;
+  uint32_t start_;
+  size_t bytes_{0};
+  bool ok_{true};
+#endif
+};
+
+#ifdef USE_SD_MMC_ALLOCATION_COUNTER
+// Allocations par operator new faites par la tâche courante depuis le démarrage (option
+// debug_allocations, qui remplace operator new/delete). Les malloc de la libc et de FatFS
+// ne sont pas comptés.
+uint32_t thread_allocation_count();
+#endif
+
+// Compte les allocations faites par la tâche courante pendant une opération et les ajoute à
+// `total`. Sans USE_SD_MMC_ALLOCATION_COUNTER, la classe est vide.
+class AllocationProbe {
+ public:
+#ifdef USE_SD_MMC_ALLOCATION_COUNTER
+  AllocationProbe(std::atomic<uint32_t> &total, SdMmcOperation operation)
+      : total_(total), operation_(operation), start_(thread_allocation_count()) {}
+  ~AllocationProbe();
+#else
+  AllocationProbe(std::atomic<uint32_t> &total, SdMmcOperation operation) {}
+#endif
+  AllocationProbe(AllocationProbe const &) = delete;
+  AllocationProbe &operator=(AllocationProbe const &) = delete;
+
+#ifdef USE_SD_MMC_ALLOCATION_COUNTER
+ protected:
+  std::atomic<uint32_t> &total_;
+  SdMmcOperation operation_;
+  uint32_t start_;
+#endif
+};
+
+#if defined(USE_SENSOR) && defined(USE_SD_MMC_OPERATION_STATS)
+struct OperationSensor {
+  sensor::Sensor *sensor;
+  SdMmcOperation operation;
+  OperationStatistic statistic;
+};
+#endif
+
+// Moment où une écriture est synchronisée (fsync) sur la carte :
+// - NONE : pas de promesse, le pool pousse les données selon flush_interval / flush_threshold ;
+// - PERIODIC : au plus `sync_interval` ms après l'écriture ;
+// - GROUP_COMMIT : avant le retour de l'appel, tous les fichiers en attente étant synchronisés
+//   ensemble ; les appels concurrents partagent le même point de synchronisation ;
+// - EVERY_WRITE : un fsync par écriture.
+// INHERIT reprend le niveau de la règle du chemin.
+enum class Durability : uint8_t { INHERIT, NONE, PERIODIC, GROUP_COMMIT, EVERY_WRITE };
+const char *durability_to_string(Durability durability);
+
+// Règle de durabilité appliquée aux chemins commençant par `prefix` (la plus longue gagne).
+// Avec atomic_write, write_file écrit `<path>.tmp` puis le renomme sur `path`.
+struct DurabilityRule {
+  std::string prefix;
+  Durability level;
+  uint32_t sync_interval;
+  bool atomic_write;
+};
+
+// Points de synchronisation (un fsync groupé compte pour un) et écritures qu'ils couvrent :
+// writes / syncs mesure l'amplification due à la durabilité
+struct SyncStats {
+  uint32_t syncs{0};
+  uint32_t files{0};
+  uint32_t writes{0};
+  LatencyHistogram latency;
+
+  float writes_per_sync() const { return this->syncs == 0 ? NAN : this->writes * 1.0f / this->syncs; }
+};
+
+// Pool LRU de fichiers gardés ouverts en ajout, indexés par chemin.
+// Les données sont poussées sur la carte (fflush + fsync) au-delà d'un seuil d'octets,
+// après un délai ou selon la durabilité de l'ajout ; les accès sont protégés par un mutex.
+class FileHandlePool {
+ public:
+  // Durée du point de synchronisation (us), fichiers synchronisés, écritures couvertes
+  using SyncCallback = std::function<void(uint32_t us, uint32_t files, uint32_t writes)>;
+
+  FileHandlePool(size_t size, uint32_t flush_interval, size_t flush_threshold);
+  ~FileHandlePool();
+
+  // Ajoute `len` octets au fichier ; renvoie les tailles avant/après pour la comptabilité.
+  // En GROUP_COMMIT, `commit` reçoit le ticket à passer à commit() une fois le verrou du
+  // chemin relâché (0 sinon).
+  bool append(const char *path, const uint8_t *buffer, size_t len, Durability durability, uint32_t sync_interval,
+              uint64_t &old_size, uint64_t &new_size, uint64_t &commit);
+  // Attend que l'écriture `commit` soit synchronisée : le premier appelant synchronise tous
+  // les fichiers modifiés, ceux qui arrivent pendant ce temps attendent le point suivant.
+  // commit(0) synchronise tout ce qui est en attente.
+  void commit(uint64_t commit = 0);
+  // Pousse sur la carte les données d'un fichier ouvert (avant une lecture)
+  void flush(const char *path);
+  // Ferme le fichier s'il est ouvert (avant une réécriture, suppression ou renommage)
+  void close(const char *path);
+  // Ferme les fichiers dont le chemin commence par `prefix` (suppression de dossier)
+  void close_prefix(const char *prefix);
+  void flush_due(uint32_t now);
+  void close_all();
+
+  size_t size() const { return this->size_; }
+  uint32_t hits() const { return this->hits_; }
+  uint32_t misses() const { return this->misses_; }
+  void set_on_sync(SyncCallback &&callback) { this->on_sync_ = std::move(callback); }
+
+ protected:
+  struct Handle {
+    std::string path;
+    FILE *file;
+    uint64_t size;
+    size_t dirty_bytes;
+    uint32_t last_flush;
+    uint32_t last_use;
+    // Ajouts depuis le dernier fsync et date du premier d'entre eux ; PERIODIC : délai
+    // avant le fsync (0 = aucun)
+    uint32_t pending_writes;
+    uint32_t dirty_since;
+    uint32_t sync_interval;
+  };
+
+  Handle *find_(const char *path);
+  void flush_(Handle &handle, uint32_t now);
+  // Fermeture, éviction : attendent la fin d'un commit() dont le fsync se fait hors du mutex
+  void wait_commit_(std::unique_lock<std::mutex> &lock);
+  void close_(Handle &handle);
+
+  std::vector<Handle> handles_;
+  size_t size_;
+  uint32_t flush_interval_;
+  size_t flush_threshold_;
+  uint32_t use_counter_{0};
+  uint32_t hits_{0};
+  uint32_t misses_{0};
+  // Numéro du dernier ajout et du dernier ajout couvert par un commit()
+  uint64_t write_sequence_{0};
+  uint64_t committed_sequence_{0};
+  bool committing_{false};
+  // Fichiers synchronisés par le commit() en cours (capacité réservée à la construction)
+  std::vector<FILE *> commit_files_;
+  SyncCallback on_sync_;
+  std::mutex mutex_;
+  std::condition_variable commit_cv_;
+};
+
+struct FileMetadata {
+  bool exists{false};
+  bool is_directory{false};
+  uint64_t size{0};
+  time_t mtime{0};
+
+  static FileMetadata file(uint64_t size) { return FileMetadata{true, false, size, time(nullptr)}; }
+  static FileMetadata directory() { return FileMetadata{true, true, 0, time(nullptr)}; }
+  static FileMetadata missing() { return FileMetadata{}; }
+};
+
+// Cache LRU des métadonnées (type, taille, date) indexé par chemin, chemins absents compris.
+// Rempli à la demande et tenu à jour par chaque méthode de SdMmc qui modifie la carte.
+class MetadataIndex {
+ public:
+  explicit MetadataIndex(size_t capacity) : capacity_(capacity) {}
+
+  bool find(const char *path, FileMetadata &metadata);
+  void put(const char *path, FileMetadata const &metadata);
+  void invalidate(const char *path);
+  // Oublie `prefix` et tout ce qu'il contient (suppression de dossier)
+  void invalidate_prefix(const char *prefix);
+  void clear();
+
+  size_t capacity() const { return this->capacity_; }
+  size_t size() const;
+  uint32_t hits() const { return this->hits_; }
+  uint32_t misses() const { return this->misses_; }
+  uint32_t invalidations() const { return this->invalidations_; }
+
+ protected:
+  using Entry = std::pair<std::string, FileMetadata>;
+
+  // Entrée la plus récente en tête
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> map_;
+  size_t capacity_;
+  std::atomic<uint32_t> hits_{0};
+  std::atomic<uint32_t> misses_{0};
+  std::atomic<uint32_t> invalidations_{0};
+  mutable std::mutex mutex_;
+};
+
+// Cache LRU de secteurs de 512 octets entre FatFS et le pilote SDMMC (ESP-IDF). Les lectures
+// d'un seul secteur, c'est-à-dire les secteurs de FAT, de répertoire et les bouts de fichier
+// lus par FatFS, sont gardées ; les lectures de plusieurs secteurs (données de fichier)
+// passent directement. Les écritures vont toujours jusqu'à la carte et mettent à jour les
+// copies ; seuls les secteurs de la zone système (avant data_start) y sont ajoutés.
+// Les données sont en PSRAM si possible, sans allocation après la construction.
+class SectorCache {
+ public:
+  static constexpr size_t SECTOR_SIZE = 512;
+  static constexpr size_t MAX_SECTORS = 32768;
+  using DeviceRead = std::function<bool(uint32_t sector, uint8_t *buffer, uint32_t count)>;
+  using DeviceWrite = std::function<bool(uint32_t sector, const uint8_t *buffer, uint32_t count)>;
+
+  // `size` en octets, arrondi au secteur
+  explicit SectorCache(size_t size);
+  ~SectorCache();
+  SectorCache(SectorCache const &) = delete;
+  SectorCache &operator=(SectorCache const &) = delete;
+
+  bool ok() const { return this->data_ != nullptr; }
+  size_t capacity() const { return this->capacity_; }
+  bool is_external() const { return this->external_; }
+  // Premier secteur de la zone de données (0 tant qu'il n'est pas connu)
+  void set_data_start(uint32_t sector) { this->data_start_ = sector; }
+
+  bool read(uint32_t sector, uint8_t *buffer, uint32_t count, DeviceRead const &device);
+  bool write(uint32_t sector, const uint8_t *buffer, uint32_t count, DeviceWrite const &device);
+  // Secteurs écrits sans passer par le cache (écriture directe par étendue)
+  void invalidate(uint32_t sector, uint32_t count);
+  void clear();
+
+  uint32_t hits() const { return this->hits_; }
+  uint32_t misses() const { return this->misses_; }
+  // Secteurs lus directement, hors cache
+  uint32_t bypassed() const { return this->bypassed_; }
+  // Pourcentage de secteurs servis par le cache parmi ceux qui pouvaient l'être
+  float hit_rate() const;
+  void reset_stats();
+
+ protected:
+  static constexpr uint16_t NONE = 0xFFFF;
+  struct Entry {
+    uint32_t sector;
+    uint16_t prev{NONE};
+    uint16_t next{NONE};
+    uint16_t chain{NONE};
+    bool used{false};
+  };
+
+  uint16_t find_(uint32_t sector) const;
+  void unlink_(uint16_t index);
+  void push_front_(uint16_t index);
+  void remove_(uint16_t index);
+  // Entrée pour `sector`, réutilise la moins récente si le cache est plein ; NONE sans
+  // aucune entrée disponible
+  uint16_t insert_(uint32_t sector);
+  uint8_t *sector_data_(uint16_t index) const { return this->data_ + static_cast<size_t>(index) * SECTOR_SIZE; }
+  size_t bucket_(uint32_t sector) const { return (sector * 2654435761u) & (this->buckets_.size() - 1); }
+
+  size_t capacity_;
+  bool external_{false};
+  uint8_t *data_{nullptr};
+  std::vector<Entry> entries_;
+  std::vector<uint16_t> buckets_;
+  uint16_t head_{NONE};
+  uint16_t tail_{NONE};
+  uint16_t free_{0};
+  // Entrées libérées par invalidate(), chaînées par `chain`
+  uint16_t free_list_{NONE};
+  uint32_t data_start_{0};
+  // Incrémenté à chaque invalidation : une lecture en cours pendant une invalidation n'est
+  // pas mise en cache
+  uint32_t generation_{0};
+  std::atomic<uint32_t> hits_{0};
+  std::atomic<uint32_t> misses_{0};
+  std::atomic<uint32_t> bypassed_{0};
+  mutable std::mutex mutex_;
+};
+
+// Statistiques de contention des verrous de chemins et du verrou de volume
+struct LockStats {
+  uint32_t acquisitions{0};
+  // Acquisitions qui ont dû attendre
+  uint32_t contentions{0};
+  uint64_t wait_us{0};
+  uint32_t max_wait_us{0};
+  uint32_t max_hold_us{0};
+};
+
+// Verrous lecteurs/rédacteur par chemin exact : des chemins différents ne se bloquent jamais.
+// Une entrée n'existe que tant que le chemin est verrouillé ou attendu. Les rédacteurs en
+// attente passent avant les nouveaux lecteurs ; un callback ne doit donc pas reprendre le
+// chemin que son propre appel tient déjà.
+// Les entrées vivent dans SLOTS emplacements fixes (chemins de moins de SLOT_PATH_SIZE
+// octets) : verrouiller ne fait pas d'allocation. Au-delà, elles débordent dans une table.
+class PathLocks {
+ public:
+  static constexpr size_t SLOTS = 8;
+  static constexpr size_t SLOT_PATH_SIZE = 96;
+
+ protected:
+  struct Entry {
+    uint16_t readers{0};
+    uint16_t waiting_readers{0};
+    uint16_t waiting_writers{0};
+    bool writer{false};
+    int8_t slot{-1};
+    const std::string *overflow_key{nullptr};
+    bool idle() const {
+      return !this->writer && this->readers == 0 && this->waiting_readers == 0 && this->waiting_writers == 0;
+    }
+  };
+
+ public:
+  class Guard {
+   public:
+    Guard() = default;
+    Guard(PathLocks *owner, const char *path, bool exclusive);
+    Guard(Guard &&other) noexcept { *this = std::move(other); }
+    Guard &operator=(Guard &&other) noexcept;
+    ~Guard() { this->release(); }
+    void release();
+
+   protected:
+    PathLocks *owner_{nullptr};
+    Entry *entry_{nullptr};
+    bool exclusive_{false};
+    uint32_t acquired_us_{0};
+  };
+
+  Guard lock_shared(const char *path) { return Guard(this, path, false); }
+  Guard lock_exclusive(const char *path) { return Guard(this, path, true); }
+  // Deux chemins (différents) pris toujours dans l'ordre lexicographique, quel que soit
+  // l'ordre des arguments : deux copies croisées a -> b et b -> a ne s'interbloquent pas
+  void lock_pair(const char *first, bool first_exclusive, Guard &first_guard, const char *second,
+                 bool second_exclusive, Guard &second_guard);
+  LockStats stats() const;
+  void reset_stats();
+
+ protected:
+  struct Slot {
+    Entry entry;
+    bool used{false};
+    char path[SLOT_PATH_SIZE];
+  };
+
+  // L'entrée reste en place tant qu'elle n'est pas libre : le pointeur est stable
+  Entry *acquire_(const char *path, bool exclusive);
+  void release_(Entry *entry, bool exclusive, uint32_t held_us);
+  Entry *find_or_insert_(const char *path);
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  Slot slots_[SLOTS];
+  std::unordered_map<std::string, Entry> overflow_;
+  LockStats stats_;
+};
+
+// Verrou du volume pour les opérations qui modifient l'arborescence (création, suppression).
+// Toujours pris après le verrou du chemin concerné.
+class VolumeLock {
+ public:
+  void lock();
+  void unlock();
+  LockStats stats() const;
+  void reset_stats();
+
+ protected:
+  std::mutex mutex_;
+  mutable std::mutex stats_mutex_;
+  uint32_t acquired_us_{0};
+  LockStats stats_;
+};
+
+// File d'écriture différée : les écritures sont copiées dans un tampon circulaire
+// (PSRAM si disponible) et écrites sur la carte par une tâche de fond.
+class WriteBehindQueue {
+ public:
+  explicit WriteBehindQueue(size_t capacity);
+  ~WriteBehindQueue();
+
+  void start();
+  void stop();
+  // Non bloquant : renvoie false et compte une perte si le tampon est plein
+  bool enqueue(const char *path, const uint8_t *buffer, size_t len, bool append);
+  // Bloque jusqu'à ce que toutes les écritures en attente soient sur la carte (rend la main
+  // tout de suite en pause)
+  void flush();
+  // En pause (carte démontée), les écritures s'accumulent dans le tampon sans être écrites ;
+  // la mise en pause attend la fin de l'écriture en cours
+  void set_paused(bool paused);
+  bool is_paused() const;
+
+  size_t capacity() const { return this->capacity_; }
+  size_t depth() const;
+  size_t pending_bytes() const;
+  uint32_t dropped() const { return this->dropped_; }
+  uint32_t last_flush_latency() const { return this->last_flush_latency_; }
+  // Appelé par la tâche d'écriture avant d'ouvrir un fichier
+  void set_on_write_start(std::function<void(const char *)> &&callback) { this->on_write_start_ = std::move(callback); }
+  // Appelé par la tâche d'écriture avec l'ancienne et la nouvelle taille du fichier
+  void set_on_written(std::function<void(const char *, uint64_t, uint64_t)> &&callback) {
+    this->on_written_ = std::move(callback);
+  }
+  // Appelé par la tâche d'écriture avant de fermer un fichier (synchronisation)
+  void set_on_before_close(std::function<void(const char *, FILE *)> &&callback) {
+    this->on_before_close_ = std::move(callback);
+  }
+  // Chaque écriture tient le verrou de son chemin
+  void set_path_locks(PathLocks *locks) { this->path_locks_ = locks; }
+
+ protected:
+  struct Entry {
+    std::string path;
+    bool append;
+    size_t offset;
+    size_t len;
+    uint32_t enqueued_ms;
+  };
+
+  void run_();
+  bool write_entry_(Entry const &entry);
+  bool write_aligned_(FILE *file, size_t &position, const uint8_t *data, size_t len);
+
+  std::vector<uint8_t, ExternalRAMAllocator<uint8_t>> ring_;
+  size_t capacity_;
+  size_t head_{0};
+  size_t used_{0};
+  std::deque<Entry> entries_;
+  bool in_flight_{false};
+  bool stop_{false};
+  bool paused_{false};
+  mutable std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable idle_cv_;
+  std::thread thread_;
+  std::atomic<uint32_t> dropped_{0};
+  std::atomic<uint32_t> last_flush_latency_{0};
+  std::function<void(const char *)> on_write_start_;
+  std::function<void(const char *, uint64_t, uint64_t)> on_written_;
+  std::function<void(const char *, FILE *)> on_before_close_;
+  PathLocks *path_locks_{nullptr};
+};
+
+class FileStream;
+
+// Journal en segments de taille fixe `<directory>/NNNNNNNN.log`. Chaque segment est
+// préalloué d'un seul bloc contigu quand le backend le permet (f_expand sous ESP-IDF) : les
+// ajouts n'allouent alors aucun cluster. Le segment courant est tronqué à sa taille réelle
+// à la rotation ; sa position est sauvegardée dans `.log_state` à chaque sync pour couper
+// la zone préallouée non écrite après une coupure. Un nouveau segment est ouvert à chaque
+// démarrage. Les segments les plus anciens sont supprimés en tâche de fond selon
+// max_files, max_total_bytes et max_age (0 = pas de limite).
+//
+// append() et sync() peuvent être appelés depuis plusieurs tâches. Les fichiers sont des
+// FileStream de SdMmc, écrits sous le verrou exclusif de leur chemin : le démontage arrête le
+// journal, et le montage suivant ouvre un nouveau segment.
+class RotatingLog {
+ public:
+  RotatingLog(SdMmc *parent, std::string directory, size_t max_file_size);
+  ~RotatingLog();
+
+  void set_max_files(uint32_t max_files) { this->max_files_ = max_files; }
+  void set_max_total_bytes(uint64_t max_total_bytes) { this->max_total_bytes_ = max_total_bytes; }
+  // Âge maximal en secondes, ignoré tant que l'horloge n'est pas réglée
+  void set_max_age(uint32_t max_age) { this->max_age_ = max_age; }
+  void set_sync_interval(uint32_t sync_interval) { this->sync_interval_ = sync_interval; }
+
+  // Récupère les segments existants et ouvre le suivant (après le montage)
+  void start();
+  void stop();
+  // Un enregistrement n'est jamais coupé entre deux segments
+  bool append(const uint8_t *data, size_t len);
+  bool sync();
+  void loop(uint32_t now);
+
+  std::string segment_path(uint32_t number) const;
+  uint32_t segment() const { return this->number_; }
+  size_t segment_count() const;
+  uint64_t bytes_written() const { return this->bytes_written_; }
+  uint32_t rotations() const { return this->rotations_; }
+  uint32_t last_rotation_latency() const { return this->rotation_latency_; }
+
+ protected:
+  struct Segment {
+    uint32_t number;
+    uint64_t size;
+    time_t modified;
+  };
+  struct State {
+    uint32_t number;
+    uint32_t position;
+  };
+
+  // Les méthodes ci-dessous sont appelées avec mutex_ pris, sauf prune_ qui le prend
+  bool sync_();
+  void recover_();
+  bool open_segment_(uint32_t number);
+  void close_segment_();
+  bool rotate_();
+  void write_state_();
+  void schedule_prune_();
+  void prune_();
+
+  SdMmc *parent_;
+  std::string directory_;
+  size_t max_file_size_;
+  uint32_t max_files_{0};
+  uint64_t max_total_bytes_{0};
+  uint32_t max_age_{0};
+  uint32_t sync_interval_{1000};
+  std::unique_ptr<FileStream> file_;
+  std::string path_;
+  std::unique_ptr<FileStream> state_file_;
+  std::string state_path_;
+  std::atomic<uint32_t> number_{0};
+  size_t position_{0};
+  // Octets réservés sur la carte par le segment courant (préallocation ou données écrites)
+  std::atomic<size_t> allocated_{0};
+  size_t dirty_bytes_{0};
+  uint32_t pending_writes_{0};
+  uint32_t last_sync_{0};
+  // Segments fermés, du plus ancien au plus récent
+  std::deque<Segment> segments_;
+  // Protège le segment courant, sa position, l'état et segments_
+  mutable std::mutex mutex_;
+  std::thread prune_thread_;
+  std::atomic<bool> prune_done_{false};
+  bool prune_pending_{false};
+  // Lus par les capteurs depuis la boucle principale
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint32_t> rotations_{0};
+  std::atomic<uint32_t> rotation_latency_{0};
+};
+
+// Classe pour les opérations de streaming sur les fichiers. Les positions et tailles sont sur
+// 64 bits ; sur ESP-IDF, FatFS/VFS limite encore les fichiers à ce que `off_t` peut adresser.
 class FileStream {
  public:
+  // Tampon stdio par défaut (128 octets avec la newlib d'ESP-IDF)
+  static constexpr size_t DEFAULT_BUFFER = SIZE_MAX;
+  // Sans tampon : read()/write() vont directement au système de fichiers. Avec des tampons
+  // de allocate_stream_buffer() et des multiples de 512 octets, FatFS transfère les secteurs
+  // entiers par DMA directement dans le tampon de l'appelant.
+  static constexpr size_t UNBUFFERED = 0;
+
   FileStream() = default;
   ~FileStream();
   
-  // Ouvre un fichier en mode lecture
-  bool open_read(const char* path);
+  // Ouvre un fichier en mode lecture, avec un tampon de `buffer_size` octets
+  bool open_read(const char* path, size_t buffer_size = DEFAULT_BUFFER);
   
-  // Ouvre un fichier en mode écriture
-  bool open_write(const char* path, const char* mode);
+  // Ouvre un fichier en mode écriture, avec un tampon de `buffer_size` octets
+  bool open_write(const char* path, const char* mode, size_t buffer_size = DEFAULT_BUFFER);
   
-  // Lit un bloc de données
+  // Lit un bloc de données à la position courante
   size_t read(uint8_t* buffer, size_t max_size);
   
-  // Écrit un bloc de données
+  // Écrit un bloc de données à la position courante
   size_t write(const uint8_t* buffer, size_t len);
+
+  // Lit / écrit à `offset` sans déplacer la position courante. En mode ajout ("a"),
+  // pwrite écrit à la fin du fichier quel que soit `offset`.
+  size_t pread(uint8_t* buffer, size_t max_size, uint64_t offset);
+  size_t pwrite(const uint8_t* buffer, size_t len, uint64_t offset);
   
   // Renvoie si le stream est arrivé à la fin
   bool eof() const;
@@ -88,28 +864,221 @@ class FileStream {
   // Renvoie si le fichier est ouvert
   bool is_open() const;
   
-  // Obtient la taille du fichier
-  size_t size() const;
+  // Obtient la taille du fichier (écritures par ce stream comprises)
+  uint64_t size() const;
   
   // Position actuelle dans le fichier
-  size_t tell() const;
+  uint64_t tell() const;
   
   // Déplace la position dans le fichier
-  bool seek(size_t position);
+  bool seek(uint64_t position);
+
+  // Fixe la taille du fichier à `size` octets ; la position courante n'est pas modifiée
+  bool truncate(uint64_t size);
+
+  // Vide le tampon stdio vers le système de fichiers
+  bool flush();
+
+  // flush() puis fsync : les données et la taille sont sur la carte au retour
+  bool sync();
+
+  // Appelé une fois à la fermeture du fichier
+  void set_on_close(std::function<void()> &&callback) { this->on_close_ = std::move(callback); }
+  // Table où comptabiliser read()/write() (nullptr : pas de statistiques)
+  void set_operation_stats(OperationStatsTable *table) { this->operation_stats_ = table; }
 
  private:
+  friend class SdMmc;
+  enum class LastOperation : uint8_t { NONE, READ, WRITE };
+
+  bool open_(const char* path, const char* mode, size_t buffer_size);
+  void close_file_();
+  // Rend le descripteur cohérent avec le tampon stdio avant un accès positionnel
+  bool sync_stdio_(bool drop_read_buffer);
+
   FILE* file_{nullptr};
-  size_t file_size_{0};
+  uint8_t* buffer_{nullptr};
+  uint64_t file_size_{0};
+  // Suivie ici : ftell coûte un lseek sur la newlib
+  uint64_t position_{0};
+  bool append_{false};
+  LastOperation last_operation_{LastOperation::NONE};
+  std::function<void()> on_close_;
+  OperationStatsTable *operation_stats_{nullptr};
+  // Carte du fichier (stream ouvert par SdMmc) : chaque opération la garde montée et le
+  // démontage ferme le stream
+  SdMmc *parent_{nullptr};
+};
+
+// Enregistrement à haut débit dans un fichier dont les clusters sont réservés d'un seul
+// bloc à l'ouverture. Les données passent par un tampon DMA et sont écrites directement
+// par runs de secteurs (sdmmc_write_sectors), sans FatFS : ni FAT ni entrée de répertoire
+// ne sont touchées pendant l'écriture. La taille du fichier n'est mise à jour que par
+// checkpoint() et close(), qui rend aussi les clusters non utilisés. Après une coupure, le
+// fichier a la taille du dernier checkpoint et garde ses clusters réservés. Une fois la carte
+// démontée, les écritures échouent et close() abandonne l'étendue sans toucher au volume.
+class ExtentWriter {
+ public:
+  static constexpr size_t SECTOR_SIZE = 512;
+
+  ExtentWriter(SdMmc *parent, std::string path, ExtentHandle *handle, uint64_t first_sector, uint64_t capacity,
+               size_t buffer_size);
+  ~ExtentWriter();
+
+  // Renvoie le nombre d'octets acceptés (moins que `len` une fois la capacité atteinte)
+  size_t write(const uint8_t *data, size_t len);
+  // Écrit le tampon (dernier secteur partiel compris) et publie la taille dans le répertoire
+  bool checkpoint();
+  bool close();
+  bool is_open() const { return this->handle_ != nullptr; }
+
+  uint64_t size() const { return this->size_; }
+  uint64_t capacity() const { return this->capacity_; }
+  // Débit soutenu de la carte en MB/s (octets écrits / temps passé dans les écritures)
+  float throughput() const;
+  // Latence des écritures de secteurs en µs, pour dimensionner les tampons de capture
+  uint32_t max_write_latency() const { return this->latency_.max(); }
+  LatencyHistogram const &write_latency() const { return this->latency_; }
+
+ protected:
+  bool flush_(bool partial);
+  // false si la carte a été démontée depuis l'ouverture ; appelé sous MountGuard
+  bool same_card_(bool mounted) const;
+
+  SdMmc *parent_;
+  std::string path_;
+  ExtentHandle *handle_;
+  uint32_t generation_;
+  uint64_t first_sector_;
+  uint64_t capacity_;
+  uint64_t size_{0};
+  // Prochain secteur à écrire, relatif au début de l'étendue
+  uint64_t sector_{0};
+  uint8_t *buffer_;
+  size_t buffer_size_;
+  size_t buffer_used_{0};
+  uint64_t bytes_on_card_{0};
+  uint64_t busy_us_{0};
+  LatencyHistogram latency_;
+};
+
+// Compression LZSS par blocs indépendants. Chaque trame porte un en-tête de 12 octets
+// (magic, drapeaux, taille brute, taille compressée, CRC-32 des données brutes) : un fichier
+// compressé s'étend par simple ajout de trames et se relit à partir de n'importe quelle trame.
+// La fenêtre (2^window_bits octets, 8 à 12) ne limite que la recherche des correspondances :
+// elle fixe la mémoire et le temps CPU du compresseur, pas le format.
+class BlockCompressor {
+ public:
+  static constexpr size_t HEADER_SIZE = 12;
+  static constexpr size_t MAX_BLOCK_SIZE = 32768;
+
+  BlockCompressor(uint8_t window_bits, size_t block_size);
+
+  size_t block_size() const { return this->block_size_; }
+  // Taille maximale de la trame produite pour `len` octets (len <= block_size)
+  static size_t max_frame_size(size_t len) { return HEADER_SIZE + len + (len + 7) / 8; }
+  // Compresse un bloc dans `out` (au moins max_frame_size(len) octets) ; renvoie la taille de la
+  // trame. Un bloc qui ne se compresse pas est stocké tel quel.
+  size_t compress_frame(const uint8_t *in, size_t len, uint8_t *out);
+
+  // Lit l'en-tête d'une trame ; false si ce n'en est pas une
+  static bool parse_header(const uint8_t *frame, size_t &raw_len, size_t &payload_len);
+  // Décompresse la charge utile d'une trame dans `out` (raw_len octets) et vérifie son CRC
+  static bool decompress_frame(const uint8_t *frame, uint8_t *out);
+
+ protected:
+  size_t compress_(const uint8_t *in, size_t len, uint8_t *out, size_t capacity);
+
+  uint8_t window_bits_;
+  size_t block_size_;
+  // Chaînes de hachage : dernière position de chaque empreinte et position précédente
+  std::vector<uint16_t> head_;
+  std::vector<uint16_t> prev_;
+};
+
+struct CompressionStats {
+  uint64_t raw_bytes{0};
+  uint64_t compressed_bytes{0};
+  uint64_t compress_us{0};
+  uint64_t decompressed_bytes{0};
+  uint64_t decompress_us{0};
+
+  // Taille brute / taille sur la carte
+  float ratio() const { return this->compressed_bytes == 0 ? NAN : this->raw_bytes * 1.0f / this->compressed_bytes; }
+  // Temps CPU en ms par MB de données brutes
+  float compress_ms_per_mb() const;
+  float decompress_ms_per_mb() const;
 };
 
-class SdMmc : public Component {
+enum class HashAlgorithm : uint8_t { CRC32, SHA256, MD5 };
+const char *hash_algorithm_to_string(HashAlgorithm algorithm);
+
+// Empreinte incrémentale. Sur ESP32, SHA-256 passe par mbedTLS et donc par le périphérique SHA
+// quand l'accélération matérielle est activée (défaut d'ESP-IDF) ; ailleurs, implémentation
+// logicielle.
+class Hasher {
+ public:
+  explicit Hasher(HashAlgorithm algorithm);
+  ~Hasher();
+  Hasher(Hasher const &) = delete;
+  Hasher &operator=(Hasher const &) = delete;
+
+  void update(const uint8_t *data, size_t len);
+  // Empreinte en hexadécimal minuscule ; update() ne doit plus être appelé ensuite
+  std::string finish();
+
+ protected:
+  HashAlgorithm algorithm_;
+  uint32_t crc_{0};
+  // Contexte SHA-256 / MD5, défini dans checksum.cpp
+  void *context_{nullptr};
+};
+
+// État du montage : MOUNTING pendant le montage en tâche de fond, UNMOUNTING pendant
+// l'attente des opérations en cours avant le démontage
+enum class CardState : uint8_t { UNMOUNTED, MOUNTING, MOUNTED, UNMOUNTING };
+const char *card_state_to_string(CardState state);
+
+// Écritures reçues carte démontée : échec immédiat ou mise en file d'écriture différée
+enum class UnmountedPolicy : uint8_t { FAIL, QUEUE };
+
+class SdMmc : public PollingComponent {
 #ifdef USE_SENSOR
   SUB_SENSOR(used_space)
   SUB_SENSOR(total_space)
   SUB_SENSOR(free_space)
+  SUB_SENSOR(write_queue_depth)
+  SUB_SENSOR(write_queue_dropped)
+  SUB_SENSOR(write_queue_latency)
+  SUB_SENSOR(file_handle_hits)
+  SUB_SENSOR(file_handle_misses)
+  SUB_SENSOR(metadata_hits)
+  SUB_SENSOR(metadata_misses)
+  SUB_SENSOR(metadata_invalidations)
+  SUB_SENSOR(sector_cache_hits)
+  SUB_SENSOR(sector_cache_misses)
+  SUB_SENSOR(sector_cache_hit_rate)
+  SUB_SENSOR(hot_path_allocations)
+  SUB_SENSOR(bus_frequency)
+  SUB_SENSOR(bus_throughput)
+  SUB_SENSOR(log_segment)
+  SUB_SENSOR(log_bytes_written)
+  SUB_SENSOR(log_rotation_latency)
+  SUB_SENSOR(compression_ratio)
+  SUB_SENSOR(compression_time)
+  SUB_SENSOR(decompression_time)
+  SUB_SENSOR(lock_contentions)
+  SUB_SENSOR(lock_wait_time)
+  SUB_SENSOR(lock_hold_time)
+  SUB_SENSOR(ready_time)
+  SUB_SENSOR(mount_time)
+  SUB_SENSOR(sync_count)
+  SUB_SENSOR(sync_latency)
+  SUB_SENSOR(writes_per_sync)
 #endif
 #ifdef USE_TEXT_SENSOR
   SUB_TEXT_SENSOR(sd_card_type)
+  SUB_TEXT_SENSOR(last_checksum)
 #endif
  public:
   enum ErrorCode {
@@ -119,45 +1088,232 @@ class SdMmc : public Component {
   };
   void setup() override;
   void loop() override;
+  void update() override;
   void dump_config() override;
-  
-  // Méthodes de fichier traditionnelles
-  void write_file(const char *path, const uint8_t *buffer, size_t len, const char *mode);
-  void write_file(const char *path, const uint8_t *buffer, size_t len);
-  void append_file(const char *path, const uint8_t *buffer, size_t len);
+  void on_shutdown() override;
+
+  // Montage en tâche de fond : setup() rend la main tout de suite et on_ready est appelé une
+  // fois la carte montée. Tant qu'elle ne l'est pas, les opérations échouent sans attendre
+  // (les écritures sont mises en file avec when_unmounted: queue). unmount() attend la fin
+  // des opérations en cours : ne pas l'appeler depuis un callback de process_file ou de
+  // walk_directory. Le démontage ferme les FileStream ouverts par open_file_read/open_file_write
+  // (le tampon est écrit si la carte est encore là) ; leurs opérations échouent ensuite, même
+  // après un remontage. Les ExtentWriter ouverts échouent de même jusqu'à leur fermeture ; les
+  // RecordStore écrivent leur bloc avant le démontage et rouvrent leurs fichiers au remontage.
+  void mount();
+  void unmount();
+  void remount();
+  CardState get_card_state() const { return this->card_state_; }
+  bool is_mounted() const { return this->card_state_ == CardState::MOUNTED; }
+  // Incrémenté au début de chaque démontage : un fichier ouvert sous une génération antérieure
+  // appartient à une carte qui n'est plus montée (ou a été remplacée)
+  uint32_t get_mount_generation() const { return this->mount_generation_; }
+  // Millisecondes entre le démarrage et le premier montage réussi (0 avant)
+  uint32_t get_ready_time() const { return this->ready_time_; }
+  void add_on_ready_callback(std::function<void()> &&callback) { this->ready_callback_.add(std::move(callback)); }
+  void set_card_detect_pin(GPIOPin *pin) { this->card_detect_pin_ = pin; }
+  // Délai avant une nouvelle tentative après un montage raté (0 = pas de nouvelle tentative)
+  void set_mount_retry_interval(uint32_t interval) { this->mount_retry_interval_ = interval; }
+  void set_unmounted_policy(UnmountedPolicy policy) { this->unmounted_policy_ = policy; }
+
+  // Accès concurrents : les méthodes ci-dessous peuvent être appelées depuis plusieurs tâches.
+  // Lectures (read_file*, process_file*) : verrou partagé du chemin ; écritures (write_file,
+  // append_file, write_file_stream*, file d'écriture différée) : verrou exclusif ; création et
+  // suppression : verrou exclusif du chemin puis verrou du volume. Les FileStream ouverts par
+  // open_file_read/open_file_write ne sont pas protégés pendant leur utilisation.
+
+  // Méthodes de fichier traditionnelles. Les surcharges std::string_view (qui acceptent aussi
+  // std::string) recopient le chemin dans un PathBuffer sur la pile ; write_file, append_file
+  // et read_file_into ne font aucune allocation une fois le fichier ouvert par le système.
+  // `durability` remplace le niveau de la règle du chemin (voir Durability). write_file et
+  // append_file renvoient false si les données ne sont pas toutes écrites (ou mises en file).
+  bool write_file(const char *path, const uint8_t *buffer, size_t len, const char *mode,
+                  Durability durability = Durability::INHERIT);
+  bool write_file(const char *path, const uint8_t *buffer, size_t len);
+  bool write_file(const char *path, const uint8_t *buffer, size_t len, Durability durability);
+  bool write_file(std::string_view path, const uint8_t *buffer, size_t len);
+  bool append_file(const char *path, const uint8_t *buffer, size_t len, Durability durability = Durability::INHERIT);
+  bool append_file(std::string_view path, const uint8_t *buffer, size_t len);
   bool delete_file(const char *path);
-  bool delete_file(std::string const &path);
+  bool delete_file(std::string_view path);
   bool create_directory(const char *path);
+  bool create_directory(std::string_view path);
   bool remove_directory(const char *path);
-  bool exists(const std::string &path);
-  size_t get_file_size(const std::string &path);
+  bool remove_directory(std::string_view path);
+  // Copie `source` sur `destination` (remplacé s'il existe) par blocs de `buffer_size` : le
+  // bloc suivant est lu par une tâche de fond pendant l'écriture du bloc courant
+  bool copy_file(const char *source, const char *destination, size_t buffer_size = DEFAULT_COPY_BUFFER_SIZE);
+  bool copy_file(std::string_view source, std::string_view destination,
+                 size_t buffer_size = DEFAULT_COPY_BUFFER_SIZE);
+  // Renomme un fichier ou un dossier ; un fichier `destination` existant est remplacé
+  bool move_file(const char *source, const char *destination);
+  bool move_file(std::string_view source, std::string_view destination);
+  // Copie récursive d'un dossier ; les fichiers existants sous `destination` sont remplacés
+  bool copy_tree(const char *source, const char *destination, size_t buffer_size = DEFAULT_COPY_BUFFER_SIZE);
+  bool copy_tree(std::string_view source, std::string_view destination,
+                 size_t buffer_size = DEFAULT_COPY_BUFFER_SIZE);
+  // Supprime un dossier et tout son contenu (ou un fichier)
+  bool remove_tree(const char *path);
+  bool remove_tree(std::string_view path);
+  // Mêmes opérations dans une tâche de fond qui rend la main à loop() par tranches ;
+  // l'avancement est publié depuis loop() (callbacks on_file_operation). `destination` est
+  // ignorée pour REMOVE_TREE. false si une opération est déjà en cours.
+  bool start_file_operation(FileOperationType type, std::string const &source, std::string const &destination = "");
+  void add_on_file_operation_callback(std::function<void(FileOperationProgress)> &&callback) {
+    this->file_operation_callback_.add(std::move(callback));
+  }
+  bool exists(const char *path);
+  bool exists(std::string_view path);
+  size_t get_file_size(const char *path);
+  size_t get_file_size(std::string_view path);
   std::vector<uint8_t> read_file(char const *path);
-  std::vector<uint8_t> read_file(std::string const &path);
+  std::vector<uint8_t> read_file(std::string_view path);
+
+  // Lecture par blocs dans un tampon fourni ; renvoie le nombre d'octets lus
+  size_t read_file_into(const char *path, uint8_t *buffer, size_t capacity, size_t offset = 0);
+  size_t read_file_into(std::string_view path, uint8_t *buffer, size_t capacity, size_t offset = 0);
+
+  // Lecture complète avec l'allocateur choisi (PSRAM par défaut). Renvoie un vecteur vide si
+  // le fichier dépasse max_read_size ou le plus grand bloc libre : utiliser process_file.
+  template<typename Allocator = ExternalRAMAllocator<uint8_t>>
+  std::vector<uint8_t, Allocator> read_file_alloc(const char *path, Allocator allocator = Allocator()) {
+    std::vector<uint8_t, Allocator> res(allocator);
+    bool external = std::is_same<Allocator, ExternalRAMAllocator<uint8_t>>::value;
+    OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::READ);
+    MountGuard mounted(this);
+    if (!mounted) {
+      timer.set_ok(false);
+      return res;
+    }
+    auto guard = this->path_locks_.lock_shared(path);
+    size_t expected = SIZE_MAX;
+    size_t len = this->read_file_(path, 0, [this, &res, &expected, path, external](size_t file_size, size_t &capacity) {
+      if (!this->can_allocate_read_(path, file_size, external))
+        return static_cast<uint8_t *>(nullptr);
+      res.resize(file_size);
+      capacity = expected = file_size;
+      return res.data();
+    });
+    res.resize(len);
+    timer.add_bytes(len);
+    timer.set_ok(len == expected);
+    return res;
+  }
+  template<typename Allocator = ExternalRAMAllocator<uint8_t>>
+  std::vector<uint8_t, Allocator> read_file_alloc(std::string_view path, Allocator allocator = Allocator()) {
+    return this->read_file_alloc<Allocator>(PathBuffer(path).c_str(), allocator);
+  }
+  void set_max_read_size(size_t max_read_size) { this->max_read_size_ = max_read_size; }
+
+  // Écritures différées (écriture synchrone si la file n'est pas configurée)
+  void set_write_behind_buffer_size(size_t size);
+  bool queue_write_file(const char *path, const uint8_t *buffer, size_t len);
+  bool queue_append_file(const char *path, const uint8_t *buffer, size_t len);
+  void flush_write_queue();
+  WriteBehindQueue *get_write_queue() { return this->write_queue_.get(); }
+
+  // Durabilité : niveau par défaut et règles par préfixe de chemin. write_file ferme le
+  // fichier à chaque appel, PERIODIC y revient donc à NONE et GROUP_COMMIT à EVERY_WRITE ;
+  // les niveaux jouent pleinement sur les ajouts du pool de fichiers. La file d'écriture
+  // différée synchronise avant de fermer les fichiers en GROUP_COMMIT ou EVERY_WRITE.
+  void set_default_durability(Durability level, uint32_t sync_interval, bool atomic_write);
+  void add_durability_rule(std::string const &prefix, Durability level, uint32_t sync_interval, bool atomic_write);
+  DurabilityRule const &get_durability(const char *path) const;
+  // Point de synchronisation immédiat : fichiers du pool et journal rotatif
+  void sync();
+  void record_sync(uint32_t us, uint32_t files, uint32_t writes);
+  SyncStats get_sync_stats() const;
+
+  // Journal rotatif (append_log échoue s'il n'est pas configuré)
+  RotatingLog *set_rotating_log(std::string const &directory, size_t max_file_size);
+  RotatingLog *get_rotating_log() { return this->rotating_log_.get(); }
+  bool append_log(const uint8_t *data, size_t len);
+  // Crée `path` avec `size` octets réservés en un bloc contigu ; false si le backend ne sait
+  // pas préallouer (le fichier n'est alors pas créé)
+  bool preallocate_file(const char *path, size_t size);
+
+  // Réserve `capacity` octets contigus pour `path` et renvoie un ExtentWriter (nullptr si le
+  // backend ne sait pas écrire par secteurs ou si aucune zone contiguë n'est libre).
+  // `buffer_size` est arrondi au secteur ; plus il est grand, moins il y a de commandes.
+  std::unique_ptr<ExtentWriter> open_extent(const char *path, uint64_t capacity, size_t buffer_size = 32 * 1024);
   
   // Nouvelles méthodes pour le streaming
-  std::unique_ptr<FileStream> open_file_read(const char* path);
-  std::unique_ptr<FileStream> open_file_read(const std::string& path);
-  std::unique_ptr<FileStream> open_file_write(const char* path, const char* mode = "w");
-  std::unique_ptr<FileStream> open_file_write(const std::string& path, const char* mode = "w");
+  // `buffer_size` : tampon du stream, voir FileStream::DEFAULT_BUFFER et FileStream::UNBUFFERED
+  std::unique_ptr<FileStream> open_file_read(const char* path, size_t buffer_size = FileStream::DEFAULT_BUFFER);
+  std::unique_ptr<FileStream> open_file_read(std::string_view path, size_t buffer_size = FileStream::DEFAULT_BUFFER);
+  std::unique_ptr<FileStream> open_file_write(const char* path, const char* mode = "w",
+                                              size_t buffer_size = FileStream::DEFAULT_BUFFER);
+  std::unique_ptr<FileStream> open_file_write(std::string_view path, const char* mode = "w",
+                                              size_t buffer_size = FileStream::DEFAULT_BUFFER);
   
   // Callbacks pour le traitement de fichier par morceaux
   using ReadCallback = std::function<bool(const uint8_t* data, size_t size, size_t total_size, size_t position)>;
   using WriteCallback = std::function<size_t(uint8_t* buffer, size_t max_size)>;
   
-  // Traitement d'un fichier par streaming avec callbacks
+  // Traitement d'un fichier par streaming avec callbacks. La lecture du bloc suivant se fait
+  // dans une tâche de fond pendant que le callback traite le bloc courant ; `position` est
+  // l'offset du bloc dans le fichier. Le callback arrête la lecture en renvoyant false.
+  // WriteCallback remplit le tampon et renvoie le nombre d'octets, 0 pour terminer.
   bool process_file(const char* path, ReadCallback callback, size_t buffer_size = DEFAULT_STREAM_BUFFER_SIZE);
-  bool process_file(const std::string& path, ReadCallback callback, size_t buffer_size = DEFAULT_STREAM_BUFFER_SIZE);
+  bool process_file(std::string_view path, ReadCallback callback, size_t buffer_size = DEFAULT_STREAM_BUFFER_SIZE);
   bool write_file_stream(const char* path, WriteCallback callback, size_t buffer_size = DEFAULT_STREAM_BUFFER_SIZE);
-  bool write_file_stream(const std::string& path, WriteCallback callback, size_t buffer_size = DEFAULT_STREAM_BUFFER_SIZE);
+  bool write_file_stream(std::string_view path, WriteCallback callback, size_t buffer_size = DEFAULT_STREAM_BUFFER_SIZE);
+
+  // Fichiers compressés par blocs (voir BlockCompressor). Sans set_compression(), fenêtre de
+  // 2^10 octets et blocs de 4 Ko. compress() renvoie les trames à écrire telles quelles, par
+  // exemple avec queue_append_file ; un appel produit au moins une trame, mieux vaut donc
+  // regrouper les petites écritures.
+  void set_compression(uint8_t window_bits, size_t block_size);
+  std::vector<uint8_t> compress(const uint8_t *data, size_t len);
+  void append_file_compressed(const char *path, const uint8_t *data, size_t len);
+  // Les données du callback sont découpées en blocs et compressées au fil de l'eau
+  bool write_file_stream_compressed(const char *path, WriteCallback callback, bool append = false);
+  // Rend les données décompressées bloc par bloc à partir de l'offset brut `offset` : les
+  // trames précédentes sont sautées grâce à leur en-tête, sans être lues ni décompressées.
+  // `position` est l'offset brut et `total_size` la taille décompressée, lue dans les en-têtes
+  // avant le premier appel (jusqu'à la première trame invalide). La lecture s'arrête (false)
+  // sur une trame corrompue ou tronquée.
+  bool process_file_compressed(const char *path, ReadCallback callback, size_t offset = 0);
+  CompressionStats get_compression_stats();
+
+  // Empreinte d'un fichier lu par grands blocs, la lecture du bloc suivant se faisant pendant
+  // le calcul ; chaîne vide en cas d'erreur
+  std::string checksum(const char *path, HashAlgorithm algorithm, size_t buffer_size = 16384);
+  // Même calcul dans une tâche de fond, le résultat est publié depuis loop() (callbacks
+  // on_checksum et capteur texte last_checksum). Avec `expected`, le résultat est comparé à
+  // cette empreinte. false si un calcul est déjà en cours.
+  bool start_checksum(std::string const &path, HashAlgorithm algorithm, std::string const &expected = "");
+  // path, empreinte (vide en cas d'erreur), succès (empreinte calculée et égale à `expected`)
+  void add_on_checksum_callback(std::function<void(std::string, std::string, bool)> &&callback) {
+    this->checksum_callback_.add(std::move(callback));
+  }
 
   bool is_directory(const char *path);
-  bool is_directory(std::string const &path);
+  bool is_directory(std::string_view path);
   std::vector<std::string> list_directory(const char *path, uint8_t depth);
-  std::vector<std::string> list_directory(std::string path, uint8_t depth);
+  std::vector<std::string> list_directory(std::string_view path, uint8_t depth);
   std::vector<FileInfo> list_directory_file_info(const char *path, uint8_t depth);
-  std::vector<FileInfo> list_directory_file_info(std::string path, uint8_t depth);
+  std::vector<FileInfo> list_directory_file_info(std::string_view path, uint8_t depth);
+
+  // Parcours itératif en profondeur, un seul répertoire ouvert par niveau et aucune
+  // liste en mémoire. Le callback renvoie false pour arrêter le parcours.
+  using WalkCallback = std::function<bool(DirEntry const &entry)>;
+  bool walk_directory(const char *path, WalkCallback const &callback, WalkOptions const &options = WalkOptions());
+  bool walk_directory(std::string_view path, WalkCallback const &callback,
+                      WalkOptions const &options = WalkOptions());
+  // Recherche sur walk_directory : les entrées ne sont jamais toutes en mémoire, seulement
+  // les `limit` meilleures. `results` est remplacé, dans l'ordre du tri demandé.
+  bool find(const char *root, FindOptions const &options, std::vector<FindResult> &results);
+  bool find(std::string_view root, FindOptions const &options, std::vector<FindResult> &results);
+  // Même recherche dans une tâche de fond, le résultat est publié depuis loop() (callbacks
+  // on_find). `options.pattern` est copié. false si une recherche est déjà en cours.
+  bool start_find(std::string const &root, FindOptions const &options);
+  // résultats, succès
+  void add_on_find_callback(std::function<void(std::vector<FindResult>, bool)> &&callback) {
+    this->find_callback_.add(std::move(callback));
+  }
   size_t file_size(const char *path);
-  size_t file_size(std::string const &path);
+  size_t file_size(std::string_view path);
 #ifdef USE_SENSOR
   void add_file_size_sensor(sensor::Sensor *, std::string const &path);
 #endif
@@ -170,6 +1326,50 @@ class SdMmc : public Component {
   void set_data3_pin(uint8_t);
   void set_mode_1bit(bool);
   void set_power_ctrl_pin(GPIOPin *);
+  void set_space_reconcile_interval(uint32_t interval) { this->space_reconcile_interval_ = interval; }
+  void set_max_open_files(uint8_t max_open_files) { this->max_open_files_ = max_open_files; }
+  void set_file_handle_pool(size_t size, uint32_t flush_interval, size_t flush_threshold);
+  FileHandlePool *get_file_handle_pool() { return this->handle_pool_.get(); }
+  void set_metadata_cache_size(size_t size);
+  MetadataIndex *get_metadata_index() { return this->metadata_index_.get(); }
+  // Cache de secteurs sous FatFS (ESP-IDF uniquement), installé au montage
+  void set_sector_cache_size(size_t size);
+  SectorCache *get_sector_cache() { return this->sector_cache_.get(); }
+  void set_bus_speed(BusSpeed speed) { this->bus_speed_ = speed; }
+  void set_allocation_unit_size(size_t size) { this->allocation_unit_size_ = size; }
+  uint32_t get_bus_frequency() const { return this->bus_frequency_khz_; }
+  float get_bus_throughput() const { return this->bus_throughput_; }
+
+  // Comptabilité incrémentale de l'espace occupé (arrondi aux clusters)
+  void account_file_change(uint64_t old_size, uint64_t new_size);
+  void account_directory_change(bool created);
+  // Relance un calcul complet de l'espace libre en tâche de fond
+  void start_space_scan();
+
+  // Statistiques par opération, compilées avec l'option operation_stats ou un capteur operation_*
+#ifdef USE_SD_MMC_OPERATION_STATS
+  OperationStats get_operation_stats(SdMmcOperation operation) const { return this->operation_stats_.get(operation); }
+#ifdef USE_SENSOR
+  void add_operation_sensor(sensor::Sensor *sensor, SdMmcOperation operation, OperationStatistic statistic);
+#endif
+#endif
+  // Remet à zéro les statistiques d'opérations, de verrous, de synchronisation et du cache de secteurs
+  void reset_statistics();
+
+  // Allocations faites par write_file, append_file et read_file_into (option debug_allocations)
+  uint32_t get_hot_path_allocations() const { return this->hot_path_allocations_; }
+
+  PathLocks &get_path_locks() { return this->path_locks_; }
+  // Appelés par RecordStore::open()/close() : loop() synchronise le bloc courant des journaux
+  // ouverts et le démontage l'écrit avant d'attendre les opérations en cours
+  void register_record_store(RecordStore *store);
+  void unregister_record_store(RecordStore *store);
+  LockStats get_path_lock_stats() const { return this->path_locks_.stats(); }
+  LockStats get_volume_lock_stats() const { return this->volume_lock_.stats(); }
+#ifdef USE_HOST
+  void set_host_root(std::string const &root);
+  void set_host_bus_model(HostBusModel const &model);
+#endif
 
  protected:
   ErrorCode init_error_;
@@ -183,27 +1383,308 @@ class SdMmc : public Component {
   GPIOPin *power_ctrl_pin_{nullptr};
 
 #ifdef USE_ESP_IDF
-  sdmmc_card_t *card_;
+  sdmmc_card_t *card_{nullptr};
+#endif
+#ifdef USE_HOST
+  HostBusModel bus_model_{};
 #endif
 #ifdef USE_SENSOR
   std::vector<FileSizeSensor> file_size_sensors_{};
+#ifdef USE_SD_MMC_OPERATION_STATS
+  std::vector<OperationSensor> operation_sensors_{};
+#endif
+#endif
+#ifdef USE_SD_MMC_OPERATION_STATS
+  mutable OperationStatsTable operation_stats_;
 #endif
+  PathLocks path_locks_;
+  VolumeLock volume_lock_;
+  std::atomic<uint32_t> hot_path_allocations_{0};
+  std::unique_ptr<WriteBehindQueue> write_queue_;
+  std::unique_ptr<RotatingLog> rotating_log_;
+  uint32_t last_queue_publish_{0};
+  std::unique_ptr<FileHandlePool> handle_pool_;
+  std::unique_ptr<MetadataIndex> metadata_index_;
+  std::unique_ptr<SectorCache> sector_cache_;
+  uint8_t compression_window_bits_{10};
+  size_t compression_block_size_{4096};
+  std::unique_ptr<BlockCompressor> compressor_;
+  std::thread checksum_thread_;
+  std::atomic<bool> checksum_done_{false};
+  std::string checksum_path_;
+  HashAlgorithm checksum_algorithm_{HashAlgorithm::CRC32};
+  std::string checksum_expected_;
+  std::string checksum_result_;
+  CallbackManager<void(std::string, std::string, bool)> checksum_callback_;
+  std::thread file_operation_thread_;
+  std::atomic<bool> file_operation_done_{false};
+  std::atomic<bool> file_operation_cancelled_{false};
+  // Protège file_operation_progress_, mis à jour par la tâche et lu par loop()
+  std::mutex file_operation_mutex_;
+  FileOperationProgress file_operation_progress_;
+  uint32_t file_operation_start_{0};
+  uint32_t file_operation_slice_start_{0};
+  uint32_t last_file_operation_publish_{0};
+  CallbackManager<void(FileOperationProgress)> file_operation_callback_;
+  std::thread find_thread_;
+  std::atomic<bool> find_done_{false};
+  std::atomic<bool> find_cancelled_{false};
+  std::string find_root_;
+  std::string find_pattern_;
+  FindOptions find_options_;
+  std::vector<FindResult> find_results_;
+  bool find_ok_{false};
+  CallbackManager<void(std::vector<FindResult>, bool)> find_callback_;
+  std::mutex compression_mutex_;
+  CompressionStats compression_stats_;
+  uint8_t max_open_files_{5};
+  size_t max_read_size_{0};
+
+  DurabilityRule default_durability_{"", Durability::NONE, 1000, false};
+  // Triées du préfixe le plus long au plus court
+  std::vector<DurabilityRule> durability_rules_;
+  mutable std::mutex sync_mutex_;
+  SyncStats sync_stats_;
+  // Un seul remplacement journalisé à la fois (journal unique)
+  std::mutex replace_mutex_;
+
+  BusSpeed bus_speed_{BUS_SPEED_DEFAULT};
+  size_t allocation_unit_size_{16 * 1024};
+  uint32_t bus_frequency_khz_{0};
+  float bus_throughput_{NAN};
+  std::atomic<uint8_t> io_errors_{0};
+  std::atomic<uint32_t> io_error_window_start_{0};
+  // Horloge à appliquer dès que la carte est inactive (0 : aucune)
+  std::atomic<uint32_t> bus_step_khz_{0};
+  std::atomic<bool> bus_paused_{false};
+
+  // Opération sur la carte montée ; le démontage attend qu'elles soient toutes terminées. Une
+  // opération imbriquée dans une autre de la même tâche est toujours admise, de même qu'une
+  // opération sans carte (`parent` nul : FileStream ouvert hors de SdMmc).
+  class MountGuard {
+   public:
+    explicit MountGuard(SdMmc *parent);
+    ~MountGuard();
+    MountGuard(MountGuard const &) = delete;
+    MountGuard &operator=(MountGuard const &) = delete;
+    explicit operator bool() const { return this->mounted_; }
+
+   protected:
+    void release_();
+
+    SdMmc *parent_;
+    bool mounted_;
+  };
+
+  std::atomic<CardState> card_state_{CardState::UNMOUNTED};
+  std::atomic<uint32_t> active_operations_{0};
+  std::atomic<uint32_t> mount_generation_{0};
+  std::mutex mount_mutex_;
+  std::condition_variable mount_cv_;
+  std::thread mount_thread_;
+  std::atomic<bool> mount_done_{false};
+  bool mount_ok_{false};
+  // false après unmount() : pas de remontage automatique jusqu'à mount() ou une insertion
+  bool auto_mount_{true};
+  uint32_t mount_start_{0};
+  uint32_t mount_retry_interval_{10000};
+  uint32_t ready_time_{0};
+  uint32_t last_remount_{0};
+  GPIOPin *card_detect_pin_{nullptr};
+  bool card_present_{true};
+  uint32_t card_detect_stable_{0};
+  UnmountedPolicy unmounted_policy_{UnmountedPolicy::FAIL};
+  CallbackManager<void()> ready_callback_;
+
+  // Lance le montage en tâche de fond ; finish_mount_() le termine depuis loop()
+  void start_mount_();
+  void finish_mount_();
+  // Attend les opérations en cours puis démonte ; `flush` écrit d'abord la file différée
+  void unmount_card_(bool flush);
+  // Refuse les nouvelles opérations, interrompt les opérations de fond et attend la fin de
+  // celles en cours ; l'état reste UNMOUNTING jusqu'à ce que l'appelant le change
+  void drain_operations_();
+  void poll_card_detect_(uint32_t now);
+  // Écriture reçue carte démontée : mise en file selon when_unmounted, sinon échec
+  bool write_unmounted_(const char *path, const uint8_t *buffer, size_t len, bool append);
+
+  // Préparation unique avant le premier montage (implémentée par chaque backend)
+  bool init_bus_();
+  // Montage à une vitesse donnée, démontage et changement d'horloge à chaud (implémentés par chaque backend)
+  bool mount_(BusSpeed speed);
+  void unmount_();
+  bool set_bus_frequency_(uint32_t frequency_khz);
+  // Monte la carte selon bus_speed_ ; en AUTO, de la vitesse la plus haute à la plus basse,
+  // chacune validée par probe_bus_()
+  bool mount_bus_();
+  // Écrit puis relit un fichier de test ; mesure le débit en lecture
+  bool probe_bus_();
+  // Erreur de transfert : au-delà d'un seuil, loop() abaisse l'horloge (mode AUTO)
+  void report_io_error_();
+  void handle_io_errors_();
+  // Change l'horloge demandée par handle_io_errors_() dès que la carte est inactive, sans
+  // interrompre ni attendre les opérations en cours ; celles qui arrivent pendant le
+  // changement attendent dans MountGuard
+  void lower_bus_clock_();
+  void resume_bus_();
+
+  OperationStatsTable *operation_stats_table_() {
+#ifdef USE_SD_MMC_OPERATION_STATS
+    return &this->operation_stats_;
+#else
+    return nullptr;
+#endif
+  }
+
+  // Opérations implémentées par chaque backend, appelées avec les verrous déjà pris.
+  // write_file_ renvoie le nombre d'octets écrits ; avec `sync`, le fichier est synchronisé
+  // avant d'être fermé.
+  size_t write_file_(const char *path, const uint8_t *buffer, size_t len, const char *mode, bool sync);
+  bool create_directory_(const char *path);
+  bool remove_directory_(const char *path);
+  bool delete_file_(const char *path);
+
+  // Reçoit la taille du fichier ouvert et renvoie le tampon de destination et sa capacité
+  // (nullptr pour abandonner la lecture)
+  using ReadAllocator = std::function<uint8_t *(size_t file_size, size_t &capacity)>;
+  // Ouvre le fichier une seule fois et le lit par blocs à partir de `offset` (implémenté par chaque backend)
+  size_t read_file_(const char *path, size_t offset, ReadAllocator const &allocate);
+  bool can_allocate_read_(const char *path, size_t size, bool external) const;
+
+  // Nombre de fichiers ouverts simultanément à réserver au montage
+  uint8_t mount_max_files() const;
+  // fflush + fsync d'un fichier ouvert, compté dans les statistiques de synchronisation
+  bool sync_file_(FILE *file);
+  // Écrit `<path>.tmp`, le synchronise puis le renomme sur `path`. FatFS ne renomme pas sur
+  // un fichier existant : l'ancien est alors supprimé avant, sous la protection d'un journal
+  // que recover_replace_() rejoue au montage suivant après une coupure.
+  size_t replace_file_(const char *path, const uint8_t *buffer, size_t len);
+  void recover_replace_();
+  // Synchronise le pool avant un accès au chemin (lecture : flush, écriture : fermeture)
+  void flush_pooled_file(const char *path);
+  void close_pooled_file(const char *path);
+  // Appelé après chaque bloc copié ; false pour interrompre la copie
+  using CopyCallback = std::function<bool(size_t len)>;
+  // Copie avec les verrous des deux chemins déjà pris ; une copie interrompue est supprimée
+  bool copy_locked_(const char *source, const char *destination, size_t buffer_size, CopyCallback const &on_chunk);
+  // Avec `progress` (opération de fond), l'avancement y est compté, la tâche rend la main
+  // entre deux tranches et les fonctions renvoient false une fois l'opération annulée
+  bool copy_file_(const char *source, const char *destination, size_t buffer_size, FileOperationProgress *progress);
+  bool move_file_(const char *source, const char *destination, FileOperationProgress *progress);
+  bool copy_tree_(const char *source, const char *destination, size_t buffer_size, FileOperationProgress *progress);
+  bool remove_tree_(const char *path, FileOperationProgress *progress);
+  bool track_file_operation_(FileOperationProgress *progress, uint32_t files, uint32_t directories, uint64_t bytes);
+  void publish_file_operation_(bool done);
+  // Publie l'avancement de l'opération de fond, puis son résultat une fois terminée
+  void poll_file_operation_(uint32_t now);
+  void finish_file_operation_();
+  // find, interrompu dès que `cancelled` passe à true
+  bool find_(const char *root, FindOptions const &options, std::vector<FindResult> &results,
+             std::atomic<bool> const *cancelled);
+  void finish_find_();
+  // write_file_stream avec le mode d'ouverture choisi ("wb" ou "ab")
+  bool write_stream_(const char *path, const char *mode, WriteCallback const &callback, size_t buffer_size);
+  // Métadonnées d'un chemin, depuis l'index si possible ; renvoie metadata.exists
+  bool stat_(const char *path, FileMetadata &metadata);
+  void update_metadata_(const char *path, FileMetadata const &metadata);
+  void invalidate_metadata_(const char *path, bool recursive = false);
+
+  std::mutex space_mutex_;
+  uint64_t total_bytes_{0};
+  uint64_t used_bytes_{0};
+  uint32_t cluster_size_{0};
+  bool space_valid_{false};
+  std::thread space_thread_;
+  std::atomic<bool> space_scan_done_{false};
+  uint32_t space_reconcile_interval_{3600000};
+  uint32_t last_space_scan_{0};
+
+  // Interroge le système de fichiers (potentiellement lent : parcours de la FAT)
+  bool query_space(uint64_t &total_bytes, uint64_t &used_bytes, uint32_t &cluster_size);
+  void finish_space_scan();
+  void finish_checksum_();
   void update_sensors();
+  void publish_write_queue_sensors();
 #ifdef USE_ESP32_FRAMEWORK_ARDUINO
   std::string sd_card_type_to_string(int) const;
 #endif
-#ifdef USE_ESP_IDF
   std::string sd_card_type() const;
-#endif
-  std::vector<FileInfo> &list_directory_file_info_rec(const char *path, uint8_t depth, std::vector<FileInfo> &list);
+  DirCursor *open_directory_(const char *path);
+  bool read_directory_(DirCursor *cursor, DirEntry &entry);
+  void close_directory_(DirCursor *cursor);
+
+  friend class FileStream;
+  // Streams ouverts par open_file_read/open_file_write, fermés par le démontage
+  std::mutex streams_mutex_;
+  std::vector<FileStream *> open_streams_;
+  void track_stream_(FileStream *stream);
+  // Ferme le stream, que le démontage l'ait déjà fermé ou non
+  void close_stream_(FileStream *stream);
+  void close_streams_();
+
+  std::mutex record_stores_mutex_;
+  std::vector<RecordStore *> record_stores_;
+  void loop_record_stores_(uint32_t now);
+  void sync_record_stores_();
+
+  friend class ExtentWriter;
+  // Étendue contiguë (implémentée par chaque backend) ; les secteurs sont relatifs à la carte
+  ExtentHandle *open_extent_(const char *path, uint64_t capacity, uint64_t &first_sector);
+  bool write_extent_(ExtentHandle *handle, uint64_t sector, const uint8_t *data, size_t count);
+  bool set_extent_size_(ExtentHandle *handle, uint64_t size);
+  void close_extent_(ExtentHandle *handle, uint64_t capacity, uint64_t size);
+  // Libère le descripteur d'une étendue dont la carte a été démontée, sans toucher au volume
+  void discard_extent_(ExtentHandle *handle);
   static std::string error_code_to_string(ErrorCode);
 };
 
-// Actions pour le streaming
-template<typename... Ts> class SdMmcProcessFileAction : public Action<Ts...> {
+// Base des actions sur un chemin. Un chemin fixe (littéral YAML) est passé tel quel, sans
+// copie ; seul un chemin calculé par une lambda est construit à chaque exécution.
+template<typename... Ts> class SdMmcPathAction : public Action<Ts...> {
  public:
-  SdMmcProcessFileAction(SdMmc *parent) : parent_(parent) {}
+  explicit SdMmcPathAction(SdMmc *parent) : parent_(parent) {}
   TEMPLATABLE_VALUE(std::string, path)
+  void set_path(const char *path) { this->static_path_ = path; }
+
+ protected:
+  // `storage` garde le chemin calculé en vie pendant l'appel
+  const char *path_of_(std::string &storage, Ts... x) {
+    if (this->static_path_ != nullptr)
+      return this->static_path_;
+    storage = this->path_.value(x...);
+    return storage.c_str();
+  }
+
+  SdMmc *parent_;
+  const char *static_path_{nullptr};
+};
+
+// Données d'une action : les données fixes sont gardées une fois pour toutes et passées par
+// référence, une lambda est évaluée à chaque exécution
+template<typename... Ts> class SdMmcActionData {
+ public:
+  TEMPLATABLE_VALUE(std::vector<uint8_t>, data)
+  void set_data_static(std::vector<uint8_t> data) {
+    this->static_data_ = std::move(data);
+    this->has_static_data_ = true;
+  }
+
+ protected:
+  const std::vector<uint8_t> &data_of_(std::vector<uint8_t> &storage, Ts... x) {
+    if (this->has_static_data_)
+      return this->static_data_;
+    storage = this->data_.value(x...);
+    return storage;
+  }
+
+  std::vector<uint8_t> static_data_;
+  bool has_static_data_{false};
+};
+
+// Actions pour le streaming
+template<typename... Ts> class SdMmcProcessFileAction : public SdMmcPathAction<Ts...> {
+ public:
+  SdMmcProcessFileAction(SdMmc *parent) : SdMmcPathAction<Ts...>(parent) {}
   TEMPLATABLE_VALUE(size_t, buffer_size)
 
   void set_process_callback(std::function<bool(const uint8_t*, size_t, size_t, size_t)> callback) {
@@ -211,7 +1692,8 @@ template<typename... Ts> class SdMmcProcessFileAction : public Action<Ts...> {
   }
 
   void play(Ts... x) {
-    auto path = this->path_.value(x...);
+    std::string storage;
+    const char *path = this->path_of_(storage, x...);
     auto buffer_size = this->buffer_size_.has_value() ? this->buffer_size_.value(x...) : DEFAULT_STREAM_BUFFER_SIZE;
     
     if (this->callback_) {
@@ -220,89 +1702,279 @@ template<typename... Ts> class SdMmcProcessFileAction : public Action<Ts...> {
   }
 
  protected:
-  SdMmc *parent_;
   std::function<bool(const uint8_t*, size_t, size_t, size_t)> callback_;
 };
 
 // Actions traditionnelles
-template<typename... Ts> class SdMmcWriteFileAction : public Action<Ts...> {
+template<typename... Ts>
+class SdMmcWriteFileAction : public SdMmcPathAction<Ts...>, public SdMmcActionData<Ts...> {
  public:
-  SdMmcWriteFileAction(SdMmc *parent) : parent_(parent) {}
-  TEMPLATABLE_VALUE(std::string, path)
-  TEMPLATABLE_VALUE(std::vector<uint8_t>, data)
+  SdMmcWriteFileAction(SdMmc *parent) : SdMmcPathAction<Ts...>(parent) {}
+
+  void set_write_behind(bool write_behind) { this->write_behind_ = write_behind; }
+  void set_durability(Durability durability) { this->durability_ = durability; }
 
   void play(Ts... x) {
-    auto path = this->path_.value(x...);
-    auto buffer = this->data_.value(x...);
-    this->parent_->write_file(path.c_str(), buffer.data(), buffer.size());
+    std::string path_storage;
+    std::vector<uint8_t> data_storage;
+    const char *path = this->path_of_(path_storage, x...);
+    auto &buffer = this->data_of_(data_storage, x...);
+    if (this->write_behind_) {
+      this->parent_->queue_write_file(path, buffer.data(), buffer.size());
+    } else {
+      this->parent_->write_file(path, buffer.data(), buffer.size(), this->durability_);
+    }
   }
 
  protected:
-  SdMmc *parent_;
+  bool write_behind_{false};
+  Durability durability_{Durability::INHERIT};
 };
 
-template<typename... Ts> class SdMmcAppendFileAction : public Action<Ts...> {
+template<typename... Ts>
+class SdMmcAppendFileAction : public SdMmcPathAction<Ts...>, public SdMmcActionData<Ts...> {
  public:
-  SdMmcAppendFileAction(SdMmc *parent) : parent_(parent) {}
-  TEMPLATABLE_VALUE(std::string, path)
-  TEMPLATABLE_VALUE(std::vector<uint8_t>, data)
+  SdMmcAppendFileAction(SdMmc *parent) : SdMmcPathAction<Ts...>(parent) {}
+
+  void set_write_behind(bool write_behind) { this->write_behind_ = write_behind; }
+  void set_compress(bool compress) { this->compress_ = compress; }
+  void set_durability(Durability durability) { this->durability_ = durability; }
 
   void play(Ts... x) {
-    auto path = this->path_.value(x...);
-    auto buffer = this->data_.value(x...);
-    this->parent_->append_file(path.c_str(), buffer.data(), buffer.size());
+    std::string path_storage;
+    std::vector<uint8_t> data_storage;
+    const char *path = this->path_of_(path_storage, x...);
+    const std::vector<uint8_t> *buffer = &this->data_of_(data_storage, x...);
+    std::vector<uint8_t> compressed;
+    if (this->compress_) {
+      compressed = this->parent_->compress(buffer->data(), buffer->size());
+      buffer = &compressed;
+    }
+    if (this->write_behind_) {
+      this->parent_->queue_append_file(path, buffer->data(), buffer->size());
+    } else {
+      this->parent_->append_file(path, buffer->data(), buffer->size(), this->durability_);
+    }
+  }
+
+ protected:
+  bool write_behind_{false};
+  bool compress_{false};
+  Durability durability_{Durability::INHERIT};
+};
+
+template<typename... Ts> class SdMmcAppendLogAction : public Action<Ts...>, public SdMmcActionData<Ts...> {
+ public:
+  SdMmcAppendLogAction(SdMmc *parent) : parent_(parent) {}
+
+  void play(Ts... x) {
+    std::vector<uint8_t> storage;
+    auto &buffer = this->data_of_(storage, x...);
+    this->parent_->append_log(buffer.data(), buffer.size());
   }
 
  protected:
   SdMmc *parent_;
 };
 
-template<typename... Ts> class SdMmcCreateDirectoryAction : public Action<Ts...> {
+template<typename... Ts> class SdMmcFlushAction : public Action<Ts...> {
+ public:
+  SdMmcFlushAction(SdMmc *parent) : parent_(parent) {}
+
+  void play(Ts... x) { this->parent_->flush_write_queue(); }
+
+ protected:
+  SdMmc *parent_;
+};
+
+template<typename... Ts> class SdMmcSyncAction : public Action<Ts...> {
+ public:
+  SdMmcSyncAction(SdMmc *parent) : parent_(parent) {}
+
+  void play(Ts... x) { this->parent_->sync(); }
+
+ protected:
+  SdMmc *parent_;
+};
+
+template<typename... Ts> class SdMmcResetStatisticsAction : public Action<Ts...> {
+ public:
+  SdMmcResetStatisticsAction(SdMmc *parent) : parent_(parent) {}
+
+  void play(Ts... x) { this->parent_->reset_statistics(); }
+
+ protected:
+  SdMmc *parent_;
+};
+
+template<typename... Ts> class SdMmcCreateDirectoryAction : public SdMmcPathAction<Ts...> {
+ public:
+  SdMmcCreateDirectoryAction(SdMmc *parent) : SdMmcPathAction<Ts...>(parent) {}
+
+  void play(Ts... x) {
+    std::string storage;
+    this->parent_->create_directory(this->path_of_(storage, x...));
+  }
+};
+
+template<typename... Ts> class SdMmcRemoveDirectoryAction : public SdMmcPathAction<Ts...> {
+ public:
+  SdMmcRemoveDirectoryAction(SdMmc *parent) : SdMmcPathAction<Ts...>(parent) {}
+
+  void play(Ts... x) {
+    std::string storage;
+    this->parent_->remove_directory(this->path_of_(storage, x...));
+  }
+};
+
+template<typename... Ts> class SdMmcDeleteFileAction : public SdMmcPathAction<Ts...> {
+ public:
+  SdMmcDeleteFileAction(SdMmc *parent) : SdMmcPathAction<Ts...>(parent) {}
+
+  void play(Ts... x) {
+    std::string storage;
+    this->parent_->delete_file(this->path_of_(storage, x...));
+  }
+};
+
+template<typename... Ts> class SdMmcChecksumAction : public Action<Ts...> {
  public:
-  SdMmcCreateDirectoryAction(SdMmc *parent) : parent_(parent) {}
+  SdMmcChecksumAction(SdMmc *parent) : parent_(parent) {}
   TEMPLATABLE_VALUE(std::string, path)
+  TEMPLATABLE_VALUE(std::string, expected)
+
+  void set_algorithm(HashAlgorithm algorithm) { this->algorithm_ = algorithm; }
 
   void play(Ts... x) {
     auto path = this->path_.value(x...);
-    this->parent_->create_directory(path.c_str());
+    std::string expected = this->expected_.has_value() ? this->expected_.value(x...) : "";
+    this->parent_->start_checksum(path, this->algorithm_, expected);
   }
 
  protected:
   SdMmc *parent_;
+  HashAlgorithm algorithm_{HashAlgorithm::SHA256};
 };
 
-template<typename... Ts> class SdMmcRemoveDirectoryAction : public Action<Ts...> {
+// copy_file, move_file, copy_tree et remove_tree, exécutées en tâche de fond
+template<typename... Ts> class SdMmcFileOperationAction : public Action<Ts...> {
  public:
-  SdMmcRemoveDirectoryAction(SdMmc *parent) : parent_(parent) {}
-  TEMPLATABLE_VALUE(std::string, path)
+  SdMmcFileOperationAction(SdMmc *parent) : parent_(parent) {}
+  TEMPLATABLE_VALUE(std::string, source)
+  TEMPLATABLE_VALUE(std::string, destination)
+
+  void set_type(FileOperationType type) { this->type_ = type; }
 
   void play(Ts... x) {
-    auto path = this->path_.value(x...);
-    this->parent_->remove_directory(path.c_str());
+    std::string destination = this->destination_.has_value() ? this->destination_.value(x...) : "";
+    this->parent_->start_file_operation(this->type_, this->source_.value(x...), destination);
   }
 
  protected:
   SdMmc *parent_;
+  FileOperationType type_{FileOperationType::COPY};
 };
 
-template<typename... Ts> class SdMmcDeleteFileAction : public Action<Ts...> {
+template<typename... Ts> class SdMmcFindAction : public Action<Ts...> {
  public:
-  SdMmcDeleteFileAction(SdMmc *parent) : parent_(parent) {}
+  SdMmcFindAction(SdMmc *parent) : parent_(parent) {}
   TEMPLATABLE_VALUE(std::string, path)
+  TEMPLATABLE_VALUE(std::string, pattern)
+
+  void set_depth(uint8_t depth) { this->options_.depth = depth; }
+  void set_type(WalkType type) { this->options_.type = type; }
+  void set_min_size(size_t min_size) { this->options_.min_size = min_size; }
+  void set_max_size(size_t max_size) { this->options_.max_size = max_size; }
+  void set_min_age(uint32_t min_age) { this->options_.min_age = min_age; }
+  void set_max_age(uint32_t max_age) { this->options_.max_age = max_age; }
+  void set_sort(FindSort sort) { this->options_.sort = sort; }
+  void set_descending(bool descending) { this->options_.descending = descending; }
+  void set_limit(size_t limit) { this->options_.limit = limit; }
 
   void play(Ts... x) {
-    auto path = this->path_.value(x...);
-    this->parent_->delete_file(path.c_str());
+    std::string pattern = this->pattern_.has_value() ? this->pattern_.value(x...) : "";
+    FindOptions options = this->options_;
+    options.pattern = pattern.empty() ? nullptr : pattern.c_str();
+    this->parent_->start_find(this->path_.value(x...), options);
   }
 
  protected:
   SdMmc *parent_;
+  FindOptions options_;
+};
+
+template<typename... Ts> class SdMmcMountAction : public Action<Ts...> {
+ public:
+  SdMmcMountAction(SdMmc *parent) : parent_(parent) {}
+
+  void play(Ts... x) { this->parent_->mount(); }
+
+ protected:
+  SdMmc *parent_;
+};
+
+template<typename... Ts> class SdMmcUnmountAction : public Action<Ts...> {
+ public:
+  SdMmcUnmountAction(SdMmc *parent) : parent_(parent) {}
+
+  void play(Ts... x) { this->parent_->unmount(); }
+
+ protected:
+  SdMmc *parent_;
+};
+
+template<typename... Ts> class SdMmcRemountAction : public Action<Ts...> {
+ public:
+  SdMmcRemountAction(SdMmc *parent) : parent_(parent) {}
+
+  void play(Ts... x) { this->parent_->remount(); }
+
+ protected:
+  SdMmc *parent_;
+};
+
+class ReadyTrigger : public Trigger<> {
+ public:
+  explicit ReadyTrigger(SdMmc *parent) {
+    parent->add_on_ready_callback([this]() { this->trigger(); });
+  }
+};
+
+class ChecksumTrigger : public Trigger<std::string, std::string, bool> {
+ public:
+  explicit ChecksumTrigger(SdMmc *parent) {
+    parent->add_on_checksum_callback(
+        [this](std::string path, std::string checksum, bool ok) { this->trigger(path, checksum, ok); });
+  }
+};
+
+class FileOperationTrigger : public Trigger<FileOperationProgress> {
+ public:
+  explicit FileOperationTrigger(SdMmc *parent) {
+    parent->add_on_file_operation_callback([this](FileOperationProgress progress) { this->trigger(progress); });
+  }
+};
+
+class FindTrigger : public Trigger<std::vector<FindResult>, bool> {
+ public:
+  explicit FindTrigger(SdMmc *parent) {
+    parent->add_on_find_callback([this](std::vector<FindResult> results, bool ok) { this->trigger(results, ok); });
+  }
+};
+
+// Taille formatée pour les journaux, sans allocation
+struct SizeString {
+  char text[24];
+  const char *c_str() const { return this->text; }
 };
 
 long double convertBytes(uint64_t, MemoryUnits);
+const char *memory_unit_suffix(MemoryUnits);
 std::string memory_unit_to_string(MemoryUnits);
 MemoryUnits memory_unit_from_size(size_t);
-std::string format_size(size_t);
+SizeString format_size(size_t);
+// CRC-32 (IEEE 802.3) ; passer le résultat précédent dans `crc` pour chaîner les appels
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc = 0);
 
 }  // namespace sd_mmc_card
 }  // namespace esphome
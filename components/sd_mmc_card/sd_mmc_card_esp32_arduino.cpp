@@ -3,152 +3,225 @@
 #ifdef USE_ESP32_FRAMEWORK_ARDUINO
 
 #include "math.h"
+#include "esphome/core/hal.h"
 #include "esphome/core/log.h"
 
 #include "SD_MMC.h"
 #include "FS.h"
+#include <sys/stat.h>
 
 namespace esphome {
 namespace sd_mmc_card {
 
+static constexpr size_t READ_BLOCK_SIZE = 64 * 1024;
 static const char *TAG = "sd_mmc_card_esp32_arduino";
+static const std::string MOUNT_POINT("/sdcard");
+// SD_MMC does not expose the FAT geometry; space accounting assumes the usual SDHC cluster size.
+static constexpr uint32_t CLUSTER_SIZE = 32 * 1024;
 
-void SdMmc::setup() {
-  if (this->power_ctrl_pin_ != nullptr)
-    this->power_ctrl_pin_->setup();
+PathBuffer build_path(const char *path) { return PathBuffer(MOUNT_POINT, path); }
 
+bool SdMmc::init_bus_() {
   bool setPinResult = this->mode_1bit_ ? SD_MMC.setPins(this->clk_pin_, this->cmd_pin_, this->data0_pin_)
                                        : SD_MMC.setPins(this->clk_pin_, this->cmd_pin_, this->data0_pin_,
                                                         this->data1_pin_, this->data2_pin_, this->data3_pin_);
 
   if (!setPinResult) {
     this->init_error_ = ErrorCode::ERR_PIN_SETUP;
-    this->mark_failed();
-    return;
+    return false;
   }
+  return true;
+}
 
-  bool beginResult = this->mode_1bit_ ? SD_MMC.begin("/sdcard", this->mode_1bit_) : SD_MMC.begin();
-  if (!beginResult) {
+bool SdMmc::mount_(BusSpeed speed) {
+  // SD_MMC only takes a clock: there is no DDR mode, it runs as high speed.
+  int frequency = speed == BUS_SPEED_DEFAULT ? SDMMC_FREQ_DEFAULT : SDMMC_FREQ_HIGHSPEED;
+  if (!SD_MMC.begin(MOUNT_POINT.c_str(), this->mode_1bit_, false, frequency, this->mount_max_files())) {
     this->init_error_ = ErrorCode::ERR_MOUNT;
-    this->mark_failed();
-    return;
+    return false;
   }
-
-  uint8_t cardType = SD_MMC.cardType();
-
-#ifdef USE_TEXT_SENSOR
-  if (this->sd_card_type_text_sensor_ != nullptr)
-    this->sd_card_type_text_sensor_->publish_state(sd_card_type_to_string(cardType));
-#endif
-
-  if (cardType == CARD_NONE) {
+  if (SD_MMC.cardType() == CARD_NONE) {
+    SD_MMC.end();
     this->init_error_ = ErrorCode::ERR_NO_CARD;
-    this->mark_failed();
-    return;
+    return false;
   }
+  this->bus_frequency_khz_ = frequency;
+  return true;
+}
+
+void SdMmc::unmount_() { SD_MMC.end(); }
 
-  update_sensors();
+bool SdMmc::set_bus_frequency_(uint32_t frequency_khz) {
+  // The clock is only applied by begin(), so the card has to be remounted.
+  SD_MMC.end();
+  if (!SD_MMC.begin(MOUNT_POINT.c_str(), this->mode_1bit_, false, frequency_khz, this->mount_max_files()))
+    return false;
+  this->bus_frequency_khz_ = frequency_khz;
+  return true;
 }
 
-void SdMmc::write_file(const char *path, const uint8_t *buffer, size_t len, const char *mode) {
+size_t SdMmc::write_file_(const char *path, const uint8_t *buffer, size_t len, const char *mode, bool sync) {
+  this->close_pooled_file(path);
+  bool append = mode[0] == 'a';
+  size_t old_size = 0;
+  struct stat info;
+  if (!append && stat(build_path(path).c_str(), &info) == 0)
+    old_size = info.st_size;
   File file = SD_MMC.open(path, mode);
   if (!file) {
     ESP_LOGE(TAG, "Failed to open file for writing");
-    return;
+    return 0;
+  }
+  if (append)
+    old_size = file.size();
+
+  size_t written = file.write(buffer, len);
+  if (sync && written == len) {
+    // File::flush() is fflush + fsync on the VFS
+    uint32_t start = micros();
+    file.flush();
+    this->record_sync(micros() - start, 1, 1);
   }
-
-  file.write(buffer, len);
   file.close();
-  this->update_sensors();
+  if (written != len) {
+    ESP_LOGE(TAG, "Failed to write to file");
+    this->report_io_error_();
+  }
+  size_t new_size = append ? old_size + written : written;
+  this->account_file_change(old_size, new_size);
+  this->update_metadata_(path, FileMetadata::file(new_size));
+  return written;
 }
 
-bool SdMmc::create_directory(const char *path) {
+bool SdMmc::create_directory_(const char *path) {
   ESP_LOGV(TAG, "Create directory: %s", path);
   if (!SD_MMC.mkdir(path)) {
     ESP_LOGE(TAG, "Failed to create directory");
     return false;
   }
-  this->update_sensors();
+  this->account_directory_change(true);
+  this->update_metadata_(path, FileMetadata::directory());
   return true;
 }
 
-bool SdMmc::remove_directory(const char *path) {
+bool SdMmc::remove_directory_(const char *path) {
   ESP_LOGV(TAG, "Remove directory: %s", path);
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->close_prefix(path);
   if (!SD_MMC.rmdir(path)) {
     ESP_LOGE(TAG, "Failed to remove directory");
     return false;
   }
-  this->update_sensors();
+  this->account_directory_change(false);
+  this->invalidate_metadata_(path, true);
+  this->update_metadata_(path, FileMetadata::missing());
   return true;
 }
 
-bool SdMmc::delete_file(const char *path) {
+bool SdMmc::delete_file_(const char *path) {
   ESP_LOGV(TAG, "Delete File: %s", path);
+  this->close_pooled_file(path);
+  struct stat info;
+  size_t old_size = stat(build_path(path).c_str(), &info) == 0 ? info.st_size : 0;
   if (!SD_MMC.remove(path)) {
     ESP_LOGE(TAG, "failed to remove file");
     return false;
   }
-  this->update_sensors();
+  this->account_file_change(old_size, 0);
+  this->update_metadata_(path, FileMetadata::missing());
   return true;
 }
 
-std::vector<uint8_t> SdMmc::read_file(char const *path) {
-  ESP_LOGV(TAG, "Read File: %s", path);
+bool SdMmc::preallocate_file(const char *path, size_t size) {
+  // SD_MMC keeps its card handle private, so the FatFS volume cannot be reached for f_expand.
+  return false;
+}
+
+// Sector writes need the card handle, which SD_MMC keeps private.
+struct ExtentHandle {};
+
+ExtentHandle *SdMmc::open_extent_(const char *path, uint64_t capacity, uint64_t &first_sector) { return nullptr; }
+
+bool SdMmc::write_extent_(ExtentHandle *handle, uint64_t sector, const uint8_t *data, size_t count) { return false; }
+
+bool SdMmc::set_extent_size_(ExtentHandle *handle, uint64_t size) { return false; }
+
+void SdMmc::close_extent_(ExtentHandle *handle, uint64_t capacity, uint64_t size) { delete handle; }
+
+void SdMmc::discard_extent_(ExtentHandle *handle) { delete handle; }
+
+size_t SdMmc::read_file_(const char *path, size_t offset, ReadAllocator const &allocate) {
+  this->flush_pooled_file(path);
   File file = SD_MMC.open(path);
   if (!file) {
     ESP_LOGE(TAG, "Failed to open file for reading");
-    return std::vector<uint8_t>();
-  }
-
-  std::vector<uint8_t> res;
-  res.reserve(file.size());
-  while (file.available()) {
-    res.push_back(file.read());
+    return 0;
   }
-  return res;
-}
 
-std::vector<FileInfo> &SdMmc::list_directory_file_info_rec(const char *path, uint8_t depth,
-                                                           std::vector<FileInfo> &list) {
-  ESP_LOGV(TAG, "Listing directory file info: %s\n", path);
-
-  File root = SD_MMC.open(path);
-  if (!root) {
-    ESP_LOGE(TAG, "Failed to open directory");
-    return list;
+  size_t file_size = file.size();
+  if (offset > file_size) {
+    file.close();
+    return 0;
   }
-  if (!root.isDirectory()) {
-    ESP_LOGE(TAG, "Not a directory");
-    return list;
+  // An empty file (or a read at its end) still calls allocate: 0 bytes read, not an error
+  size_t capacity = 0;
+  uint8_t *buffer = allocate(file_size - offset, capacity);
+  if (file_size == offset || buffer == nullptr || !file.seek(offset)) {
+    file.close();
+    return 0;
   }
 
-  File file = root.openNextFile();
-  while (file) {
-    list.emplace_back(file.path(), file.size(), file.isDirectory());
-    if (file.isDirectory()) {
-      if (depth) {
-        list_directory_file_info_rec(file.path(), depth - 1, list);
-      }
+  size_t total = 0;
+  size_t to_read = std::min(capacity, file_size - offset);
+  while (total < to_read) {
+    size_t len = file.read(buffer + total, std::min(READ_BLOCK_SIZE, to_read - total));
+    if (len == 0) {
+      ESP_LOGE(TAG, "Failed to read file");
+      this->report_io_error_();
+      break;
     }
-    file = root.openNextFile();
+    total += len;
   }
-  return list;
+  file.close();
+  return total;
 }
 
-bool SdMmc::is_directory(const char *path) {
-  File root = SD_MMC.open(path);
-  if (!root) {
-    ESP_LOGE(TAG, "Failed to open directory");
+struct DirCursor {
+  File dir;
+  File entry;
+  String name;
+};
+
+DirCursor *SdMmc::open_directory_(const char *path) {
+  File dir = SD_MMC.open(path);
+  if (!dir || !dir.isDirectory())
+    return nullptr;
+  return new DirCursor{dir, File(), String()};
+}
+
+bool SdMmc::read_directory_(DirCursor *cursor, DirEntry &entry) {
+  cursor->entry = cursor->dir.openNextFile();
+  if (!cursor->entry)
     return false;
-  }
-  return root.isDirectory();
+  // Depending on the core version name() is either the base name or the full path.
+  const char *path = cursor->entry.path();
+  const char *name = strrchr(path, '/');
+  cursor->name = name != nullptr ? name + 1 : path;
+  entry.name = cursor->name.c_str();
+  entry.is_directory = cursor->entry.isDirectory();
+  entry.size = entry.is_directory ? 0 : cursor->entry.size();
+  entry.mtime = cursor->entry.getLastWrite();
+  return true;
 }
 
-size_t SdMmc::file_size(const char *path) {
-  File file = SD_MMC.open(path);
-  return file.size();
+void SdMmc::close_directory_(DirCursor *cursor) {
+  cursor->entry.close();
+  cursor->dir.close();
+  delete cursor;
 }
 
+std::string SdMmc::sd_card_type() const { return this->sd_card_type_to_string(SD_MMC.cardType()); }
+
 std::string SdMmc::sd_card_type_to_string(int type) const {
   switch (type) {
     case CARD_NONE:
@@ -165,22 +238,11 @@ std::string SdMmc::sd_card_type_to_string(int type) const {
   }
 }
 
-void SdMmc::update_sensors() {
-#ifdef USE_SENSOR
-  uint64_t used_bytes = SD_MMC.usedBytes();
-  uint64_t total_bytes = SD_MMC.totalBytes();
-  if (this->used_space_sensor_ != nullptr)
-    this->used_space_sensor_->publish_state(used_bytes);
-  if (this->total_space_sensor_ != nullptr)
-    this->total_space_sensor_->publish_state(total_bytes);
-  if (this->free_space_sensor_ != nullptr)
-    this->free_space_sensor_->publish_state(total_bytes - used_bytes);
-
-  for (auto &sensor : this->file_size_sensors_) {
-    if (sensor.sensor != nullptr)
-      sensor.sensor->publish_state(this->file_size(sensor.path));
-  }
-#endif
+bool SdMmc::query_space(uint64_t &total_bytes, uint64_t &used_bytes, uint32_t &cluster_size) {
+  total_bytes = SD_MMC.totalBytes();
+  used_bytes = SD_MMC.usedBytes();
+  cluster_size = CLUSTER_SIZE;
+  return total_bytes > 0;
 }
 
 }  // namespace sd_mmc_card
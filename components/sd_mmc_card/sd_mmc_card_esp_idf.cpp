@@ -5,6 +5,8 @@
 #include "esphome/core/log.h"
 #include "esp_vfs.h"
 #include "esp_vfs_fat.h"
+#include "diskio_impl.h"
+#include "diskio_sdmmc.h"
 #include "sdmmc_cmd.h"
 #include "driver/sdmmc_host.h"
 #include "driver/sdmmc_types.h"
@@ -15,19 +17,91 @@ namespace esphome {
 namespace sd_mmc_card {
 
 static constexpr size_t FILE_PATH_MAX = ESP_VFS_PATH_MAX + CONFIG_SPIFFS_OBJ_NAME_LEN;
+static constexpr size_t READ_BLOCK_SIZE = 64 * 1024;
 static const char *TAG = "sd_mmc_card";
 static const std::string MOUNT_POINT("/sdcard");
 
-std::string build_path(const char *path) { return MOUNT_POINT + path; }
+PathBuffer build_path(const char *path) { return PathBuffer(MOUNT_POINT, path); }
 
-void SdMmc::setup() {
-  if (this->power_ctrl_pin_ != nullptr)
-    this->power_ctrl_pin_->setup();
+// Disk driver installed in place of the stock SDMMC one when a sector cache is configured.
+// FatFS calls it under its volume lock, one card per component.
+static sdmmc_card_t *s_cache_card = nullptr;
+static SectorCache *s_sector_cache = nullptr;
 
-  esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-      .format_if_mount_failed = false, .max_files = 5, .allocation_unit_size = 16 * 1024};
+static DSTATUS cached_disk_initialize(BYTE pdrv) { return 0; }
+
+static DSTATUS cached_disk_status(BYTE pdrv) { return 0; }
+
+static DRESULT cached_disk_read(BYTE pdrv, BYTE *buffer, LBA_t sector, UINT count) {
+  bool ok = s_sector_cache->read(sector, buffer, count, [](uint32_t first, uint8_t *data, uint32_t n) {
+    esp_err_t err = sdmmc_read_sectors(s_cache_card, data, first, n);
+    if (err != ESP_OK)
+      ESP_LOGE(TAG, "Sector read failed: %s", esp_err_to_name(err));
+    return err == ESP_OK;
+  });
+  return ok ? RES_OK : RES_ERROR;
+}
+
+static DRESULT cached_disk_write(BYTE pdrv, const BYTE *buffer, LBA_t sector, UINT count) {
+  bool ok = s_sector_cache->write(sector, buffer, count, [](uint32_t first, const uint8_t *data, uint32_t n) {
+    esp_err_t err = sdmmc_write_sectors(s_cache_card, data, first, n);
+    if (err != ESP_OK)
+      ESP_LOGE(TAG, "Sector write failed: %s", esp_err_to_name(err));
+    return err == ESP_OK;
+  });
+  return ok ? RES_OK : RES_ERROR;
+}
+
+static DRESULT cached_disk_ioctl(BYTE pdrv, BYTE cmd, void *buffer) {
+  switch (cmd) {
+    case CTRL_SYNC:
+      // Write-through: nothing is pending
+      return RES_OK;
+    case GET_SECTOR_COUNT:
+      *static_cast<DWORD *>(buffer) = s_cache_card->csd.capacity;
+      return RES_OK;
+    case GET_SECTOR_SIZE:
+      *static_cast<WORD *>(buffer) = s_cache_card->csd.sector_size;
+      return RES_OK;
+#if FF_USE_TRIM
+    case CTRL_TRIM:
+      return RES_OK;
+#endif
+    default:
+      return RES_ERROR;
+  }
+}
+
+static const ff_diskio_impl_t CACHED_DISK_IMPL = {
+    .init = &cached_disk_initialize,
+    .status = &cached_disk_status,
+    .read = &cached_disk_read,
+    .write = &cached_disk_write,
+    .ioctl = &cached_disk_ioctl,
+};
+
+// The SDMMC host is set up by each mount
+bool SdMmc::init_bus_() { return true; }
+
+bool SdMmc::mount_(BusSpeed speed) {
+  esp_vfs_fat_sdmmc_mount_config_t mount_config = {.format_if_mount_failed = false,
+                                                   .max_files = this->mount_max_files(),
+                                                   .allocation_unit_size = this->allocation_unit_size_};
 
   sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+  switch (speed) {
+    case BUS_SPEED_HIGH_SPEED:
+      host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+      host.flags &= ~SDMMC_HOST_FLAG_DDR;
+      break;
+    case BUS_SPEED_DDR:
+      // DDR is only negotiated by eMMC; SD cards settle on high speed.
+      host.max_freq_khz = SDMMC_FREQ_52M;
+      break;
+    default:
+      host.flags &= ~SDMMC_HOST_FLAG_DDR;
+      break;
+  }
   sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
 
   if (this->mode_1bit_) {
@@ -61,154 +135,302 @@ void SdMmc::setup() {
     } else {
       this->init_error_ = ErrorCode::ERR_NO_CARD;
     }
-    mark_failed();
-    return;
+    this->card_ = nullptr;
+    return false;
   }
+  this->bus_frequency_khz_ = this->card_->max_freq_khz;
+
+  if (this->sector_cache_ != nullptr) {
+    // The volume is already mounted; only sectors read from now on go through the cache
+    this->sector_cache_->clear();
+    s_cache_card = this->card_;
+    s_sector_cache = this->sector_cache_.get();
+    ff_diskio_register(ff_diskio_get_pdrv_card(this->card_), &CACHED_DISK_IMPL);
+  }
+  return true;
+}
 
-#ifdef USE_TEXT_SENSOR
-  if (this->sd_card_type_text_sensor_ != nullptr)
-    this->sd_card_type_text_sensor_->publish_state(sd_card_type());
-#endif
+void SdMmc::unmount_() {
+  if (this->card_ == nullptr)
+    return;
+  // Unmounting unregisters the disk driver of this drive, stock or cached
+  esp_vfs_fat_sdcard_unmount(MOUNT_POINT.c_str(), this->card_);
+  this->card_ = nullptr;
+  if (this->sector_cache_ != nullptr) {
+    this->sector_cache_->clear();
+    s_cache_card = nullptr;
+  }
+}
 
-  update_sensors();
+bool SdMmc::set_bus_frequency_(uint32_t frequency_khz) {
+  if (this->card_ == nullptr || sdmmc_host_set_card_clk(this->card_->host.slot, frequency_khz) != ESP_OK)
+    return false;
+  this->card_->max_freq_khz = frequency_khz;
+  this->bus_frequency_khz_ = frequency_khz;
+  return true;
 }
 
-void SdMmc::write_file(const char *path, const uint8_t *buffer, size_t len, const char *mode) {
-  std::string absolut_path = build_path(path);
+size_t SdMmc::write_file_(const char *path, const uint8_t *buffer, size_t len, const char *mode, bool sync) {
+  this->close_pooled_file(path);
+  PathBuffer absolut_path = build_path(path);
+  bool append = mode[0] == 'a';
+  size_t old_size = 0;
+  struct stat info;
+  if (!append && stat(absolut_path.c_str(), &info) == 0)
+    old_size = info.st_size;
   FILE *file = NULL;
   file = fopen(absolut_path.c_str(), mode);
   if (file == NULL) {
     ESP_LOGE(TAG, "Failed to open file for writing");
-    return;
+    return 0;
+  }
+  // Unbuffered: one write straight from the caller's buffer, no stdio buffer to allocate
+  setvbuf(file, nullptr, _IONBF, 0);
+  if (append) {
+    fseek(file, 0, SEEK_END);
+    old_size = ftell(file);
   }
-  bool ok = fwrite(buffer, 1, len, file);
-  if (!ok) {
+  size_t written = fwrite(buffer, 1, len, file);
+  if (written != len) {
     ESP_LOGE(TAG, "Failed to write to file");
+    this->report_io_error_();
+  } else if (sync) {
+    this->sync_file_(file);
   }
   fclose(file);
-  this->update_sensors();
+  size_t new_size = append ? old_size + written : written;
+  this->account_file_change(old_size, new_size);
+  this->update_metadata_(path, FileMetadata::file(new_size));
+  return written;
 }
 
-bool SdMmc::create_directory(const char *path) {
+bool SdMmc::create_directory_(const char *path) {
   ESP_LOGV(TAG, "Create directory: %s", path);
-  std::string absolut_path = build_path(path);
+  PathBuffer absolut_path = build_path(path);
   if (mkdir(absolut_path.c_str(), 0777) < 0) {
     ESP_LOGE(TAG, "Failed to create a new directory: %s", strerror(errno));
     return false;
   }
-  this->update_sensors();
+  this->account_directory_change(true);
+  this->update_metadata_(path, FileMetadata::directory());
   return true;
 }
 
-bool SdMmc::remove_directory(const char *path) {
+bool SdMmc::remove_directory_(const char *path) {
   ESP_LOGV(TAG, "Remove directory: %s", path);
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->close_prefix(path);
   if (!this->is_directory(path)) {
     ESP_LOGE(TAG, "Not a directory");
     return false;
   }
-  std::string absolut_path = build_path(path);
+  PathBuffer absolut_path = build_path(path);
   if (remove(absolut_path.c_str()) != 0) {
     ESP_LOGE(TAG, "Failed to remove directory: %s", strerror(errno));
+    return false;
   }
-  this->update_sensors();
+  this->account_directory_change(false);
+  this->invalidate_metadata_(path, true);
+  this->update_metadata_(path, FileMetadata::missing());
   return true;
 }
 
-bool SdMmc::delete_file(const char *path) {
+bool SdMmc::delete_file_(const char *path) {
   ESP_LOGV(TAG, "Delete File: %s", path);
+  this->close_pooled_file(path);
   if (this->is_directory(path)) {
     ESP_LOGE(TAG, "Not a file");
     return false;
   }
-  std::string absolut_path = build_path(path);
+  PathBuffer absolut_path = build_path(path);
+  struct stat info;
+  size_t old_size = stat(absolut_path.c_str(), &info) == 0 ? info.st_size : 0;
   if (remove(absolut_path.c_str()) != 0) {
     ESP_LOGE(TAG, "Failed to remove file: %s", strerror(errno));
+    return false;
   }
-  this->update_sensors();
+  this->account_file_change(old_size, 0);
+  this->update_metadata_(path, FileMetadata::missing());
   return true;
 }
 
-std::vector<uint8_t> SdMmc::read_file(char const *path) {
-  ESP_LOGV(TAG, "Read File: %s", path);
+bool SdMmc::preallocate_file(const char *path, size_t size) {
+#if FF_USE_EXPAND
+  MountGuard mounted(this);
+  if (!mounted || this->card_ == nullptr)
+    return false;
+  this->close_pooled_file(path);
+  char fat_path[FILE_PATH_MAX];
+  snprintf(fat_path, sizeof(fat_path), "%u:%s", ff_diskio_get_pdrv_card(this->card_), path);
+  FIL file;
+  if (f_open(&file, fat_path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+    return false;
+  // Allocates one contiguous run of clusters now and sets the file size; later writes
+  // through the VFS only overwrite it.
+  FRESULT res = f_expand(&file, size, 1);
+  f_close(&file);
+  this->invalidate_metadata_(path);
+  if (res != FR_OK) {
+    ESP_LOGW(TAG, "No contiguous %s free for %s", format_size(size).c_str(), path);
+    f_unlink(fat_path);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
 
-  std::string absolut_path = build_path(path);
-  FILE *file = nullptr;
-  file = fopen(absolut_path.c_str(), "rb");
-  if (file == nullptr) {
-    ESP_LOGE(TAG, "Failed to open file for reading");
-    return std::vector<uint8_t>();
+struct ExtentHandle {
+  FIL file;
+};
+
+// FA_MODIFIED is private to ff.c; it makes f_sync rewrite the directory entry.
+static constexpr BYTE FIL_MODIFIED = 0x40;
+
+ExtentHandle *SdMmc::open_extent_(const char *path, uint64_t capacity, uint64_t &first_sector) {
+#if FF_USE_EXPAND
+  if (this->card_ == nullptr)
+    return nullptr;
+  char fat_path[FILE_PATH_MAX];
+  snprintf(fat_path, sizeof(fat_path), "%u:%s", ff_diskio_get_pdrv_card(this->card_), path);
+  auto *handle = new ExtentHandle();
+  if (f_open(&handle->file, fat_path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+    delete handle;
+    return nullptr;
   }
+  if (f_expand(&handle->file, capacity, 1) != FR_OK) {
+    f_close(&handle->file);
+    f_unlink(fat_path);
+    delete handle;
+    return nullptr;
+  }
+  FATFS *fs = handle->file.obj.fs;
+  first_sector = fs->database + static_cast<uint64_t>(handle->file.obj.sclust - 2) * fs->csize;
+  // Publish an empty file: the clusters stay reserved by the chain until close.
+  this->set_extent_size_(handle, 0);
+  return handle;
+#else
+  return nullptr;
+#endif
+}
 
-  std::vector<uint8_t> res;
-  size_t fileSize = this->file_size(path);
-  res.resize(fileSize);
-  size_t len = fread(res.data(), 1, fileSize, file);
-  fclose(file);
-  if (len < 0) {
-    ESP_LOGE(TAG, "Failed to read file: %s", strerror(errno));
-    return std::vector<uint8_t>();
+bool SdMmc::write_extent_(ExtentHandle *handle, uint64_t sector, const uint8_t *data, size_t count) {
+  esp_err_t err = sdmmc_write_sectors(this->card_, data, sector, count);
+  // Extent sectors bypass FatFS, so any cached copy is now stale (even after a partial write)
+  if (this->sector_cache_ != nullptr)
+    this->sector_cache_->invalidate(sector, count);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Sector write failed: %s", esp_err_to_name(err));
+    this->report_io_error_();
+    return false;
   }
+  return true;
+}
 
-  return res;
+bool SdMmc::set_extent_size_(ExtentHandle *handle, uint64_t size) {
+  handle->file.obj.objsize = size;
+  handle->file.flag |= FIL_MODIFIED;
+  return f_sync(&handle->file) == FR_OK;
 }
 
-std::vector<FileInfo> &SdMmc::list_directory_file_info_rec(const char *path, uint8_t depth,
-                                                           std::vector<FileInfo> &list) {
-  ESP_LOGV(TAG, "Listing directory file info: %s\n", path);
-  std::string absolut_path = build_path(path);
-  DIR *dir = opendir(absolut_path.c_str());
-  if (!dir) {
-    ESP_LOGE(TAG, "Failed to open directory: %s", strerror(errno));
-    return list;
+void SdMmc::close_extent_(ExtentHandle *handle, uint64_t capacity, uint64_t size) {
+  // Back to the reserved length so that f_truncate frees the clusters past `size`
+  handle->file.obj.objsize = capacity;
+  if (f_lseek(&handle->file, size) != FR_OK || f_truncate(&handle->file) != FR_OK)
+    ESP_LOGW(TAG, "Failed to release the unused extent");
+  f_close(&handle->file);
+  delete handle;
+}
+
+void SdMmc::discard_extent_(ExtentHandle *handle) {
+  // The FATFS object the FIL points to was freed by the unmount
+  delete handle;
+}
+
+size_t SdMmc::read_file_(const char *path, size_t offset, ReadAllocator const &allocate) {
+  this->flush_pooled_file(path);
+  PathBuffer absolut_path = build_path(path);
+  FILE *file = fopen(absolut_path.c_str(), "rb");
+  if (file == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for reading");
+    return 0;
+  }
+  // Unbuffered: each fread goes straight from the filesystem into the caller's buffer.
+  setvbuf(file, nullptr, _IONBF, 0);
+  fseek(file, 0, SEEK_END);
+  size_t file_size = ftell(file);
+  if (offset > file_size) {
+    fclose(file);
+    return 0;
+  }
+  // An empty file (or a read at its end) still calls allocate: 0 bytes read, not an error
+  size_t capacity = 0;
+  uint8_t *buffer = allocate(file_size - offset, capacity);
+  if (file_size == offset || buffer == nullptr || fseek(file, offset, SEEK_SET) != 0) {
+    fclose(file);
+    return 0;
   }
-  char entry_absolut_path[FILE_PATH_MAX];
-  char entry_path[FILE_PATH_MAX];
-  const size_t dirpath_len = MOUNT_POINT.size();
-  size_t entry_path_len = strlen(path);
-  strlcpy(entry_path, path, sizeof(entry_path));
-  strlcpy(entry_path + entry_path_len, "/", sizeof(entry_path) - entry_path_len);
-  entry_path_len = strlen(entry_path);
-
-  strlcpy(entry_absolut_path, MOUNT_POINT.c_str(), sizeof(entry_absolut_path));
-  struct dirent *entry;
-  while ((entry = readdir(dir)) != nullptr) {
-    size_t file_size = 0;
-    strlcpy(entry_path + entry_path_len, entry->d_name, sizeof(entry_path) - entry_path_len);
-    strlcpy(entry_absolut_path + dirpath_len, entry_path, sizeof(entry_absolut_path) - dirpath_len);
-    if (entry->d_type != DT_DIR) {
-      struct stat info;
-      if (stat(entry_absolut_path, &info) < 0) {
-        ESP_LOGE(TAG, "Failed to stat file: %s '%s' %s", strerror(errno), entry->d_name, entry_absolut_path);
-      } else {
-        file_size = info.st_size;
-      }
+
+  size_t total = 0;
+  size_t to_read = std::min(capacity, file_size - offset);
+  while (total < to_read) {
+    size_t len = fread(buffer + total, 1, std::min(READ_BLOCK_SIZE, to_read - total), file);
+    if (len == 0) {
+      ESP_LOGE(TAG, "Failed to read file: %s", strerror(errno));
+      this->report_io_error_();
+      break;
     }
-    list.emplace_back(entry_path, file_size, entry->d_type == DT_DIR);
-    if (entry->d_type == DT_DIR && depth)
-      list_directory_file_info_rec(entry_absolut_path, depth - 1, list);
+    total += len;
   }
-  closedir(dir);
-  return list;
+  fclose(file);
+  return total;
 }
 
-bool SdMmc::is_directory(const char *path) {
-  std::string absolut_path = build_path(path);
-  DIR *dir = opendir(absolut_path.c_str());
-  if (dir) {
-    closedir(dir);
-  }
-  return dir != nullptr;
+struct DirCursor {
+  FF_DIR dir;
+  FILINFO info;
+};
+
+static time_t fat_time_to_unix(WORD date, WORD time) {
+  struct tm tm = {};
+  tm.tm_year = (date >> 9) + 80;
+  tm.tm_mon = ((date >> 5) & 0x0F) - 1;
+  tm.tm_mday = date & 0x1F;
+  tm.tm_hour = time >> 11;
+  tm.tm_min = (time >> 5) & 0x3F;
+  tm.tm_sec = (time & 0x1F) * 2;
+  return mktime(&tm);
 }
 
-size_t SdMmc::file_size(const char *path) {
-  std::string absolut_path = build_path(path);
-  struct stat info;
-  size_t file_size = 0;
-  if (stat(absolut_path.c_str(), &info) < 0) {
-    ESP_LOGE(TAG, "Failed to stat file: %s", strerror(errno));
-    return -1;
+DirCursor *SdMmc::open_directory_(const char *path) {
+  if (this->card_ == nullptr)
+    return nullptr;
+  // Go to FatFS directly: the VFS readdir drops the size and date that f_readdir already has,
+  // which would cost one stat (and a directory scan) per entry to get back.
+  char fat_path[FILE_PATH_MAX];
+  snprintf(fat_path, sizeof(fat_path), "%u:%s", ff_diskio_get_pdrv_card(this->card_), path);
+  auto *cursor = new DirCursor();
+  if (f_opendir(&cursor->dir, fat_path) != FR_OK) {
+    delete cursor;
+    return nullptr;
   }
-  return info.st_size;
+  return cursor;
+}
+
+bool SdMmc::read_directory_(DirCursor *cursor, DirEntry &entry) {
+  if (f_readdir(&cursor->dir, &cursor->info) != FR_OK || cursor->info.fname[0] == '\0')
+    return false;
+  entry.name = cursor->info.fname;
+  entry.is_directory = cursor->info.fattrib & AM_DIR;
+  entry.size = entry.is_directory ? 0 : cursor->info.fsize;
+  entry.mtime = fat_time_to_unix(cursor->info.fdate, cursor->info.ftime);
+  return true;
+}
+
+void SdMmc::close_directory_(DirCursor *cursor) {
+  f_closedir(&cursor->dir);
+  delete cursor;
 }
 
 std::string SdMmc::sd_card_type() const {
@@ -222,36 +444,25 @@ std::string SdMmc::sd_card_type() const {
   return "UNKNOWN";
 }
 
-void SdMmc::update_sensors() {
-#ifdef USE_SENSOR
+bool SdMmc::query_space(uint64_t &total_bytes, uint64_t &used_bytes, uint32_t &cluster_size) {
   if (this->card_ == nullptr)
-    return;
+    return false;
 
   FATFS *fs;
   DWORD fre_clust, fre_sect, tot_sect;
-  uint64_t total_bytes = -1, free_bytes = -1, used_bytes = -1;
   auto res = f_getfree(MOUNT_POINT.c_str(), &fre_clust, &fs);
-  if (!res) {
-    tot_sect = (fs->n_fatent - 2) * fs->csize;
-    fre_sect = fre_clust * fs->csize;
-
-    total_bytes = static_cast<uint64_t>(tot_sect) * FF_SS_SDCARD;
-    free_bytes = static_cast<uint64_t>(fre_sect) * FF_SS_SDCARD;
-    used_bytes = total_bytes - free_bytes;
-  }
-
-  if (this->used_space_sensor_ != nullptr)
-    this->used_space_sensor_->publish_state(used_bytes);
-  if (this->total_space_sensor_ != nullptr)
-    this->total_space_sensor_->publish_state(total_bytes);
-  if (this->free_space_sensor_ != nullptr)
-    this->free_space_sensor_->publish_state(free_bytes);
-
-  for (auto &sensor : this->file_size_sensors_) {
-    if (sensor.sensor != nullptr)
-      sensor.sensor->publish_state(this->file_size(sensor.path));
-  }
-#endif
+  if (res)
+    return false;
+  tot_sect = (fs->n_fatent - 2) * fs->csize;
+  fre_sect = fre_clust * fs->csize;
+
+  total_bytes = static_cast<uint64_t>(tot_sect) * FF_SS_SDCARD;
+  used_bytes = total_bytes - static_cast<uint64_t>(fre_sect) * FF_SS_SDCARD;
+  cluster_size = fs->csize * FF_SS_SDCARD;
+  // Sectors below the data area (FAT, root directory) are the ones worth keeping on writes
+  if (this->sector_cache_ != nullptr)
+    this->sector_cache_->set_data_start(fs->database);
+  return true;
 }
 
 }  // namespace sd_mmc_card
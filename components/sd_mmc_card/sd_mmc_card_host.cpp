@@ -0,0 +1,352 @@
+#include "sd_mmc_card.h"
+
+#ifdef USE_HOST
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include "math.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static constexpr size_t SECTOR_SIZE = 512;
+static constexpr size_t READ_BLOCK_SIZE = 64 * 1024;
+static const char *TAG = "sd_mmc_card_host";
+static std::string MOUNT_POINT("sdcard");
+static HostBusModel BUS_MODEL;
+
+PathBuffer build_path(const char *path) { return PathBuffer(MOUNT_POINT, path); }
+
+uint32_t HostBusModel::transfer_us(size_t bytes, bool write) const {
+  uint64_t us = this->command_latency_us;
+  if (bytes > 0) {
+    uint64_t sectors = (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    uint64_t bits = sectors * SECTOR_SIZE * 8;
+    uint64_t bits_per_ms = static_cast<uint64_t>(this->frequency_khz) * this->bus_width;
+    us += bits * 1000 / bits_per_ms;
+    if (write)
+      us += this->write_latency_us;
+  }
+  return us;
+}
+
+void host_bus_transfer(size_t bytes, bool write) {
+  if (!BUS_MODEL.enabled)
+    return;
+  // Sleep granularity on a desktop OS is far coarser than a single command, so the simulated
+  // bus time is accumulated and only slept off once it amounts to something measurable.
+  static thread_local uint64_t debt_us = 0;
+  debt_us += BUS_MODEL.transfer_us(bytes, write);
+  if (debt_us >= 200) {
+    std::this_thread::sleep_for(std::chrono::microseconds(debt_us));
+    debt_us = 0;
+  }
+}
+
+void SdMmc::set_host_root(std::string const &root) { MOUNT_POINT = root; }
+
+void SdMmc::set_host_bus_model(HostBusModel const &model) { this->bus_model_ = model; }
+
+bool SdMmc::init_bus_() {
+  this->bus_model_.bus_width = this->mode_1bit_ ? 1 : 4;
+  BUS_MODEL = this->bus_model_;
+  return true;
+}
+
+bool SdMmc::mount_(BusSpeed speed) {
+  // The host root plays the card: checked on every mount, so that it can come and go
+  struct stat info;
+  if (stat(MOUNT_POINT.c_str(), &info) < 0) {
+    if (errno != ENOENT || mkdir(MOUNT_POINT.c_str(), 0777) < 0) {
+      ESP_LOGE(TAG, "Failed to create host root %s: %s", MOUNT_POINT.c_str(), strerror(errno));
+      this->init_error_ = ErrorCode::ERR_MOUNT;
+      return false;
+    }
+  } else if (!S_ISDIR(info.st_mode)) {
+    ESP_LOGE(TAG, "Host root %s is not a directory", MOUNT_POINT.c_str());
+    this->init_error_ = ErrorCode::ERR_NO_CARD;
+    return false;
+  }
+
+  uint32_t frequency_khz = 20000;
+  if (speed == BUS_SPEED_HIGH_SPEED) {
+    frequency_khz = 40000;
+  } else if (speed == BUS_SPEED_DDR) {
+    frequency_khz = 50000;
+  }
+  // host_bus.frequency is the fastest clock the simulated card answers to.
+  if (this->bus_model_.enabled && frequency_khz > this->bus_model_.frequency_khz) {
+    this->init_error_ = ErrorCode::ERR_MOUNT;
+    return false;
+  }
+  // Both clock edges carry data in DDR mode.
+  BUS_MODEL.frequency_khz = speed == BUS_SPEED_DDR ? frequency_khz * 2 : frequency_khz;
+  this->bus_frequency_khz_ = frequency_khz;
+  return true;
+}
+
+void SdMmc::unmount_() {}
+
+bool SdMmc::set_bus_frequency_(uint32_t frequency_khz) {
+  BUS_MODEL.frequency_khz = frequency_khz;
+  this->bus_frequency_khz_ = frequency_khz;
+  return true;
+}
+
+size_t SdMmc::write_file_(const char *path, const uint8_t *buffer, size_t len, const char *mode, bool sync) {
+  this->close_pooled_file(path);
+  PathBuffer absolut_path = build_path(path);
+  bool append = mode[0] == 'a';
+  size_t old_size = 0;
+  struct stat info;
+  if (!append && stat(absolut_path.c_str(), &info) == 0)
+    old_size = info.st_size;
+  FILE *file = fopen(absolut_path.c_str(), mode);
+  host_bus_transfer(0, false);
+  if (file == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for writing");
+    return 0;
+  }
+  // Unbuffered: one write straight from the caller's buffer, no stdio buffer to allocate
+  setvbuf(file, nullptr, _IONBF, 0);
+  if (append) {
+    fseek(file, 0, SEEK_END);
+    old_size = ftell(file);
+  }
+  size_t written = fwrite(buffer, 1, len, file);
+  host_bus_transfer(len, true);
+  if (written != len) {
+    ESP_LOGE(TAG, "Failed to write to file");
+    this->report_io_error_();
+  } else if (sync) {
+    this->sync_file_(file);
+  }
+  fclose(file);
+  size_t new_size = append ? old_size + written : written;
+  this->account_file_change(old_size, new_size);
+  this->update_metadata_(path, FileMetadata::file(new_size));
+  return written;
+}
+
+bool SdMmc::create_directory_(const char *path) {
+  ESP_LOGV(TAG, "Create directory: %s", path);
+  PathBuffer absolut_path = build_path(path);
+  host_bus_transfer(0, true);
+  if (mkdir(absolut_path.c_str(), 0777) < 0) {
+    ESP_LOGE(TAG, "Failed to create a new directory: %s", strerror(errno));
+    return false;
+  }
+  this->account_directory_change(true);
+  this->update_metadata_(path, FileMetadata::directory());
+  return true;
+}
+
+bool SdMmc::remove_directory_(const char *path) {
+  ESP_LOGV(TAG, "Remove directory: %s", path);
+  if (this->handle_pool_ != nullptr)
+    this->handle_pool_->close_prefix(path);
+  if (!this->is_directory(path)) {
+    ESP_LOGE(TAG, "Not a directory");
+    return false;
+  }
+  PathBuffer absolut_path = build_path(path);
+  host_bus_transfer(0, true);
+  if (rmdir(absolut_path.c_str()) != 0) {
+    ESP_LOGE(TAG, "Failed to remove directory: %s", strerror(errno));
+    return false;
+  }
+  this->account_directory_change(false);
+  this->invalidate_metadata_(path, true);
+  this->update_metadata_(path, FileMetadata::missing());
+  return true;
+}
+
+bool SdMmc::delete_file_(const char *path) {
+  ESP_LOGV(TAG, "Delete File: %s", path);
+  this->close_pooled_file(path);
+  if (this->is_directory(path)) {
+    ESP_LOGE(TAG, "Not a file");
+    return false;
+  }
+  PathBuffer absolut_path = build_path(path);
+  struct stat info;
+  size_t old_size = stat(absolut_path.c_str(), &info) == 0 ? info.st_size : 0;
+  host_bus_transfer(0, true);
+  if (remove(absolut_path.c_str()) != 0) {
+    ESP_LOGE(TAG, "Failed to remove file: %s", strerror(errno));
+    return false;
+  }
+  this->account_file_change(old_size, 0);
+  this->update_metadata_(path, FileMetadata::missing());
+  return true;
+}
+
+bool SdMmc::preallocate_file(const char *path, size_t size) {
+  MountGuard mounted(this);
+  if (!mounted)
+    return false;
+  this->close_pooled_file(path);
+  FILE *file = fopen(build_path(path).c_str(), "wb");
+  host_bus_transfer(0, true);
+  if (file == nullptr)
+    return false;
+  // Sparse on most host filesystems: only the size is reserved, which is all the
+  // callers rely on.
+  bool ok = ftruncate(fileno(file), size) == 0;
+  fclose(file);
+  if (!ok)
+    remove(build_path(path).c_str());
+  this->invalidate_metadata_(path);
+  return ok;
+}
+
+struct ExtentHandle {
+  FILE *file;
+};
+
+ExtentHandle *SdMmc::open_extent_(const char *path, uint64_t capacity, uint64_t &first_sector) {
+  FILE *file = fopen(build_path(path).c_str(), "w+b");
+  host_bus_transfer(0, true);
+  if (file == nullptr)
+    return nullptr;
+  // Host files are sparse, there is nothing to reserve. The file length stands in for the
+  // directory entry size and sectors are counted from the start of the file.
+  first_sector = 0;
+  return new ExtentHandle{file};
+}
+
+bool SdMmc::write_extent_(ExtentHandle *handle, uint64_t sector, const uint8_t *data, size_t count) {
+  size_t len = count * ExtentWriter::SECTOR_SIZE;
+  bool ok = pwrite(fileno(handle->file), data, len, sector * ExtentWriter::SECTOR_SIZE) == static_cast<ssize_t>(len);
+  host_bus_transfer(len, true);
+  if (!ok)
+    this->report_io_error_();
+  return ok;
+}
+
+bool SdMmc::set_extent_size_(ExtentHandle *handle, uint64_t size) {
+  host_bus_transfer(SECTOR_SIZE, true);
+  return ftruncate(fileno(handle->file), size) == 0 && fsync(fileno(handle->file)) == 0;
+}
+
+void SdMmc::close_extent_(ExtentHandle *handle, uint64_t capacity, uint64_t size) {
+  if (ftruncate(fileno(handle->file), size) != 0)
+    ESP_LOGW(TAG, "Failed to release the unused extent");
+  host_bus_transfer(SECTOR_SIZE, true);
+  fclose(handle->file);
+  delete handle;
+}
+
+void SdMmc::discard_extent_(ExtentHandle *handle) {
+  fclose(handle->file);
+  delete handle;
+}
+
+size_t SdMmc::read_file_(const char *path, size_t offset, ReadAllocator const &allocate) {
+  this->flush_pooled_file(path);
+  PathBuffer absolut_path = build_path(path);
+  FILE *file = fopen(absolut_path.c_str(), "rb");
+  host_bus_transfer(0, false);
+  if (file == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for reading");
+    return 0;
+  }
+  // Unbuffered: each fread goes straight from the filesystem into the caller's buffer.
+  setvbuf(file, nullptr, _IONBF, 0);
+  fseek(file, 0, SEEK_END);
+  size_t file_size = ftell(file);
+  if (offset > file_size) {
+    fclose(file);
+    return 0;
+  }
+  // An empty file (or a read at its end) still calls allocate: 0 bytes read, not an error
+  size_t capacity = 0;
+  uint8_t *buffer = allocate(file_size - offset, capacity);
+  if (file_size == offset || buffer == nullptr || fseek(file, offset, SEEK_SET) != 0) {
+    fclose(file);
+    return 0;
+  }
+
+  size_t total = 0;
+  size_t to_read = std::min(capacity, file_size - offset);
+  while (total < to_read) {
+    size_t len = fread(buffer + total, 1, std::min(READ_BLOCK_SIZE, to_read - total), file);
+    host_bus_transfer(len, false);
+    if (len == 0) {
+      ESP_LOGE(TAG, "Failed to read file: %s", strerror(errno));
+      this->report_io_error_();
+      break;
+    }
+    total += len;
+  }
+  fclose(file);
+  return total;
+}
+
+struct DirCursor {
+  DIR *dir;
+  uint32_t entries;
+};
+
+DirCursor *SdMmc::open_directory_(const char *path) {
+  host_bus_transfer(0, false);
+  DIR *dir = opendir(build_path(path).c_str());
+  if (dir == nullptr)
+    return nullptr;
+  return new DirCursor{dir, 0};
+}
+
+bool SdMmc::read_directory_(DirCursor *cursor, DirEntry &entry) {
+  struct dirent *record;
+  do {
+    record = readdir(cursor->dir);
+    if (record == nullptr)
+      return false;
+  } while (strcmp(record->d_name, ".") == 0 || strcmp(record->d_name, "..") == 0);
+  // A FAT directory sector holds 16 records, roughly 8 entries once long names are counted.
+  if (cursor->entries++ % 8 == 0)
+    host_bus_transfer(SECTOR_SIZE, false);
+
+  // POSIX directory records carry no size, so the host has to stat; FAT records do not need it.
+  struct stat info;
+  if (fstatat(dirfd(cursor->dir), record->d_name, &info, 0) < 0) {
+    ESP_LOGE(TAG, "Failed to stat file: %s '%s'", strerror(errno), record->d_name);
+    info = {};
+    info.st_mode = record->d_type == DT_DIR ? S_IFDIR : S_IFREG;
+  }
+  entry.name = record->d_name;
+  entry.is_directory = S_ISDIR(info.st_mode);
+  entry.size = entry.is_directory ? 0 : info.st_size;
+  entry.mtime = info.st_mtime;
+  return true;
+}
+
+void SdMmc::close_directory_(DirCursor *cursor) {
+  closedir(cursor->dir);
+  delete cursor;
+}
+
+std::string SdMmc::sd_card_type() const { return "HOST"; }
+
+bool SdMmc::query_space(uint64_t &total_bytes, uint64_t &used_bytes, uint32_t &cluster_size) {
+  struct statvfs info;
+  if (statvfs(MOUNT_POINT.c_str(), &info) != 0)
+    return false;
+  total_bytes = static_cast<uint64_t>(info.f_blocks) * info.f_frsize;
+  used_bytes = total_bytes - static_cast<uint64_t>(info.f_bavail) * info.f_frsize;
+  cluster_size = info.f_bsize;
+  return true;
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
+
+#endif  // USE_HOST
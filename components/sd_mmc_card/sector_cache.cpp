@@ -0,0 +1,235 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+
+#include "esphome/core/log.h"
+
+#ifdef USE_ESP32
+#include "esp_heap_caps.h"
+#endif
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_cache";
+
+SectorCache::SectorCache(size_t size) {
+  size_t sectors = std::min(std::max<size_t>(size / SECTOR_SIZE, 1), MAX_SECTORS);
+#ifdef USE_ESP32
+  // PSRAM first: the cache only sees FAT and directory sectors, PSRAM latency is negligible next to the card
+  this->data_ = static_cast<uint8_t *>(heap_caps_malloc(sectors * SECTOR_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+  this->external_ = this->data_ != nullptr;
+  if (this->data_ == nullptr)
+    this->data_ = static_cast<uint8_t *>(heap_caps_malloc(sectors * SECTOR_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+#else
+  this->data_ = static_cast<uint8_t *>(malloc(sectors * SECTOR_SIZE));
+#endif
+  if (this->data_ == nullptr) {
+    ESP_LOGE(TAG, "Failed to allocate a %s sector cache", format_size(sectors * SECTOR_SIZE).c_str());
+    this->capacity_ = 0;
+    return;
+  }
+  this->capacity_ = sectors;
+  this->entries_.resize(sectors);
+  size_t buckets = 1;
+  while (buckets < sectors)
+    buckets <<= 1;
+  this->buckets_.assign(buckets, NONE);
+  this->clear();
+}
+
+SectorCache::~SectorCache() {
+#ifdef USE_ESP32
+  heap_caps_free(this->data_);
+#else
+  free(this->data_);
+#endif
+}
+
+uint16_t SectorCache::find_(uint32_t sector) const {
+  for (uint16_t i = this->buckets_[this->bucket_(sector)]; i != NONE; i = this->entries_[i].chain) {
+    if (this->entries_[i].sector == sector)
+      return i;
+  }
+  return NONE;
+}
+
+void SectorCache::unlink_(uint16_t index) {
+  Entry &entry = this->entries_[index];
+  if (entry.prev != NONE)
+    this->entries_[entry.prev].next = entry.next;
+  else
+    this->head_ = entry.next;
+  if (entry.next != NONE)
+    this->entries_[entry.next].prev = entry.prev;
+  else
+    this->tail_ = entry.prev;
+  entry.prev = entry.next = NONE;
+}
+
+void SectorCache::push_front_(uint16_t index) {
+  Entry &entry = this->entries_[index];
+  entry.prev = NONE;
+  entry.next = this->head_;
+  if (this->head_ != NONE)
+    this->entries_[this->head_].prev = index;
+  this->head_ = index;
+  if (this->tail_ == NONE)
+    this->tail_ = index;
+}
+
+void SectorCache::remove_(uint16_t index) {
+  Entry &entry = this->entries_[index];
+  uint16_t *link = &this->buckets_[this->bucket_(entry.sector)];
+  while (*link != index)
+    link = &this->entries_[*link].chain;
+  *link = entry.chain;
+  // Out of every bucket, the chain link now threads the free list
+  entry.chain = this->free_list_;
+  this->free_list_ = index;
+  entry.used = false;
+  this->unlink_(index);
+}
+
+uint16_t SectorCache::insert_(uint32_t sector) {
+  // Slots freed by invalidate() first, then the never used ones, then the least recently used
+  if (this->free_list_ == NONE && this->free_ >= this->capacity_) {
+    if (this->tail_ == NONE)
+      return NONE;
+    this->remove_(this->tail_);
+  }
+  uint16_t index;
+  if (this->free_list_ != NONE) {
+    index = this->free_list_;
+    this->free_list_ = this->entries_[index].chain;
+  } else {
+    index = this->free_++;
+  }
+  Entry &entry = this->entries_[index];
+  entry.sector = sector;
+  entry.used = true;
+  size_t bucket = this->bucket_(sector);
+  entry.chain = this->buckets_[bucket];
+  this->buckets_[bucket] = index;
+  this->push_front_(index);
+  return index;
+}
+
+bool SectorCache::read(uint32_t sector, uint8_t *buffer, uint32_t count, DeviceRead const &device) {
+  // Multi-sector reads outside the system area are file data: straight to the card
+  if (count > 1 && sector + count > this->data_start_) {
+    this->bypassed_ += count;
+    return device(sector, buffer, count);
+  }
+
+  uint32_t generation;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      uint16_t index = this->find_(sector + i);
+      if (index == NONE)
+        break;
+      memcpy(buffer + i * SECTOR_SIZE, this->sector_data_(index), SECTOR_SIZE);
+      this->unlink_(index);
+      this->push_front_(index);
+      found++;
+    }
+    if (found == count) {
+      this->hits_ += count;
+      return true;
+    }
+    generation = this->generation_;
+  }
+
+  // A partial hit still costs a command for the whole run, so it counts as a miss.
+  // The card is read without holding the lock; a concurrent write bumps the generation.
+  this->misses_ += count;
+  if (!device(sector, buffer, count))
+    return false;
+
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (generation != this->generation_)
+    return true;
+  for (uint32_t i = 0; i < count; i++) {
+    uint16_t index = this->find_(sector + i);
+    if (index == NONE)
+      index = this->insert_(sector + i);
+    if (index == NONE)
+      break;
+    memcpy(this->sector_data_(index), buffer + i * SECTOR_SIZE, SECTOR_SIZE);
+  }
+  return true;
+}
+
+bool SectorCache::write(uint32_t sector, const uint8_t *buffer, uint32_t count, DeviceWrite const &device) {
+  // Write-through: the card is updated first so the cache never holds data the card does not have
+  if (!device(sector, buffer, count)) {
+    this->invalidate(sector, count);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->generation_++;
+  for (uint32_t i = 0; i < count; i++) {
+    uint16_t index = this->find_(sector + i);
+    if (index == NONE) {
+      if (sector + i >= this->data_start_)
+        continue;
+      index = this->insert_(sector + i);
+      if (index == NONE)
+        continue;
+    } else {
+      this->unlink_(index);
+      this->push_front_(index);
+    }
+    memcpy(this->sector_data_(index), buffer + i * SECTOR_SIZE, SECTOR_SIZE);
+  }
+  return true;
+}
+
+void SectorCache::invalidate(uint32_t sector, uint32_t count) {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->generation_++;
+  if (count >= this->capacity_) {
+    // Cheaper to scan the entries than to probe every sector of a large range
+    for (uint16_t i = 0; i < this->free_; i++) {
+      Entry &entry = this->entries_[i];
+      if (entry.used && entry.sector >= sector && entry.sector - sector < count)
+        this->remove_(i);
+    }
+    return;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    uint16_t index = this->find_(sector + i);
+    if (index != NONE)
+      this->remove_(index);
+  }
+}
+
+void SectorCache::clear() {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->generation_++;
+  for (auto &entry : this->entries_)
+    entry = Entry();
+  std::fill(this->buckets_.begin(), this->buckets_.end(), NONE);
+  this->head_ = this->tail_ = NONE;
+  this->free_list_ = NONE;
+  this->free_ = 0;
+}
+
+float SectorCache::hit_rate() const {
+  uint32_t hits = this->hits_;
+  uint32_t total = hits + this->misses_;
+  if (total == 0)
+    return NAN;
+  return hits * 100.0f / total;
+}
+
+void SectorCache::reset_stats() {
+  this->hits_ = 0;
+  this->misses_ = 0;
+  this->bypassed_ = 0;
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
@@ -5,11 +5,20 @@ from esphome.const import (
     CONF_TYPE,
     STATE_CLASS_MEASUREMENT,
     UNIT_BYTES,
+    UNIT_MILLISECOND,
+    UNIT_PERCENT,
     ICON_MEMORY,
+    ICON_TIMER,
+    ICON_SPEEDOMETER,
+    ENTITY_CATEGORY_DIAGNOSTIC,
 )
 from . import (
     SdMmc,
+    BenchmarkRunner,
+    sd_mmc_card_component_ns,
+    BENCHMARK_WORKLOADS,
     CONF_SD_MMC_CARD_ID,
+    CONF_BENCHMARK_ID,
     CONF_PATH,
 )
 
@@ -19,9 +28,134 @@ CONF_USED_SPACE = "used_space"
 CONF_TOTAL_SPACE = "total_space"
 CONF_FREE_SPACE = "free_space"
 CONF_FILE_SIZE = "file_size"
+CONF_WRITE_QUEUE_DEPTH = "write_queue_depth"
+CONF_WRITE_QUEUE_DROPPED = "write_queue_dropped"
+CONF_WRITE_QUEUE_LATENCY = "write_queue_latency"
+CONF_FILE_HANDLE_HITS = "file_handle_hits"
+CONF_FILE_HANDLE_MISSES = "file_handle_misses"
+CONF_METADATA_HITS = "metadata_hits"
+CONF_METADATA_MISSES = "metadata_misses"
+CONF_METADATA_INVALIDATIONS = "metadata_invalidations"
+CONF_SECTOR_CACHE_HITS = "sector_cache_hits"
+CONF_SECTOR_CACHE_MISSES = "sector_cache_misses"
+CONF_SECTOR_CACHE_HIT_RATE = "sector_cache_hit_rate"
+CONF_HOT_PATH_ALLOCATIONS = "hot_path_allocations"
+CONF_BUS_FREQUENCY = "bus_frequency"
+CONF_BUS_THROUGHPUT = "bus_throughput"
+CONF_LOG_SEGMENT = "log_segment"
+CONF_LOG_BYTES_WRITTEN = "log_bytes_written"
+CONF_LOG_ROTATION_LATENCY = "log_rotation_latency"
+CONF_COMPRESSION_RATIO = "compression_ratio"
+CONF_COMPRESSION_TIME = "compression_time"
+CONF_DECOMPRESSION_TIME = "decompression_time"
+CONF_LOCK_CONTENTIONS = "lock_contentions"
+CONF_LOCK_WAIT_TIME = "lock_wait_time"
+CONF_LOCK_HOLD_TIME = "lock_hold_time"
+CONF_READY_TIME = "ready_time"
+CONF_MOUNT_TIME = "mount_time"
+CONF_SYNC_COUNT = "sync_count"
+CONF_SYNC_LATENCY = "sync_latency"
+CONF_WRITES_PER_SYNC = "writes_per_sync"
+CONF_OPERATION_COUNT = "operation_count"
+CONF_OPERATION_BYTES = "operation_bytes"
+CONF_OPERATION_ERRORS = "operation_errors"
+CONF_OPERATION_LATENCY = "operation_latency"
+CONF_OPERATION_THROUGHPUT = "operation_throughput"
+CONF_OPERATION = "operation"
+CONF_BENCHMARK_THROUGHPUT = "benchmark_throughput"
+CONF_BENCHMARK_IOPS = "benchmark_iops"
+CONF_BENCHMARK_LATENCY = "benchmark_latency"
+CONF_BENCHMARK_ERRORS = "benchmark_errors"
+CONF_WORKLOAD = "workload"
+CONF_PERCENTILE = "percentile"
+
+UNIT_MEGAHERTZ = "MHz"
+UNIT_MEGABYTES_PER_SECOND = "MB/s"
+UNIT_MILLISECONDS_PER_MEGABYTE = "ms/MB"
+UNIT_IOPS = "IOPS"
+
+SdMmcOperation = sd_mmc_card_component_ns.enum("SdMmcOperation", is_class=True)
+OperationStatistic = sd_mmc_card_component_ns.enum("OperationStatistic", is_class=True)
+
+OPERATIONS = {
+    "read": SdMmcOperation.READ,
+    "write": SdMmcOperation.WRITE,
+    "append": SdMmcOperation.APPEND,
+    "queue": SdMmcOperation.QUEUE,
+    "delete": SdMmcOperation.DELETE,
+    "mkdir": SdMmcOperation.MKDIR,
+    "rmdir": SdMmcOperation.RMDIR,
+    "stat": SdMmcOperation.STAT,
+    "list": SdMmcOperation.LIST,
+    "stream_read": SdMmcOperation.STREAM_READ,
+    "stream_write": SdMmcOperation.STREAM_WRITE,
+    "copy": SdMmcOperation.COPY,
+    "rename": SdMmcOperation.RENAME,
+}
+
+PERCENTILES = {
+    "p50": OperationStatistic.P50,
+    "p95": OperationStatistic.P95,
+    "p99": OperationStatistic.P99,
+    "max": OperationStatistic.MAX,
+}
+
+BenchmarkStatistic = sd_mmc_card_component_ns.enum("BenchmarkStatistic", is_class=True)
+
+BENCHMARK_PERCENTILES = {
+    "p50": BenchmarkStatistic.P50,
+    "p95": BenchmarkStatistic.P95,
+    "p99": BenchmarkStatistic.P99,
+    "max": BenchmarkStatistic.MAX,
+}
+
+BENCHMARK_STATISTICS = {
+    CONF_BENCHMARK_THROUGHPUT: BenchmarkStatistic.THROUGHPUT,
+    CONF_BENCHMARK_IOPS: BenchmarkStatistic.IOPS,
+    CONF_BENCHMARK_ERRORS: BenchmarkStatistic.ERRORS,
+}
+
+OPERATION_STATISTICS = {
+    CONF_OPERATION_COUNT: OperationStatistic.COUNT,
+    CONF_OPERATION_BYTES: OperationStatistic.BYTES,
+    CONF_OPERATION_ERRORS: OperationStatistic.ERRORS,
+    CONF_OPERATION_THROUGHPUT: OperationStatistic.THROUGHPUT,
+}
 
 TYPES = [CONF_USED_SPACE, CONF_TOTAL_SPACE, CONF_USED_SPACE, CONF_FREE_SPACE]
-SIMPLE_TYPES = [CONF_USED_SPACE, CONF_TOTAL_SPACE, CONF_FREE_SPACE]
+SIMPLE_TYPES = [
+    CONF_USED_SPACE,
+    CONF_TOTAL_SPACE,
+    CONF_FREE_SPACE,
+    CONF_WRITE_QUEUE_DEPTH,
+    CONF_WRITE_QUEUE_DROPPED,
+    CONF_WRITE_QUEUE_LATENCY,
+    CONF_FILE_HANDLE_HITS,
+    CONF_FILE_HANDLE_MISSES,
+    CONF_METADATA_HITS,
+    CONF_METADATA_MISSES,
+    CONF_METADATA_INVALIDATIONS,
+    CONF_SECTOR_CACHE_HITS,
+    CONF_SECTOR_CACHE_MISSES,
+    CONF_SECTOR_CACHE_HIT_RATE,
+    CONF_BUS_FREQUENCY,
+    CONF_BUS_THROUGHPUT,
+    CONF_LOG_SEGMENT,
+    CONF_LOG_BYTES_WRITTEN,
+    CONF_LOG_ROTATION_LATENCY,
+    CONF_COMPRESSION_RATIO,
+    CONF_COMPRESSION_TIME,
+    CONF_DECOMPRESSION_TIME,
+    CONF_LOCK_CONTENTIONS,
+    CONF_LOCK_WAIT_TIME,
+    CONF_LOCK_HOLD_TIME,
+    CONF_HOT_PATH_ALLOCATIONS,
+    CONF_READY_TIME,
+    CONF_MOUNT_TIME,
+    CONF_SYNC_COUNT,
+    CONF_SYNC_LATENCY,
+    CONF_WRITES_PER_SYNC,
+]
 
 BASE_CONFIG_SCHEMA = sensor.sensor_schema(
     unit_of_measurement=UNIT_BYTES,
@@ -34,6 +168,147 @@ BASE_CONFIG_SCHEMA = sensor.sensor_schema(
     }
 )
 
+COUNTER_CONFIG_SCHEMA = sensor.sensor_schema(
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(
+    {
+        cv.GenerateID(CONF_SD_MMC_CARD_ID): cv.use_id(SdMmc),
+    }
+)
+
+LATENCY_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MILLISECOND,
+    icon=ICON_TIMER,
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(
+    {
+        cv.GenerateID(CONF_SD_MMC_CARD_ID): cv.use_id(SdMmc),
+    }
+)
+
+BUS_FREQUENCY_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MEGAHERTZ,
+    icon=ICON_SPEEDOMETER,
+    accuracy_decimals=1,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(
+    {
+        cv.GenerateID(CONF_SD_MMC_CARD_ID): cv.use_id(SdMmc),
+    }
+)
+
+BUS_THROUGHPUT_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MEGABYTES_PER_SECOND,
+    icon=ICON_SPEEDOMETER,
+    accuracy_decimals=2,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(
+    {
+        cv.GenerateID(CONF_SD_MMC_CARD_ID): cv.use_id(SdMmc),
+    }
+)
+
+HIT_RATE_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_PERCENT,
+    icon=ICON_MEMORY,
+    accuracy_decimals=1,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(
+    {
+        cv.GenerateID(CONF_SD_MMC_CARD_ID): cv.use_id(SdMmc),
+    }
+)
+
+COMPRESSION_RATIO_CONFIG_SCHEMA = sensor.sensor_schema(
+    icon=ICON_MEMORY,
+    accuracy_decimals=2,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(
+    {
+        cv.GenerateID(CONF_SD_MMC_CARD_ID): cv.use_id(SdMmc),
+    }
+)
+
+COMPRESSION_TIME_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MILLISECONDS_PER_MEGABYTE,
+    icon=ICON_TIMER,
+    accuracy_decimals=1,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(
+    {
+        cv.GenerateID(CONF_SD_MMC_CARD_ID): cv.use_id(SdMmc),
+    }
+)
+
+OPERATION_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_OPERATION): cv.enum(OPERATIONS, lower=True),
+    }
+)
+
+OPERATION_LATENCY_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MILLISECOND,
+    icon=ICON_TIMER,
+    accuracy_decimals=2,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(OPERATION_SCHEMA).extend(
+    {
+        cv.GenerateID(CONF_SD_MMC_CARD_ID): cv.use_id(SdMmc),
+        cv.Optional(CONF_PERCENTILE, default="p95"): cv.enum(PERCENTILES, lower=True),
+    }
+)
+
+BENCHMARK_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(CONF_BENCHMARK_ID): cv.use_id(BenchmarkRunner),
+        cv.Required(CONF_WORKLOAD): cv.enum(BENCHMARK_WORKLOADS, lower=True),
+    }
+)
+
+BENCHMARK_THROUGHPUT_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MEGABYTES_PER_SECOND,
+    icon=ICON_SPEEDOMETER,
+    accuracy_decimals=2,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(BENCHMARK_SCHEMA)
+
+BENCHMARK_IOPS_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_IOPS,
+    icon=ICON_SPEEDOMETER,
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(BENCHMARK_SCHEMA)
+
+BENCHMARK_LATENCY_CONFIG_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MILLISECOND,
+    icon=ICON_TIMER,
+    accuracy_decimals=2,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(BENCHMARK_SCHEMA).extend(
+    {
+        cv.Optional(CONF_PERCENTILE, default="p99"): cv.enum(BENCHMARK_PERCENTILES, lower=True),
+    }
+)
+
+BENCHMARK_ERRORS_CONFIG_SCHEMA = sensor.sensor_schema(
+    accuracy_decimals=0,
+    state_class=STATE_CLASS_MEASUREMENT,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(BENCHMARK_SCHEMA)
+
 CONFIG_SCHEMA = cv.typed_schema(
     {
         CONF_TOTAL_SPACE : BASE_CONFIG_SCHEMA,
@@ -43,17 +318,71 @@ CONFIG_SCHEMA = cv.typed_schema(
             {
                 cv.Required(CONF_PATH): cv.templatable(cv.string_strict),
             }
-        )
+        ),
+        CONF_WRITE_QUEUE_DEPTH: COUNTER_CONFIG_SCHEMA,
+        CONF_WRITE_QUEUE_DROPPED: COUNTER_CONFIG_SCHEMA,
+        CONF_WRITE_QUEUE_LATENCY: LATENCY_CONFIG_SCHEMA,
+        CONF_FILE_HANDLE_HITS: COUNTER_CONFIG_SCHEMA,
+        CONF_FILE_HANDLE_MISSES: COUNTER_CONFIG_SCHEMA,
+        CONF_METADATA_HITS: COUNTER_CONFIG_SCHEMA,
+        CONF_METADATA_MISSES: COUNTER_CONFIG_SCHEMA,
+        CONF_METADATA_INVALIDATIONS: COUNTER_CONFIG_SCHEMA,
+        CONF_SECTOR_CACHE_HITS: COUNTER_CONFIG_SCHEMA,
+        CONF_SECTOR_CACHE_MISSES: COUNTER_CONFIG_SCHEMA,
+        CONF_SECTOR_CACHE_HIT_RATE: HIT_RATE_CONFIG_SCHEMA,
+        CONF_BUS_FREQUENCY: BUS_FREQUENCY_CONFIG_SCHEMA,
+        CONF_BUS_THROUGHPUT: BUS_THROUGHPUT_CONFIG_SCHEMA,
+        CONF_LOG_SEGMENT: COUNTER_CONFIG_SCHEMA,
+        CONF_LOG_BYTES_WRITTEN: BASE_CONFIG_SCHEMA,
+        CONF_LOG_ROTATION_LATENCY: LATENCY_CONFIG_SCHEMA,
+        CONF_COMPRESSION_RATIO: COMPRESSION_RATIO_CONFIG_SCHEMA,
+        CONF_COMPRESSION_TIME: COMPRESSION_TIME_CONFIG_SCHEMA,
+        CONF_DECOMPRESSION_TIME: COMPRESSION_TIME_CONFIG_SCHEMA,
+        CONF_LOCK_CONTENTIONS: COUNTER_CONFIG_SCHEMA,
+        CONF_LOCK_WAIT_TIME: LATENCY_CONFIG_SCHEMA,
+        CONF_LOCK_HOLD_TIME: LATENCY_CONFIG_SCHEMA,
+        CONF_HOT_PATH_ALLOCATIONS: COUNTER_CONFIG_SCHEMA,
+        CONF_READY_TIME: LATENCY_CONFIG_SCHEMA,
+        CONF_MOUNT_TIME: LATENCY_CONFIG_SCHEMA,
+        CONF_SYNC_COUNT: COUNTER_CONFIG_SCHEMA,
+        CONF_SYNC_LATENCY: LATENCY_CONFIG_SCHEMA,
+        CONF_WRITES_PER_SYNC: COMPRESSION_RATIO_CONFIG_SCHEMA,
+        CONF_OPERATION_COUNT: COUNTER_CONFIG_SCHEMA.extend(OPERATION_SCHEMA),
+        CONF_OPERATION_BYTES: BASE_CONFIG_SCHEMA.extend(OPERATION_SCHEMA),
+        CONF_OPERATION_ERRORS: COUNTER_CONFIG_SCHEMA.extend(OPERATION_SCHEMA),
+        CONF_OPERATION_LATENCY: OPERATION_LATENCY_CONFIG_SCHEMA,
+        CONF_OPERATION_THROUGHPUT: BUS_THROUGHPUT_CONFIG_SCHEMA.extend(OPERATION_SCHEMA),
+        CONF_BENCHMARK_THROUGHPUT: BENCHMARK_THROUGHPUT_CONFIG_SCHEMA,
+        CONF_BENCHMARK_IOPS: BENCHMARK_IOPS_CONFIG_SCHEMA,
+        CONF_BENCHMARK_LATENCY: BENCHMARK_LATENCY_CONFIG_SCHEMA,
+        CONF_BENCHMARK_ERRORS: BENCHMARK_ERRORS_CONFIG_SCHEMA,
     },
     lower=True,
 )
 
 
 async def to_code(config):
-    sd_mmc_component = await cg.get_variable(config[CONF_SD_MMC_CARD_ID])
     var = await sensor.new_sensor(config)
+    if config[CONF_TYPE] in BENCHMARK_STATISTICS or config[CONF_TYPE] == CONF_BENCHMARK_LATENCY:
+        runner = await cg.get_variable(config[CONF_BENCHMARK_ID])
+        if config[CONF_TYPE] == CONF_BENCHMARK_LATENCY:
+            statistic = config[CONF_PERCENTILE]
+        else:
+            statistic = BENCHMARK_STATISTICS[config[CONF_TYPE]]
+        cg.add(runner.add_sensor(var, config[CONF_WORKLOAD], statistic))
+        return
+    sd_mmc_component = await cg.get_variable(config[CONF_SD_MMC_CARD_ID])
+    if config[CONF_TYPE] == CONF_HOT_PATH_ALLOCATIONS:
+        cg.add_define("USE_SD_MMC_ALLOCATION_COUNTER")
     if config[CONF_TYPE] in SIMPLE_TYPES:
         func = getattr(sd_mmc_component, f"set_{config[CONF_TYPE]}_sensor")
         cg.add(func(var))
     elif config[CONF_TYPE] == CONF_FILE_SIZE:
         cg.add(sd_mmc_component.add_file_size_sensor(var, config[CONF_PATH]))
+    elif config[CONF_TYPE] == CONF_OPERATION_LATENCY:
+        cg.add_define("USE_SD_MMC_OPERATION_STATS")
+        cg.add(sd_mmc_component.add_operation_sensor(var, config[CONF_OPERATION], config[CONF_PERCENTILE]))
+    elif config[CONF_TYPE] in OPERATION_STATISTICS:
+        cg.add_define("USE_SD_MMC_OPERATION_STATS")
+        statistic = OPERATION_STATISTICS[config[CONF_TYPE]]
+        cg.add(sd_mmc_component.add_operation_sensor(var, config[CONF_OPERATION], statistic))
@@ -0,0 +1,455 @@
+#include "sd_mmc_card.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#include "esphome/core/log.h"
+
+#ifdef USE_ESP32
+#include "esp_heap_caps.h"
+#endif
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_stream";
+static constexpr size_t STREAM_WORKER_STACK_SIZE = 4096;
+
+uint8_t *allocate_stream_buffer(size_t size) {
+#ifdef USE_ESP32
+  return static_cast<uint8_t *>(heap_caps_aligned_alloc(STREAM_BUFFER_ALIGNMENT, size, MALLOC_CAP_DMA));
+#else
+  return static_cast<uint8_t *>(aligned_alloc(STREAM_BUFFER_ALIGNMENT, size));
+#endif
+}
+
+void free_stream_buffer(uint8_t *buffer) {
+#ifdef USE_ESP32
+  heap_caps_free(buffer);
+#else
+  free(buffer);
+#endif
+}
+
+namespace {
+
+struct StreamSlot {
+  uint8_t *data{nullptr};
+  size_t len{0};
+  size_t position{0};
+};
+
+// Ring of aligned buffers handed back and forth between one producer and one consumer.
+// A slot stays owned by the consumer between acquire_filled() and release().
+class SlotRing {
+ public:
+  SlotRing(size_t buffer_size, size_t count) : slots_(count) {
+    for (auto &slot : this->slots_) {
+      slot.data = allocate_stream_buffer(buffer_size);
+      this->ok_ = this->ok_ && slot.data != nullptr;
+    }
+  }
+  ~SlotRing() {
+    for (auto &slot : this->slots_)
+      free_stream_buffer(slot.data);
+  }
+  bool ok() const { return this->ok_; }
+
+  StreamSlot *acquire_free() {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    this->cv_.wait(lock, [this]() { return this->cancelled_ || this->filled_ < this->slots_.size(); });
+    return this->cancelled_ ? nullptr : &this->slots_[this->produce_index_];
+  }
+  void publish() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->produce_index_ = (this->produce_index_ + 1) % this->slots_.size();
+      this->filled_++;
+    }
+    this->cv_.notify_all();
+  }
+  StreamSlot *acquire_filled() {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    this->cv_.wait(lock, [this]() { return this->cancelled_ || this->finished_ || this->filled_ > 0; });
+    if (this->cancelled_ || this->filled_ == 0)
+      return nullptr;
+    return &this->slots_[this->consume_index_];
+  }
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->consume_index_ = (this->consume_index_ + 1) % this->slots_.size();
+      this->filled_--;
+    }
+    this->cv_.notify_all();
+  }
+  void finish() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->finished_ = true;
+    }
+    this->cv_.notify_all();
+  }
+  void cancel() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->cancelled_ = true;
+    }
+    this->cv_.notify_all();
+  }
+
+ protected:
+  std::vector<StreamSlot> slots_;
+  size_t produce_index_{0};
+  size_t consume_index_{0};
+  size_t filled_{0};
+  bool finished_{false};
+  bool cancelled_{false};
+  bool ok_{true};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+size_t align_buffer_size(size_t size) {
+  size = std::max(size, STREAM_BUFFER_ALIGNMENT);
+  return (size + STREAM_BUFFER_ALIGNMENT - 1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT;
+}
+
+}  // namespace
+
+std::unique_ptr<FileStream> SdMmc::open_file_read(const char* path, size_t buffer_size) {
+  MountGuard mounted(this);
+  if (!mounted)
+    return nullptr;
+  this->flush_pooled_file(path);
+  auto stream = std::make_unique<FileStream>();
+  if (!stream->open_read(build_path(path).c_str(), buffer_size))
+    return nullptr;
+  stream->set_operation_stats(this->operation_stats_table_());
+  this->track_stream_(stream.get());
+  return stream;
+}
+
+std::unique_ptr<FileStream> SdMmc::open_file_read(std::string_view path, size_t buffer_size) {
+  return this->open_file_read(PathBuffer(path).c_str(), buffer_size);
+}
+
+std::unique_ptr<FileStream> SdMmc::open_file_write(const char* path, const char* mode, size_t buffer_size) {
+  MountGuard mounted(this);
+  if (!mounted)
+    return nullptr;
+  this->close_pooled_file(path);
+  this->invalidate_metadata_(path);
+  auto stream = std::make_unique<FileStream>();
+  if (!stream->open_write(build_path(path).c_str(), mode, buffer_size))
+    return nullptr;
+  stream->set_operation_stats(this->operation_stats_table_());
+  // Size changes behind our back while the stream is open; forget whatever was cached meanwhile.
+  stream->set_on_close([this, path = std::string(path)]() { this->invalidate_metadata_(path.c_str()); });
+  this->track_stream_(stream.get());
+  return stream;
+}
+
+void SdMmc::track_stream_(FileStream* stream) {
+  std::lock_guard<std::mutex> lock(this->streams_mutex_);
+  stream->parent_ = this;
+  this->open_streams_.push_back(stream);
+}
+
+void SdMmc::close_stream_(FileStream* stream) {
+  std::lock_guard<std::mutex> lock(this->streams_mutex_);
+  auto it = std::find(this->open_streams_.begin(), this->open_streams_.end(), stream);
+  if (it != this->open_streams_.end())
+    this->open_streams_.erase(it);
+  stream->close_file_();
+}
+
+void SdMmc::close_streams_() {
+  std::lock_guard<std::mutex> lock(this->streams_mutex_);
+  if (!this->open_streams_.empty())
+    ESP_LOGD(TAG, "Closing %zu open streams", this->open_streams_.size());
+  for (FileStream* stream : this->open_streams_)
+    stream->close_file_();
+  this->open_streams_.clear();
+}
+
+std::unique_ptr<FileStream> SdMmc::open_file_write(std::string_view path, const char* mode,
+                                                   size_t buffer_size) {
+  return this->open_file_write(PathBuffer(path).c_str(), mode, buffer_size);
+}
+
+bool SdMmc::process_file(const char* path, ReadCallback callback, size_t buffer_size) {
+  ESP_LOGV(TAG, "Process file: %s", path);
+  OperationTimer timer(this->operation_stats_table_(), SdMmcOperation::READ);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return false;
+  }
+  auto guard = this->path_locks_.lock_shared(path);
+  this->flush_pooled_file(path);
+  FILE *file = fopen(build_path(path).c_str(), "rb");
+  if (file == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for reading: %s", path);
+    timer.set_ok(false);
+    return false;
+  }
+  // Unbuffered, so that whole-sector reads go from the card straight into the aligned buffers.
+  setvbuf(file, nullptr, _IONBF, 0);
+  fseek(file, 0, SEEK_END);
+  size_t total_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  buffer_size = align_buffer_size(buffer_size);
+
+  // A file that fits in one buffer gains nothing from a reader task.
+  size_t buffer_count = total_size <= buffer_size ? 1 : STREAM_BUFFER_COUNT;
+  SlotRing ring(buffer_size, buffer_count);
+  if (!ring.ok()) {
+    ESP_LOGE(TAG, "Failed to allocate %zu x %s stream buffers", buffer_count, format_size(buffer_size).c_str());
+    fclose(file);
+    timer.set_ok(false);
+    return false;
+  }
+
+  std::atomic<bool> read_error{false};
+  auto reader = [&]() {
+    size_t position = 0;
+    while (position < total_size) {
+      StreamSlot *slot = ring.acquire_free();
+      if (slot == nullptr)
+        break;
+      size_t len = fread(slot->data, 1, std::min(buffer_size, total_size - position), file);
+#ifdef USE_HOST
+      host_bus_transfer(len, false);
+#endif
+      if (len == 0) {
+        read_error = true;
+        break;
+      }
+      slot->len = len;
+      slot->position = position;
+      position += len;
+      ring.publish();
+    }
+    ring.finish();
+  };
+
+  std::thread reader_thread;
+  if (buffer_count > 1) {
+    reader_thread = start_worker_thread("sd_prefetch", STREAM_WORKER_STACK_SIZE, reader);
+  } else {
+    reader();
+  }
+
+  while (StreamSlot *slot = ring.acquire_filled()) {
+    timer.add_bytes(slot->len);
+    bool more = callback(slot->data, slot->len, total_size, slot->position);
+    ring.release();
+    if (!more) {
+      ring.cancel();
+      break;
+    }
+  }
+  if (reader_thread.joinable())
+    reader_thread.join();
+  fclose(file);
+
+  if (read_error) {
+    ESP_LOGE(TAG, "Failed to read file: %s", path);
+    this->report_io_error_();
+    timer.set_ok(false);
+    return false;
+  }
+  return true;
+}
+
+bool SdMmc::process_file(std::string_view path, ReadCallback callback, size_t buffer_size) {
+  return this->process_file(PathBuffer(path).c_str(), std::move(callback), buffer_size);
+}
+
+bool SdMmc::write_file_stream(const char* path, WriteCallback callback, size_t buffer_size) {
+  return this->write_stream_(path, "wb", callback, buffer_size);
+}
+
+bool SdMmc::write_stream_(const char *path, const char *mode, WriteCallback const &callback, size_t buffer_size) {
+  ESP_LOGV(TAG, "Write file stream: %s", path);
+  OperationTimer timer(this->operation_stats_table_(),
+                       mode[0] == 'a' ? SdMmcOperation::APPEND : SdMmcOperation::WRITE);
+  MountGuard mounted(this);
+  if (!mounted) {
+    timer.set_ok(false);
+    return false;
+  }
+  auto guard = this->path_locks_.lock_exclusive(path);
+  this->close_pooled_file(path);
+  PathBuffer absolut_path = build_path(path);
+  struct stat info;
+  size_t old_size = stat(absolut_path.c_str(), &info) == 0 ? info.st_size : 0;
+  FILE *file = fopen(absolut_path.c_str(), mode);
+  if (file == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for writing: %s", path);
+    timer.set_ok(false);
+    return false;
+  }
+  setvbuf(file, nullptr, _IONBF, 0);
+  buffer_size = align_buffer_size(buffer_size);
+
+  SlotRing ring(buffer_size, STREAM_BUFFER_COUNT);
+  if (!ring.ok()) {
+    ESP_LOGE(TAG, "Failed to allocate %zu x %s stream buffers", STREAM_BUFFER_COUNT, format_size(buffer_size).c_str());
+    fclose(file);
+    timer.set_ok(false);
+    return false;
+  }
+
+  std::atomic<bool> write_error{false};
+  size_t written = 0;
+  std::thread writer_thread = start_worker_thread("sd_writer", STREAM_WORKER_STACK_SIZE, [&]() {
+    while (StreamSlot *slot = ring.acquire_filled()) {
+      size_t len = fwrite(slot->data, 1, slot->len, file);
+#ifdef USE_HOST
+      host_bus_transfer(len, true);
+#endif
+      written += len;
+      bool failed = len != slot->len;
+      ring.release();
+      if (failed) {
+        write_error = true;
+        ring.cancel();
+        break;
+      }
+    }
+  });
+
+  while (StreamSlot *slot = ring.acquire_free()) {
+    size_t len = callback(slot->data, buffer_size);
+    if (len == 0)
+      break;
+    slot->len = std::min(len, buffer_size);
+    ring.publish();
+  }
+  ring.finish();
+  writer_thread.join();
+  fclose(file);
+  size_t new_size = (mode[0] == 'a' ? old_size : 0) + written;
+  this->account_file_change(old_size, new_size);
+  this->update_metadata_(path, FileMetadata::file(new_size));
+  timer.add_bytes(written);
+
+  if (write_error) {
+    ESP_LOGE(TAG, "Failed to write file: %s", path);
+    this->report_io_error_();
+    timer.set_ok(false);
+    return false;
+  }
+  return true;
+}
+
+bool SdMmc::copy_locked_(const char *source, const char *destination, size_t buffer_size,
+                         CopyCallback const &on_chunk) {
+  this->flush_pooled_file(source);
+  this->close_pooled_file(destination);
+  FILE *input = fopen(build_path(source).c_str(), "rb");
+  if (input == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for reading: %s", source);
+    return false;
+  }
+  struct stat info;
+  uint64_t total_size = fstat(fileno(input), &info) == 0 ? info.st_size : 0;
+  buffer_size = align_buffer_size(buffer_size);
+  size_t buffer_count = total_size <= buffer_size ? 1 : STREAM_BUFFER_COUNT;
+  SlotRing ring(buffer_size, buffer_count);
+  if (!ring.ok()) {
+    ESP_LOGE(TAG, "Failed to allocate %zu x %s copy buffers", buffer_count, format_size(buffer_size).c_str());
+    fclose(input);
+    return false;
+  }
+
+  PathBuffer absolut_destination = build_path(destination);
+  uint64_t old_size = stat(absolut_destination.c_str(), &info) == 0 ? info.st_size : 0;
+  FILE *output = fopen(absolut_destination.c_str(), "wb");
+  if (output == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for writing: %s", destination);
+    fclose(input);
+    return false;
+  }
+  // Whole aligned buffers go straight between the card and the slots
+  setvbuf(input, nullptr, _IONBF, 0);
+  setvbuf(output, nullptr, _IONBF, 0);
+
+  std::atomic<bool> read_error{false};
+  auto reader = [&]() {
+    uint64_t position = 0;
+    while (position < total_size) {
+      StreamSlot *slot = ring.acquire_free();
+      if (slot == nullptr)
+        break;
+      size_t len = fread(slot->data, 1, std::min<uint64_t>(buffer_size, total_size - position), input);
+#ifdef USE_HOST
+      host_bus_transfer(len, false);
+#endif
+      if (len == 0) {
+        read_error = true;
+        break;
+      }
+      slot->len = len;
+      position += len;
+      ring.publish();
+    }
+    ring.finish();
+  };
+  std::thread reader_thread;
+  if (buffer_count > 1) {
+    reader_thread = start_worker_thread("sd_prefetch", STREAM_WORKER_STACK_SIZE, reader);
+  } else {
+    reader();
+  }
+
+  // This task writes block n while the reader fetches block n + 1
+  uint64_t written = 0;
+  bool ok = true;
+  while (StreamSlot *slot = ring.acquire_filled()) {
+    size_t len = fwrite(slot->data, 1, slot->len, output);
+#ifdef USE_HOST
+    host_bus_transfer(len, true);
+#endif
+    written += len;
+    ok = len == slot->len;
+    ring.release();
+    if (!ok) {
+      ESP_LOGE(TAG, "Failed to write file: %s", destination);
+      this->report_io_error_();
+    }
+    if (!ok || (on_chunk && !on_chunk(len))) {
+      ok = false;
+      ring.cancel();
+      break;
+    }
+  }
+  if (reader_thread.joinable())
+    reader_thread.join();
+  fclose(input);
+  fclose(output);
+  if (read_error) {
+    ESP_LOGE(TAG, "Failed to read file: %s", source);
+    this->report_io_error_();
+    ok = false;
+  }
+
+  this->account_file_change(old_size, written);
+  this->update_metadata_(destination, FileMetadata::file(written));
+  // No half-copied file left behind
+  if (!ok) {
+    std::lock_guard<VolumeLock> volume(this->volume_lock_);
+    this->delete_file_(destination);
+  }
+  return ok;
+}
+
+bool SdMmc::write_file_stream(std::string_view path, WriteCallback callback, size_t buffer_size) {
+  return this->write_file_stream(PathBuffer(path).c_str(), std::move(callback), buffer_size);
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
@@ -0,0 +1,190 @@
+#include "sd_mmc_card.h"
+
+#include <cstring>
+#include <sys/stat.h>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sd_mmc_card {
+
+static const char *TAG = "sd_mmc_write_queue";
+static constexpr size_t SECTOR_SIZE = 512;
+static constexpr size_t WRITER_STACK_SIZE = 4096;
+
+WriteBehindQueue::WriteBehindQueue(size_t capacity) : capacity_(capacity) {}
+
+WriteBehindQueue::~WriteBehindQueue() { this->stop(); }
+
+void WriteBehindQueue::start() {
+  if (this->thread_.joinable())
+    return;
+  this->ring_.resize(this->capacity_);
+  this->stop_ = false;
+  this->thread_ = start_worker_thread("sd_write_behind", WRITER_STACK_SIZE, [this]() { this->run_(); });
+}
+
+void WriteBehindQueue::stop() {
+  if (!this->thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stop_ = true;
+  }
+  this->work_cv_.notify_all();
+  this->thread_.join();
+}
+
+bool WriteBehindQueue::enqueue(const char *path, const uint8_t *buffer, size_t len, bool append) {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (len > this->capacity_ - this->used_) {
+      this->dropped_++;
+      ESP_LOGW(TAG, "Write-behind buffer full, dropping %zu bytes for %s", len, path);
+      return false;
+    }
+
+    size_t offset = this->head_;
+    size_t first = std::min(len, this->capacity_ - offset);
+    memcpy(this->ring_.data() + offset, buffer, first);
+    memcpy(this->ring_.data(), buffer + first, len - first);
+    this->head_ = (offset + len) % this->capacity_;
+    this->used_ += len;
+
+    // The last queued entry always ends where this data starts, so an append to the
+    // same file simply grows it into one larger write.
+    if (append && !this->entries_.empty()) {
+      Entry &last = this->entries_.back();
+      if (last.append && last.path == path) {
+        last.len += len;
+        return true;
+      }
+    }
+    this->entries_.push_back(Entry{path, append, offset, len, millis()});
+  }
+  this->work_cv_.notify_one();
+  return true;
+}
+
+void WriteBehindQueue::flush() {
+  if (!this->thread_.joinable())
+    return;
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  this->idle_cv_.wait(lock, [this]() { return this->paused_ || (this->entries_.empty() && !this->in_flight_); });
+}
+
+void WriteBehindQueue::set_paused(bool paused) {
+  {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    this->paused_ = paused;
+    if (paused)
+      this->idle_cv_.wait(lock, [this]() { return !this->in_flight_; });
+  }
+  this->work_cv_.notify_all();
+  // Releases flush() callers, which would otherwise wait for the card to come back
+  this->idle_cv_.notify_all();
+}
+
+bool WriteBehindQueue::is_paused() const {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->paused_;
+}
+
+size_t WriteBehindQueue::depth() const {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->entries_.size() + (this->in_flight_ ? 1 : 0);
+}
+
+size_t WriteBehindQueue::pending_bytes() const {
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->used_;
+}
+
+void WriteBehindQueue::run_() {
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  while (true) {
+    this->work_cv_.wait(lock, [this]() { return this->stop_ || (!this->paused_ && !this->entries_.empty()); });
+    // Stopping drains the queue, unless the card is not mounted
+    if (this->entries_.empty() || this->paused_)
+      break;
+
+    Entry entry = std::move(this->entries_.front());
+    this->entries_.pop_front();
+    this->in_flight_ = true;
+    lock.unlock();
+
+    this->write_entry_(entry);
+
+    lock.lock();
+    this->used_ -= entry.len;
+    this->in_flight_ = false;
+    this->last_flush_latency_ = millis() - entry.enqueued_ms;
+    this->idle_cv_.notify_all();
+  }
+}
+
+bool WriteBehindQueue::write_entry_(Entry const &entry) {
+  PathLocks::Guard guard;
+  if (this->path_locks_ != nullptr)
+    guard = this->path_locks_->lock_exclusive(entry.path.c_str());
+  if (this->on_write_start_)
+    this->on_write_start_(entry.path.c_str());
+  PathBuffer absolut_path = build_path(entry.path.c_str());
+  size_t old_size = 0;
+  struct stat info;
+  if (!entry.append && stat(absolut_path.c_str(), &info) == 0)
+    old_size = info.st_size;
+  FILE *file = fopen(absolut_path.c_str(), entry.append ? "ab" : "wb");
+  if (file == nullptr) {
+    ESP_LOGE(TAG, "Failed to open file for writing: %s", entry.path.c_str());
+    return false;
+  }
+  // Writes are already batched here, stdio buffering would only split them again.
+  setvbuf(file, nullptr, _IONBF, 0);
+  fseek(file, 0, SEEK_END);
+  size_t position = ftell(file);
+  if (entry.append)
+    old_size = position;
+
+  size_t first = std::min(entry.len, this->capacity_ - entry.offset);
+  bool ok = this->write_aligned_(file, position, this->ring_.data() + entry.offset, first) &&
+            this->write_aligned_(file, position, this->ring_.data(), entry.len - first);
+  if (!ok)
+    ESP_LOGE(TAG, "Failed to write to file: %s", entry.path.c_str());
+  if (ok && this->on_before_close_)
+    this->on_before_close_(entry.path.c_str(), file);
+  fclose(file);
+  if (this->on_written_)
+    this->on_written_(entry.path.c_str(), old_size, position);
+  return ok;
+}
+
+bool WriteBehindQueue::write_aligned_(FILE *file, size_t &position, const uint8_t *data, size_t len) {
+  // Split into a head that reaches the next sector boundary, a run of whole sectors and
+  // a tail, so that the bulk of the data never straddles a partially written sector.
+  while (len > 0) {
+    size_t misalignment = position % SECTOR_SIZE;
+    size_t chunk;
+    if (misalignment != 0) {
+      chunk = std::min(len, SECTOR_SIZE - misalignment);
+    } else if (len >= SECTOR_SIZE) {
+      chunk = len - len % SECTOR_SIZE;
+    } else {
+      chunk = len;
+    }
+    size_t written = fwrite(data, 1, chunk, file);
+#ifdef USE_HOST
+    host_bus_transfer(written, true);
+#endif
+    if (written != chunk)
+      return false;
+    data += chunk;
+    position += chunk;
+    len -= chunk;
+  }
+  return true;
+}
+
+}  // namespace sd_mmc_card
+}  // namespace esphome
@@ -0,0 +1,262 @@
+#pragma once
+// Test de charge concurrente du composant sur le backend hôte (voir concurrency.yaml).
+//
+// THREADS tâches mélangent écritures, lectures, renommages et suppressions sur un petit
+// ensemble de chemins communs, et ajoutent chacune des enregistrements numérotés à un même
+// journal. Vérifie à la fin :
+// - qu'aucune lecture n'a vu un fichier partiellement écrit (chaque fichier est écrit d'un
+//   seul octet répété : une lecture valide est vide ou uniforme et complète) ;
+// - que le journal contient tous les ajouts réussis, dans l'ordre de chaque tâche ;
+// - que tout se termine avant DEADLINE_MS (pas d'interblocage entre les paires de verrous
+//   prises par move_file dans des ordres opposés).
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "esphome/components/sd_mmc_card/sd_mmc_card.h"
+#include "esphome/core/log.h"
+
+namespace sd_mmc_card_test {
+
+using esphome::sd_mmc_card::SdMmc;
+
+static const char *const TAG = "concurrency_test";
+static constexpr unsigned THREADS = 8;
+static constexpr unsigned OPS = 1500;
+static constexpr unsigned PATHS = 4;
+static constexpr size_t FILE_SIZE = 1536;
+static constexpr uint32_t DEADLINE_MS = 120000;
+static const char *const DIRECTORY = "/concurrency";
+static const char *const LOG_PATH = "/concurrency/log.bin";
+
+struct LogRecord {
+  uint32_t thread;
+  uint32_t sequence;
+  uint32_t check;
+  uint32_t magic;
+};
+static constexpr uint32_t LOG_MAGIC = 0x5344434C;
+
+static uint32_t record_check(uint32_t thread, uint32_t sequence) { return (thread * 0x9E3779B1u) ^ sequence; }
+
+static std::string shared_path(unsigned index) {
+  return std::string(DIRECTORY) + "/f" + std::to_string(index) + ".bin";
+}
+
+// Empty (missing file) or FILE_SIZE copies of one byte
+static bool whole_file(const uint8_t *data, size_t len) {
+  if (len == 0)
+    return true;
+  if (len != FILE_SIZE)
+    return false;
+  for (size_t i = 1; i < len; i++) {
+    if (data[i] != data[0])
+      return false;
+  }
+  return true;
+}
+
+static void clean_up(SdMmc *sd) {
+  for (unsigned p = 0; p < PATHS; p++)
+    sd->delete_file(shared_path(p));
+  sd->delete_file(LOG_PATH);
+  sd->remove_directory(DIRECTORY);
+}
+
+struct Counters {
+  std::atomic<uint32_t> torn{0};
+  std::atomic<uint32_t> failed_appends{0};
+  std::atomic<uint32_t> writes{0};
+  std::atomic<uint32_t> moves{0};
+  std::atomic<uint32_t> removes{0};
+  std::atomic<uint32_t> reads{0};
+  uint32_t appended[THREADS]{};
+  // Completion, shared with the tasks so that they can outlive a failed test
+  std::mutex mutex;
+  std::condition_variable done;
+  unsigned finished{0};
+};
+
+static void worker(SdMmc *sd, unsigned thread, Counters &counters) {
+  uint32_t seed = 0x2545F491u * (thread + 1);
+  auto next = [&seed]() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  };
+  std::vector<uint8_t> buffer(FILE_SIZE);
+  for (uint32_t i = 0; i < OPS; i++) {
+    LogRecord record{thread, counters.appended[thread], record_check(thread, counters.appended[thread]), LOG_MAGIC};
+    if (sd->append_file(LOG_PATH, reinterpret_cast<const uint8_t *>(&record), sizeof(record))) {
+      counters.appended[thread]++;
+    } else {
+      counters.failed_appends++;
+    }
+
+    std::string path = shared_path(next() % PATHS);
+    switch (next() % 7) {
+      case 0:
+      case 1: {
+        memset(buffer.data(), static_cast<uint8_t>(thread * 16 + (i & 0x0F)), FILE_SIZE);
+        if (sd->write_file(path.c_str(), buffer.data(), FILE_SIZE))
+          counters.writes++;
+        break;
+      }
+      case 2: {
+        std::vector<uint8_t> content = sd->read_file(path);
+        counters.reads++;
+        if (!whole_file(content.data(), content.size()))
+          counters.torn++;
+        break;
+      }
+      case 3: {
+        size_t len = sd->read_file_into(path, buffer.data(), FILE_SIZE);
+        counters.reads++;
+        if (!whole_file(buffer.data(), len))
+          counters.torn++;
+        break;
+      }
+      case 4: {
+        // An existing file is never empty: unlike read_file, process_file tells it from a missing one
+        std::vector<uint8_t> content;
+        bool found = sd->process_file(path, [&content](const uint8_t *data, size_t len, size_t, size_t) {
+          content.insert(content.end(), data, data + len);
+          return true;
+        });
+        counters.reads++;
+        if (found && (content.empty() || !whole_file(content.data(), content.size())))
+          counters.torn++;
+        break;
+      }
+      case 5: {
+        // Another task may move the other way at the same time: the pair is locked in a fixed order
+        std::string destination = shared_path(next() % PATHS);
+        if (destination != path && sd->move_file(path.c_str(), destination.c_str()))
+          counters.moves++;
+        break;
+      }
+      default:
+        if (sd->delete_file(path.c_str()))
+          counters.removes++;
+        break;
+    }
+  }
+}
+
+// Renvoie le nombre d'échecs (0 : test réussi)
+inline int run_concurrency_test(SdMmc *sd) {
+  int failures = 0;
+  auto fail = [&failures](const char *what) {
+    ESP_LOGE(TAG, "FAILED: %s", what);
+    failures++;
+  };
+  if (!sd->is_mounted()) {
+    fail("card not mounted");
+    return failures;
+  }
+  if (sd->exists(DIRECTORY))
+    clean_up(sd);
+  if (!sd->create_directory(DIRECTORY)) {
+    fail("cannot create the test directory");
+    return failures;
+  }
+
+  auto shared = std::make_shared<Counters>();
+  Counters &counters = *shared;
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < THREADS; t++) {
+    workers.emplace_back([sd, t, shared]() {
+      worker(sd, t, *shared);
+      std::lock_guard<std::mutex> lock(shared->mutex);
+      shared->finished++;
+      shared->done.notify_all();
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(counters.mutex);
+    if (!counters.done.wait_for(lock, std::chrono::milliseconds(DEADLINE_MS),
+                                [&counters]() { return counters.finished == THREADS; })) {
+      ESP_LOGE(TAG, "FAILED: %u of %u tasks still running after %" PRIu32 " ms (deadlock?)",
+               THREADS - counters.finished, THREADS, DEADLINE_MS);
+      // The blocked tasks cannot be joined: leave them to the process exit
+      for (auto &worker : workers)
+        worker.detach();
+      return failures + 1;
+    }
+  }
+  for (auto &worker : workers)
+    worker.join();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  ESP_LOGI(TAG, "%u tasks x %u ops in %lld ms: %u writes, %u reads, %u moves, %u removes", THREADS, OPS,
+           static_cast<long long>(elapsed), counters.writes.load(), counters.reads.load(), counters.moves.load(),
+           counters.removes.load());
+
+  if (counters.torn != 0) {
+    ESP_LOGE(TAG, "%u reads saw a partially written file", counters.torn.load());
+    fail("torn reads");
+  }
+  if (counters.failed_appends != 0) {
+    ESP_LOGE(TAG, "%u appends failed", counters.failed_appends.load());
+    fail("append errors");
+  }
+
+  // Final content of the shared files
+  for (unsigned p = 0; p < PATHS; p++) {
+    std::vector<uint8_t> content = sd->read_file(shared_path(p));
+    if (!whole_file(content.data(), content.size())) {
+      ESP_LOGE(TAG, "%s: %zu bytes, not a whole file", shared_path(p).c_str(), content.size());
+      fail("final file content");
+    }
+  }
+
+  // Every successful append is in the log exactly once, in the order of its task
+  std::vector<uint8_t> log = sd->read_file(LOG_PATH);
+  uint32_t expected = 0;
+  for (unsigned t = 0; t < THREADS; t++)
+    expected += counters.appended[t];
+  if (log.size() != expected * sizeof(LogRecord)) {
+    ESP_LOGE(TAG, "Log holds %zu bytes, expected %" PRIu32 " records of %zu bytes", log.size(), expected,
+             sizeof(LogRecord));
+    fail("lost or torn appends");
+  }
+  uint32_t next_sequence[THREADS]{};
+  size_t bad_records = 0;
+  for (size_t offset = 0; offset + sizeof(LogRecord) <= log.size(); offset += sizeof(LogRecord)) {
+    LogRecord record;
+    memcpy(&record, log.data() + offset, sizeof(record));
+    if (record.magic != LOG_MAGIC || record.thread >= THREADS ||
+        record.check != record_check(record.thread, record.sequence) ||
+        record.sequence != next_sequence[record.thread]) {
+      bad_records++;
+      continue;
+    }
+    next_sequence[record.thread]++;
+  }
+  if (bad_records != 0) {
+    ESP_LOGE(TAG, "%zu log records are corrupted, duplicated or out of order", bad_records);
+    fail("log records");
+  }
+  for (unsigned t = 0; t < THREADS; t++) {
+    if (next_sequence[t] != counters.appended[t]) {
+      ESP_LOGE(TAG, "Task %u: %" PRIu32 " records in the log, %" PRIu32 " appended", t, next_sequence[t],
+               counters.appended[t]);
+      fail("lost appends");
+    }
+  }
+
+  clean_up(sd);
+  if (failures == 0)
+    ESP_LOGI(TAG, "PASSED");
+  return failures;
+}
+
+}  // namespace sd_mmc_card_test
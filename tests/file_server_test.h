@@ -0,0 +1,192 @@
+#pragma once
+// Test du serveur de fichiers HTTP sur le backend hôte (voir file_server.yaml), par le
+// serveur loopback de FileServer et de vraies sockets :
+// - GET complet et GET avec Range (intervalle, suffixe, ouvert, hors fichier) ;
+// - PUT avec Content-Length et en chunked, PUT interrompu qui laisse l'ancien fichier intact ;
+// - client inactif : libéré au bout du délai de connexion, et stop_loopback() ne l'attend pas.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "esphome/components/sd_mmc_card/file_server.h"
+#include "esphome/core/log.h"
+
+namespace sd_mmc_card_test {
+
+using esphome::sd_mmc_card::FileServer;
+using esphome::sd_mmc_card::SdMmc;
+
+static const char *const HTTP_TAG = "file_server_test";
+// Longer than the server's connection timeout: a test never hangs on a silent server
+static constexpr int CLIENT_TIMEOUT_S = 20;
+
+struct HttpResponse {
+  int status{0};
+  std::string headers;
+  std::string body;
+
+  std::string header(const char *name) const {
+    std::string key = std::string("\r\n") + name + ": ";
+    size_t start = this->headers.find(key);
+    if (start == std::string::npos)
+      return "";
+    start += key.size();
+    return this->headers.substr(start, this->headers.find("\r\n", start) - start);
+  }
+};
+
+static int http_connect(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  timeval timeout{CLIENT_TIMEOUT_S, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static HttpResponse http_read(int fd) {
+  std::string raw;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+    raw.append(buffer, n);
+  HttpResponse response;
+  size_t end = raw.find("\r\n\r\n");
+  if (end == std::string::npos || sscanf(raw.c_str(), "HTTP/1.1 %d", &response.status) != 1)
+    return response;
+  response.headers = raw.substr(0, end + 2);
+  response.body = raw.substr(end + 4);
+  return response;
+}
+
+// Sends `request` as is and reads the response until the server closes the connection
+static HttpResponse http(uint16_t port, std::string const &request, bool shut_write = false) {
+  int fd = http_connect(port);
+  if (fd < 0)
+    return HttpResponse();
+  send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+  if (shut_write)
+    shutdown(fd, SHUT_WR);
+  HttpResponse response = http_read(fd);
+  close(fd);
+  return response;
+}
+
+static std::string file_content(SdMmc *sd, const char *path) {
+  std::vector<uint8_t> data = sd->read_file(path);
+  return std::string(data.begin(), data.end());
+}
+
+// Renvoie le nombre d'échecs (0 : test réussi)
+inline int run_file_server_test(SdMmc *sd) {
+  int failures = 0;
+  auto check = [&failures](bool ok, const char *what) {
+    if (!ok) {
+      ESP_LOGE(HTTP_TAG, "FAILED: %s", what);
+      failures++;
+    }
+  };
+
+  std::string content;
+  for (int i = 0; i < 100000; i++)
+    content += static_cast<char>('a' + i % 26);
+  sd->create_directory("/http");
+  check(sd->write_file("/http/big.txt", reinterpret_cast<const uint8_t *>(content.data()), content.size()),
+        "write the test file");
+
+  FileServer server(sd, "/sd", 4096);
+  if (!server.start_loopback(0)) {
+    check(false, "start the loopback server");
+    return failures;
+  }
+  uint16_t port = server.loopback_port();
+
+  // GET
+  HttpResponse response = http(port, "GET /sd/http/big.txt HTTP/1.1\r\n\r\n");
+  check(response.status == 200 && response.body == content, "GET returns the whole file");
+  check(response.header("Content-Length") == std::to_string(content.size()), "GET Content-Length");
+  response = http(port, "HEAD /sd/http/big.txt HTTP/1.1\r\n\r\n");
+  check(response.status == 200 && response.body.empty(), "HEAD has no body");
+  response = http(port, "GET /sd/http/missing.txt HTTP/1.1\r\n\r\n");
+  check(response.status == 404, "GET of a missing file is 404");
+
+  // Range
+  response = http(port, "GET /sd/http/big.txt HTTP/1.1\r\nRange: bytes=10-19\r\n\r\n");
+  check(response.status == 206 && response.body == content.substr(10, 10), "Range bytes=10-19");
+  check(response.header("Content-Range") == "bytes 10-19/" + std::to_string(content.size()), "Content-Range");
+  response = http(port, "GET /sd/http/big.txt HTTP/1.1\r\nRange: bytes=-5\r\n\r\n");
+  check(response.status == 206 && response.body == content.substr(content.size() - 5), "Range bytes=-5");
+  response = http(port, "GET /sd/http/big.txt HTTP/1.1\r\nRange: bytes=99990-\r\n\r\n");
+  check(response.status == 206 && response.body == content.substr(99990), "Range bytes=99990-");
+  response = http(port, "GET /sd/http/big.txt HTTP/1.1\r\nRange: bytes=200000-\r\n\r\n");
+  check(response.status == 416, "Range past the end is 416");
+
+  // PUT with Content-Length, then chunked over the same file
+  std::string upload(50000, 'z');
+  response = http(port, "PUT /sd/http/up.bin HTTP/1.1\r\nContent-Length: 50000\r\n\r\n" + upload);
+  check(response.status == 201 && file_content(sd, "/http/up.bin") == upload, "PUT with Content-Length");
+  std::string chunked = "PUT /sd/http/up.bin HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+  std::string expected;
+  for (int i = 0; i < 3; i++) {
+    std::string chunk(3000 + i, static_cast<char>('A' + i));
+    char size_line[16];
+    snprintf(size_line, sizeof(size_line), "%zx\r\n", chunk.size());
+    chunked += size_line + chunk + "\r\n";
+    expected += chunk;
+  }
+  chunked += "5\r\nhello\r\n0\r\n\r\n";
+  expected += "hello";
+  response = http(port, chunked);
+  check(response.status == 201 && file_content(sd, "/http/up.bin") == expected, "chunked PUT replaces the file");
+  check(!sd->exists("/http/up.bin.part"), "no temporary file left after a PUT");
+
+  // A body cut short is rejected and the previous content survives
+  response = http(port, "PUT /sd/http/up.bin HTTP/1.1\r\nContent-Length: 1000\r\n\r\nabc", true);
+  check(response.status == 400, "truncated PUT is 400");
+  check(file_content(sd, "/http/up.bin") == expected, "truncated PUT leaves the old file intact");
+  check(!sd->exists("/http/up.bin.part"), "no temporary file left after a truncated PUT");
+
+  // An idle client holds the only connection slot until the server times it out
+  int idle = http_connect(port);
+  auto start = std::chrono::steady_clock::now();
+  response = http(port, "GET /sd/http/big.txt HTTP/1.1\r\nRange: bytes=0-3\r\n\r\n");
+  auto waited = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start).count();
+  check(response.status == 206 && response.body == "abcd", "request served after an idle client");
+  check(waited < CLIENT_TIMEOUT_S, "idle client released by the connection timeout");
+  if (idle >= 0)
+    close(idle);
+
+  // stop_loopback() does not wait for an idle client
+  idle = http_connect(port);
+  usleep(200 * 1000);
+  start = std::chrono::steady_clock::now();
+  server.stop_loopback();
+  auto stopped =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  check(stopped < 1000, "stop_loopback() returns with an idle client connected");
+  if (idle >= 0)
+    close(idle);
+
+  sd->delete_file("/http/big.txt");
+  sd->delete_file("/http/up.bin");
+  sd->remove_directory("/http");
+  if (failures == 0)
+    ESP_LOGI(HTTP_TAG, "PASSED");
+  return failures;
+}
+
+}  // namespace sd_mmc_card_test